@@ -41,6 +41,7 @@ OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <util/atomic.h>
 #include <string.h>
 #include <NmraDcc.h>
+#include "cvstore.h"
 
 #define HWVERSION "2"
 #pragma message "Info: Hardware version is " xstr(HWVERSION)
@@ -75,10 +76,8 @@ OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #if defined(USE_NEW_LCD)
 #pragma message "Using OLED display"
-#define LCD_PRINT lcd.println
 #else
 #pragma message "Using LCD display"
-#define LCD_PRINT lcd.print
 #endif
 
 #if defined(TRANSMITTER)
@@ -88,16 +87,72 @@ OF THE POSSIBILITY OF SUCH DAMAGE.
 #error "Error: Neither TRANSMITTER or RECEIVER is defined"
 #endif
 
-#if defined(USE_OLD_LCD)
-#include <Wire.h>
-#include <LiquidCrystal_I2C.h>
-#elif defined(USE_NEW_LCD)
-// #include <Wire.h>
-// #include <Adafruit_GFX.h>
-// #include <Adafruit_SSD1306.h>
-#include <Wire.h>
-#include <SSD1306Ascii.h>
-#include <SSD1306AsciiAvrI2c.h>
+// The transmitter sends from an address-aware priority queue instead of the plain
+// ring buffer: newer speed/function packets replace queued ones for the same address
+// and e-stops jump the line. Define NO_PRIORITY_QUEUE to get the old ring back.
+#if defined(TRANSMITTER) && ! defined(NO_PRIORITY_QUEUE)
+#define PRIORITY_QUEUE
+#endif
+
+#if defined(PRIORITY_QUEUE)
+#include "dccqueue.h"
+#pragma message "Info: using the priority packet queue, size " xstr(DCCQ_SIZE)
+#else
+#pragma message "Info: using the FIFO packet ring buffer"
+#endif
+
+// With the priority queue, idle airtime is filled with refreshes of the latest speed and
+// function state of each active loco. Define NO_REFRESH_ENGINE to turn this off.
+#if defined(PRIORITY_QUEUE) && ! defined(NO_REFRESH_ENGINE)
+#define REFRESH_ENGINE
+#endif
+
+#if defined(REFRESH_ENGINE)
+#include "dccrefresh.h"
+#pragma message "Info: using the loco refresh engine, size " xstr(DCCR_SIZE)
+#endif
+
+// The receiver keeps the latest speed and function state of each loco it hears, and
+// regenerates them through a short RF dropout instead of letting the locos coast or
+// stop. Define NO_DROPOUT_CONCEALMENT to turn this off.
+#if defined(RECEIVER) && ! defined(NO_DROPOUT_CONCEALMENT)
+#define DROPOUT_CONCEALMENT
+#endif
+
+#if defined(DROPOUT_CONCEALMENT)
+#include "dccrefresh.h"
+#pragma message "Info: concealing RF dropouts from the loco cache, size " xstr(DCCR_SIZE)
+#endif
+
+// The receiver searches the channels it has found DCC on before, best first
+#if defined(RECEIVER)
+#include "chscore.h"
+#endif
+
+// Per-packet latency histograms, DCC input to air. Transmitter only. See config.h
+#if defined(LATENCY_STATS) && defined(TRANSMITTER)
+#include "dcclatency.h"
+#pragma message "Info: timing packets from the DCC input to the air, CV216-229"
+#else
+#undef LATENCY_STATS
+#endif
+
+// The transmitter's preamble length comes from a table by receiver profile (CV232)
+// and packet class. The default profile is Airwire: 30 bits on every packet. See config.h
+#if defined(TRANSMITTER)
+#include "dccpreamble.h"
+#include "dccqueue.h"
+#if ! defined(PREAMBLE_PROFILE)
+#define PREAMBLE_PROFILE DCCP_AIRWIRE
+#endif
+#pragma message "Info: default transmitter preamble profile: " xstr(PREAMBLE_PROFILE)
+#endif
+
+// The display is driven through an interrupt-driven I2C queue, and only changed
+// characters are sent, so a refresh never holds up DCC.process()
+#if defined(USE_OLD_LCD) || defined(USE_NEW_LCD)
+#include "twiq.h"
+#include "lcdview.h"
 #endif
 
 #if defined(TRANSMITTER)
@@ -180,11 +235,35 @@ volatile enum {PREAMBLE, STARTBYTE, SENDBYTE, STOPPACKET, CUTOUT} current_state,
 #define MINIMUM_PREAMBLE_BITS 16
 #define MAXIMUM_PREAMBLE_BITS 30
 #if defined(TRANSMITTER)
-#if !defined(PREAMBLE_BITS)
+#if defined(PREAMBLE_BITS)
+#define PREAMBLE_FIXED 1                         // Set at compile time: it overrides the profile
+#else
 #define PREAMBLE_BITS MAXIMUM_PREAMBLE_BITS
+#define PREAMBLE_FIXED 0
 #endif
-volatile uint8_t preamble_bits = PREAMBLE_BITS;  // Large enough for Airwire
+volatile uint8_t preamble_bits = PREAMBLE_BITS;  // Preamble on every packet when fixed (CV242)
 #pragma message "Info: Transmitter PREAMBLE_BITS is " xstr(PREAMBLE_BITS)
+volatile uint8_t preambleFixed = PREAMBLE_FIXED; // 1: preamble_bits on every packet; 0: the profile's
+uint8_t preambleProfile = PREAMBLE_PROFILE;      // Receiver profile (CV232)
+volatile uint8_t preamble_min = MAXIMUM_PREAMBLE_BITS;  // Used by the ISR: set by setPreamblePolicy
+volatile uint8_t longCutout = 1;                 // Airwire's long first cutout pulse
+
+// Writing CV242 fixes the preamble of every packet, and the long cutout pulse
+// with it, as before the profiles; writing CV232 goes back to the profile.
+// The profile's idle preamble is its shortest, and is also the least any packet
+// gets: packets that did not come through the table (e.g., msgIdle) are covered by it
+void setPreamblePolicy() {
+  uint8_t b = dccpBits(preambleProfile, DCCQ_IDLE);
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+     if (preambleFixed) {
+        preamble_min = preamble_bits;
+        longCutout = (preamble_bits >= MAXIMUM_PREAMBLE_BITS);
+     } else {
+        preamble_min = b;
+        longCutout = dccpLongCutout(preambleProfile);
+     }
+  }
+}
 #endif
 volatile uint8_t preamble_count = MINIMUM_PREAMBLE_BITS; // will be reset in the ISR
 volatile uint8_t outbyte = 0;
@@ -194,6 +273,13 @@ volatile uint8_t byteIndex = 0;
 // For NmraDcc
 #define OUTPUT_ENABLE 5  // Output Enable
 #define DCC_DIAG1 6      // Diagnostic Pin #2
+#if defined(PRIORITY_QUEUE)
+//{
+volatile DCC_MSG msgLastIn = { 3, MINIMUM_PREAMBLE_BITS, { 0xFF, 0, 0xFF, 0, 0, 0}};  // Last queued msg, display only
+volatile DCC_MSG msgISR    = { 3, MINIMUM_PREAMBLE_BITS, { 0xFF, 0, 0xFF, 0, 0, 0}};  // Msg being sent by the ISR
+//}
+#else
+//{
 #define MAXMSG 16        // The size of the ring buffer. Per Martin's new code
 // Implement a ring buffer
 volatile DCC_MSG msg[MAXMSG] = {
@@ -215,11 +301,36 @@ volatile DCC_MSG msg[MAXMSG] = {
   { 3, MINIMUM_PREAMBLE_BITS, { 0xFF, 0, 0xFF, 0, 0, 0}},
 };
 
-// Idle message
-const DCC_MSG msgIdle = { 3, MINIMUM_PREAMBLE_BITS, { 0xFF, 0, 0xFF, 0, 0, 0}};  // idle msg
-
 volatile uint8_t msgIndexOut = 0;
 volatile uint8_t msgIndexIn  = 0;  // runs from 0 to MAXMSG-1
+#if defined(LATENCY_STATS)
+volatile uint32_t msgTag[MAXMSG];  // dcclatency tag of each ring entry
+#endif
+//}
+#endif
+uint32_t tagISR = 0;               // Tag of the msg being sent by the ISR. 0: not timed
+
+// Packet ring/queue statistics, for sizing MAXMSG and the preamble settings from data.
+// Written by notifyDccMsg and the Timer1 ISR. Read them with interrupts off (readRingStats).
+// All counters wrap.
+typedef struct {
+  uint16_t enqueued;     // Valid packets from the command station handed to the ring/queue
+  uint16_t overwritten;  // Ring: times msgIndexIn lapped msgIndexOut. Queue: packets dropped or evicted
+  uint16_t coalesced;    // Queue only: packets merged into a queued packet for the same address
+  uint16_t repeated;     // Last packet re-sent for lack of a new one
+  uint16_t idled;        // Fell back to preamble-only fill or idle packets
+  uint16_t sent;         // New packets started by the ISR
+  uint8_t  depthMax;     // Queue depth high-water mark
+} ringStats_t;
+volatile ringStats_t ringStats;
+#define RINGSTATSCV 200  // CV200-214, read-only. Writing CV200 clears the counters
+#define LATENCYCV 216    // CV216-229, read-only. Writing CV216 clears the histograms
+#if defined(SHOW_RING_STATS)
+#pragma message "Info: showing packet queue statistics on the display"
+#endif
+
+// Idle message
+const DCC_MSG msgIdle = { 3, MINIMUM_PREAMBLE_BITS, { 0xFF, 0, 0xFF, 0, 0, 0}};  // idle msg
 
 // Times
 // #if defined(TRANSMITTER)
@@ -228,7 +339,6 @@ volatile uint8_t msgIndexIn  = 0;  // runs from 0 to MAXMSG-1
 // #define INITIALDELAYMS       1000   // Initial processor start-up delay in ms
 // #endif
 
-#define EEPROMDELAYMS       100   // Delay after eeprom write in ms
 #define MILLISEC        1000ULL   //    1 msec. Units: us
 #define QUARTERSEC    250000ULL   // 0.25  sec. Units: us
 #define SEC          1000000ULL   // 1.00  sec. Units: us
@@ -328,6 +438,17 @@ uint64_t startInitialWaitTime;               // The start of the initial wait ti
 uint64_t endInitialWaitTime;                 // The end of the initial wait time. Will be set in initialization
 uint8_t InitialWaitPeriodSEC;                // Wait period
 uint8_t searchChannelIndex = 0;              // Initialial channel search order index
+#if defined(DROPOUT_CONCEALMENT)
+#define CONCEALSTART   (60*MILLISEC)         // No valid DCC for this long is a dropout
+#if ! defined(CONCEALCUTOFFDEFAULT)
+#define CONCEALCUTOFFDEFAULT 8               // Stop concealing after 8 1/4 sec intervals
+#endif
+#pragma message "Info: CONCEALCUTOFFDEFAULT (number of 1/4 sec intervals): " xstr(CONCEALCUTOFFDEFAULT)
+uint8_t concealCutoff = CONCEALCUTOFFDEFAULT;  // Safety cutoff, 1/4 sec intervals (CV231). 0: off
+volatile uint64_t timeOfHeardDCC;            // Time stamp of the last packet from the air
+uint8_t concealing = 0;                      // 1: regenerating cached packets
+uint8_t concealDone = 0;                     // 1: this dropout already reached the cutoff
+#endif
 //} RECEIVER
 #else
 //{ TRANSMITTER
@@ -396,6 +517,12 @@ const char *regionString[] = {"W"};  // Region code: N=North America, E=Europe,
 //}
 #endif
 
+#if defined(RECEIVER)
+// Channels to search at power-up: the remembered ones by score, CV255's, then searchChannels
+uint8_t searchOrder[CHS_SLOTS + 1 + sizeof(searchChannels)];
+uint8_t searchOrderLength = 0;
+#endif
+
 // Changing with CV's
 // uint16_t CVnum;                              // CV numbers consume 10 bits
 // uint8_t CVval;                               // CV values consume only 8 bits
@@ -421,65 +548,42 @@ uint8_t AirMiniCV18;                         // The AirMini's address, LOW uint8
 uint8_t AirMiniCV29;                         // The AirMini's address, HIGH uint8_t
 uint8_t AirMiniCV29Bit5;                     // The value of AirMiniCV29, bit 5
 uint8_t printDCC = 1;                        // Global flag for LCD for DCC msg display
+#if defined(SHOW_RING_STATS)
+uint8_t printStats = 0;                      // Global flag for LCD for queue statistics display
+#endif
 
 /////////////////////
 // Start: EEPROM data
 /////////////////////
 
-#define ISSET 0b10101010
-
-uint8_t SET_DEFAULT = 1;
-uint8_t EEFirst = 0;  // Store the first time
-
-// EEPROM data for persistence after turn-off of the AirMini
-uint8_t  EEisSetCHANNEL = 1;               // Stored RF channel is set
-uint8_t  EECHANNEL = 2;                    // Stored RF channel #
-// uint8_t  EECHANNELDefault;                 // Stored RF channel #
-
-uint8_t  EEisSetlockedAntiphase = 3;        // Stored modem turn on/off is set
-uint8_t  EElockedAntiphase = 4;             // Stored modem turn on/off
-// uint8_t  EElockedAntiphaseDefault;          // Stored modem turn on/off
-
-uint8_t  EEisSetdcLevel = 5;               // Stored DC output level is set
-uint8_t  EEdcLevel = 6;                    // Stored DC output level if modem turned off
-// uint8_t  EEdcLevelDefault;                 // Stored DC output level if modem turned off
-
-uint8_t  EEisSetpowerLevel = 7;            // Stored DC output power level is set
-uint8_t  EEpowerLevel = 8;                 // Stored DC output power level
-// uint8_t  EEpowerLevelDefault;              // Stored DC output power level
-
-uint8_t  EEisSetfilterModemData = 9;       // Stored filterModemData set flag
-uint8_t  EEfilterModemData = 10;            // Stored filterModemData
-// uint8_t  EEfilterModemDataDefault;          // Stored filterModemData
-
-uint8_t  EEisSetAirMiniCV1 = 11;            // Stored AirMini decoder short address is set
-uint8_t  EEAirMiniCV1 = 12;                 // Stored AirMini decoder short address
-// uint8_t  EEAirMiniCV1Default;               // Stored AirMini decoder short address
-
-uint8_t  EEisSetAirMiniCV17 = 13;           // Stored AirMini decoder high uint8_t address is set
-uint8_t  EEAirMiniCV17 = 14;                // Stored AirMini decoder high uint8_t address
-// uint8_t  EEAirMiniCV17Default;
-
-uint8_t  EEisSetAirMiniCV18 = 15;           // Stored AirMini decoder low uint8_t address is set
-uint8_t  EEAirMiniCV18 = 16;                // Stored AirMini decoder low uint8_t address
-// uint8_t  EEAirMiniCV18Default;              // Stored AirMini decoder low uint8_t address
-
-uint8_t  EEisSetAirMiniCV29 = 17;           // Stored AirMini decoder configuration variable is set
-uint8_t  EEAirMiniCV29 = 18;                // Stored AirMini decoder configuration variable
-// uint8_t  EEAirMiniCV29Default;              // Stored AirMini decoder configuration variable
-
+// Persistent CV's are kept in the cvstore journal, keyed by their CV number:
+// 255 CHANNEL, 254 powerLevel, 253 lockedAntiphase, 248 dcLevel, 246 filterModemData,
+// 245 InitialWaitPeriodSEC (receiver), 244 repeatPacket, 232 preambleProfile (transmitter),
+// 231 concealCutoff (receiver), 1/17/18/29 the AirMini's address.
+// A CV that was never written reads as its compile-time default; nothing is written at boot.
+// The display's address and type (LCDADDRID, LCDTYPEID) and the receiver's channel history
+// (chscore.h) are journal ids too. Writes that do not fit the journal's cache are counted
+// in CV215 (read-only).
+#define CVS_IDS_CV 11                            // 255 254 253 248 246 244 1 17 18 29, and 232 or 245
+#if defined(DROPOUT_CONCEALMENT)
+#define CVS_IDS_CONCEAL 1                        // 231
+#else
+#define CVS_IDS_CONCEAL 0
+#endif
 #if defined(RECEIVER)
-//{ RECEIVER
-uint8_t  EEisSetInitialWaitPeriodSEC = 19;  // Stored AirMini decoder configuration variable
-uint8_t  EEInitialWaitPeriodSEC = 20;       // Stored AirMini decoder configuration variable
-// uint8_t  EEInitialWaitPeriodSECDefault;     // Stored AirMini decoder configuration variable
-//} RECEIVER
+#define CVS_IDS_CHS CHS_IDS
 #else
-//{ TRANSMITTER
-//} TRANSMITTER
+#define CVS_IDS_CHS 0
 #endif
-uint8_t  EEisSetRepeatPacket = 21;  // Stored AirMini decoder configuration variable
-uint8_t  EERepeatPacket = 22;       // Stored AirMini decoder configuration variable
+#if defined(USE_OLD_LCD) || defined(USE_NEW_LCD)
+#define CVS_IDS_LCD 2                            // LCDADDRID, LCDTYPEID
+#else
+#define CVS_IDS_LCD 0
+#endif
+#if (CVS_IDS_CV + CVS_IDS_CONCEAL + CVS_IDS_CHS + CVS_IDS_LCD) > CVS_CACHE
+#error "More journal ids than CVS_CACHE: raise CVS_CACHE in cvstore.h"
+#endif
+#define CVSLOSTCV 215                            // Read-only: journal writes lost, cvsLost()
 
 ///////////////////
 // End: EEPROM data
@@ -491,24 +595,29 @@ enum {ACCEPTED, IGNORED, PENDING} CVStatus = ACCEPTED;
 //{
 uint8_t LCDAddress;                  // The I2C address of the LCD
 bool LCDFound = false;               // Whether a valid lcd was found
-#if defined(USE_OLD_LCD)
-#define LCDCOLUMNS 16                // Number of LCD columns
-#define LCDROWS 2                    // Number of LCD rows
-#else
-#define LCDCOLUMNS 128               // Number of LCD columns
-// #define LCDROWS 32                   // Number of LCD rows
-#define LCDROWS 64                   // Number of LCD rows
-#endif
 uint64_t LCDTimePeriod = 2ULL*SEC;   // Set up the LCD re-display time interval, 2 s
 uint64_t LCDprevTime = 0;            // Initialize the last time displayed
 bool LCDrefresh = false;             // Whether to refresh
-char lcd_line[LCDCOLUMNS+1];         // Note the "+1" to insert an end null!
+char lcd_line[LCDV_COLS+1];          // Note the "+1" to insert an end null!
+
+// Display discovery. The address found last time is kept in the EEPROM
+// journal under ids that no CV write stores to, and is probed first.
+// Then the usual backpack/OLED addresses. Only if all fail is the whole
+// bus scanned, a few addresses per background tick once the radio is live.
+#define LCDADDRID 250                // Journal id of the cached display address
+#define LCDTYPEID 251                // Journal id of the cached display type
 #if defined(USE_OLD_LCD)
-LiquidCrystal_I2C lcd;               // Create the LCD object with a default address
+#define LCDTYPE LCDV_HD44780         // HD44780 on a PCF8574 backpack
+#define I2CCLOCK 100000UL            // The PCF8574 is a 100 kHz part
+const uint8_t LCDKnownAddress[] PROGMEM = {0x27, 0x3F, 0x3C};
 #else
-// Adafruit_SSD1306 lcd(LCDCOLUMNS, LCDROWS, &Wire, -1);
-SSD1306AsciiAvrI2c lcd;
+#define LCDTYPE LCDV_SSD1306         // SSD1306
+#define I2CCLOCK 400000UL
+const uint8_t LCDKnownAddress[] PROGMEM = {0x3C, 0x27, 0x3F};
 #endif
+#define I2CSCANPERTICK 4             // Addresses probed per background tick by the fallback scan
+uint8_t I2CScanAddress = 0;          // Next address of the fallback scan. 0: no scan running
+uint8_t I2CScanFound = 0;            // Devices that acknowledged during the fallback scan
 //}
 #endif
 
@@ -521,8 +630,102 @@ SSD1306AsciiAvrI2c lcd;
 ///////////////////
 // Start of code //
 ///////////////////
+// Current number of packets waiting to be sent
+uint8_t ringDepth() {
+#if defined(PRIORITY_QUEUE)
+   return dccqCount;
+#else
+   return (uint8_t)(msgIndexIn - msgIndexOut + MAXMSG) % MAXMSG;
+#endif
+}
+
+#if defined(DROPOUT_CONCEALMENT)
+// Queue a packet of the receiver's own. Unlike notifyDccMsg, it does not count as valid DCC
+void ringPutOwn(const DCC_MSG *Msg) {
+   msgIndexIn = (msgIndexIn+1) % MAXMSG;
+   memcpy((void *)&msg[msgIndexIn], (const void *)Msg, sizeof(DCC_MSG));
+}
+#endif
+
+// Consistent copy of the statistics
+void readRingStats(ringStats_t *stats) {
+   ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      memcpy(stats, (const void *)&ringStats, sizeof(ringStats_t));
+#if defined(PRIORITY_QUEUE)
+      stats->overwritten = dccqDropped + dccqEvicted;
+      stats->coalesced = dccqCoalesced;
+#endif
+   }
+}
+
+void clearRingStats() {
+   ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+      memset((void *)&ringStats, 0, sizeof(ringStats_t));
+#if defined(PRIORITY_QUEUE)
+      dccqDropped = dccqEvicted = dccqCoalesced = 0;
+#endif
+   }
+}
+
+// CV200-214. 16-bit counters are low byte (even CV) then high byte (odd CV).
+// Reading the low byte latches the counter so the high byte matches it.
+uint8_t readRingStatsCV(uint16_t CV) {
+   static uint16_t latch = 0;
+   ringStats_t stats;
+   uint8_t i = CV - RINGSTATSCV;
+
+   if (i & 1) return highByte(latch);
+   readRingStats(&stats);
+   switch (i) {
+      case  0: latch = stats.enqueued; break;
+      case  2: latch = stats.overwritten; break;
+      case  4: latch = stats.coalesced; break;
+      case  6: latch = stats.repeated; break;
+      case  8: latch = stats.idled; break;
+      case 10: latch = stats.sent; break;
+      case 12: return stats.depthMax;
+#if defined(PRIORITY_QUEUE)
+      case 14: return DCCQ_SIZE;
+#else
+      case 14: return MAXMSG;
+#endif
+   }
+   return lowByte(latch);
+}
+
+#if defined(LATENCY_STATS)
+// CV216-229, in us, low byte (even CV) then high byte (odd CV), latched as for CV200-214.
+// Values saturate at 65535 us; the serial dump (DEBUG) has the full range.
+uint8_t readLatencyCV(uint16_t CV) {
+   static uint16_t latch = 0;
+   uint8_t i = CV - LATENCYCV;
+   uint32_t us = 0;
+
+   if (i & 1) return highByte(latch);
+   dcclPoll();
+   switch (i) {
+      case  0: us = dcclCount(DCCL_TOTAL); break;              // Packets timed
+      case  2: us = dcclPercentile(DCCL_TOTAL, 50); break;     // End bit to air: median
+      case  4: us = dcclPercentile(DCCL_TOTAL, 90); break;
+      case  6: us = dcclPercentile(DCCL_TOTAL, 99); break;
+      case  8: us = dcclMax(DCCL_TOTAL); break;
+      case 10: us = dcclPercentile(DCCL_WAIT, 90); break;      // Time in the ring/queue
+      case 12: us = dcclPercentile(DCCL_DECODE, 90); break;    // End bit to notifyDccMsg
+   }
+   latch = (us > 0xFFFF) ? 0xFFFF : (uint16_t)us;
+   return lowByte(latch);
+}
+#endif
+
 uint8_t notifyCVRead (uint16_t CV) {
+    if ((RINGSTATSCV <= CV) && (CV <= RINGSTATSCV+14)) return readRingStatsCV(CV);
+#if defined(LATENCY_STATS)
+    if ((LATENCYCV <= CV) && (CV <= LATENCYCV+13)) return readLatencyCV(CV);
+#endif
     switch(CV) {
+       case(CVSLOSTCV):
+          return cvsLost();
+          break;
        case(1):
           return AirMiniCV1;
           break;
@@ -541,6 +744,27 @@ uint8_t notifyCVRead (uint16_t CV) {
        case(254):
           return powerLevel;
           break;
+#if defined(TRANSMITTER)
+       case(232):
+          return preambleProfile;
+          break;
+#endif
+#if defined(DROPOUT_CONCEALMENT)
+       case(231):
+          return concealCutoff;
+          break;
+#endif
+#if defined(REFRESH_ENGINE) || defined(DROPOUT_CONCEALMENT)
+       case(239):
+          return dccrAge;
+          break;
+       case(238):
+          return dccrFuncPeriod;
+          break;
+       case(237):
+          return dccrSpeedPeriod;
+          break;
+#endif
        default:
           return (uint8_t)0;
           break;
@@ -556,9 +780,44 @@ void notifyDccMsg(DCC_MSG * Msg) {
   noInterrupts();  // Turning on/off interrupts does not seem to be needed
 #endif
   if ((3 <= Msg->Size) && (Msg->Size <= 6)) {  // Check for a valid message
+     uint8_t own = (Msg == (DCC_MSG *)&msgIdle);  // loop()'s idle fill: counted as idled, not enqueued
+#if defined(LATENCY_STATS)
+     uint32_t tag = dcclQueued(DCC.getPacketEndMicros(), micros());
+#else
+     uint32_t tag = 0;
+#endif
+#if defined(PRIORITY_QUEUE)
+     uint8_t cls = dccpSet(Msg, preambleProfile);  // Preamble on air for this packet
+     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {  // The Timer1 ISR dequeues
+        dccqPutClass(Msg, cls, tag);
+     }
+     if (!own) ringStats.enqueued++;
+#if defined(REFRESH_ENGINE)
+     dccrUpdate(Msg, millis());
+#endif
+     memcpy((void *)&msgLastIn, (void *)Msg, sizeof(DCC_MSG));
+     dccptrIn = &msgLastIn;
+#else
+#if defined(TRANSMITTER)
+     dccpSet(Msg, preambleProfile);  // Preamble on air for this packet
+#endif
+     if (ringDepth() == MAXMSG-1) ringStats.overwritten++;  // About to lap the ISR
      msgIndexIn = (msgIndexIn+1) % MAXMSG;
      memcpy((void *)&msg[msgIndexIn], (void *)Msg, sizeof(DCC_MSG));
+#if defined(LATENCY_STATS)
+     msgTag[msgIndexIn] = tag;
+#endif
      dccptrIn = &msg[msgIndexIn];
+     if (!own) ringStats.enqueued++;
+#if defined(DROPOUT_CONCEALMENT)
+     if (!own) {  // Not the receiver's own fill
+        dccrUpdate(Msg, millis());
+        timeOfHeardDCC = micros();
+     }
+#endif
+     (void)tag;
+#endif
+     if (ringDepth() > ringStats.depthMax) ringStats.depthMax = ringDepth();
      timeOfValidDCC = micros();          // Initialize the valid DCC data time
   }
 #if defined(TURNOFFNOTIFYINTERRUPTS)
@@ -576,11 +835,6 @@ void reboot() {
 
 void LCD_CVval_Status(uint8_t CVnum, uint8_t CVval, uint8_t CVStatus) {
 
-  lcd.clear();
-
-#if defined(USE_OLD_LCD)
-  lcd.setCursor(0, 0);  // column, row
-#endif
   switch (CVStatus) {
      case ACCEPTED:
         snprintf(lcd_line, sizeof(lcd_line), "Changed:");
@@ -592,13 +846,10 @@ void LCD_CVval_Status(uint8_t CVnum, uint8_t CVval, uint8_t CVStatus) {
         snprintf(lcd_line, sizeof(lcd_line), "Pending:");
      break;
   }
-  LCD_PRINT(lcd_line);
+  lcdvLine(0, lcd_line);
 
-#if defined(USE_OLD_LCD)
-  lcd.setCursor(0, 1);  // column, row
-#endif
   snprintf(lcd_line, sizeof(lcd_line), "CV%d=%d", CVnum, CVval);
-  LCD_PRINT(lcd_line);
+  lcdvLine(1, lcd_line);
 
   LCDprevTime  = micros();
   LCDrefresh = true;
@@ -608,115 +859,15 @@ void LCD_CVval_Status(uint8_t CVnum, uint8_t CVval, uint8_t CVStatus) {
 
 uint8_t decoderInitialized = 0;
 
-// Function, based on the value of forceDefault:
-//    - TRUE:   TargetPtr's value and its related EEPROM variables are forced to use defaultValue
-//    - FALSE:  extract and use EEPROM data, if previously-set, to set the TargetPtr's value
-void checkSetDefaultEE(uint8_t *TargetPtr, const uint8_t *EEisSetTargetPtr,
-                       const uint8_t *EETargetPtr, uint8_t defaultValue, uint8_t forceDefault) {
-  uint8_t isSet;
-#if defined(DEBUG)
-  uint8_t isSet_Save;
-#endif
-  eeprom_busy_wait();
-  isSet = (uint8_t)eeprom_read_byte((const uint8_t *)EEisSetTargetPtr);
-  if ((isSet != ISSET) || forceDefault) {
-#if defined(DEBUG)
-     isSet_Save = isSet;
-#endif
-     *TargetPtr = defaultValue;
-     eeprom_busy_wait();
-
-     eeprom_update_byte((uint8_t *)EEisSetTargetPtr, (const uint8_t)ISSET);
-     delay(EEPROMDELAYMS);  // Magic delay time to ensure update is complete
-     eeprom_busy_wait();
-     for (uint8_t i = 0; i < 10; i++) {
-        isSet = (uint8_t)eeprom_read_byte((const uint8_t *)EEisSetTargetPtr);
-        if (isSet != ISSET) {
-#if defined(DEBUG)
-           Serial.print("ISSET error: isSet, ISSET = ");
-           Serial.print(isSet);
-           Serial.print(", ");
-           Serial.print(ISSET);
-           Serial.print("\n");
-           delay(10);
-#endif
-           eeprom_update_byte((uint8_t *)EEisSetTargetPtr, (const uint8_t)ISSET);
-           eeprom_busy_wait();
-        } else {
-            break;
-        }
-     }
-
-     eeprom_update_byte((uint8_t *)EETargetPtr, defaultValue);
-     delay(EEPROMDELAYMS);  // Magic delay time to ensure update is complete
-     eeprom_busy_wait();
-
-     for (uint8_t i = 0; i < 10; i++) {
-        *TargetPtr = (uint8_t)eeprom_read_byte((const uint8_t *)EETargetPtr);
-        if (*TargetPtr != defaultValue) {
-#if defined(DEBUG)
-           Serial.print("TargetPtr error: *TgtPtr, defaultValue = ");
-           Serial.print(*TargetPtr);
-           Serial.print(", ");
-           Serial.print(defaultValue);
-           Serial.print("\n");
-           delay(10);
-#endif
-           eeprom_update_byte((uint8_t *)EETargetPtr, defaultValue);
-           eeprom_busy_wait();
-        } else {
-           break;
-        }
-     }
-
-#if defined(DEBUG)
-     Serial.print("   Reset: *TargetPtr, *EEisSetTargetPtr, *EETargetPtr, ISSET, isSet, forceDefault, "
-                  "defaultValue (Orig isSet): ");
-     Serial.print(*TargetPtr);
-     Serial.print(" <");
-     Serial.print(*EEisSetTargetPtr);
-     Serial.print("> <");
-     Serial.print(*EETargetPtr);
-     Serial.print("> ");
-     Serial.print(ISSET);
-     Serial.print(" ");
-     Serial.print(isSet);
-     Serial.print(" ");
-     Serial.print(forceDefault);
-     Serial.print(" ");
-     Serial.print(defaultValue);
-     Serial.print(" (");
-     Serial.print(isSet_Save);
-     Serial.print(")\n");
-#endif
-  } else {
-     *TargetPtr = (uint8_t)eeprom_read_byte((const uint8_t *)EETargetPtr);
-#if defined(DEBUG)
-     Serial.print("No Reset: *TargetPtr, *EEisSetTargetPtr, *EETargetPtr, ISSET, isSet, forceDefault, defaultValue: ");
-     Serial.print(*TargetPtr);
-     Serial.print(" <");
-     Serial.print(*EEisSetTargetPtr);
-     Serial.print("> <");
-     Serial.print(*EETargetPtr);
-     Serial.print("> ");
-     Serial.print(ISSET);
-     Serial.print(" ");
-     Serial.print(isSet);
-     Serial.print(" ");
-     Serial.print(forceDefault);
-     Serial.print(" ");
-     Serial.print(defaultValue);
-     Serial.print("\n");
-#endif
-  }
-
-  eeprom_busy_wait();
-}  // end of checkSetDefaultEE
+// Set a persistent CV's variable and journal it. The EEPROM write happens in the background,
+// so DCC forwarding does not stall
+void saveCV(uint8_t *TargetPtr, uint8_t CVnum, uint8_t value) {
+  *TargetPtr = value;
+  cvsWrite(CVnum, value);
+}  // end of saveCV
 
 void eepromClear() {
-  for (unsigned int i = 0 ; i < EEPROM.length() ; i++) {
-     EEPROM.write(i, 0);
-  }
+  cvsErase();  // Invalidates every journal record: all CV's revert to their defaults
 }
 
 uint8_t notifyCVWrite (uint16_t CVnum, uint8_t CVval) {
@@ -731,7 +882,10 @@ uint8_t notifyCVWrite (uint16_t CVnum, uint8_t CVval) {
       case  255:  // Set the channel number and reset related EEPROM values.
                   // Modest error checking. Verified this feature works
          if (CVval <= channels_max) {         // Check for good values
-            checkSetDefaultEE(&CHANNEL, &EEisSetCHANNEL, &EECHANNEL, (uint8_t)CVval, 1);
+            saveCV(&CHANNEL, 255, (uint8_t)CVval);
+#if defined(RECEIVER)
+            chsPrefer(CHANNEL);               // Searched first from now on
+#endif
             startModemFlag = 1;
          } else {                    // Ignore bad values
             CVStatus = IGNORED;
@@ -740,9 +894,8 @@ uint8_t notifyCVWrite (uint16_t CVnum, uint8_t CVval) {
       case  254:  // Set the RF power level and reset related EEPROM values.
                   // Verified this feature works.
          if (CVval <= 10) {
-            checkSetDefaultEE(&powerLevel, &EEisSetpowerLevel,
-                              &EEpowerLevel, (uint8_t)CVval, 1);  // Set powerLevel and reset
-                                                                  // EEPROM values. Ignore bad values
+            saveCV(&powerLevel, 254, (uint8_t)CVval);  // Set powerLevel and reset
+                                                       // EEPROM values. Ignore bad values
             startModemFlag = 1;
          } else {
             CVStatus = IGNORED;
@@ -751,30 +904,27 @@ uint8_t notifyCVWrite (uint16_t CVnum, uint8_t CVval) {
       break;
       case  253:  // Turn off/on the modem for bad packet intervals and reset related EEPROM values.
                   // Verified this feature works
-         checkSetDefaultEE(&lockedAntiphase, &EEisSetlockedAntiphase,
-                           &EElockedAntiphase, (uint8_t)CVval, 1);  // Set lockedAntiphase
-                                                                    // and reset EEPROM values
+         saveCV(&lockedAntiphase, 253, (uint8_t)CVval);  // Set lockedAntiphase
+                                                         // and reset EEPROM values
       break;
       case  252:  // Set the tooLong (in quarter second intervals) and reset related EEPROM values.
          tooLong = (uint64_t)CVval * QUARTERSEC;
       break;
       case  248:  // Set the DC output level and reset related EEPROM values.
                   // Verified this feature works.
-         checkSetDefaultEE((uint8_t *)&dcLevel, &EEisSetdcLevel, &EEdcLevel, (uint8_t)CVval, 1);
+         saveCV((uint8_t *)&dcLevel, 248, (uint8_t)CVval);
          // Set dcLevel and reset EEPROM values
       break;
       case  246:  // Set whether to always use modem data
          if (CVval) CVval = 1;  // Non-zero reset to 1
-         checkSetDefaultEE(&filterModemData, &EEisSetfilterModemData,
-                           &EEfilterModemData, (uint8_t)CVval, 1);  // Set filterModemData
-                                                                    // and reset EEPROM values
+         saveCV(&filterModemData, 246, (uint8_t)CVval);  // Set filterModemData
+                                                         // and reset EEPROM values
       break;
 #if defined(RECEIVER)
       case  245:  // Set the wait period in 1 second intervals
                   // - Nothing can be done with this until reset
          if (CVval <= 60)
-            checkSetDefaultEE(&InitialWaitPeriodSEC, &EEisSetInitialWaitPeriodSEC,
-                              &EEInitialWaitPeriodSEC,  (uint8_t)CVval, 1);  // Wait time in sec
+            saveCV(&InitialWaitPeriodSEC, 245, (uint8_t)CVval);  // Wait time in sec
          else 
             CVStatus = IGNORED;
 
@@ -782,8 +932,7 @@ uint8_t notifyCVWrite (uint16_t CVnum, uint8_t CVval) {
       break;
 #endif
       case 244: // Repeat packet
-            checkSetDefaultEE(&repeatPacket, &EEisSetRepeatPacket,
-                              &EERepeatPacket,  (uint8_t)CVval, 1);  // repeatPacket
+            saveCV(&repeatPacket, 244, (uint8_t)CVval);  // repeatPacket
       break;
 
       case  243:  // Set the DEVIATN hex code
@@ -795,8 +944,20 @@ uint8_t notifyCVWrite (uint16_t CVnum, uint8_t CVval) {
       break;
 
 #if defined(TRANSMITTER)
-      case  242:  // Set the preamble counts
+      case  242:  // Set the preamble counts. Overrides the profile
          preamble_bits = CVval;
+         preambleFixed = 1;
+         setPreamblePolicy();
+      break;
+      case  232:  // Set the receiver profile for the preamble policy
+         if (CVval < DCCP_PROFILES) {
+            saveCV(&preambleProfile, 232, (uint8_t)CVval);
+            preambleFixed = 0;
+            setPreamblePolicy();
+         } else {
+            CVStatus = IGNORED;
+            CVval = preambleProfile;
+         }
       break;
 #endif
       case  241:  // Set the timer long counts
@@ -807,6 +968,22 @@ uint8_t notifyCVWrite (uint16_t CVnum, uint8_t CVval) {
          // Add validation
          timer_short = CVval;
       break;
+#if defined(DROPOUT_CONCEALMENT)
+      case  231:  // Stop regenerating cached packets this many 1/4 sec into a dropout. 0: off
+         saveCV(&concealCutoff, 231, (uint8_t)CVval);
+      break;
+#endif
+#if defined(REFRESH_ENGINE) || defined(DROPOUT_CONCEALMENT)
+      case  239:  // Forget locos not heard from in this many sec. 0: never
+         dccrAge = CVval;
+      break;
+      case  238:  // Function group refresh period per loco, 100 ms units. 0: speed only
+         dccrFuncPeriod = CVval;
+      break;
+      case  237:  // Speed refresh period per loco, 10 ms units. 0: no refresh
+         dccrSpeedPeriod = CVval;
+      break;
+#endif
       case  236:  // timer_long_cutout[3]
          // Add validation
         advance  = 2*(uint16_t)CVval;
@@ -838,16 +1015,15 @@ uint8_t notifyCVWrite (uint16_t CVnum, uint8_t CVval) {
 
       case 29:    // Set the Configuration CV and reset related EEPROM values.
                   // Verified this feature works.
-         checkSetDefaultEE(&AirMiniCV29, &EEisSetAirMiniCV29, &EEAirMiniCV29, (uint8_t)CVval, 1);
+         saveCV(&AirMiniCV29, 29, (uint8_t)CVval);
          AirMiniCV29Bit5 = AirMiniCV29 & 0b00100000;  // Save the bit 5 value of CV29
                                                       // (0: Short address, 1: Long address)
       break;
       case 18:    // Set the Long Address Low Byte CV and reset related EEPROM values.
                   // Verified this feature works.
                   // See NMRA S-9.2.1 Footnote 8.
-         checkSetDefaultEE(&AirMiniCV17, &EEisSetAirMiniCV17, &EEAirMiniCV17,
-                           (uint8_t)AirMiniCV17tmp, 1);
-         checkSetDefaultEE(&AirMiniCV18, &EEisSetAirMiniCV18, &EEAirMiniCV18, (uint8_t)CVval, 1);
+         saveCV(&AirMiniCV17, 17, (uint8_t)AirMiniCV17tmp);
+         saveCV(&AirMiniCV18, 18, (uint8_t)CVval);
       break;
       case 17:    // Set the Long Address High Byte CV and save values after validation (do NOT
                   // write to AirMini's CV17 or EEPROM yet!).
@@ -860,24 +1036,23 @@ uint8_t notifyCVWrite (uint16_t CVnum, uint8_t CVval) {
             CVStatus = IGNORED;
          }
       break;
+      case  200:  // Clear the packet queue statistics. CV201-214 are read-only
+         clearRingStats();
+      break;
+#if defined(LATENCY_STATS)
+      case  216:  // Clear the latency histograms. CV217-229 are read-only
+         dcclClear();
+      break;
+#endif
       case  8:  // Full EEPROM Reset and reboot!
          if (CVval == 8) {
 #if defined(USE_OLD_LCD) || defined(USE_NEW_LCD)
 //{
             if (LCDFound) {
 
-               snprintf(lcd_line, sizeof(lcd_line), "Keep Power ON!");
-
-               lcd.clear();
-#if defined(USE_OLD_LCD)
-               lcd.setCursor(0, 0);  // column, row
-#endif
-               LCD_PRINT(lcd_line);
-               snprintf(lcd_line, sizeof(lcd_line), "Factory Reset...");
-#if defined(USE_OLD_LCD)
-               lcd.setCursor(0, 1);  // column, row
-#endif
-               LCD_PRINT(lcd_line);
+               lcdvLine(0, "Keep Power ON!");
+               lcdvLine(1, "Factory Reset...");
+               lcdvFlush();  // Get it on the display before the reboot
             }
 //}
 #endif
@@ -891,7 +1066,7 @@ uint8_t notifyCVWrite (uint16_t CVnum, uint8_t CVval) {
                   // Verified this feature works.
          if ((0 < CVval) && (CVval < 128)) {  // CV1 cannot be outside this range.
                                               // Some decoders limit 0<CVval<100
-            checkSetDefaultEE(&AirMiniCV1, &EEisSetAirMiniCV1, &EEAirMiniCV1, (uint8_t)CVval, 1);
+            saveCV(&AirMiniCV1, 1, (uint8_t)CVval);
          } else {
             CVStatus = IGNORED;
          }
@@ -949,7 +1124,7 @@ ISR(TIMER1_OVF_vect) {
      }
 #if defined(TRANSMITTER)
      if (current_state == CUTOUT) {
-        if ((num_cutout == 1) && (preamble_bits >= MAXIMUM_PREAMBLE_BITS)) {
+        if ((num_cutout == 1) && longCutout) {
            timer_val = timer_long;
         }
      }
@@ -969,25 +1144,40 @@ ISR(TIMER1_OVF_vect) {
            timer_val = timer_short;  // second half will be reset
            num_cutout++;
            // get next message
+#if defined(PRIORITY_QUEUE)
+           if (dccqCount && dccqGet((DCC_MSG *)&msgISR, &tagISR)) {
+              dccptrISR = &msgISR;
+#else
            if (msgIndexOut != msgIndexIn) {
               msgIndexOut = (msgIndexOut+1) % MAXMSG;
               dccptrISR = &msg[msgIndexOut];
+#if defined(LATENCY_STATS)
+              tagISR = msgTag[msgIndexOut];
+#endif
+#endif
               dccptrOut = dccptrISR;  // For display only
               useModemData = 1;
               next_state = PREAMBLE;  // jump out of state
+              ringStats.sent++;
+#if defined(LATENCY_STATS)
+              dcclSent(tagISR, micros());  // Its preamble starts now
+#endif
            }
            else if (num_cutout >= MAX_NUM_CUTOUT) {
-              if (repeatPacket)
+              if (repeatPacket) {
                  next_state = PREAMBLE;  // jump out of state w/ same dccptrISR
-              else
+                 ringStats.repeated++;
+              } else {
                  num_cutout = 2; // restart the counter, but prevent long pulse cutout
+                 ringStats.idled++;
+              }
            }
            if (next_state == PREAMBLE) {
 #if defined(TRANSMITTER)
               preamble_count = 
-                 (preamble_bits > dccptrISR->PreambleBits) ? 
-                 preamble_bits :          // large enough to satisfy Airwire!
-                 dccptrISR->PreambleBits; // use what was given
+                 (preambleFixed || (preamble_min > dccptrISR->PreambleBits)) ? 
+                 preamble_min :           // CV242's, or at least the profile's least
+                 dccptrISR->PreambleBits; // set by the preamble policy when queued
 #else
               preamble_count = dccptrISR->PreambleBits;
 #endif
@@ -1037,21 +1227,63 @@ ISR(TIMER1_OVF_vect) {
 
 #if defined(DEBUG)
 void printMsgSerial() {
+#if defined(PRIORITY_QUEUE)
+  Serial.print("queue[");
+  Serial.print(dccqCount, HEX);
+  Serial.print("] coalesced/dropped/evicted: ");
+  Serial.print(dccqCoalesced);
+  Serial.print("/");
+  Serial.print(dccqDropped);
+  Serial.print("/");
+  Serial.print(dccqEvicted);
+  Serial.print("\n");
+#else
   Serial.print("msg[");
   Serial.print(msgIndexIn, HEX);
   Serial.print("]:\n");
+#endif
   Serial.print(" len: ");
-  Serial.print(msg[msgIndexIn].Size, HEX);
+  Serial.print(dccptrIn->Size, HEX);
   Serial.print("\n");
-  for (uint8_t i = 0; i < msg[msgIndexIn].Size; i++) {
+  for (uint8_t i = 0; i < dccptrIn->Size; i++) {
      Serial.print(" data[");
      Serial.print(i, HEX);
      Serial.print("]: ");
-     Serial.print(msg[msgIndexIn].Data[i], HEX);
+     Serial.print(dccptrIn->Data[i], HEX);
+     Serial.print("\n");
+  }
+}
+
+#if defined(LATENCY_STATS)
+#define LATENCYPRINTTIME 10000000UL  // 10 sec. Units: us
+void printLatencySerial() {
+  static const char *names[DCCL_HISTS] = {"decode", "wait", "total"};
+
+  for (uint8_t h = 0; h < DCCL_HISTS; h++) {
+     Serial.print(names[h]);
+     Serial.print(" n/p50/p90/p99/max(us): ");
+     Serial.print(dcclCount(h));
+     Serial.print("/");
+     Serial.print(dcclPercentile(h, 50));
+     Serial.print("/");
+     Serial.print(dcclPercentile(h, 90));
+     Serial.print("/");
+     Serial.print(dcclPercentile(h, 99));
+     Serial.print("/");
+     Serial.print(dcclMax(h));
+     Serial.print(" buckets:");
+     for (uint8_t b = 0; b < DCCL_BUCKETS; b++) {
+        Serial.print(" ");
+        Serial.print(dcclBucket(h, b));
+     }
      Serial.print("\n");
   }
+  Serial.print("overruns: ");
+  Serial.print(dcclOverruns);
+  Serial.print("\n");
 }
 #endif
+#endif
 
 // Function to combine High and Low bytes into 16 uint8_t variable
 uint16_t combineHighLow(uint8_t High, uint8_t Low) {
@@ -1062,50 +1294,43 @@ uint16_t combineHighLow(uint8_t High, uint8_t Low) {
   return (tmp16);
 }
 
-/* Not used
-void checkSetDefault(uint8_t *TargetPtr, const uint8_t *EEisSetTargetPtr, 
-                    const uint8_t *EETargetPtr, uint8_t defaultValue, uint8_t forceDefault) {
-  Serial.print("   Check: *TargetPtr, *EEisSetTargetPtr, *EETargetPtr, ISSET, isSet, defaultValue: ");
-  Serial.print(*TargetPtr);
-  Serial.print(" <");
-  Serial.print(*EEisSetTargetPtr);
-  Serial.print("> <");
-  Serial.print(*EETargetPtr);
-  Serial.print("> ");
-  Serial.print(defaultValue);
-  Serial.print("\n");
-}
-*/
-
-
 #if defined(USE_OLD_LCD) || defined(USE_NEW_LCD)
 //{  // USE_OLD_LCD
 void LCD_Banner() {
-#if defined(USE_OLD_LCD)
-  lcd.setCursor(0, 0);              // Set initial column, row
-#else
-  lcd.clear();              // Set initial column, row
-#endif
   if (whichBanner == INITIAL)
-     LCD_PRINT(bannerString);   // Banner
+     lcdvLine(0, bannerString);   // Banner
   else
-     LCD_PRINT("ProMini Air Info");
-#if defined(USE_OLD_LCD)
-  lcd.setCursor(0, 1);              // Set next line column, row
-#endif
-  LCD_PRINT("H:" HWVERSION " S:" SWVERSION "/" FREQMH "MH");   // Show state
+     lcdvLine(0, "ProMini Air Info");
+  lcdvLine(1, "H:" HWVERSION " S:" SWVERSION "/" FREQMH "MH");   // Show state
   LCDprevTime  = micros();     // Set up the previous display time
   LCDrefresh = true;
 }  // end of LCD_Banner
 
+#if defined(SHOW_RING_STATS)
+void LCD_RingStats() {
+  ringStats_t stats;
+  readRingStats(&stats);
+
+  snprintf(lcd_line, sizeof(lcd_line), "Q%u/%u S%u", stats.depthMax, ringDepth(), stats.sent);
+  lcdvLine(0, lcd_line);
+  snprintf(lcd_line, sizeof(lcd_line), "O%u R%u I%u", stats.overwritten, stats.repeated, stats.idled);
+  lcdvLine(1, lcd_line);
+
+  return;
+}  // end of LCD_RingStats
+#endif
+
 void LCD_Addr_Ch_PL() {
+#if defined(SHOW_RING_STATS)
+  if (printStats) {
+     printStats = 0;
+     LCD_RingStats();
+     return;
+  }
+#endif
   if (!printIn) dccptrTmp = dccptrOut;
   else dccptrTmp = dccptrIn;
 
-  lcd.clear();
-#if defined(USE_OLD_LCD)
-  lcd.setCursor(0, 0);  // column, row
-#endif
   if (printDCC) {
      if (dccptrTmp->Data[0] < 128) {
            snprintf(lcd_line, sizeof(lcd_line), "Msg Ad: %d(S)", (uint16_t)dccptrTmp->Data[0]);
@@ -1136,10 +1361,7 @@ void LCD_Addr_Ch_PL() {
            snprintf(lcd_line, sizeof(lcd_line), "My Ad: %d(S)", AirMiniAddress_int);
   }
 
-  LCD_PRINT(lcd_line);
-#if defined(USE_OLD_LCD)
-  lcd.setCursor(0, 1);  // column, row
-#endif
+  lcdvLine(0, lcd_line);
 
   if (printDCC) {
      snprintf(lcd_line, sizeof(lcd_line), "                ");
@@ -1163,6 +1385,9 @@ void LCD_Addr_Ch_PL() {
 #endif
   } else {
      printDCC = 1;
+#if defined(SHOW_RING_STATS)
+     printStats = 1;  // Statistics page next
+#endif
 #if defined(NAEU_900MHz)
      if (CHANNEL <= channels_na_max)
         regionNum = 0;
@@ -1177,28 +1402,18 @@ void LCD_Addr_Ch_PL() {
 #endif
   }
 
-  LCD_PRINT(lcd_line);
+  lcdvLine(1, lcd_line);
 
   return;
 }  // end of LCD_Addr_Ch_PL
 
 void LCD_Wait_Period_Over(uint16_t status) {
 
-  lcd.clear();
-
-#if defined(USE_OLD_LCD)
-  lcd.setCursor(0, 0);  // column, row
-#endif
   if (!status) {
-     snprintf(lcd_line, sizeof(lcd_line), "NO valid");
+     lcdvLine(0, "NO valid");
   } else {
-     snprintf(lcd_line, sizeof(lcd_line), "Found valid");
+     lcdvLine(0, "Found valid");
   }
-  LCD_PRINT(lcd_line);
-
-#if defined(USE_OLD_LCD)
-  lcd.setCursor(0, 1);  // column, row
-#endif
 
 #if defined(NAEU_900MHz)
   if (CHANNEL <= channels_na_max)
@@ -1208,15 +1423,80 @@ void LCD_Wait_Period_Over(uint16_t status) {
 #endif
 
   snprintf(lcd_line, sizeof(lcd_line), "RF on Ch: %d(%s)", CHANNEL, regionString[regionNum]);
-  LCD_PRINT(lcd_line);
+  lcdvLine(1, lcd_line);
   LCDprevTime  = micros();
   LCDrefresh = true;
 
   return;
 }  // end of LCD_Wait_Period_Over
+
+// A bus held low by a hung device would stall every transfer: leave it alone
+bool I2C_Bus_Idle() {
+  pinMode(SDA, INPUT_PULLUP);
+  pinMode(SCL, INPUT_PULLUP);
+  delayMicroseconds(10);  // Let the pullups raise the lines
+  return digitalRead(SDA) && digitalRead(SCL);
+}  // end of I2C_Bus_Idle
+
+// Does a device acknowledge its address? Bounded by TWIQ_TIMEOUTUS on a stuck bus
+bool I2C_Probe(uint8_t address) {
+  return twiqProbe(address);
+}  // end of I2C_Probe
+
+void LCD_Init(uint8_t address) {
+  LCDAddress = address;
+  LCDFound = true;
+  LCDrefresh = true;
+  lcdvBegin(LCDAddress, LCDTYPE);             // Initialize the display
+  whichBanner = INITIAL;
+  LCDprevTime = micros()+LCDTimePeriod;
+  cvsWrite(LCDTYPEID, LCDTYPE);               // Remember it for the next boot. No wear if unchanged
+  cvsWrite(LCDADDRID, LCDAddress);
+}  // end of LCD_Init
+
+// A few addresses of the fallback scan. As with the old boot-time scan, a
+// lone device on the bus is taken to be the display.
+void I2C_Scan_Step() {
+  for (uint8_t n = 0; (n < I2CSCANPERTICK) && (I2CScanAddress < 127); n++, I2CScanAddress++) {
+     if (I2C_Probe(I2CScanAddress)) {
+        I2CScanFound++;
+        LCDAddress = I2CScanAddress;
+     }
+  }
+  if (twiqTimedOut) {  // Bus got stuck: give up on the display
+     twiqTimedOut = 0;
+     I2CScanAddress = 0;
+     return;
+  }
+  if (I2CScanAddress >= 127) {
+     I2CScanAddress = 0;
+     if (I2CScanFound == 1) LCD_Init(LCDAddress);
+  }
+}  // end of I2C_Scan_Step
 //}  // USE_OLD_LCD
 #endif
 
+#if defined(RECEIVER)
+// Append a channel to the search order, once
+void addSearchChannel(uint8_t channel) {
+  if (channel > channels_max) return;
+  for (uint8_t i = 0; i < searchOrderLength; i++)
+     if (searchOrder[i] == channel) return;
+  searchOrder[searchOrderLength++] = channel;
+}
+
+void setSearchOrder() {
+  uint8_t scored[CHS_SLOTS];
+  uint8_t n = chsOrder(scored, CHS_SLOTS);
+  uint8_t i;
+
+  searchOrderLength = 0;
+  for (i = 0; i < n; i++) addSearchChannel(scored[i]);
+  addSearchChannel(CHANNEL);
+  for (i = 0; i < sizeof(searchChannels); i++) addSearchChannel(searchChannels[i]);
+}
+#endif
+
 void setup() {
   // delay(INITIALDELAYMS);
 #if defined(DEBUG) || defined(DEBUG_LOCAL)
@@ -1224,97 +1504,58 @@ void setup() {
 #endif
 
   ///////////////////////////////////////////////////////
-  // Start: Let's get the slow EEPROM stuff done first //
+  // Start: Read the persistent CV's. Nothing waits here //
   ///////////////////////////////////////////////////////
 
-#if defined(DEBUG)
-  Serial.print("Initial SET_DEFAULT: "); Serial.print(SET_DEFAULT); Serial.print("\n");
-#endif
-  SET_DEFAULT = (uint8_t)eeprom_read_byte((const uint8_t *)&EEFirst);
-  if (SET_DEFAULT != ISSET)
-     SET_DEFAULT = 1;
-  else
-     SET_DEFAULT = 0;
-  eeprom_busy_wait();
-#if defined(DEBUG)
-  Serial.print("Final SET_DEFAULT: "); Serial.print(SET_DEFAULT); Serial.print("\n");
-  delay(100);
-#endif
+  cvsBegin();                                   // One read pass over the EEPROM journal
 
   // Get the CHANNEL # stored in EEPROM and validate it
-  // eeprom_update_byte(&EECHANNELDefault, CHANNELDEFAULT );
-  checkSetDefaultEE(&CHANNEL, &EEisSetCHANNEL, &EECHANNEL,
-                    (uint8_t)CHANNELDEFAULT, SET_DEFAULT);      // Validate the channel, it's possible
-                                                                // the EEPROM has bad data
-  if (CHANNEL > channels_max)
-     checkSetDefaultEE(&CHANNEL, &EEisSetCHANNEL, &EECHANNEL,
-                       (uint8_t)CHANNELDEFAULT, 1);  // Force the EEPROM data to use CHANNEL 0,
-                                                     // if the CHANNEL is invalid
-
-  // Just flat out set the powerLevel
-  // eeprom_update_byte(&EEpowerLevelDefault, POWERLEVELDEFAULT );
-  checkSetDefaultEE(&powerLevel, &EEisSetpowerLevel, &EEpowerLevel,
-                    (uint8_t)POWERLEVELDEFAULT, SET_DEFAULT);  // Use EEPROM value if it's been set,
-                                                               // otherwise set to 1 and set EEPROM values
+  CHANNEL = cvsRead(255, CHANNELDEFAULT);
+  if (CHANNEL > channels_max) CHANNEL = CHANNELDEFAULT;  // It's possible the EEPROM has bad data
+
+  powerLevel = cvsRead(254, POWERLEVELDEFAULT);
 
   // Set the alternate DC output level to HIGH or LOW (i.e., bad CC1101 data)
   // The level of this output can be used by some decoders. The default is HIGH.
-  // eeprom_update_byte(&EEdcLevelDefault, DCLEVELDEFAULT );
-  checkSetDefaultEE((uint8_t *)&dcLevel, &EEisSetdcLevel, &EEdcLevel,
-                    (uint8_t)DCLEVELDEFAULT, SET_DEFAULT);  // Use EEPROM value if it's been set, otherwise set
-                                                               // to 1 and set EEPROM values
+  dcLevel = cvsRead(248, DCLEVELDEFAULT);
+
   // Turn the lockedAntiphase OFF/ON option.
-  // eeprom_update_byte(&EElockedAntiphaseDefault, LOCKEDANTIPHASEDEFAULT );
-  checkSetDefaultEE(&lockedAntiphase, &EEisSetlockedAntiphase, &EElockedAntiphase,
-                    (uint8_t)LOCKEDANTIPHASEDEFAULT, SET_DEFAULT);  // Use EEPROM value if it's been set,
-                                                                    // otherwise set to 1 and set EEPROM values
+  lockedAntiphase = cvsRead(253, LOCKEDANTIPHASEDEFAULT);
 
   // Set whether to always use modem data on transmit
-  // eeprom_update_byte(&EEfilterModemDataDefault, FILTERMODEMDATADEFAULT );
-  checkSetDefaultEE(&filterModemData, &EEisSetfilterModemData, &EEfilterModemData,
-                    (uint8_t)FILTERMODEMDATADEFAULT, SET_DEFAULT);  // Use EEPROM value if it's been set,
-                                                                    // otherwise set to 0
-
-  // Get up addressing-related CV's from EEPROM, or if not set set them in EEPROM
-  // eeprom_update_byte(&EEAirMiniCV1Default, AIRMINICV1DEFAULT );
-  checkSetDefaultEE(&AirMiniCV1,  &EEisSetAirMiniCV1,  &EEAirMiniCV1,
-                    (uint8_t)AIRMINICV1DEFAULT, SET_DEFAULT);  // Short address. By default, not using
-
-  // eeprom_update_byte(&EEAirMiniCV17Default, AIRMINICV17DEFAULT );
-  checkSetDefaultEE(&AirMiniCV17, &EEisSetAirMiniCV17, &EEAirMiniCV17,
-                    (uint8_t)AIRMINICV17DEFAULT, SET_DEFAULT);  // High uint8_t to set final address to 9000
-  AirMiniCV17tmp = AirMiniCV17;                                 // Due to the special nature of CV17 paired with CV18
-
-  // eeprom_update_byte(&EEAirMiniCV18Default, AIRMINICV18DEFAULT );
-  checkSetDefaultEE(&AirMiniCV18, &EEisSetAirMiniCV18, &EEAirMiniCV18,
-                    (uint8_t)AIRMINICV18DEFAULT, SET_DEFAULT);  // Low uint8_t to set final address to
-                                                                // 9000/9001 for transmitter/receiver
-
-  // eeprom_update_byte(&EEAirMiniCV29Default, AIRMINICV29DEFAULT );
-  checkSetDefaultEE(&AirMiniCV29, &EEisSetAirMiniCV29, &EEAirMiniCV29,
-                    (uint8_t)AIRMINICV29DEFAULT, SET_DEFAULT);  // Set CV29 so that it will use a long address
-  AirMiniCV29Bit5 = AirMiniCV29 & 0b00100000;  // Save the bit 5 value of CV29 (0: Short address, 1: Long address)
+  filterModemData = cvsRead(246, FILTERMODEMDATADEFAULT);
+
+  // Get up addressing-related CV's
+  AirMiniCV1 = cvsRead(1, AIRMINICV1DEFAULT);     // Short address. By default, not using
+  AirMiniCV17 = cvsRead(17, AIRMINICV17DEFAULT);  // High uint8_t to set final address to 9000
+  AirMiniCV17tmp = AirMiniCV17;                   // Due to the special nature of CV17 paired with CV18
+  AirMiniCV18 = cvsRead(18, AIRMINICV18DEFAULT);  // Low uint8_t to set final address to
+                                                  // 9000/9001 for transmitter/receiver
+  AirMiniCV29 = cvsRead(29, AIRMINICV29DEFAULT);  // Set CV29 so that it will use a long address
+  AirMiniCV29Bit5 = AirMiniCV29 & 0b00100000;     // Save the bit 5 value of CV29 (0: Short address, 1: Long address)
 
 #if defined(RECEIVER)
 //{ RECEIVER
-  // eeprom_update_byte(&EEInitialWaitPeriodSECDefault, INITIALWAITPERIODSECDEFAULT );
-  checkSetDefaultEE(&InitialWaitPeriodSEC, &EEisSetInitialWaitPeriodSEC, &EEInitialWaitPeriodSEC,
-                    (uint8_t)INITIALWAITPERIODSECDEFAULT, SET_DEFAULT);  // Wait time in sec
+  InitialWaitPeriodSEC = cvsRead(245, INITIALWAITPERIODSECDEFAULT);  // Wait time in sec
+  chsBegin();                                        // Channel history
+  setSearchOrder();
+  searchChannelIndex = 0;
+  CHANNEL = searchOrder[0];                          // Start on the best channel
+#if defined(DROPOUT_CONCEALMENT)
+  concealCutoff = cvsRead(231, CONCEALCUTOFFDEFAULT);  // Dropout concealment cutoff
+#endif
 //} RECEIVER
 #else
 //{ TRANSMITTER
+  preambleProfile = cvsRead(232, PREAMBLE_PROFILE);  // Preamble policy
+  if (preambleProfile >= DCCP_PROFILES) preambleProfile = DCCP_AIRWIRE;
+  setPreamblePolicy();
 //} TRANSMITTER
 #endif
-  // eeprom_update_byte(&EERepeatPacket, REPEATPACKETDEFAULT );
-  checkSetDefaultEE(&repeatPacket, &EEisSetRepeatPacket, &EERepeatPacket,
-                    (uint8_t)REPEATPACKETDEFAULT, SET_DEFAULT);  // Repeat packet
-
-  // Now set to not first time
-  eeprom_update_byte((uint8_t *)&EEFirst, (const uint8_t)ISSET);
-  eeprom_busy_wait();
+  repeatPacket = cvsRead(244, REPEATPACKETDEFAULT);  // Repeat packet
 
   /////////////////////////////////////////////////////
-  // End: Let's get the slow EEPROM stuff done first //
+  // End: Read the persistent CV's. Nothing waits here //
   /////////////////////////////////////////////////////
 
 
@@ -1330,6 +1571,12 @@ void setup() {
   dccptrIn =  (volatile DCC_MSG *)&msgIdle;  // Well, set it to something.
   dccptrOut = (volatile DCC_MSG *)&msgIdle;  // Well, set it to something.
   dccptrISR = (volatile DCC_MSG *)&msgIdle;  // Well, set it to something.
+#if defined(PRIORITY_QUEUE)
+  dccqInit();                                // Empty packet queue
+#endif
+#if defined(REFRESH_ENGINE) || defined(DROPOUT_CONCEALMENT)
+  dccrInit();                                // Empty loco refresh table
+#endif
 
   ///////////////////////////////////////////////
   // Set up the hardware and related variables //
@@ -1358,40 +1605,23 @@ void setup() {
   then = micros();                            // Grab Current Clock value for the loop below
 
 #if defined(USE_OLD_LCD) || defined(USE_NEW_LCD)
-  // Scan for I2C devices
-  Wire.begin();  // Wire communication begin
-  uint8_t nDevices = 0;
-  uint8_t address;
-  uint8_t error;
-  for (address = 1; address < 127; address++) {
-     // The i2c_scanner uses the return value of
-     // the Write.endTransmisstion to see if
-     // a device did acknowledge to the address.
-     Wire.beginTransmission(address);
-     error = Wire.endTransmission();
-
-     if (error == 0) {
-        nDevices++;
-        LCDAddress = address;
+  // Look for the display: cached address, then the known ones. No full scan here
+  LCDFound = false;
+  LCDrefresh = false;
+  if (I2C_Bus_Idle()) {
+     twiqBegin(I2CCLOCK);  // I2C master. Every wait on the bus is bounded
+     uint8_t address = cvsRead(LCDADDRID, 0);
+     if ((cvsRead(LCDTYPEID, 0) != LCDTYPE) || !address || !I2C_Probe(address)) {
+        address = 0;
+        for (uint8_t i = 0; i < sizeof(LCDKnownAddress); i++) {
+           if (I2C_Probe(pgm_read_byte(&LCDKnownAddress[i]))) {
+              address = pgm_read_byte(&LCDKnownAddress[i]);
+              break;
+           }
+        }
      }
-  }
-
-  if (nDevices == 1) {
-     LCDFound = true;
-     LCDrefresh = true;
-#if defined(USE_OLD_LCD)
-     lcd.init(LCDAddress, LCDCOLUMNS, LCDROWS);    // Initialize the LCD
-     lcd.backlight();                            // Backlight it
-#else
-     // lcd.begin(&Adafruit128x64, LCDAddress);
-     lcd.begin(&Adafruit128x32, LCDAddress);
-     lcd.setFont(Adafruit5x7);
-#endif
-     whichBanner = INITIAL;
-     LCDprevTime = micros()+LCDTimePeriod;
-  } else {
-     LCDFound = false;
-     LCDrefresh = false;
+     if (address) LCD_Init(address);
+     else I2CScanAddress = 1;  // Scan the rest of the bus in loop(), after the radio is up
   }
 #endif
 
@@ -1423,7 +1653,39 @@ void setup() {
 
 void loop() {
   /* Check High Priority Tasks First */
-  DCC.process();  // The DCC library does it all with the callback notifyDccMsg!
+  DCC.process(DCC_RX_QUEUE);  // The DCC library does it all with the callback notifyDccMsg! All it has queued, after a slow pass
+#if defined(LATENCY_STATS)
+  dcclPoll();     // Bin the packets the ISR has put on the air
+#endif
+#if defined(CVS_POLL)
+  cvsDrain();     // Background EEPROM commits, if not done by the EEPROM-ready interrupt
+#endif
+
+#if defined(REFRESH_ENGINE)
+  // Only fill otherwise-idle airtime. Queued in its own class, so that a packet from the
+  // command station for the same loco and group, come before the ISR takes it, replaces it
+  if (!dccqCount) {
+     DCC_MSG msgRefresh;
+     if (dccrNext(millis(), &msgRefresh)) {
+        uint8_t cls = dccpSet(&msgRefresh, preambleProfile);
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+           dccqPutClass(&msgRefresh, cls);
+        }
+     }
+  }
+#endif
+
+#if defined(DROPOUT_CONCEALMENT)
+  // During a dropout, feed the ISR the cached state of each loco as it comes due
+  if (concealing && !ringDepth()) {
+     DCC_MSG msgConceal;
+     if (dccrNext(millis(), &msgConceal)) ringPutOwn(&msgConceal);
+  }
+#endif
+
+#if defined(USE_OLD_LCD) || defined(USE_NEW_LCD)
+  lcdvUpdate();   // Queue the next few changed characters, if any. Never waits on the bus
+#endif
 
   /**** After checking highest priority stuff, check for the timed tasks ****/
 
@@ -1434,8 +1696,19 @@ void loop() {
                                                  // A priority Schedule could be implemented in here if needed
      then = micros();             // Grab Clock Value for next time
 
+#if defined(DEBUG) && defined(LATENCY_STATS)
+     static uint32_t latencyPrevTime = 0;
+     if ((uint32_t)(then - latencyPrevTime) >= LATENCYPRINTTIME) {
+        latencyPrevTime = then;
+        printLatencySerial();
+     }
+#endif
+
 #if defined(USE_OLD_LCD) || defined(USE_NEW_LCD)
 //{
+     if (I2CScanAddress) I2C_Scan_Step();  // Background fallback scan for the display
+     twiqCheck();                          // Reset the I2C queue if the bus got stuck
+
      if (LCDrefresh && ((then-LCDprevTime) >= LCDTimePeriod)) {
         if (whichBanner == NONE) {
            LCD_Addr_Ch_PL();           // Update the display of address, chanel #, and power level
@@ -1483,13 +1756,37 @@ void loop() {
      // It is ESSENTIAL that you do NOT jump to DC output too soon! Otherwise Airwire programming will NOT
      // work well. Outputting an indefinite number of preamble bits seems to work OK with Airwire programming.
      // Also, do NOT jump to DC output until the receiver has set its final channel.
+#if defined(DROPOUT_CONCEALMENT)
+     // A short dropout is bridged from the loco cache first. The cutoff is a safety
+     // limit: past it, an idle replaces whatever the ISR would otherwise keep repeating,
+     // and the usual DC/idle handling takes over.
+     if (initialWait || ((then-timeOfHeardDCC) < CONCEALSTART)) {
+        concealing = 0;
+        concealDone = 0;
+     } else if (!concealDone && ((then-timeOfHeardDCC) < (uint64_t)concealCutoff*QUARTERSEC)) {
+        concealing = 1;
+     } else if (!concealDone) {
+        concealing = 0;
+        concealDone = 1;
+        ringPutOwn(&msgIdle);
+     }
+     if (filterModemData && (!initialWait) && ((then-timeOfValidDCC) >= tooLong) && !concealing) {
+#else
      if (filterModemData && (!initialWait) && ((then-timeOfValidDCC) >= tooLong)) {
+#endif
          useModemData = 0; // false use-of-modem-data state
      } else {
          useModemData = 1;
      }
+#if defined(DROPOUT_CONCEALMENT)
+     if ((!filterModemData) && (!initialWait) && ((then-timeOfValidDCC) >= tooLong) && !concealing) {
+#else
      if ((!filterModemData) && (!initialWait) && ((then-timeOfValidDCC) >= tooLong)) {
+#endif
         notifyDccMsg((DCC_MSG *)&msgIdle);
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+           ringStats.idled++;
+        }
      }
 
      if (!useModemData) {  // If not using modem data, ensure the output is set to a DC level
@@ -1504,6 +1801,7 @@ void loop() {
         // If we received a valid DCC signal during the intial wait period, stop waiting and proceed normally
         if (timeOfValidDCC > startInitialWaitTime) {
            initialWait = 0;
+           chsHit(CHANNEL);  // Remember where DCC was found
 #if defined(USE_OLD_LCD) || defined(USE_NEW_LCD)
            if (LCDFound) LCD_Wait_Period_Over(1);
 #endif
@@ -1513,10 +1811,10 @@ void loop() {
 #if defined(USE_OLD_LCD) || defined(USE_NEW_LCD)
               if (LCDFound) LCD_Wait_Period_Over(0);
 #endif
-              if (++searchChannelIndex <= sizeof(searchChannels)) {
+              if (++searchChannelIndex < searchOrderLength) {
               // Keep searching...
                  // Update the seach channel and endInitialWaitTime
-                 CHANNEL = searchChannels[searchChannelIndex-1];
+                 CHANNEL = searchOrder[searchChannelIndex];
                  // Re-initialize the start of the wait time
                  startInitialWaitTime = then;
                  // Re-initialize the end of the wait time
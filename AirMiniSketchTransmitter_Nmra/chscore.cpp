@@ -0,0 +1,133 @@
+/*
+chscore.cpp
+
+Receiver channel history.
+
+Each slot holds a channel, its hits (1-7) and the acquisition count when
+it was last found ("seen"). The acquisition count advances each time a
+receiver finds valid DCC after power-up, so age is counted in power-ups
+that found DCC, not in time. A channel's score is its hits, halved for
+every CHS_HALFLIFE acquisitions since it was seen: a layout that moved
+to a new channel overtakes the old one after a few sessions.
+
+A slot is 2 records in the CV store, the channel and hits packed in one
+byte. Normally 3 records are written per power-up, and only when the
+receiver acquires DCC.
+
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "chscore.h"
+#include "cvstore.h"
+
+#define CHS_NONE    0xFF  // An unwritten slot reads as this
+#define CHS_MAXHITS 7
+
+typedef struct {
+  uint8_t channel;  // CHS_NONE: empty
+  uint8_t hits;
+  uint8_t seen;
+} chsSlot_t;
+
+static chsSlot_t slot[CHS_SLOTS];
+static uint8_t session;  // Acquisitions so far. Wraps
+
+void chsBegin(void) {
+  session = cvsRead(CHS_ID, 0);
+  for (uint8_t i = 0; i < CHS_SLOTS; i++) {
+     uint8_t v = cvsRead(CHS_ID+1+2*i, CHS_NONE);
+     slot[i].channel = (v == CHS_NONE) ? CHS_NONE : (v & 0b00011111);
+     slot[i].hits = v >> 5;
+     slot[i].seen = cvsRead(CHS_ID+2+2*i, 0);
+  }
+}
+
+// Hits in 1/16ths, halved per CHS_HALFLIFE acquisitions of age
+static uint8_t score(uint8_t i) {
+  uint8_t halvings;
+
+  if (slot[i].channel == CHS_NONE) return 0;
+  halvings = (uint8_t)(session - slot[i].seen) / CHS_HALFLIFE;
+  if (halvings > 7) return 0;
+  return (uint8_t)(slot[i].hits << 4) >> halvings;
+}
+
+uint8_t chsOrder(uint8_t *order, uint8_t n) {
+  uint8_t used = 0;  // Bit i: slot i already in order[]
+  uint8_t k;
+
+  for (k = 0; k < n; k++) {
+     int8_t best = -1;
+     for (uint8_t i = 0; i < CHS_SLOTS; i++) {
+        if ((used & (1 << i)) || !score(i)) continue;
+        if ((best < 0) || (score(i) > score(best)) ||
+            ((score(i) == score(best)) && ((uint8_t)(session - slot[i].seen) < (uint8_t)(session - slot[best].seen))))
+           best = i;
+     }
+     if (best < 0) break;
+     used |= 1 << best;
+     order[k] = slot[best].channel;
+  }
+  return k;
+}  // end of chsOrder
+
+static void record(uint8_t channel, uint8_t prefer) {
+  int8_t s = -1;
+  uint8_t i;
+
+  if (channel >= 0b00011111) return;  // Does not fit the packed byte
+  session++;
+  for (i = 0; i < CHS_SLOTS; i++) {
+     if (slot[i].channel == channel) {
+        s = i;
+     } else if ((slot[i].channel != CHS_NONE) && !score(i)) {  // Decayed away: forget it
+        slot[i].channel = CHS_NONE;                            // before its age wraps
+        cvsWrite(CHS_ID+1+2*i, CHS_NONE);
+     }
+  }
+  if (s < 0) {  // Replace the empty or lowest-scoring slot
+     for (i = 0; i < CHS_SLOTS; i++) {
+        if ((s < 0) || (score(i) < score(s))) s = i;
+     }
+     slot[s].channel = channel;
+     slot[s].hits = 0;
+  }
+  if (prefer) slot[s].hits = CHS_MAXHITS;
+  else if (slot[s].hits < CHS_MAXHITS) slot[s].hits++;
+  slot[s].seen = session;
+  cvsWrite(CHS_ID, session);
+  cvsWrite(CHS_ID+1+2*s, channel | (slot[s].hits << 5));
+  cvsWrite(CHS_ID+2+2*s, session);
+}  // end of record
+
+void chsHit(uint8_t channel) {
+  record(channel, 0);
+}
+
+void chsPrefer(uint8_t channel) {
+  record(channel, 1);
+}
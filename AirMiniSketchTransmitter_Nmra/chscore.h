@@ -0,0 +1,66 @@
+/*
+chscore.h
+
+Receiver channel history: which channels valid DCC was found on, kept
+in the CV store across power cycles, to order the channel search.
+
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CHSCORE_H_
+#define CHSCORE_H_
+
+#include <stdint.h>
+
+// Channels remembered. The lowest-scoring one is replaced by a new channel.
+#if ! defined(CHS_SLOTS)
+#define CHS_SLOTS 4
+#endif
+
+// Acquisitions after which an unused channel's score halves
+#if ! defined(CHS_HALFLIFE)
+#define CHS_HALFLIFE 4
+#endif
+
+// cvstore ids CHS_ID to CHS_ID+2*CHS_SLOTS. Not CV numbers, so not reachable by CV access
+#define CHS_ID 120
+#define CHS_IDS (1 + 2*CHS_SLOTS)
+
+// Load the table from the CV store
+void chsBegin(void);
+
+// Write the remembered channels, best score first, into order[0..n-1].
+// Returns how many were written.
+uint8_t chsOrder(uint8_t *order, uint8_t n);
+
+// Valid DCC was found on channel
+void chsHit(uint8_t channel);
+
+// The channel was chosen by hand (CV255): rank it first from now on
+void chsPrefer(uint8_t channel);
+
+#endif /* CHSCORE_H_ */
\ No newline at end of file
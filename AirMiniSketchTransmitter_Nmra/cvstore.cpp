@@ -0,0 +1,298 @@
+/*
+cvstore.cpp
+
+Log-structured, wear-leveled CV store in the AVR's 1 KB EEPROM.
+
+Every write appends a CRC-protected record [id][value][seq][crc] at the
+log head, which walks round the EEPROM. The newest record of each id
+(by sequence number) is its value. The head skips over records that are
+still the live value of their id, so a torn write from a power loss can
+only ever lose the record being written, never the previous value. A
+live record that the head has passed CVS_MAXSKIPS times is copied
+forward, which keeps every live record within a 16-bit sequence window.
+
+Boot is a single read pass over the EEPROM: no defaults are written and
+nothing waits on the EEPROM. Writes are queued in RAM and drained one
+byte per EEPROM-ready interrupt.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "cvstore.h"
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+#define CVS_MAGIC    0xA7
+#define CVS_RECSIZE  6
+#define CVS_SLOTS    ((E2END + 1 - CVS_BASE) / CVS_RECSIZE)
+#define CVS_NONE     0xFF  // No slot
+#define CVS_MAXSKIPS 64    // (CVS_MAXSKIPS+1)*CVS_SLOTS must stay well below 32768
+
+// Keeps the compiler from moving the record's stores past the index that hands it to the ISR
+#define CVS_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+
+#if (CVS_PENDING & (CVS_PENDING-1))
+#error "CVS_PENDING must be a power of 2"
+#endif
+
+typedef struct {
+  uint8_t id;
+  uint8_t value;
+  uint8_t slot;   // Slot of the live record
+  uint8_t skips;  // Times the head skipped over the live record
+} cvsEntry_t;
+
+typedef struct {
+  uint8_t slot;
+  uint8_t b[CVS_RECSIZE];
+} cvsRecord_t;
+
+static cvsEntry_t cache[CVS_CACHE];
+static uint8_t nCache;
+static uint8_t epoch;
+static uint16_t seq;   // Sequence number of the newest record
+static uint8_t head;   // Next slot to try
+static uint8_t lost;   // Ids that did not fit the cache
+
+static cvsRecord_t pend[CVS_PENDING];
+static volatile uint8_t pendIn = 0;   // Free-running. Advanced by the writer only
+static volatile uint8_t pendOut = 0;  // Free-running. Advanced by cvsDrain only
+static uint8_t pendByte = 0;          // Next byte of pend[pendOut] to write
+
+static uint16_t recCrc(const uint8_t *b) {
+  uint16_t crc = 0xA55A ^ (((uint16_t)epoch << 8) | epoch);  // Never 0 for any epoch
+  for (uint8_t i = 0; i < 4; i++) {                          // CRC-16/CCITT
+     crc ^= (uint16_t)b[i] << 8;
+     for (uint8_t j = 0; j < 8; j++)
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+  }
+  return crc;
+}
+
+static uint8_t *slotAddr(uint8_t s) {
+  return (uint8_t *)(uintptr_t)(CVS_BASE + (uint16_t)s*CVS_RECSIZE);
+}
+
+// Read the record in slot s. Returns 1 if it is valid.
+static uint8_t readRec(uint8_t s, uint8_t *b) {
+  uint8_t *a = slotAddr(s);
+  for (uint8_t i = 0; i < CVS_RECSIZE; i++) b[i] = eeprom_read_byte(a+i);
+  if (b[0] == 0) return 0;
+  return (uint16_t)(b[4] | ((uint16_t)b[5] << 8)) == recCrc(b);
+}
+
+static int8_t findId(uint8_t id) {
+  for (uint8_t c = 0; c < nCache; c++)
+     if (cache[c].id == id) return c;
+  return -1;
+}
+
+static int8_t liveAt(uint8_t s) {
+  for (uint8_t c = 0; c < nCache; c++)
+     if (cache[c].slot == s) return c;
+  return -1;
+}
+
+static void writeHeader(void) {
+  eeprom_busy_wait();
+  eeprom_update_byte((uint8_t *)(CVS_HEADER+1), epoch);
+  eeprom_update_byte((uint8_t *)(CVS_HEADER+2), (uint8_t)~epoch);
+  eeprom_update_byte((uint8_t *)CVS_HEADER, CVS_MAGIC);
+  eeprom_busy_wait();
+}
+
+static void kick(void) {
+#if ! defined(CVS_POLL)
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+     EECR |= _BV(EERIE);
+  }
+#endif
+}
+
+void cvsBegin(void) {
+  uint8_t b[CVS_RECSIZE];
+  uint8_t newest = CVS_NONE;
+
+  nCache = 0;
+  head = 0;
+  seq = 0;
+  lost = 0;
+  pendIn = pendOut = 0;
+  pendByte = 0;
+
+  epoch = eeprom_read_byte((const uint8_t *)(CVS_HEADER+1));
+  if ((eeprom_read_byte((const uint8_t *)CVS_HEADER) != CVS_MAGIC) ||
+      (eeprom_read_byte((const uint8_t *)(CVS_HEADER+2)) != (uint8_t)~epoch)) {
+     epoch++;        // Blank, foreign or torn header. A new epoch disowns whatever is there
+     writeHeader();
+     return;
+  }
+
+  for (uint8_t s = 0; s < CVS_SLOTS; s++) {
+     if (!readRec(s, b)) continue;
+     uint16_t rseq = b[2] | ((uint16_t)b[3] << 8);
+     if ((newest == CVS_NONE) || ((int16_t)(rseq - seq) > 0)) {
+        seq = rseq;
+        newest = s;
+     }
+     int8_t c = findId(b[0]);
+     if (c < 0) {
+        if (nCache >= CVS_CACHE) {
+           if (lost < 0xFF) lost++;
+           continue;
+        }
+        c = nCache++;
+        cache[c].id = b[0];
+     } else {
+        uint8_t o[CVS_RECSIZE];
+        readRec(cache[c].slot, o);
+        if ((int16_t)(rseq - (uint16_t)(o[2] | ((uint16_t)o[3] << 8))) <= 0) continue;  // Older
+     }
+     cache[c].value = b[1];
+     cache[c].slot = s;
+  }
+
+  if (newest != CVS_NONE) head = (newest+1) % CVS_SLOTS;
+  for (uint8_t c = 0; c < nCache; c++) {  // How often has the head lapped each live record?
+     readRec(cache[c].slot, b);
+     uint16_t age = seq - (uint16_t)(b[2] | ((uint16_t)b[3] << 8));
+     cache[c].skips = (age / CVS_SLOTS < CVS_MAXSKIPS) ? age / CVS_SLOTS : CVS_MAXSKIPS-1;
+  }
+}  // end of cvsBegin
+
+uint8_t cvsRead(uint8_t id, uint8_t defaultValue) {
+  int8_t c = findId(id);
+  return (c < 0) ? defaultValue : cache[c].value;
+}
+
+// Queue the record of cache entry c for slot s
+static void emit(int8_t c, uint8_t s) {
+  cvsRecord_t *r;
+  uint16_t crc;
+
+  while ((uint8_t)(pendIn - pendOut) >= CVS_PENDING) {  // Wait for room
+     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        cvsDrain();
+     }
+  }
+  r = &pend[pendIn % CVS_PENDING];
+  seq++;
+  r->slot = s;
+  r->b[0] = cache[c].id;
+  r->b[1] = cache[c].value;
+  r->b[2] = seq & 0xFF;
+  r->b[3] = seq >> 8;
+  crc = recCrc(r->b);
+  r->b[4] = crc & 0xFF;
+  r->b[5] = crc >> 8;
+  cache[c].slot = s;
+  cache[c].skips = 0;
+  CVS_BARRIER();  // The record is whole before the ISR can see it
+  pendIn++;
+  kick();
+}
+
+uint8_t cvsWrite(uint8_t id, uint8_t value) {
+  int8_t c;
+
+  if (id == 0) return 0;
+  c = findId(id);
+  if (c < 0) {
+     if (nCache >= CVS_CACHE) {
+        if (lost < 0xFF) lost++;
+        return 0;
+     }
+     c = nCache++;
+     cache[c].id = id;
+     cache[c].slot = CVS_NONE;
+  } else if (cache[c].value == value) {
+     return 1;  // Unchanged: no wear
+  }
+  cache[c].value = value;
+
+  while (c >= 0) {
+     int8_t stale = -1;
+     int8_t l;
+     uint8_t s;
+     for (;;) {  // Next slot not holding a live record
+        s = head;
+        head = (head+1) % CVS_SLOTS;
+        l = liveAt(s);
+        if (l < 0) break;
+        if ((l != c) && (++cache[l].skips >= CVS_MAXSKIPS) && (stale < 0)) stale = l;
+     }
+     emit(c, s);
+     c = stale;  // Copy a long-lived record forward as well
+  }
+  return 1;
+}  // end of cvsWrite
+
+uint8_t cvsLost(void) {
+  return lost;
+}
+
+uint8_t cvsPending(void) {
+  return (uint8_t)(pendIn - pendOut);
+}
+
+uint8_t cvsDrain(void) {
+  if (pendOut == pendIn) return 0;
+  if (!eeprom_is_ready()) return 1;
+  CVS_BARRIER();  // Read the record only after pendIn has shown it
+  cvsRecord_t *r = &pend[pendOut % CVS_PENDING];
+  eeprom_update_byte(slotAddr(r->slot) + pendByte, r->b[pendByte]);
+  if (++pendByte >= CVS_RECSIZE) {
+     pendByte = 0;
+     pendOut++;
+  }
+  return pendOut != pendIn;
+}
+
+void cvsFlush(void) {
+  while (cvsPending()) {
+     ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        cvsDrain();
+     }
+  }
+  eeprom_busy_wait();
+}
+
+void cvsErase(void) {
+  cvsFlush();
+  epoch++;
+  writeHeader();
+  nCache = 0;
+  head = 0;
+  seq = 0;
+}
+
+#if ! defined(CVS_POLL)
+ISR(EE_READY_vect) {
+  if (!cvsDrain()) EECR &= ~_BV(EERIE);  // Nothing left to write
+}
+#endif
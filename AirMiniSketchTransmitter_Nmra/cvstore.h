@@ -0,0 +1,87 @@
+/*
+cvstore.h
+
+Log-structured, wear-leveled CV store in the AVR's 1 KB EEPROM.
+Reads come from a RAM cache; writes return at once and are committed in
+the background by the EEPROM-ready interrupt.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef CVSTORE_H_
+#define CVSTORE_H_
+
+#include <stdint.h>
+
+// Layout: header (magic, epoch, ~epoch) at CVS_HEADER, then 6-byte records
+// [id][value][seq low][seq high][crc low][crc high] from CVS_BASE to E2END.
+// The CRC is seeded with the epoch, so a factory reset only has to bump the
+// epoch to invalidate every record.
+#define CVS_HEADER 24
+#define CVS_BASE   32
+
+// Number of distinct ids kept, 4 bytes of RAM each. Persistent CV's use their CV number
+// as id; 0 is reserved. The sketch checks at compile time that its ids fit.
+#if ! defined(CVS_CACHE)
+#define CVS_CACHE 32
+#endif
+
+// Records waiting for the EEPROM
+#if ! defined(CVS_PENDING)
+#define CVS_PENDING 4
+#endif
+
+// Scan the EEPROM and fill the cache. Formats a blank/foreign EEPROM. No
+// record is written at boot: ids not found simply read as their default.
+void cvsBegin(void);
+
+// Cached value of id, or defaultValue if it was never written
+uint8_t cvsRead(uint8_t id, uint8_t defaultValue);
+
+// Set id to value. Returns at once (unless CVS_PENDING records are still
+// waiting); the record is written in the background. Returns 0 if the
+// value could not be stored (cache full or id 0).
+uint8_t cvsWrite(uint8_t id, uint8_t value);
+
+// Writes not stored since cvsBegin() because the cache was full, and records
+// left unread by cvsBegin() for the same reason. Stops at 255.
+uint8_t cvsLost(void);
+
+// Number of records not yet committed to EEPROM
+uint8_t cvsPending(void);
+
+// Write at most one byte of the pending records, if the EEPROM is ready.
+// Returns 0 when nothing is left. Called by the EEPROM-ready ISR, or from
+// loop() when CVS_POLL is defined.
+uint8_t cvsDrain(void);
+
+// Block until all pending records are committed
+void cvsFlush(void);
+
+// Invalidate every record (factory reset). Blocks for about 10 ms.
+void cvsErase(void);
+
+#endif /* CVSTORE_H_ */
@@ -0,0 +1,143 @@
+/*
+dcclatency.cpp
+
+Per-packet latency histograms for the transmitter.
+
+A packet is timed at three points: its end bit at the DCC input (kept
+by NmraDcc), notifyDccMsg queueing it, and the Timer1 ISR starting its
+preamble. The first two are folded into a 32-bit tag that rides with the
+packet through the ring or queue: the decode time in us in the high half
+and the queueing time in 16 us units in the low half. The ISR only drops
+the tag and its own time into a small mailbox; the loop does the binning.
+
+Buckets are powers of 2 from 64 us. Counts are 16 bits: when one would
+overflow, the whole histogram is halved, so old traffic fades out.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "dcclatency.h"
+#include <string.h>
+
+#define DCCL_MAILBOX 4  // Packets the ISR can report between two dcclPoll() calls. Power of 2
+
+typedef struct {
+  uint32_t tag;
+  uint16_t t2;   // 16 us units
+} dcclSent_t;
+
+static uint16_t hist[DCCL_HISTS][DCCL_BUCKETS];
+static uint32_t maxUs[DCCL_HISTS];
+static volatile dcclSent_t mailbox[DCCL_MAILBOX];
+static volatile uint8_t mbIn = 0;   // Free-running. Advanced by the ISR only
+static volatile uint8_t mbOut = 0;  // Free-running. Advanced by dcclPoll only
+
+volatile uint16_t dcclOverruns = 0;
+
+void dcclClear(void) {
+  memset(hist, 0, sizeof(hist));
+  memset(maxUs, 0, sizeof(maxUs));
+  dcclOverruns = 0;
+}
+
+static void add(uint8_t h, uint32_t us) {
+  uint8_t b = 0;
+  uint32_t v = us >> 6;
+
+  while (v && (b < DCCL_BUCKETS-1)) {
+     b++;
+     v >>= 1;
+  }
+  if (hist[h][b] == 0xFFFF) {  // Full: decay the whole histogram
+     for (uint8_t i = 0; i < DCCL_BUCKETS; i++) hist[h][i] >>= 1;
+  }
+  hist[h][b]++;
+  if (us > maxUs[h]) maxUs[h] = us;
+}
+
+uint32_t dcclQueued(uint16_t t0, uint32_t t1) {
+  uint16_t decode = (uint16_t)t1 - t0;
+  uint32_t tag = ((uint32_t)decode << 16) | (uint16_t)(t1 >> 4);
+
+  add(DCCL_DECODE, decode);
+  return tag ? tag : 1;
+}
+
+void dcclSent(uint32_t tag, uint32_t t2) {
+  uint8_t i = mbIn;
+
+  if (!tag) return;
+  if ((uint8_t)(i - mbOut) >= DCCL_MAILBOX) {
+     dcclOverruns++;
+     return;
+  }
+  mailbox[i % DCCL_MAILBOX].tag = tag;
+  mailbox[i % DCCL_MAILBOX].t2 = (uint16_t)(t2 >> 4);
+  mbIn = i+1;
+}
+
+void dcclPoll(void) {
+  while (mbOut != mbIn) {
+     volatile dcclSent_t *m = &mailbox[mbOut % DCCL_MAILBOX];
+     uint32_t wait = (uint32_t)(uint16_t)(m->t2 - (uint16_t)m->tag) << 4;
+     add(DCCL_WAIT, wait);
+     add(DCCL_TOTAL, wait + (m->tag >> 16));
+     mbOut++;
+  }
+}
+
+uint16_t dcclCount(uint8_t h) {
+  uint32_t n = 0;
+  for (uint8_t b = 0; b < DCCL_BUCKETS; b++) n += hist[h][b];
+  return (n > 0xFFFF) ? 0xFFFF : (uint16_t)n;
+}
+
+uint32_t dcclPercentile(uint8_t h, uint8_t pct) {
+  uint32_t n = 0;
+  uint32_t target;
+  uint32_t below = 0;
+  uint8_t b;
+
+  for (b = 0; b < DCCL_BUCKETS; b++) n += hist[h][b];
+  if (!n) return 0;
+  target = (n*pct + 99) / 100;  // Rank of the wanted packet, from 1
+  if (!target) target = 1;
+  for (b = 0; below + hist[h][b] < target; b++) below += hist[h][b];
+
+  uint32_t lo = b ? (1UL << (b+5)) : 0;
+  uint32_t hi = (b < DCCL_BUCKETS-1) ? (1UL << (b+6)) : maxUs[h];
+  uint32_t f = ((target - below) << 8) / hist[h][b];  // Position within the bucket, 1/256ths
+  uint32_t us = lo + (((hi - lo) * f) >> 8);         // Values stay below 2^21 us: no overflow
+  return (us > maxUs[h]) ? maxUs[h] : us;
+}  // end of dcclPercentile
+
+uint32_t dcclMax(uint8_t h) {
+  return maxUs[h];
+}
+
+uint16_t dcclBucket(uint8_t h, uint8_t b) {
+  return hist[h][b];
+}
@@ -0,0 +1,78 @@
+/*
+dcclatency.h
+
+Per-packet latency histograms for the transmitter: from the end bit of a
+packet at the DCC input, to notifyDccMsg queueing it, to the Timer1 ISR
+starting its preamble on air.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DCCLATENCY_H_
+#define DCCLATENCY_H_
+
+#include <stdint.h>
+
+// Histograms
+#define DCCL_DECODE 0   // End bit to notifyDccMsg: time the loop took to get to the packet
+#define DCCL_WAIT   1   // notifyDccMsg to preamble start: time in the ring/queue
+#define DCCL_TOTAL  2   // End bit to preamble start
+#define DCCL_HISTS  3
+
+// Bucket 0 is below 64 us; bucket b>0 is [2^(b+5), 2^(b+6)) us; the last one is open-ended (>= 262 ms)
+#define DCCL_BUCKETS 14
+
+extern volatile uint16_t dcclOverruns;  // Sent packets not binned because loop() fell behind
+
+// Empty the histograms
+void dcclClear(void);
+
+// A packet is being queued: t0 is the low 16 bits of micros() at its end
+// bit, t1 is micros() now. Records the decode time and returns the tag to
+// carry with the packet to the ISR. Never 0: a tag of 0 is not timed.
+uint32_t dcclQueued(uint16_t t0, uint32_t t1);
+
+// The ISR is starting the preamble of a packet with this tag. t2 is micros().
+// Just stores it; dcclPoll() does the binning.
+void dcclSent(uint32_t tag, uint32_t t2);
+
+// Bin the packets sent since the last call. Call from loop().
+void dcclPoll(void);
+
+// Number of packets in a histogram (saturates as the histogram decays)
+uint16_t dcclCount(uint8_t hist);
+
+// Estimated pct-th percentile of a histogram, in us, interpolated within
+// its bucket. 0 if empty.
+uint32_t dcclPercentile(uint8_t hist, uint8_t pct);
+
+// Largest value seen, in us
+uint32_t dcclMax(uint8_t hist);
+
+// Bucket counts of a histogram
+uint16_t dcclBucket(uint8_t hist, uint8_t bucket);
+
+#endif /* DCCLATENCY_H_ */
@@ -0,0 +1,71 @@
+/*
+dccpreamble.cpp
+
+Preamble policy for the transmitter.
+
+Airwire receivers need a long preamble, 30 bits, to lock on. That is
+about 40% of the airtime of a 3-byte packet. Other receivers lock on much
+sooner, so the preamble is taken from a table by receiver profile and
+packet class instead. Resets and e-stops, and CV/ops packets, whose loss
+costs the most, keep a few more bits than the refresh traffic.
+
+The values for the Tam Valley and ProMiniAir profiles are starting points;
+confirm them on the bench with the receivers in use. The table is read
+when a packet is queued, so the ISR only copies PreambleBits.
+
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "dccpreamble.h"
+#include "dccqueue.h"
+#include <avr/pgmspace.h>
+
+static const uint8_t bitsTable[DCCP_PROFILES][DCCQ_CLASSES] PROGMEM = {
+//  ESTOP SPEED FUNC ACC OPS IDLE
+  {  30,   30,  30,  30, 30,  30 },  // DCCP_AIRWIRE
+  {  24,   20,  20,  20, 24,  20 },  // DCCP_TAMVALLEY
+  {  20,   16,  16,  16, 20,  16 },  // DCCP_PROMINIAIR
+};
+
+uint8_t dccpBits(uint8_t profile, uint8_t cls) {
+  if (profile >= DCCP_PROFILES) profile = DCCP_AIRWIRE;
+  if (cls >= DCCQ_CLASSES) cls = DCCQ_OPS;
+  return pgm_read_byte(&bitsTable[profile][cls]);
+}
+
+uint8_t dccpSet(DCC_MSG *Msg, uint8_t profile) {
+  uint16_t addr;
+  uint8_t group;
+  uint8_t cls = dccqClassify(Msg, &addr, &group);
+
+  Msg->PreambleBits = dccpBits(profile, cls);
+  return cls;
+}
+
+uint8_t dccpLongCutout(uint8_t profile) {
+  return (profile == DCCP_AIRWIRE) || (profile >= DCCP_PROFILES);
+}
@@ -0,0 +1,55 @@
+/*
+dccpreamble.h
+
+Preamble policy for the transmitter: how many preamble bits each packet
+gets on air, by the receivers in use (the profile) and the packet class.
+
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DCCPREAMBLE_H_
+#define DCCPREAMBLE_H_
+
+#include <stdint.h>
+#include <NmraDcc.h>
+
+// Receiver profiles
+#define DCCP_AIRWIRE    0  // Airwire and compatibles: 30 bits everywhere and the long cutout pulse
+#define DCCP_TAMVALLEY  1  // Tam Valley DRS1 and compatibles
+#define DCCP_PROMINIAIR 2  // ProMiniAir receivers only
+#define DCCP_PROFILES   3
+
+// Preamble bits for a packet of class cls (DCCQ_ESTOP..DCCQ_IDLE) under profile
+uint8_t dccpBits(uint8_t profile, uint8_t cls);
+
+// Classify a packet, set its PreambleBits for the profile and return its class
+uint8_t dccpSet(DCC_MSG *Msg, uint8_t profile);
+
+// Whether the profile needs the long first cutout pulse
+uint8_t dccpLongCutout(uint8_t profile);
+
+#endif /* DCCPREAMBLE_H_ */
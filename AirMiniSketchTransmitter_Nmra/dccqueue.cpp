@@ -0,0 +1,260 @@
+/*
+dccqueue.cpp
+
+Address-aware, coalescing priority queue for outgoing DCC packets.
+
+Each class keeps its own FIFO list threaded through a shared slot pool.
+A new speed or function packet for an address that already has one of
+the same instruction group queued replaces that packet in place, so the
+decoder never sees a stale command after a newer one. An emergency stop
+also purges any queued speed packets for its address (all of them for a
+broadcast stop). CV/ops packets are never merged, since service and
+ops-mode programming rely on repeated identical packets.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "dccqueue.h"
+#include <string.h>
+
+#define DCCQ_NIL 0xFF
+
+// Instruction group keys for coalescing
+#define DCCQ_GROUP_SPEED 0x40  // 28-step and 128-step speed share one key
+#define DCCQ_LONG_ADDR   0x4000  // Keeps long address N distinct from short address N
+
+typedef struct {
+  DCC_MSG  msg;
+  uint32_t tag;    // Caller's, returned by dccqGet
+  uint16_t addr;   // Coalescing key: address
+  uint8_t  group;  // Coalescing key: instruction group
+  uint8_t  next;   // Next slot in the same class, or DCCQ_NIL
+} dccqSlot_t;
+
+static dccqSlot_t slot[DCCQ_SIZE];
+static uint8_t head[DCCQ_CLASSES];
+static uint8_t tail[DCCQ_CLASSES];
+static uint8_t freeHead;
+static uint8_t nonEmpty;  // Bit n set if class n has packets
+static uint8_t bypass;    // Consecutive dequeues that skipped a waiting lower class
+
+volatile uint8_t  dccqCount = 0;
+volatile uint16_t dccqCoalesced = 0;
+volatile uint16_t dccqDropped = 0;
+volatile uint16_t dccqEvicted = 0;
+
+void dccqInit(void) {
+  for (uint8_t i = 0; i < DCCQ_SIZE; i++) slot[i].next = i+1;
+  slot[DCCQ_SIZE-1].next = DCCQ_NIL;
+  freeHead = 0;
+  for (uint8_t c = 0; c < DCCQ_CLASSES; c++) head[c] = tail[c] = DCCQ_NIL;
+  nonEmpty = 0;
+  bypass = 0;
+  dccqCount = 0;
+}  // end of dccqInit
+
+uint8_t dccqClassify(const DCC_MSG *Msg, uint16_t *addr, uint8_t *group) {
+  uint8_t a0 = Msg->Data[0];
+  uint8_t idx;
+  uint8_t inst;
+
+  *addr = 0;
+  *group = 0;
+
+  if (a0 == 0xFF) return DCCQ_IDLE;
+  if ((a0 & 0b11000000) == 0b10000000) {  // 10AAAAAA: accessory
+     *addr = ((uint16_t)a0 << 8) | Msg->Data[1];
+     return DCCQ_ACC;
+  }
+  if (a0 >= 232) return DCCQ_OPS;         // Reserved/advanced addresses
+  if (a0 >= 192) {                        // Long address
+     *addr = DCCQ_LONG_ADDR | ((uint16_t)(a0 & 0b00111111) << 8) | Msg->Data[1];
+     idx = 2;
+  } else {                                // Short address or broadcast (0)
+     *addr = a0;
+     idx = 1;
+  }
+  if (idx+1 >= Msg->Size) return DCCQ_OPS;  // No room for instruction + checksum
+
+  inst = Msg->Data[idx];
+  switch (inst & 0b11100000) {
+     case 0b00000000:  // Decoder/consist control
+        if ((a0 == 0) && (inst == 0)) return DCCQ_ESTOP;  // Digital decoder reset
+        return DCCQ_OPS;
+     case 0b00100000:  // Advanced operations
+        if (inst == 0b00111111) {  // 128 speed step
+           if (idx+2 >= Msg->Size) return DCCQ_OPS;
+           *group = DCCQ_GROUP_SPEED;
+           if ((Msg->Data[idx+1] & 0b01111111) == 1) return DCCQ_ESTOP;
+           return DCCQ_SPEED;
+        }
+        return DCCQ_OPS;
+     case 0b01000000:  // 01DCSSSS: 14/28 speed step
+     case 0b01100000:
+        *group = DCCQ_GROUP_SPEED;
+        if ((inst & 0b00001111) == 1) return DCCQ_ESTOP;
+        return DCCQ_SPEED;
+     case 0b10000000:  // Function group 1 (FL, F1-F4)
+        *group = 0b10000000;
+        return DCCQ_FUNC;
+     case 0b10100000:  // Function group 2 (F5-F8 or F9-F12)
+        *group = inst & 0b11110000;
+        return DCCQ_FUNC;
+     case 0b11000000:  // Feature expansion
+        if (((0b11011000 <= inst) && (inst <= 0b11011100)) ||  // F29-F68
+            (inst == 0b11011110) || (inst == 0b11011111)) {    // F13-F20, F21-F28
+           *group = inst;
+           return DCCQ_FUNC;
+        }
+        return DCCQ_OPS;
+     default:          // 111xxxxx: CV access
+        return DCCQ_OPS;
+  }
+}  // end of dccqClassify
+
+static uint8_t sameMsg(const DCC_MSG *a, const DCC_MSG *b) {
+  if (a->Size != b->Size) return 0;
+  return memcmp(a->Data, b->Data, a->Size) == 0;
+}
+
+// Unlink slot s (whose predecessor in class c is prev, or DCCQ_NIL) and free it
+static void unlinkSlot(uint8_t c, uint8_t prev, uint8_t s) {
+  uint8_t next = slot[s].next;
+  if (prev == DCCQ_NIL) head[c] = next;
+  else slot[prev].next = next;
+  if (tail[c] == s) tail[c] = prev;
+  if (head[c] == DCCQ_NIL) nonEmpty &= ~(1 << c);
+  slot[s].next = freeHead;
+  freeHead = s;
+  dccqCount--;
+}
+
+// Remove queued speed packets made obsolete by an emergency stop for addr
+static void purgeSpeed(uint16_t addr) {
+  uint8_t prev = DCCQ_NIL;
+  uint8_t s = head[DCCQ_SPEED];
+  while (s != DCCQ_NIL) {
+     uint8_t next = slot[s].next;
+     if ((addr == 0) || (slot[s].addr == addr)) {
+        unlinkSlot(DCCQ_SPEED, prev, s);
+        dccqCoalesced++;
+     } else {
+        prev = s;
+     }
+     s = next;
+  }
+}
+
+static uint8_t put(const DCC_MSG *Msg, uint32_t tag, uint8_t cls, uint16_t addr, uint8_t group) {
+  uint8_t s;
+
+  if (cls >= DCCQ_CLASSES) cls = DCCQ_OPS;
+  if (cls == DCCQ_ESTOP) purgeSpeed(addr);
+
+  // Coalesce with a queued packet of the same class
+  if (cls != DCCQ_OPS) {
+     for (s = head[cls]; s != DCCQ_NIL; s = slot[s].next) {
+        if ((cls == DCCQ_SPEED) || (cls == DCCQ_FUNC)) {
+           if ((slot[s].addr == addr) && (slot[s].group == group)) {
+              memcpy(&slot[s].msg, Msg, sizeof(DCC_MSG));  // Newest wins, keeps its place in line
+              slot[s].tag = tag;
+              dccqCoalesced++;
+              return 1;
+           }
+        } else if (sameMsg(&slot[s].msg, Msg)) {
+           dccqCoalesced++;
+           return 1;
+        }
+     }
+  }
+
+  // Full? Push out the oldest packet of the lowest class below this one
+  if (freeHead == DCCQ_NIL) {
+     uint8_t c;
+     for (c = DCCQ_CLASSES-1; c > cls; c--) {
+        if (head[c] != DCCQ_NIL) {
+           unlinkSlot(c, DCCQ_NIL, head[c]);
+           dccqEvicted++;
+           break;
+        }
+     }
+     if (freeHead == DCCQ_NIL) {
+        dccqDropped++;
+        return 0;
+     }
+  }
+
+  s = freeHead;
+  freeHead = slot[s].next;
+  memcpy(&slot[s].msg, Msg, sizeof(DCC_MSG));
+  slot[s].tag = tag;
+  slot[s].addr = addr;
+  slot[s].group = group;
+  slot[s].next = DCCQ_NIL;
+  if (tail[cls] == DCCQ_NIL) head[cls] = s;
+  else slot[tail[cls]].next = s;
+  tail[cls] = s;
+  nonEmpty |= (1 << cls);
+  dccqCount++;
+  return 1;
+}  // end of put
+
+uint8_t dccqPut(const DCC_MSG *Msg, uint32_t tag) {
+  uint16_t addr;
+  uint8_t group;
+  uint8_t cls = dccqClassify(Msg, &addr, &group);
+  return put(Msg, tag, cls, addr, group);
+}
+
+uint8_t dccqPutClass(const DCC_MSG *Msg, uint8_t cls, uint32_t tag) {
+  uint16_t addr;
+  uint8_t group;
+  dccqClassify(Msg, &addr, &group);
+  return put(Msg, tag, cls, addr, group);
+}
+
+uint8_t dccqGet(DCC_MSG *Msg, uint32_t *tag) {
+  uint8_t c;
+  uint8_t s;
+
+  if (!nonEmpty) return 0;
+
+  for (c = 0; !(nonEmpty & (1 << c)); c++);  // Highest-priority class with packets
+  if (nonEmpty >> (c+1)) {                   // Lower classes are waiting
+     if (++bypass >= DCCQ_STARVE_LIMIT) {
+        bypass = 0;
+        for (c = DCCQ_CLASSES-1; !(nonEmpty & (1 << c)); c--);  // Serve the lowest once
+     }
+  } else {
+     bypass = 0;
+  }
+
+  s = head[c];
+  memcpy(Msg, &slot[s].msg, sizeof(DCC_MSG));
+  if (tag) *tag = slot[s].tag;
+  unlinkSlot(c, DCCQ_NIL, s);
+  return 1;
+}  // end of dccqGet
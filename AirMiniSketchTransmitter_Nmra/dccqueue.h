@@ -0,0 +1,86 @@
+/*
+dccqueue.h
+
+Address-aware, coalescing priority queue for outgoing DCC packets.
+Replaces the plain msg[MAXMSG] ring when PRIORITY_QUEUE is defined.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DCCQUEUE_H_
+#define DCCQUEUE_H_
+
+#include <stdint.h>
+#include <NmraDcc.h>
+
+// Number of packet slots shared by all classes. Same footprint as the old ring.
+#if ! defined(DCCQ_SIZE)
+#define DCCQ_SIZE 16
+#endif
+
+// Consecutive dequeues from a higher class before a waiting lower class is
+// served once anyway. Keeps CV/ops and accessory packets from starving
+// behind a throttle that never stops talking.
+#if ! defined(DCCQ_STARVE_LIMIT)
+#define DCCQ_STARVE_LIMIT 8
+#endif
+
+// Packet classes, highest priority first
+#define DCCQ_ESTOP   0  // Resets and emergency stops
+#define DCCQ_SPEED   1  // Speed/direction
+#define DCCQ_FUNC    2  // Function groups
+#define DCCQ_ACC     3  // Accessory packets
+#define DCCQ_OPS     4  // CV access, consists, anything else. Never coalesced
+#define DCCQ_IDLE    5  // Idle packets
+#define DCCQ_CLASSES 6
+
+// Counters, readable from the main loop
+extern volatile uint8_t  dccqCount;      // Packets currently queued
+extern volatile uint16_t dccqCoalesced;  // New packets merged into a queued one
+extern volatile uint16_t dccqDropped;    // New packets refused because the queue was full
+extern volatile uint16_t dccqEvicted;    // Queued lower-class packets pushed out by a higher class
+
+// Decode a packet's class and, for coalescable classes, its key
+// (address in the low 14 bits, instruction group in *group).
+uint8_t dccqClassify(const DCC_MSG *Msg, uint16_t *addr, uint8_t *group);
+
+// Initialize (empty) the queue
+void dccqInit(void);
+
+// Enqueue a packet, classifying it first. Returns 1 if the packet is
+// queued or merged, 0 if dropped. Call with the dequeuing ISR masked.
+// tag is carried with the packet and handed back by dccqGet (e.g.,
+// timestamps); a packet that replaces a queued one brings its own tag.
+uint8_t dccqPut(const DCC_MSG *Msg, uint32_t tag = 0);
+
+// Same as dccqPut, but with the class given explicitly.
+uint8_t dccqPutClass(const DCC_MSG *Msg, uint8_t cls, uint32_t tag = 0);
+
+// Dequeue the next packet to send into *Msg, and its tag into *tag if
+// given. Returns 0 if empty. Intended for the waveform ISR.
+uint8_t dccqGet(DCC_MSG *Msg, uint32_t *tag = 0);
+
+#endif /* DCCQUEUE_H_ */
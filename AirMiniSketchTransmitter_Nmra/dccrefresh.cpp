@@ -0,0 +1,203 @@
+/*
+dccrefresh.cpp
+
+Refresh table of the latest speed and function state of active
+locomotives.
+
+Each entry keeps only the instruction bytes, not whole packets, and the
+packets are rebuilt on the way out. Speed and function groups have their
+own refresh periods. A loco not heard from the command station within
+the aging time is forgotten. A broadcast e-stop turns every stored speed
+into an e-stop (keeping direction), and a broadcast reset empties the
+table, so a refresh can never restart a loco the command station stopped.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "dccrefresh.h"
+#include "dccqueue.h"
+#include <string.h>
+
+#define DCCR_NUMFN      5       // FG1, F5-F8, F9-F12, F13-F20, F21-F28
+#define DCCR_LONG_ADDR  0x4000  // Same key convention as dccqClassify
+#define DCCR_VALIDSPEED 0b00000001
+#define DCCR_VALIDFN    0b00111110
+
+typedef struct {
+  uint16_t addr;            // dccqClassify key. 0: unused entry
+  uint8_t  speed[2];        // Speed instruction, and its argument for 128 steps
+  uint8_t  fn[DCCR_NUMFN];  // Instruction byte for FG1/FG2, argument for F13-F28
+  uint8_t  valid;           // Bit 0: speed, bits 1-5: fn[0..4]
+  uint8_t  fnNext;          // Next function group to refresh
+  uint16_t heard;           // Last heard, 1024 ms units
+  uint16_t speedDue;        // ms
+  uint16_t fnDue;           // ms
+} dccrEntry_t;
+
+static dccrEntry_t tab[DCCR_SIZE];
+static uint8_t rr;          // Round-robin position
+
+uint8_t dccrSpeedPeriod = DCCR_SPEEDPERIODDEFAULT;
+uint8_t dccrFuncPeriod  = DCCR_FUNCPERIODDEFAULT;
+uint8_t dccrAge         = DCCR_AGEDEFAULT;
+
+void dccrInit(void) {
+  memset(tab, 0, sizeof(tab));
+  rr = 0;
+}
+
+static void forceEstop(dccrEntry_t *e) {
+  if (e->speed[0] == 0b00111111)
+     e->speed[1] = (e->speed[1] & 0b10000000) | 1;      // 128 step: keep direction
+  else
+     e->speed[0] = (e->speed[0] & 0b11100000) | 1;      // 14/28 step: keep direction
+}
+
+static uint8_t fnIndex(uint8_t group) {
+  switch (group) {
+     case 0b10000000: return 0;  // FL, F1-F4
+     case 0b10110000: return 1;  // F5-F8
+     case 0b10100000: return 2;  // F9-F12
+     case 0b11011110: return 3;  // F13-F20
+     case 0b11011111: return 4;  // F21-F28
+     default:         return DCCR_NUMFN;
+  }
+}
+
+void dccrUpdate(const DCC_MSG *Msg, uint32_t ms) {
+  uint16_t addr;
+  uint8_t group;
+  uint8_t cls = dccqClassify(Msg, &addr, &group);
+  uint8_t idx, i;
+  dccrEntry_t *e = 0;
+
+  if (addr == 0) {  // Broadcast
+     if (cls == DCCQ_ESTOP) {
+        if (group == 0) {
+           dccrInit();  // Digital decoder reset
+        } else {
+           for (i = 0; i < DCCR_SIZE; i++)
+              if (tab[i].addr && (tab[i].valid & DCCR_VALIDSPEED)) forceEstop(&tab[i]);
+        }
+     }
+     return;
+  }
+  if ((cls != DCCQ_SPEED) && (cls != DCCQ_ESTOP) && (cls != DCCQ_FUNC)) return;
+
+  idx = (addr & DCCR_LONG_ADDR) ? 2 : 1;
+  if (group != 0b01000000) {  // Function group
+     i = fnIndex(group);
+     if (i >= DCCR_NUMFN) return;                             // Not tracked
+     if ((i >= 3) && (idx+2 >= Msg->Size)) return;            // Too short for its argument
+  }
+
+  // Find the loco, else a free entry, else the least-recently heard one
+  for (i = 0; i < DCCR_SIZE; i++) {
+     if (tab[i].addr == addr) { e = &tab[i]; break; }
+  }
+  if (!e) {
+     uint16_t oldest = 0;
+     for (i = 0; i < DCCR_SIZE; i++) {
+        uint16_t age = (uint16_t)(ms >> 10) - tab[i].heard;
+        if (!tab[i].addr) { e = &tab[i]; break; }
+        if (!e || (age > oldest)) { e = &tab[i]; oldest = age; }
+     }
+     memset(e, 0, sizeof(dccrEntry_t));
+     e->addr = addr;
+  }
+  e->heard = (uint16_t)(ms >> 10);
+
+  if (group == 0b01000000) {  // Speed (or e-stop); just sent, so not due yet
+     e->speed[0] = Msg->Data[idx];
+     e->speed[1] = (Msg->Data[idx] == 0b00111111) ? Msg->Data[idx+1] : 0;
+     e->valid |= DCCR_VALIDSPEED;
+     e->speedDue = (uint16_t)ms + 10*(uint16_t)dccrSpeedPeriod;
+  } else {
+     i = fnIndex(group);
+     e->fn[i] = (i >= 3) ? Msg->Data[idx+1] : Msg->Data[idx];
+     if (!(e->valid & DCCR_VALIDFN)) e->fnDue = (uint16_t)ms + 100*(uint16_t)dccrFuncPeriod;
+     e->valid |= (DCCR_VALIDSPEED << 1) << i;
+  }
+}  // end of dccrUpdate
+
+static void build(DCC_MSG *Msg, uint16_t addr, uint8_t inst, uint8_t arg, uint8_t hasArg) {
+  uint8_t i = 0;
+  uint8_t x = 0;
+  memset(Msg, 0, sizeof(DCC_MSG));
+  if (addr & DCCR_LONG_ADDR) {
+     Msg->Data[i++] = 0b11000000 | ((addr >> 8) & 0b00111111);
+     Msg->Data[i++] = addr & 0xFF;
+  } else {
+     Msg->Data[i++] = (uint8_t)addr;
+  }
+  Msg->Data[i++] = inst;
+  if (hasArg) Msg->Data[i++] = arg;
+  for (uint8_t j = 0; j < i; j++) x ^= Msg->Data[j];
+  Msg->Data[i++] = x;
+  Msg->Size = i;
+  Msg->PreambleBits = DCCR_PREAMBLE_BITS;
+}
+
+uint8_t dccrNext(uint32_t ms, DCC_MSG *Msg) {
+  uint16_t now = (uint16_t)ms;
+  int16_t speedLate, fnLate;
+
+  if (!dccrSpeedPeriod) return 0;
+
+  for (uint8_t n = 0; n < DCCR_SIZE; n++) {
+     dccrEntry_t *e = &tab[rr];
+     rr = (rr+1) % DCCR_SIZE;
+     if (!e->addr) continue;
+     if (dccrAge && ((uint16_t)((uint16_t)(ms >> 10) - e->heard) >= dccrAge)) {
+        e->addr = 0;  // Aged out
+        continue;
+     }
+     // Whichever is later goes first, so speed refresh cannot starve the functions
+     speedLate = (e->valid & DCCR_VALIDSPEED) ? (int16_t)(now - e->speedDue) : -1;
+     fnLate = (dccrFuncPeriod && (e->valid & DCCR_VALIDFN)) ? (int16_t)(now - e->fnDue) : -1;
+     if ((speedLate >= 0) && (speedLate >= fnLate)) {
+        build(Msg, e->addr, e->speed[0], e->speed[1], e->speed[0] == 0b00111111);
+        e->speedDue = now + 10*(uint16_t)dccrSpeedPeriod;
+        return 1;
+     }
+     if (fnLate >= 0) {
+        uint8_t g = e->fnNext;
+        while (!(e->valid & ((DCCR_VALIDSPEED << 1) << g))) g = (g+1) % DCCR_NUMFN;
+        if (g >= 3) build(Msg, e->addr, (g == 3) ? 0b11011110 : 0b11011111, e->fn[g], 1);
+        else        build(Msg, e->addr, e->fn[g], 0, 0);
+        // Move on to the next group; the cycle is done when we run off the end
+        for (g++; (g < DCCR_NUMFN) && !(e->valid & ((DCCR_VALIDSPEED << 1) << g)); g++);
+        if (g >= DCCR_NUMFN) {
+           e->fnNext = 0;
+           e->fnDue = now + 100*(uint16_t)dccrFuncPeriod;
+        } else {
+           e->fnNext = g;
+        }
+        return 1;
+     }
+  }
+  return 0;
+}  // end of dccrNext
@@ -0,0 +1,71 @@
+/*
+dccrefresh.h
+
+Refresh table of the latest speed and function state of active
+locomotives. Refresh packets are generated round-robin to fill idle
+airtime, so a receiver that misses a packet recovers within one cycle.
+On the receiver, the same table regenerates the packets through a short
+RF dropout.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DCCREFRESH_H_
+#define DCCREFRESH_H_
+
+#include <stdint.h>
+#include <NmraDcc.h>
+
+// Number of locomotives tracked. The least-recently-heard one is replaced.
+#if ! defined(DCCR_SIZE)
+#define DCCR_SIZE 8
+#endif
+
+// Preamble bits of generated packets. The ISR may lengthen these.
+#if ! defined(DCCR_PREAMBLE_BITS)
+#define DCCR_PREAMBLE_BITS 16
+#endif
+
+// Rates and aging. Changeable with CV's
+#define DCCR_SPEEDPERIODDEFAULT 10  // Per-loco speed refresh period, 10 ms units. 0: refresh off
+#define DCCR_FUNCPERIODDEFAULT   5  // Per-loco function refresh period, 100 ms units. 0: speed only
+#define DCCR_AGEDEFAULT         60  // Forget a loco not heard from for this many sec. 0: never
+
+extern uint8_t dccrSpeedPeriod;  // 10 ms units
+extern uint8_t dccrFuncPeriod;   // 100 ms units
+extern uint8_t dccrAge;          // sec
+
+// Empty the table
+void dccrInit(void);
+
+// Record the state carried by a packet from the command station.
+// ms is the current millis().
+void dccrUpdate(const DCC_MSG *Msg, uint32_t ms);
+
+// Build the next due refresh packet into *Msg. Returns 0 if nothing is due.
+uint8_t dccrNext(uint32_t ms, DCC_MSG *Msg);
+
+#endif /* DCCREFRESH_H_ */
@@ -0,0 +1,208 @@
+/*
+lcdview.cpp
+
+Text model of the 2-line status display.
+
+Two copies of the text are kept: what the sketch wants shown and what
+the display is showing. lcdvUpdate() finds the first run of characters
+that differ, queues just those (with a cursor move) on the I2C queue,
+and returns. A screen that changes one number costs a few dozen bytes on
+the bus instead of a clear and two full lines, and the loop never waits
+for any of it.
+
+The OLED is drawn directly from the 5x7 font of SSD1306Ascii, 6 columns
+per character. The LCD is driven in 4-bit mode through the PCF8574
+backpack, 4 bus bytes per character.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "lcdview.h"
+#include "twiq.h"
+#include <Arduino.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+#include <SSD1306init.h>
+#include <fonts/allFonts.h>
+
+// OLED
+#define OLED_CMD     0x00  // Control byte: commands follow
+#define OLED_DATA    0x40  // Control byte: display data follows
+#define OLED_PAGES   4     // 8-pixel pages of the 128x32 panel
+#define OLED_CHUNK   16    // Columns blanked per transaction
+#define OLED_CHARW   6     // 5 font columns and a gap
+
+// LCD on the PCF8574: P0 RS, P1 RW, P2 EN, P3 backlight, P4-P7 D4-D7
+#define LCD_RS       0b00000001
+#define LCD_EN       0b00000100
+#define LCD_BL       0b00001000
+#define LCD_COLS     16
+
+static uint8_t addr;
+static uint8_t type = 0;   // 0: no display
+static uint8_t cols;
+static uint8_t dirty;      // Bit r set: row r may differ from the display
+static uint8_t blank;      // OLED chunks still to be blanked
+static char want[LCDV_ROWS][LCDV_COLS];
+static char shown[LCDV_ROWS][LCDV_COLS];
+
+// One nibble (upper 4 bits of v) to the LCD: data with EN high, then EN low latches it
+static void lcdNibble(uint8_t v, uint8_t rs) {
+  uint8_t b = (v & 0xF0) | LCD_BL | rs;
+  twiqByte(b | LCD_EN);
+  twiqByte(b);
+}
+
+static void lcdByte(uint8_t v, uint8_t rs) {
+  lcdNibble(v, rs);
+  lcdNibble(v << 4, rs);
+}
+
+// Blocking, for the LCD's power-on sequence only
+static void lcdCommand(uint8_t v, uint8_t nibbleOnly, uint8_t waitMs) {
+  twiqOpen(addr, nibbleOnly ? 2 : 4);
+  if (nibbleOnly) lcdNibble(v, 0);
+  else lcdByte(v, 0);
+  twiqClose();
+  twiqFlush();
+  delay(waitMs);
+}
+
+void lcdvBegin(uint8_t address, uint8_t displayType) {
+  addr = address;
+  type = displayType;
+  memset(want, ' ', sizeof(want));
+  memset(shown, ' ', sizeof(shown));
+  dirty = (1 << LCDV_ROWS) - 1;  // Lines set before now still get drawn
+  blank = 0;
+
+  twiqFlush();
+  if (type == LCDV_HD44780) {
+     cols = LCD_COLS;
+     delay(50);                          // Power-up time of the controller
+     lcdCommand(0x30, 1, 5);             // Three times 8-bit mode: resyncs from any state
+     lcdCommand(0x30, 1, 5);
+     lcdCommand(0x30, 1, 1);
+     lcdCommand(0x20, 1, 1);             // 4-bit mode
+     lcdCommand(0x28, 0, 1);             // 2 lines, 5x8 dots
+     lcdCommand(0x0C, 0, 1);             // Display on, no cursor
+     lcdCommand(0x01, 0, 2);             // Clear
+     lcdCommand(0x06, 0, 1);             // Left to right, no shift
+  } else {
+     cols = LCDV_COLS;
+     twiqOpen(addr, 1 + sizeof(Adafruit128x32init));
+     twiqByte(OLED_CMD);
+     for (uint8_t i = 0; i < sizeof(Adafruit128x32init); i++) twiqByte(pgm_read_byte(&Adafruit128x32init[i]));
+     twiqClose();
+     blank = OLED_PAGES * (128 / OLED_CHUNK);  // The panel powers up with random pixels
+  }
+}  // end of lcdvBegin
+
+void lcdvLine(uint8_t row, const char *str) {
+  char line[LCDV_COLS];
+  uint8_t i;
+
+  if (row >= LCDV_ROWS) return;
+  for (i = 0; (i < LCDV_COLS) && str[i]; i++) line[i] = str[i];
+  for (; i < LCDV_COLS; i++) line[i] = ' ';
+  if (memcmp(want[row], line, LCDV_COLS)) {
+     memcpy(want[row], line, LCDV_COLS);
+     dirty |= 1 << row;
+  }
+}
+
+static void oledMove(uint8_t page, uint8_t x) {
+  twiqOpen(addr, 4);
+  twiqByte(OLED_CMD);
+  twiqByte(0xB0 | page);
+  twiqByte(x & 0x0F);
+  twiqByte(0x10 | (x >> 4));
+  twiqClose();
+}
+
+// Queue n characters of row r from column c. Returns 0 if there is no room yet.
+static uint8_t send(uint8_t r, uint8_t c, uint8_t n) {
+  uint8_t i, j;
+
+  if (type == LCDV_HD44780) {
+     if (twiqRoom() < 2 + 4*(1+n)) return 0;
+     twiqOpen(addr, 4*(1+n));
+     lcdByte(0x80 | ((r ? 0x40 : 0x00) + c), 0);  // Set DDRAM address
+     for (i = 0; i < n; i++) lcdByte(want[r][c+i], LCD_RS);
+     twiqClose();
+  } else {
+     if (twiqRoom() < (2+4) + (2+1+OLED_CHARW*n)) return 0;
+     oledMove(r, c*OLED_CHARW);
+     twiqOpen(addr, 1 + OLED_CHARW*n);
+     twiqByte(OLED_DATA);
+     for (i = 0; i < n; i++) {
+        uint8_t ch = want[r][c+i];
+        if ((ch < ' ') || (ch > '~')) ch = ' ';
+        const uint8_t *glyph = &Adafruit5x7[FONT_WIDTH_TABLE + (ch - ' ')*(OLED_CHARW-1)];
+        for (j = 0; j < OLED_CHARW-1; j++) twiqByte(readFontByte(glyph + j));
+        twiqByte(0);
+     }
+     twiqClose();
+  }
+  return 1;
+}  // end of send
+
+uint8_t lcdvUpdate(void) {
+  uint8_t r, c, n;
+
+  if (!type) return 0;
+
+  if (blank) {
+     if (twiqRoom() < (2+4) + (2+1+OLED_CHUNK)) return 1;
+     n = OLED_PAGES * (128 / OLED_CHUNK) - blank;
+     oledMove(n / (128 / OLED_CHUNK), (n % (128 / OLED_CHUNK)) * OLED_CHUNK);
+     twiqOpen(addr, 1 + OLED_CHUNK);
+     twiqByte(OLED_DATA);
+     for (c = 0; c < OLED_CHUNK; c++) twiqByte(0);
+     twiqClose();
+     blank--;
+     return 1;
+  }
+
+  while (dirty) {
+     r = (dirty & 1) ? 0 : 1;
+     for (c = 0; (c < cols) && (want[r][c] == shown[r][c]); c++);
+     if (c >= cols) {
+        dirty &= ~(1 << r);
+        continue;
+     }
+     for (n = 1; (c+n < cols) && (n < LCDV_RUN) && (want[r][c+n] != shown[r][c+n]); n++);
+     if (!send(r, c, n)) return 1;  // The queue is busy: next time
+     memcpy(&shown[r][c], &want[r][c], n);
+     return 1;
+  }
+  return 0;
+}  // end of lcdvUpdate
+
+void lcdvFlush(void) {
+  while (lcdvUpdate()) twiqCheck();
+  twiqFlush();
+}
@@ -0,0 +1,66 @@
+/*
+lcdview.h
+
+Text model of the 2-line status display. The sketch sets whole lines;
+only the characters that changed are sent to the display, a short run at
+a time, through the interrupt-driven I2C queue.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LCDVIEW_H_
+#define LCDVIEW_H_
+
+#include <stdint.h>
+
+// Display types
+#define LCDV_HD44780 1  // 16x2 character LCD on a PCF8574 backpack
+#define LCDV_SSD1306 2  // 128x32 OLED, 5x7 font: 21 columns. Only the top 2 text rows are used
+
+#define LCDV_ROWS 2
+#define LCDV_COLS 21    // The widest of the two. The LCD shows the first 16
+
+// Most characters sent per I2C transaction. Bounds the work done per lcdvUpdate() call.
+#if ! defined(LCDV_RUN)
+#define LCDV_RUN 6
+#endif
+
+// Initialize the display of the given type at I2C address addr; twiqBegin()
+// must have been called. The LCD needs a few ms of blocking waits; the OLED
+// is set up and blanked in the background by lcdvUpdate().
+void lcdvBegin(uint8_t addr, uint8_t type);
+
+// Set row to str, padded with blanks, cut at the display width. Sends nothing.
+void lcdvLine(uint8_t row, const char *str);
+
+// Send the next changed run, if the I2C queue has room for it. Returns 0 once
+// the display matches the model. Call on every pass of loop().
+uint8_t lcdvUpdate(void);
+
+// Block until the display matches the model, e.g., before a reboot
+void lcdvFlush(void);
+
+#endif /* LCDVIEW_H_ */
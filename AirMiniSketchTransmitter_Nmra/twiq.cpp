@@ -0,0 +1,211 @@
+/*
+twiq.cpp
+
+Interrupt-driven I2C (TWI) master transmit queue.
+
+Transactions are stored back to back in a byte ring as
+[address][length][data...]. The TWI interrupt walks the ring one bus
+event at a time, and chains the next transaction with a STOP+START, so
+a display refresh costs the loop only the time to copy its bytes in.
+A NACK drops the rest of that transaction and goes on with the next
+one. A bus that stops making progress is caught by twiqCheck(), which
+resets the TWI instead of letting anyone wait on it.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "twiq.h"
+#include <Arduino.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <util/twi.h>
+
+#if (TWIQ_SIZE & (TWIQ_SIZE-1)) || (TWIQ_SIZE > 128)
+#error "TWIQ_SIZE must be a power of 2, at most 128"
+#endif
+
+#define TWCR_IDLE  (_BV(TWEN))
+#define TWCR_NEXT  (_BV(TWEN) | _BV(TWIE) | _BV(TWINT))
+#define TWCR_START (TWCR_NEXT | _BV(TWSTA))
+#define TWCR_CHAIN (TWCR_NEXT | _BV(TWSTO) | _BV(TWSTA))  // STOP, then START the next transaction
+#define TWCR_STOP  (_BV(TWEN) | _BV(TWINT) | _BV(TWSTO))
+
+static uint8_t buf[TWIQ_SIZE];
+static volatile uint8_t in = 0;    // Free-running. End of the published transactions
+static volatile uint8_t out = 0;   // Free-running. Advanced by the ISR only
+static uint8_t wr = 0;             // Free-running. End of the transaction being written
+static volatile uint8_t left = 0;  // Data bytes left in the transaction on the bus
+static volatile uint8_t busy = 0;  // The ISR owns the bus
+static volatile uint8_t ticks = 0; // Bus events, to spot a stuck transfer
+
+volatile uint16_t twiqBytes = 0;
+volatile uint16_t twiqErrors = 0;
+volatile uint8_t  twiqTimedOut = 0;
+
+// Forget everything and start the TWI afresh
+static void reset(void) {
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+     TWCR = 0;
+     in = out = wr = 0;
+     left = 0;
+     busy = 0;
+     TWCR = TWCR_IDLE;
+  }
+}
+
+void twiqBegin(uint32_t clockHz) {
+  pinMode(SDA, INPUT_PULLUP);  // Internal pullups, as Wire does
+  pinMode(SCL, INPUT_PULLUP);
+  TWSR = 0;                    // Prescaler 1
+  TWBR = (uint8_t)(((F_CPU / clockHz) - 16) / 2);
+  reset();
+}
+
+// Wait for the current bus event, or give up on a stuck bus
+static uint8_t waitBus(uint8_t bit, uint8_t set) {
+  uint32_t t0 = micros();
+  while (((TWCR & _BV(bit)) != 0) != set) {
+     if ((micros() - t0) >= TWIQ_TIMEOUTUS) {
+        reset();
+        twiqTimedOut = 1;
+        twiqErrors++;
+        return 0;
+     }
+  }
+  return 1;
+}
+
+uint8_t twiqProbe(uint8_t addr) {
+  uint8_t ack;
+
+  if (!twiqIdle()) return 0;
+  if (!waitBus(TWSTO, 0)) return 0;  // Last STOP from the queue
+  TWCR = _BV(TWEN) | _BV(TWINT) | _BV(TWSTA);
+  if (!waitBus(TWINT, 1)) return 0;
+  if ((TW_STATUS != TW_START) && (TW_STATUS != TW_REP_START)) {
+     reset();
+     return 0;
+  }
+  TWDR = addr << 1;            // SLA+W
+  TWCR = _BV(TWEN) | _BV(TWINT);
+  if (!waitBus(TWINT, 1)) return 0;
+  ack = (TW_STATUS == TW_MT_SLA_ACK);
+  TWCR = TWCR_STOP;
+  if (!waitBus(TWSTO, 0)) return 0;
+  return ack;
+}  // end of twiqProbe
+
+uint8_t twiqRoom(void) {
+  return TWIQ_SIZE - (uint8_t)(wr - out);
+}
+
+uint8_t twiqOpen(uint8_t addr, uint8_t len) {
+  if ((uint16_t)len + 2 > twiqRoom()) return 0;
+  buf[wr++ % TWIQ_SIZE] = addr;
+  buf[wr++ % TWIQ_SIZE] = len;
+  return 1;
+}
+
+void twiqByte(uint8_t b) {
+  buf[wr++ % TWIQ_SIZE] = b;
+}
+
+void twiqClose(void) {
+  uint8_t n = 0;
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+     in = wr;
+     if (!busy) {
+        while ((TWCR & _BV(TWSTO)) && ++n);  // A previous STOP still on the bus: a few usec at most
+        busy = 1;
+        TWCR = TWCR_START;
+     }
+  }
+}
+
+uint8_t twiqIdle(void) {
+  return !busy && (in == out);
+}
+
+void twiqFlush(void) {
+  while (!twiqIdle()) twiqCheck();
+}
+
+void twiqCheck(void) {
+  static uint8_t seenTicks = 0;
+  static uint32_t seenTime = 0;
+  uint32_t now = micros();
+
+  if (!busy || (ticks != seenTicks)) {
+     seenTicks = ticks;
+     seenTime = now;
+  } else if ((now - seenTime) >= TWIQ_TIMEOUTUS) {
+     reset();
+     twiqTimedOut = 1;
+     twiqErrors++;
+     seenTime = now;
+  }
+}  // end of twiqCheck
+
+// Only transactions published by twiqClose() are touched here
+static inline void next(void) {
+  if (out != in) {
+     TWCR = TWCR_CHAIN;
+  } else {
+     TWCR = TWCR_STOP;  // No interrupt for the STOP itself
+     busy = 0;
+  }
+}
+
+ISR(TWI_vect) {
+  ticks++;
+  switch (TW_STATUS) {
+     case TW_START:
+     case TW_REP_START:
+        TWDR = buf[out % TWIQ_SIZE] << 1;  // SLA+W
+        left = buf[(uint8_t)(out+1) % TWIQ_SIZE];
+        out += 2;
+        TWCR = TWCR_NEXT;
+     break;
+     case TW_MT_SLA_ACK:
+     case TW_MT_DATA_ACK:
+        twiqBytes++;
+        if (left) {
+           left--;
+           TWDR = buf[out++ % TWIQ_SIZE];
+           TWCR = TWCR_NEXT;
+        } else {
+           next();
+        }
+     break;
+     default:          // NACK, lost arbitration or bus error: skip the rest of it
+        out += left;
+        left = 0;
+        twiqErrors++;
+        next();
+     break;
+  }
+}  // end of ISR(TWI_vect)
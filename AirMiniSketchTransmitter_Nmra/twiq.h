@@ -0,0 +1,78 @@
+/*
+twiq.h
+
+Interrupt-driven I2C (TWI) master transmit queue. Whole write
+transactions are queued in a small ring and sent by the TWI interrupt,
+so the caller never waits on the bus.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TWIQ_H_
+#define TWIQ_H_
+
+#include <stdint.h>
+
+// Ring size in bytes, including 2 header bytes per transaction. Must be a power of 2, at most 128.
+#if ! defined(TWIQ_SIZE)
+#define TWIQ_SIZE 64
+#endif
+
+// A transfer making no progress for this long means a stuck bus, in usec
+#if ! defined(TWIQ_TIMEOUTUS)
+#define TWIQ_TIMEOUTUS 3000UL
+#endif
+
+extern volatile uint16_t twiqBytes;    // Bytes acknowledged by a slave, address bytes included
+extern volatile uint16_t twiqErrors;   // Transactions cut short: NACK, lost arbitration, bus error or timeout
+extern volatile uint8_t  twiqTimedOut; // Set when the bus got stuck. Cleared by the caller
+
+// Take over the TWI pins as bus master at clockHz. Drops anything queued.
+void twiqBegin(uint32_t clockHz);
+
+// Blocking probe: does a device acknowledge addr? Only for discovery, with the queue idle.
+// Bounded by TWIQ_TIMEOUTUS per bus phase.
+uint8_t twiqProbe(uint8_t addr);
+
+// Free ring bytes. A transaction of len bytes needs len+2.
+uint8_t twiqRoom(void);
+
+// Start a write transaction of exactly len bytes to addr. Returns 0, queueing
+// nothing, if there is no room. Otherwise follow with len twiqByte() and a twiqClose().
+uint8_t twiqOpen(uint8_t addr, uint8_t len);
+void twiqByte(uint8_t b);
+void twiqClose(void);
+
+// Nothing queued and the bus released
+uint8_t twiqIdle(void);
+
+// Block until the queue has drained or the bus got stuck. Only for start-up and shutdown.
+void twiqFlush(void);
+
+// Call from loop(). Resets the TWI and drops the queue if a transfer is stuck.
+void twiqCheck(void);
+
+#endif /* TWIQ_H_ */
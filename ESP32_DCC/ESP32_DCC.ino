@@ -8,6 +8,14 @@ Test program to exercize the ESP32 to receive DCC
 and print it out for verification via the serial
 port.
 
+With NMRA_DCC_ESP32_RMT uncommented in NmraDcc.h, the
+DCC input is timed by the RMT peripheral and decoded
+from a task instead of by an interrupt at every edge,
+which Wi-Fi can hold up long enough to lose packets.
+Every STATSMS ms it prints how many packets came in
+and how many the receive queue had to drop, to
+compare the two.
+
 Redistribution and use in source and binary forms, with or
 without modification, are permitted provided that the following
 conditions are met: 
@@ -32,14 +40,18 @@ OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #define DCC_PIN    2
+#define STATSMS    10000   // Packet counts every this many ms. 0: none
 
 
 #include <NmraDcc.h>
 
 DCC_MSG msg;
 NmraDcc DCC;
+uint32_t packets = 0;
+uint32_t lastStatsMs = 0;
 
 extern void notifyDccMsg(DCC_MSG *Msg) {
+  packets++;
   if ((3 <= Msg->Size) && (Msg->Size <= 6)) {  // Check for a valid message
      memcpy((void *)&msg, (void *)Msg, sizeof(DCC_MSG));
   }
@@ -68,6 +80,11 @@ void setup() {
      delay(20);
 
   Serial.println("ESP32 Decoder");
+#if defined(NMRA_DCC_ESP32_RMT)
+  Serial.println("DCC input: RMT capture");
+#else
+  Serial.println("DCC input: edge interrupt");
+#endif
   Serial.println("DCC messages should follow!");
 
   // Set up the input and output pins
@@ -82,7 +99,17 @@ void setup() {
 
 void loop() {
 
-  DCC.process();  // The DCC library does it all with the callback notifyDccMsg!
+  DCC.process(DCC_RX_QUEUE);  // The DCC library does it all with the callback notifyDccMsg!
+
+#if STATSMS > 0
+  if (millis() - lastStatsMs >= STATSMS) {
+     lastStatsMs = millis();
+     Serial.print("packets: ");
+     Serial.print(packets);
+     Serial.print(" dropped: ");
+     Serial.println(DCC.getRxOverruns());
+  }
+#endif
 
 }  // end of loop
 
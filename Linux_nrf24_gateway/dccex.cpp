@@ -0,0 +1,342 @@
+/*
+Linux_nrf24_gateway/dccex.cpp
+
+DCC-EX text commands to DCC packets.
+
+Understood: <t reg cab speed dir> and <t cab speed dir> (128 steps,
+speed -1 is an emergency stop), <f cab byte1 [byte2]>, <F cab fn state>,
+<M reg hex...>, <!>, <- [cab]>, <1>, <0>, <s> and <#>. Anything else in
+<> gets <X>. A line with no < is a raw packet: hex bytes, no XOR.
+
+As a command station does, each locomotive's speed and the function
+groups it was given are sent again and again, in turn with the others,
+whenever nothing new is queued; idle packets fill when the table is
+empty. One mutex covers everything here: the input threads call
+dccxLine() while the scheduler calls dccxNext().
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "dccex.h"
+#include <ctype.h>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GROUPS 5       // F0-F4, F5-F8, F9-F12, F13-F20, F21-F28
+#define FNMAX  28
+
+typedef struct {
+  uint16_t cab;        // 0: free
+  uint8_t speed;       // 128-step speed byte: direction in bit 7, 1 is an emergency stop
+  uint32_t fn;         // F0-F28
+  uint8_t groups;      // A bit per function group given so far
+} loco_t;
+
+static std::mutex lock;
+static loco_t locos[DCCX_LOCOS];
+static DCC_MSG queue[DCCX_QUEUE];
+static uint16_t qIn = 0, qOut = 0;  // Free-running
+static uint8_t powerOn = 1;
+static uint8_t cursor = 0;           // Refresh: next loco...
+static uint8_t item = 0;             // ...and its speed (0) or function group (1-GROUPS)
+static dccxStats_t st;
+
+static const uint8_t groupOf[FNMAX+1] = {0,0,0,0,0, 1,1,1,1, 2,2,2,2, 3,3,3,3,3,3,3,3, 4,4,4,4,4,4,4,4};
+
+// Address, instruction bytes and XOR. Long addresses above 127, as DCC-EX.
+static uint8_t build(DCC_MSG *m, uint16_t cab, const uint8_t *in, uint8_t n) {
+  uint8_t i = 0, x = 0;
+
+  if (cab > 127) {
+     m->Data[i++] = 0xC0 | (uint8_t)(cab >> 8);
+     m->Data[i++] = (uint8_t)cab;
+  } else m->Data[i++] = (uint8_t)cab;
+  if (i + n + 1 > MAX_DCC_MESSAGE_LEN) return 0;
+  memcpy(&m->Data[i], in, n);
+  i += n;
+  for (uint8_t j = 0; j < i; j++) x ^= m->Data[j];
+  m->Data[i++] = x;
+  m->Size = i;
+  m->PreambleBits = 0;
+  return 1;
+}
+
+static void push(const DCC_MSG *m) {
+  if ((uint16_t)(qIn - qOut) >= DCCX_QUEUE) {
+     st.full++;
+     return;
+  }
+  queue[qIn++ % DCCX_QUEUE] = *m;
+  st.queued++;
+}
+
+static uint8_t queueRaw(const uint8_t *b, uint8_t n) {
+  DCC_MSG m;
+
+  if ((n < 2) || (n > MAX_DCC_MESSAGE_LEN-1)) return 0;
+  memcpy(&m.Data[0], b, n);
+  m.Data[n] = 0;
+  for (uint8_t i = 0; i < n; i++) m.Data[n] ^= b[i];
+  m.Size = n+1;
+  m.PreambleBits = 0;
+  push(&m);
+  return 1;
+}
+
+static uint8_t speedPacket(DCC_MSG *m, const loco_t *l) {
+  uint8_t in[2] = {0x3F, l->speed};  // 128 speed steps
+  return build(m, l->cab, in, 2);
+}
+
+static uint8_t groupPacket(DCC_MSG *m, const loco_t *l, uint8_t g) {
+  uint8_t in[2];
+  uint8_t n = 1;
+
+  switch (g) {
+     case 0: in[0] = 0x80 | (uint8_t)((l->fn & 1) << 4) | (uint8_t)((l->fn >> 1) & 0x0F); break;
+     case 1: in[0] = 0xB0 | (uint8_t)((l->fn >> 5) & 0x0F); break;
+     case 2: in[0] = 0xA0 | (uint8_t)((l->fn >> 9) & 0x0F); break;
+     case 3: in[0] = 0xDE; in[1] = (uint8_t)(l->fn >> 13); n = 2; break;
+     default: in[0] = 0xDF; in[1] = (uint8_t)(l->fn >> 21); n = 2; break;
+  }
+  return build(m, l->cab, in, n);
+}
+
+static loco_t *find(uint16_t cab, uint8_t add) {
+  loco_t *free = NULL;
+
+  for (uint8_t i = 0; i < DCCX_LOCOS; i++) {
+     if (locos[i].cab == cab) return &locos[i];
+     if (!locos[i].cab && !free) free = &locos[i];
+  }
+  if (!add || !free) return NULL;
+  memset(free, 0, sizeof(*free));
+  free->cab = cab;
+  return free;
+}
+
+static void sendGroup(loco_t *l, uint8_t g) {
+  DCC_MSG m;
+
+  l->groups |= 1 << g;
+  if (groupPacket(&m, l, g)) push(&m);
+}
+
+// <f cab byte1 [byte2]>: the DCC instruction bytes of one group
+static uint8_t functions(loco_t *l, long b1, long b2, int n) {
+  if ((b1 >= 128) && (b1 <= 159)) {
+     l->fn = (l->fn & ~0x1FUL) | ((b1 >> 4) & 1) | ((uint32_t)(b1 & 0x0F) << 1);
+     sendGroup(l, 0);
+  } else if ((b1 >= 176) && (b1 <= 191)) {
+     l->fn = (l->fn & ~(0x0FUL << 5)) | ((uint32_t)(b1 & 0x0F) << 5);
+     sendGroup(l, 1);
+  } else if ((b1 >= 160) && (b1 <= 175)) {
+     l->fn = (l->fn & ~(0x0FUL << 9)) | ((uint32_t)(b1 & 0x0F) << 9);
+     sendGroup(l, 2);
+  } else if (((b1 == 222) || (b1 == 223)) && (n == 3) && (b2 >= 0) && (b2 <= 255)) {
+     uint8_t shift = (b1 == 222) ? 13 : 21;
+     l->fn = (l->fn & ~(0xFFUL << shift)) | ((uint32_t)b2 << shift);
+     sendGroup(l, (b1 == 222) ? 3 : 4);
+  } else return 0;
+  return 1;
+}
+
+static uint16_t locoReply(char *reply, uint16_t size, const loco_t *l) {
+  return (uint16_t)snprintf(reply, size, "<l %u 0 %u %lu>\n", l->cab, l->speed, (unsigned long)l->fn);
+}
+
+static uint8_t hexBytes(const char *s, uint8_t *out, uint8_t max) {
+  uint8_t n = 0;
+  char *end;
+
+  for (;;) {
+     while (isspace((unsigned char)*s)) s++;
+     if (!*s || (*s == '>') || (*s == '#')) return n;
+     long v = strtol(s, &end, 16);
+     if ((end == s) || (v < 0) || (v > 255) || (n >= max)) return 0;
+     out[n++] = (uint8_t)v;
+     s = end;
+  }
+}
+
+// One command, the text between < and >
+static uint16_t command(const char *c, char *reply, uint16_t size) {
+  long a[4] = {0, 0, 0, 0};
+  long reg = -1;
+  int n = 0;
+  char op = *c++;
+  const char *s = c;
+  char *end;
+  loco_t *l;
+  DCC_MSG m;
+
+  if (op == 'M') {  // <M reg hex...>
+     uint8_t b[MAX_DCC_MESSAGE_LEN];
+     uint8_t k;
+     strtol(s, &end, 10);
+     if ((end == s) || ((k = hexBytes(end, b, MAX_DCC_MESSAGE_LEN-1)) < 2)) goto bad;
+     queueRaw(b, k);
+     return 0;
+  }
+  while (n < 4) {
+     long v = strtol(s, &end, 10);
+     if (end == s) break;
+     a[n++] = v;
+     s = end;
+  }
+  while (isspace((unsigned char)*s)) s++;
+  if (*s) goto bad;
+
+  switch (op) {
+     case 't':
+        if (n == 4) {  // The register is DCC-EX's old slot: only echoed
+           reg = a[0];
+           a[0] = a[1]; a[1] = a[2]; a[2] = a[3];
+        } else if (n != 3) goto bad;
+        if ((a[0] < 1) || (a[0] > 10239) || (a[1] < -1) || (a[1] > 126) || (a[2] < 0) || (a[2] > 1)) goto bad;
+        if (!(l = find((uint16_t)a[0], 1))) goto bad;
+        l->speed = (uint8_t)((a[2] ? 0x80 : 0) | ((a[1] < 0) ? 1 : (a[1] ? a[1]+1 : 0)));
+        if (speedPacket(&m, l)) push(&m);
+        if (reg >= 0) return (uint16_t)snprintf(reply, size, "<T %ld %ld %ld>\n", reg, a[1], a[2]);
+        return locoReply(reply, size, l);
+     case 'f':
+        if ((n < 2) || (n > 3) || (a[0] < 1) || (a[0] > 10239)) goto bad;
+        if (!(l = find((uint16_t)a[0], 1)) || !functions(l, a[1], a[2], n)) goto bad;
+        return 0;
+     case 'F':
+        if ((n != 3) || (a[0] < 1) || (a[0] > 10239) || (a[1] < 0) || (a[1] > FNMAX) || (a[2] < 0) || (a[2] > 1)) goto bad;
+        if (!(l = find((uint16_t)a[0], 1))) goto bad;
+        if (a[2]) l->fn |= 1UL << a[1];
+        else l->fn &= ~(1UL << a[1]);
+        sendGroup(l, groupOf[a[1]]);
+        return locoReply(reply, size, l);
+     case '!': {  // Broadcast emergency stop; the table keeps the locos stopped
+        static const uint8_t estop[2] = {0x3F, 0x01};
+        if (n) goto bad;
+        for (uint8_t i = 0; i < DCCX_LOCOS; i++) locos[i].speed = (locos[i].speed & 0x80) | 1;
+        if (build(&m, 0, estop, 2)) push(&m);
+        return 0;
+     }
+     case '-':
+        if (n == 0) memset(locos, 0, sizeof(locos));
+        else if ((n == 1) && (l = find((uint16_t)a[0], 0))) l->cab = 0;
+        return 0;
+     case '1':
+     case '0':
+        if (n) goto bad;
+        powerOn = (op == '1');
+        if (!powerOn) qOut = qIn;
+        return (uint16_t)snprintf(reply, size, "<p%c>\n", op);
+     case 's':
+        if (n) goto bad;
+        return (uint16_t)snprintf(reply, size, "<p%u>\n<iProMiniAir nRF24 gateway>\n", powerOn);
+     case '#':
+        if (n) goto bad;
+        return (uint16_t)snprintf(reply, size, "<# %u>\n", DCCX_LOCOS);
+  }
+bad:
+  st.bad++;
+  return (uint16_t)snprintf(reply, size, "<X>\n");
+}  // end of command
+void dccxBegin(uint8_t power) {
+  std::lock_guard<std::mutex> g(lock);
+
+  memset(locos, 0, sizeof(locos));
+  memset(&st, 0, sizeof(st));
+  qIn = qOut = 0;
+  cursor = item = 0;
+  powerOn = power;
+}
+
+uint16_t dccxLine(const char *line, char *reply, uint16_t size) {
+  std::lock_guard<std::mutex> g(lock);
+  char c[DCCX_LINE];
+  uint16_t len = 0;
+  const char *p = line, *e;
+
+  while (isspace((unsigned char)*p)) p++;
+  if (!*p || (*p == '#')) return 0;
+  if (*p != '<') {
+     uint8_t b[MAX_DCC_MESSAGE_LEN];
+     uint8_t n = hexBytes(p, b, MAX_DCC_MESSAGE_LEN-1);
+     if (!n || !queueRaw(b, n)) st.bad++;
+     return 0;
+  }
+  while ((p = strchr(p, '<')) && (e = strchr(p, '>'))) {  // Any number of commands on the line
+     size_t n = (size_t)(e - p - 1);
+     if (n >= sizeof(c)) n = sizeof(c)-1;
+     memcpy(c, p+1, n);
+     c[n] = 0;
+     if (n && (len < size)) len += command(c, reply + len, size - len);
+     p = e + 1;
+  }
+  return (len < size) ? len : size-1;
+}  // end of dccxLine
+
+uint8_t dccxQueue(const uint8_t *bytes, uint8_t n) {
+  std::lock_guard<std::mutex> g(lock);
+  uint32_t was = st.queued;
+
+  return queueRaw(bytes, n) && (st.queued != was);
+}
+
+uint8_t dccxNext(DCC_MSG *m, uint8_t fill) {
+  std::lock_guard<std::mutex> g(lock);
+  static const uint8_t idle[3] = {0xFF, 0x00, 0xFF};
+
+  if (!powerOn) return 0;
+  if (qOut != qIn) {
+     *m = queue[qOut++ % DCCX_QUEUE];
+     return 1;
+  }
+  if (!fill) return 0;
+  for (uint16_t tries = 0; tries < DCCX_LOCOS*(GROUPS+1); tries++) {  // The next thing the table has
+     loco_t *l = &locos[cursor];
+     uint8_t i = item;
+     if (++item > GROUPS) {
+        item = 0;
+        cursor = (cursor + 1) % DCCX_LOCOS;
+     }
+     if (!l->cab) continue;
+     if ((i == 0) ? speedPacket(m, l) : ((l->groups & (1 << (i-1))) && groupPacket(m, l, i-1))) {
+        st.refreshes++;
+        return 1;
+     }
+  }
+  memcpy(&m->Data[0], idle, 3);
+  m->Size = 3;
+  m->PreambleBits = 0;
+  st.idles++;
+  return 1;
+}  // end of dccxNext
+
+void dccxStats(dccxStats_t *out) {
+  std::lock_guard<std::mutex> g(lock);
+
+  *out = st;
+}
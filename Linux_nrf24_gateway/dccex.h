@@ -0,0 +1,72 @@
+/*
+Linux_nrf24_gateway/dccex.h
+
+What the gateway sends: DCC packets from DCC-EX commands or raw hex
+lines, a refresh table of locomotives, and idle packets to fill.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef DCCEX_H_
+#define DCCEX_H_
+
+#include <stdint.h>
+#include <NmraDcc.h>
+
+#define DCCX_LOCOS 50   // Locomotives refreshed, as DCC-EX's MAX_LOCOS
+#define DCCX_QUEUE 256  // Packets waiting to be sent ahead of the refresh
+#define DCCX_LINE  256  // Longest input line
+
+typedef struct {
+  uint32_t queued;     // Packets queued from commands and raw lines
+  uint32_t full;       // Not queued: the queue was full
+  uint32_t bad;        // Commands or lines not understood
+  uint32_t refreshes;  // Packets sent from the refresh table
+  uint32_t idles;      // Idle packets sent for want of anything else
+} dccxStats_t;
+
+// Empty the queue and the refresh table. power: send anything at all
+// (DCC-EX <1> and <0> switch it).
+void dccxBegin(uint8_t power);
+
+// Take one input line: DCC-EX commands in <>, or a raw packet as hex
+// bytes with no XOR. Writes any DCC-EX reply to reply[size] and returns
+// its length. Thread-safe.
+uint16_t dccxLine(const char *line, char *reply, uint16_t size);
+
+// Queue a raw packet of n bytes (XOR appended here). Returns 0 if it is
+// not a DCC packet or the queue is full. Thread-safe.
+uint8_t dccxQueue(const uint8_t *bytes, uint8_t n);
+
+// Next packet to send: queued ones first, then, if fill, the refresh
+// table in turn and idle packets. Returns 0 if there is none, or power
+// is off. Thread-safe.
+uint8_t dccxNext(DCC_MSG *m, uint8_t fill);
+
+// Copy of the counters. Thread-safe.
+void dccxStats(dccxStats_t *st);
+
+#endif /* DCCEX_H_ */
\ No newline at end of file
@@ -0,0 +1,413 @@
+/*
+Linux_nrf24_gateway/gateway.cpp
+
+Linux DCC gateway for ProMiniAir nRF24 receivers.
+
+DCC comes in as lines of text: DCC-EX commands or raw hex packets (see
+dccex.cpp), from standard input, a named pipe and/or TCP clients, e.g.,
+JMRI or a throttle app speaking DCC-EX on port 2560. A timer thread
+sends it the way ProMini_Air_nrf24_tx_rx_dcc's transmitter would: one
+packet per DCC packet time on the rails, so the receivers' rings never
+overrun, packed into frames by the sketch's own nrfbatch module and
+loaded into the nRF24's TX FIFO. Between commands it sends the refresh
+table, and idle packets when that is empty.
+
+The thread wakes every tick on CLOCK_MONOTONIC with absolute deadlines,
+at SCHED_FIFO priority if allowed, so neither its own work nor a late
+wakeup shifts the schedule; how late it woke is counted.
+
+-B runs a benchmark instead: a feeder thread keeps the queue full, and
+the packets go through the loopback radio, with and without the 250 kbps
+air time, paced and as fast as they come.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "dccex.h"
+#include "gwradio.h"
+#include <nrfbatch.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+
+#define TICKUS      250      // Scheduler period
+#define ONEUS       116      // DCC bit times: 1
+#define ZEROUS      200      //                0
+#define PREAMBLE    14       // Preamble bits a command station sends at least
+#define SLACKUS     20000    // Further behind than this, the schedule starts over
+#define PRIORITY    50       // SCHED_FIFO priority of the scheduler
+
+typedef struct {
+  uint32_t ticks;
+  uint32_t packets;          // Given to nrfbatch
+  uint32_t frames;           // Sent to the radio
+  uint32_t fifoFull;         // Times a frame waited for room in the TX FIFO
+  uint32_t late;             // Wakeups a tick or more late
+  uint32_t lateMaxUs;
+} sched_t;
+
+static GwRadio *radio;
+static sched_t sched;
+static std::atomic<bool> running(false);
+static volatile sig_atomic_t quit = 0;
+static uint16_t tickUs = TICKUS;
+static uint8_t paced = 1;
+static uint8_t verbose = 0;
+
+static uint32_t usOf(const struct timespec *t) {
+  return (uint32_t)((uint64_t)t->tv_sec * 1000000 + t->tv_nsec / 1000);  // Wraps, as micros()
+}
+
+static uint32_t nowUs(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return usOf(&t);
+}
+
+// Time the packet takes on the rails: preamble, a start bit per byte, end bit
+static uint32_t dccUs(const DCC_MSG *m) {
+  uint32_t us = (PREAMBLE + 1) * ONEUS;
+
+  for (uint8_t i = 0; i < m->Size; i++) {
+     uint8_t ones = (uint8_t)__builtin_popcount(m->Data[i]);
+     us += ZEROUS + ones * ONEUS + (8 - ones) * ZEROUS;
+  }
+  return us;
+}
+
+static void scheduler(void) {
+  struct timespec t;
+  struct sched_param sp;
+  uint8_t frame[NRFB_PAYLOAD];
+  uint8_t frameLen = 0;       // A frame taken that the TX FIFO had no room for
+  uint8_t have = 0;
+  uint32_t slotAt;            // When the next packet may go
+  DCC_MSG m;
+
+  sp.sched_priority = PRIORITY;
+  if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp) && verbose) fprintf(stderr, "No real-time priority: running as a normal thread\n");
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  slotAt = usOf(&t);
+  while (running) {
+     t.tv_nsec += tickUs * 1000L;
+     if (t.tv_nsec >= 1000000000L) {
+        t.tv_nsec -= 1000000000L;
+        t.tv_sec++;
+     }
+     while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) == EINTR);
+     uint32_t now = nowUs();
+     uint32_t late = now - usOf(&t);
+     sched.ticks++;
+     if (late >= tickUs) sched.late++;
+     if (late > sched.lateMaxUs) sched.lateMaxUs = late;
+
+     radio->poll();
+     for (uint16_t n = 0; n <= DCCX_QUEUE; ) {
+        if (frameLen) {
+           if (!radio->send(frame, frameLen)) {
+              sched.fifoFull++;
+              break;
+           }
+           sched.frames++;
+           frameLen = 0;
+        }
+        if (nrfbDue(now) && ((frameLen = nrfbTake(frame, now)))) continue;
+        if (paced && ((int32_t)(now - slotAt) < 0)) break;
+        if (!have && !(have = dccxNext(&m, paced))) {
+           slotAt = now;
+           break;
+        }
+        if (!nrfbAdd(&m, now)) continue;  // The frame is due and full: it goes first
+        have = 0;
+        n++;
+        sched.packets++;
+        if ((int32_t)(now - slotAt) > SLACKUS) slotAt = now;
+        slotAt += dccUs(&m);
+     }
+  }
+}  // end of scheduler
+
+static void start(void) {
+  memset(&sched, 0, sizeof(sched));
+  running = true;
+}
+
+//////////
+// Inputs
+//////////
+
+static void lines(FILE *in, int replyFd) {
+  char line[DCCX_LINE], reply[DCCX_LINE];
+
+  while (fgets(line, sizeof(line), in)) {
+     uint16_t n = dccxLine(line, reply, sizeof(reply));
+     if (n && (replyFd >= 0) && (write(replyFd, reply, n) < 0)) break;
+  }
+}
+
+static void pipeReader(const char *path) {
+  for (;;) {  // Opening blocks until a writer comes; EOF when it goes
+     FILE *f = fopen(path, "r");
+     if (!f) {
+        perror(path);
+        return;
+     }
+     lines(f, -1);
+     fclose(f);
+  }
+}
+
+static void client(int fd) {
+  FILE *f = fdopen(fd, "r");
+
+  if (!f) {
+     close(fd);
+     return;
+  }
+  lines(f, fd);
+  fclose(f);
+}
+
+static void listener(int s) {
+  for (;;) {
+     int fd = accept(s, NULL, NULL);
+     if (fd < 0) {
+        if (errno == EINTR) continue;
+        perror("accept");
+        return;
+     }
+     std::thread(client, fd).detach();
+  }
+}
+
+static int listenOn(uint16_t port) {
+  struct sockaddr_in a;
+  int one = 1;
+  int s = socket(AF_INET, SOCK_STREAM, 0);
+
+  if (s < 0) return -1;
+  setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  memset(&a, 0, sizeof(a));
+  a.sin_family = AF_INET;
+  a.sin_addr.s_addr = htonl(INADDR_ANY);
+  a.sin_port = htons(port);
+  if ((bind(s, (struct sockaddr *)&a, sizeof(a)) < 0) || (listen(s, 4) < 0)) {
+     close(s);
+     return -1;
+  }
+  return s;
+}
+
+static void onSignal(int) {
+  quit = 1;
+}
+
+static void report(void) {
+  dccxStats_t d;
+
+  dccxStats(&d);
+  fprintf(stderr, "Packets %u (queued %u, refresh %u, idle %u; queue full %u, bad %u), frames %u, TX FIFO full %u, late ticks %u of %u (max %u us)\n",
+          sched.packets, d.queued, d.refreshes, d.idles, d.full, d.bad, sched.frames, sched.fifoFull, sched.late, sched.ticks, sched.lateMaxUs);
+}
+
+/////////////
+// Benchmark
+/////////////
+
+static uint8_t benchNext;              // Sequence number the loopback should see next
+static uint32_t benchGot, benchWrong;
+
+static void benchPacket(const uint8_t *data, uint8_t size) {
+  if ((size != 4) || (data[0] != 3) || (data[1] != 0xDE)) return;  // Not from the feeder
+  if (data[2] != benchNext) benchWrong++;
+  benchNext = data[2] + 1;
+  benchGot++;
+}
+
+static void feeder(std::atomic<bool> *on) {
+  uint8_t b[3] = {3, 0xDE, 0};  // Loco 3, F13-F20: the sequence number
+
+  while (*on) {
+     if (dccxQueue(b, 3)) b[2]++;
+     else usleep(20);  // Full: the scheduler has DCCX_QUEUE to go on with
+  }
+}
+
+static double cpuS(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void bench(double seconds, uint16_t flushUs) {
+  static const struct {
+     const char *label;
+     uint8_t air, paced, batch;
+  } rows[] = {
+     {"Paced, one per frame, 250 kbps",  1, 1, 0},
+     {"Paced, batched, 250 kbps",        1, 1, 1},
+     {"One per frame, 250 kbps",         1, 0, 0},
+     {"Batched, 250 kbps",               1, 0, 1},
+     {"One per frame, no air time",      0, 0, 0},
+     {"Batched, no air time",            0, 0, 1},
+  };
+
+  printf("Gateway benchmark, %.0f s per row, tick %u us, batch flush %u us\n", seconds, tickUs, flushUs);
+  printf("%-32s %10s %10s %8s %10s %8s %10s %10s\n", "", "Packets/s", "Frames/s", "Pkt/fr", "FIFO full", "Wrong", "CPU us/pk", "Late max");
+  for (size_t r = 0; r < sizeof(rows)/sizeof(rows[0]); r++) {
+     std::atomic<bool> on(true);
+
+     radio = gwLoopback(rows[r].air, 0, 0);
+     radio->begin();
+     gwLoopPacket = benchPacket;
+     benchNext = 0;
+     benchGot = benchWrong = 0;
+     dccxBegin(1);
+     nrfbBegin(rows[r].batch, flushUs);
+     paced = rows[r].paced;
+
+     std::thread feed(feeder, &on);
+     double cpu = cpuS();
+     uint32_t t0 = nowUs();
+     start();
+     std::thread s(scheduler);
+     usleep((useconds_t)(seconds * 1e6));
+     running = false;
+     s.join();
+     double wall = (nowUs() - t0) * 1e-6;
+     on = false;
+     feed.join();
+     cpu = cpuS() - cpu;
+     delete radio;
+
+     printf("%-32s %10.0f %10.0f %8.2f %10u %8u %10.2f %10u\n", rows[r].label,
+            benchGot / wall, gwLoop.frames / wall, gwLoop.frames ? (double)gwLoop.packets / gwLoop.frames : 0.0,
+            sched.fifoFull, benchWrong, benchGot ? 1e6 * cpu / benchGot : 0.0, sched.lateMaxUs);
+  }
+  printf("Unpaced, at most %u packets go per tick.\n", DCCX_QUEUE);
+}  // end of bench
+
+static void usage(const char *me) {
+  fprintf(stderr, "Usage: %s [-p fifo] [-l port] [-i] [-R spidev|loop] [-e ce] [-n csn] [-c channel] [-P power]\n"
+                  "          [-b flushus] [-C copies] [-g spacingms] [-k tickus] [-u] [-L loss%%] [-S seconds] [-v]\n"
+                  "       %s -B seconds [-b flushus] [-k tickus]\n", me, me);
+  exit(1);
+}
+
+int main(int argc, char **argv) {
+  const char *fifo = NULL, *backend = "spidev";
+  int port = -1, c;
+  uint8_t useStdin = 0, channel = 10, power = 0, copies = 1, lossPct = 0;
+  uint16_t ce = 22, csn = 0, flushUs = 0, spacingMs = 3;
+  double benchS = 0;
+  unsigned statsS = 0;
+
+  while ((c = getopt(argc, argv, "p:l:iR:e:n:c:P:b:C:g:k:uL:S:vB:")) != -1) {
+     switch (c) {
+        case 'p': fifo = optarg; break;
+        case 'l': port = atoi(optarg); break;
+        case 'i': useStdin = 1; break;
+        case 'R': backend = optarg; break;
+        case 'e': ce = (uint16_t)atoi(optarg); break;
+        case 'n': csn = (uint16_t)atoi(optarg); break;
+        case 'c': channel = (uint8_t)atoi(optarg); break;
+        case 'P': power = (uint8_t)atoi(optarg); break;
+        case 'b': flushUs = (uint16_t)atoi(optarg); break;
+        case 'C': copies = (uint8_t)atoi(optarg); break;
+        case 'g': spacingMs = (uint16_t)atoi(optarg); break;
+        case 'k': tickUs = (uint16_t)atoi(optarg); break;
+        case 'u': paced = 0; break;
+        case 'L': lossPct = (uint8_t)atoi(optarg); break;
+        case 'S': statsS = (unsigned)atoi(optarg); break;
+        case 'v': verbose = 1; break;
+        case 'B': benchS = atof(optarg); break;
+        default: usage(argv[0]);
+     }
+  }
+  if ((channel > 125) || (power > 3) || !tickUs) usage(argv[0]);
+  mlockall(MCL_CURRENT | MCL_FUTURE);  // No page faults in the scheduler, if allowed
+
+  if (benchS > 0) {
+     bench(benchS, flushUs ? flushUs : 10000);  // The sketch's NRF_BATCHFLUSHUS
+     return 0;
+  }
+
+  if (!strcmp(backend, "spidev")) radio = gwSpidev(ce, csn, channel, power);
+  else if (!strcmp(backend, "loop")) radio = gwLoopback(1, lossPct, verbose);
+  else usage(argv[0]);
+  if (!radio->begin()) return 1;
+  dccxBegin(1);
+  nrfbBegin(flushUs > 0, flushUs);
+  nrfbCopies(copies, spacingMs * 1000);
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  signal(SIGPIPE, SIG_IGN);
+  if (fifo) {
+     if ((mkfifo(fifo, 0666) < 0) && (errno != EEXIST)) {
+        perror(fifo);
+        return 1;
+     }
+     std::thread(pipeReader, fifo).detach();
+  }
+  if (port >= 0) {
+     int s = listenOn((uint16_t)port);
+     if (s < 0) {
+        perror("listen");
+        return 1;
+     }
+     std::thread(listener, s).detach();
+  }
+  if (useStdin || (!fifo && (port < 0))) std::thread(lines, stdin, STDOUT_FILENO).detach();
+
+  start();
+  std::thread s(scheduler);
+  for (uint32_t n = 1; !quit; n++) {
+     usleep(100000);
+     if (statsS && !(n % (statsS * 10))) report();
+  }
+  running = false;
+  s.join();
+  radio->end();
+  report();
+  return 0;
+}  // end of main
\ No newline at end of file
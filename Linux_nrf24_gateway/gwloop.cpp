@@ -0,0 +1,116 @@
+/*
+Linux_nrf24_gateway/gwloop.cpp
+
+Loopback radio backend: frames go straight to nrfbUnpack(), as in the
+receiver sketch, and the packets come out checked and counted.
+
+With air time on, it keeps the 3-deep TX FIFO of the nRF24 against the
+wall clock: a frame is uploaded over SPI, goes on the air after the
+130 us TX settling (none if the one before it is still going out) and
+takes its bits at 250 kbps, so the gateway sees a full FIFO when a real
+radio would.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "gwradio.h"
+#include <nrfbatch.h>
+#include <deque>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SETTLEUS     130             // Standby to TX
+#define SPIUS(n)     (24 + 2*(n))    // Commands and payload upload
+#define TXFIFO       3
+
+gwLoopStats_t gwLoop;
+void (*gwLoopPacket)(const uint8_t *data, uint8_t size) = NULL;
+
+static uint64_t nowUs(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static uint32_t frameUs(uint8_t len) {
+  return 4 * (8 + 40 + 9 + 8*len + 16);  // Preamble, address, control field, payload, CRC at 250 kbps
+}
+
+class GwLoopback : public GwRadio {
+public:
+  GwLoopback(uint8_t a, uint8_t l, uint8_t v) : air(a), lossPct(l), verbose(v), last(0) {}
+
+  uint8_t begin(void) {
+     memset(&gwLoop, 0, sizeof(gwLoop));
+     nrfbResync();
+     return 1;
+  }
+
+  uint8_t send(const uint8_t *frame, uint8_t len) {
+     DCC_MSG out[NRFB_RECORDS];
+     uint64_t now = nowUs();
+
+     if (air) {
+        while (!fifo.empty() && (fifo.front() <= now)) fifo.pop_front();
+        if (fifo.size() >= TXFIFO) return 0;
+        uint64_t loaded = now + SPIUS(len);
+        last = ((last > loaded) ? last : loaded + SETTLEUS) + frameUs(len);
+        fifo.push_back(last);
+     }
+     gwLoop.frames++;
+     gwLoop.airUs += frameUs(len);
+     if (lossPct && ((uint32_t)(rand() % 100) < lossPct)) {
+        gwLoop.lost++;
+        return 1;
+     }
+     uint8_t n = nrfbUnpack(frame, len, out, (uint32_t)now);
+     for (uint8_t i = 0; i < n; i++) {
+        uint8_t x = 0;
+        for (uint8_t j = 0; j < out[i].Size; j++) x ^= out[i].Data[j];
+        if (x) gwLoop.bad++;
+        gwLoop.packets++;
+        if (verbose) {
+           printf("rx");
+           for (uint8_t j = 0; j < out[i].Size; j++) printf(" %02X", out[i].Data[j]);
+           printf("\n");
+        }
+        if (gwLoopPacket) gwLoopPacket(out[i].Data, out[i].Size);
+     }
+     return 1;
+  }  // end of send
+
+private:
+  uint8_t air, lossPct, verbose;
+  std::deque<uint64_t> fifo;  // When each frame in the TX FIFO is out
+  uint64_t last;              // When the radio is done with all it was given
+};
+
+GwRadio *gwLoopback(uint8_t air, uint8_t lossPct, uint8_t verbose) {
+  return new GwLoopback(air, lossPct, verbose);
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+/*
+Linux_nrf24_gateway/gwradio.h
+
+The gateway's radio backends: the nRF24 through RF24's SPIDEV driver,
+or a loopback that unpacks the frames as a receiver would, for running
+with no radio attached.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef GWRADIO_H_
+#define GWRADIO_H_
+
+#include <stdint.h>
+
+class GwRadio {
+public:
+  virtual ~GwRadio() {}
+  // Set the radio up as the ProMiniAir transmitter does. Returns 0 if it failed.
+  virtual uint8_t begin(void) = 0;
+  // Load a frame to go out with no ACK. Returns 0 if the TX FIFO is full: try again later.
+  virtual uint8_t send(const uint8_t *frame, uint8_t len) = 0;
+  // Called every scheduler tick, e.g., to take the radio out of TX when it is done
+  virtual void poll(void) {}
+  virtual void end(void) {}
+};
+
+typedef struct {
+  uint32_t frames;     // Frames sent
+  uint32_t lost;       // Of which lost on purpose
+  uint32_t packets;    // Packets unpacked from them
+  uint32_t bad;        // Packets with a bad XOR
+  uint64_t airUs;      // Air time the frames would take at 250 kbps
+} gwLoopStats_t;
+
+extern gwLoopStats_t gwLoop;
+
+// Called with each packet the loopback receiver unpacks, if set
+extern void (*gwLoopPacket)(const uint8_t *data, uint8_t size);
+
+// Loopback. air: keep the TX FIFO and air time of a 250 kbps nRF24, so
+// that send() fails while a real one would be full. lossPct: frames lost
+// at random. verbose: print every packet.
+GwRadio *gwLoopback(uint8_t air, uint8_t lossPct, uint8_t verbose);
+
+// nRF24 on /dev/spidev<csn/10>.<csn%10>, CE on GPIO ce
+GwRadio *gwSpidev(uint16_t ce, uint16_t csn, uint8_t channel, uint8_t power);
+
+#endif /* GWRADIO_H_ */
\ No newline at end of file
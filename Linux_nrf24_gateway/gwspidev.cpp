@@ -0,0 +1,92 @@
+/*
+Linux_nrf24_gateway/gwspidev.cpp
+
+nRF24 backend on RF24's Linux SPIDEV driver, set up as the transmitter
+of ProMini_Air_nrf24_tx_rx_dcc: 250 kbps, dynamic payloads, no ACK, no
+retries, writing to its pipe 1 address. Frames are loaded into the TX
+FIFO with CE left high; once the FIFO is empty, the radio goes back to
+Standby-I.
+
+Kept apart from the rest of the gateway: RF24's Linux headers bring
+their own millis() and delay().
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "gwradio.h"
+#include <RF24.h>
+#include <stdio.h>
+
+static const uint64_t pipe01 = 0xE8E8F0F0A1ULL;  // As the sketch's transmitter
+
+class GwSpidev : public GwRadio {
+public:
+  GwSpidev(uint16_t ce, uint16_t csn, uint8_t ch, uint8_t pw) : radio(ce, csn), channel(ch), power(pw), sending(false) {}
+
+  uint8_t begin(void) {
+     if (!radio.begin() || !radio.isChipConnected()) {
+        fprintf(stderr, "nRF24 not found\n");
+        return 0;
+     }
+     radio.setChannel(channel);
+     radio.setDataRate(RF24_250KBPS);
+     radio.enableDynamicPayloads();
+     radio.enableDynamicAck();
+     radio.setRetries(0, 0);  // Broadcast
+     radio.setPALevel(power, true);
+     radio.openWritingPipe(pipe01);
+     radio.stopListening();
+     return 1;
+  }
+
+  uint8_t send(const uint8_t *frame, uint8_t len) {
+     if (radio.isFifo(true) == 2) return 0;  // Full
+     radio.startFastWrite(frame, len, 1);     // NOACK; CE stays high until the FIFO is empty
+     sending = true;
+     return 1;
+  }
+
+  void poll(void) {
+     if (sending && radio.isFifo(true, true)) {  // All sent: back to Standby-I
+        radio.txStandBy();
+        sending = false;
+     }
+  }
+
+  void end(void) {
+     radio.txStandBy();
+     radio.powerDown();
+  }
+
+private:
+  RF24 radio;
+  uint8_t channel, power;
+  bool sending;
+};
+
+GwRadio *gwSpidev(uint16_t ce, uint16_t csn, uint8_t channel, uint8_t power) {
+  return new GwSpidev(ce, csn, channel, power);
+}
\ No newline at end of file
@@ -24,6 +24,40 @@
 
 #define USE_OPS_MODE
 
+// Transmitter: send several DCC packets per radio frame (nrfbatch.h).
+// Receivers from this version take either format, older ones only single
+// packets: leave this off until all the receivers are updated.
+// #define NRF_BATCH
+#if !defined(NRF_BATCHFLUSHUS)
+#define NRF_BATCHFLUSHUS 10000 // Longest a packet waits for a frame to fill, in usec
+#endif
+
+// Transmitter: times each frame is sent (CV252, 1-3) and the spacing of
+// the copies in msec (CV251). A burst of interference shorter than the
+// spacing then loses no packet, for that many times the airtime. Copies
+// use the batch format, as NRF_BATCH does: leave CV252 at 1 until all the
+// receivers are updated.
+#if !defined(NRF_COPIESDEFAULT)
+#define NRF_COPIESDEFAULT 1
+#endif
+#if !defined(NRF_SPACINGMSDEFAULT)
+#define NRF_SPACINGMSDEFAULT 3
+#endif
+
+// Receiver: the nRF24's IRQ pin is wired to D8 (PB0). A pin-change
+// interrupt flags received frames; loop() reads the RX FIFO only then,
+// and also between the lines of a display update. Without it, loop()
+// asks the radio on every pass.
+// #define NRF_IRQ
+
+// Link telemetry (nrftelem.h). A receiver with an ID in CV250 (1-8, 0 for
+// none) answers the transmitter's polls on a pipe of its own with a report
+// in the ACK: frames received and missed, RX FIFO full, supply voltage.
+// The transmitter raises its power level, then the copies of each frame,
+// while the worst receiver heard is doing badly, and goes back to CV254
+// and CV252 when all are fine. Both ends need it.
+// #define NRF_TELEMETRY
+
 //////////////////////////////////
 // Transmitter or Receiver options
 //////////////////////////////////
@@ -39,6 +73,18 @@
    #pragma message "Info: Compiling for Receiver"
 #endif
 
+#if defined(TRANSMITTER) && defined(NRF_BATCH)
+   #pragma message "Info: Batching DCC packets in radio frames, flushed after " xstr(NRF_BATCHFLUSHUS) " usec"
+#endif
+
+#if defined(RECEIVER) && defined(NRF_IRQ)
+   #pragma message "Info: Receiving on the nRF24 IRQ pin, D8"
+#endif
+
+#if defined(NRF_TELEMETRY)
+   #pragma message "Info: Link telemetry through ACK payloads"
+#endif
+
 #if defined(TRANSMITTER)
 #define USE_LCD
 #elif defined(RECEIVER)
@@ -56,6 +102,9 @@
 #include <RF24.h>
 #include <avr/io.h>
 #include <NmraDcc.h>
+#include "nrfbatch.h"
+#include "nrfscan.h"
+#include "nrftelem.h"
 #include <EEPROM.h>
 
 #if defined(USE_LCD)
@@ -119,6 +168,32 @@ uint8_t EEMEM EEisSetpowerLevel;        // Stored DC output power level is set
 uint8_t EEMEM EEpowerLevel;             // Stored DC output power level 
 // uint8_t EEMEM EEpowerLevelDefault;   // Stored DC output power level 
 
+#if defined(TRANSMITTER)
+//{ TRANSMITTER
+// Redundancy-related
+#define SPACINGMS_MAX 50
+uint8_t nrfCopies = NRF_COPIESDEFAULT;         // Times each frame is sent
+uint8_t EEMEM EEisSetnrfCopies;                // Stored copies is set
+uint8_t EEMEM EEnrfCopies;                     // Stored copies
+uint8_t nrfSpacingMS = NRF_SPACINGMSDEFAULT;   // Spacing of the copies
+uint8_t EEMEM EEisSetnrfSpacingMS;             // Stored spacing is set
+uint8_t EEMEM EEnrfSpacingMS;                  // Stored spacing in ms
+#if defined(NRF_TELEMETRY)
+uint8_t txCopies;                              // In use: telemetry may raise them above nrfCopies
+uint8_t txPower;                               // and powerLevel
+#endif
+//} TRANSMITTER
+#else
+//{ RECEIVER
+#if defined(NRF_TELEMETRY)
+// Telemetry-related
+uint8_t nrfTelemID = 0;                        // Answers polls to this ID; 0: none
+uint8_t EEMEM EEisSetnrfTelemID;               // Stored telemetry ID is set
+uint8_t EEMEM EEnrfTelemID;                    // Stored telemetry ID
+#endif
+//} RECEIVER
+#endif
+
 #if defined(RECEIVER)
 //{ RECEIVER
 // Filtering-related
@@ -193,6 +268,13 @@ DCC_MSG dccptrNULL[sizeof(DCC_MSG)] = {0, 0, {0,0,0,0,0,0}};
 uint8_t tmpuint8 = 0;
 uint8_t countPtr = 1;
 
+#if defined(TRANSMITTER)
+bool txSending = false;     // Frames loaded and CE high
+uint32_t txFrames = 0;      // Frames loaded into the TX FIFO
+uint32_t txFifoFull = 0;    // Times a frame found the TX FIFO full and had to wait
+uint32_t txDropped = 0;     // Frames dropped because the FIFO stayed full until the next packet
+#endif
+
 #if defined(TRANSMITTER)
 //{ TRANSMITTER
 
@@ -208,6 +290,13 @@ uint8_t countPtr = 1;
 //{ RECEIVER
 
 uint8_t whatChannel;
+uint32_t rxFifoFull = 0;    // Times the RX FIFO was found full: frames may have been lost
+bool rxHeard = false;       // A good frame came in since channel_search() last looked
+void rxDrain(bool ops);
+#if defined(NRF_IRQ)
+#define NRF_IRQ_PIN 8       // PB0, PCINT0
+volatile bool rxReady = false;
+#endif
 #if defined(DEBUG)
 #define PRINT_MAX 129
 int print_count = 0;
@@ -342,6 +431,12 @@ uint64_t LCDprevTime = 0;                      // Initialize the last time displ
 bool LCDrefresh = false;                       // Whether to refresh
 LiquidCrystal_I2C lcd;                         // Create the LCD object with a default address
 char lcd_line[LCDCOLUMNS+1];                   // Note the "+1" to insert an end null!
+uint8_t EEMEM EELCDAddress;                    // Stored LCD address found last time
+const uint8_t LCDKnownAddress[] PROGMEM = {0x27, 0x3F, 0x3C};  // Usual backpack addresses
+#define I2CTIMEOUTUS 3000UL                    // Abandon a transfer held up by a stuck bus, in usec
+#define I2CSCANPERTICK 4                       // Addresses probed per loop pass by the fallback scan
+uint8_t I2CScanAddress = 0;                    // Next address of the fallback scan. 0: no scan running
+uint8_t I2CScanFound = 0;                      // Devices that acknowledged during the fallback scan
 #endif
 
 
@@ -353,10 +448,7 @@ uint8_t restartModemFlag = 0;                  // Initial setting for calling st
 //{ RECEIVER
 #define INITIALWAITPERIODSECDEFAULT 1
 uint64_t timeOfValidDCC;             // Time stamp of the last valid DCC packet
-uint64_t startInitialWaitTime;       // The start of the initial wait time. Will be set in initialization
-uint64_t endInitialWaitTime;         // The end of the initial wait time. Will be set in initialization
-uint8_t InitialWaitPeriodSEC = INITIALWAITPERIODSECDEFAULT;    // Wait period
-uint8_t searchChannelIndex = 0;      // Initialial channel search order index
+uint8_t InitialWaitPeriodSEC = INITIALWAITPERIODSECDEFAULT;    // Wait period; the scan gives up after (CHANNELS_MAX+2) of them
 uint8_t  EEMEM EEisSetInitialWaitPeriodSEC;  // Stored AirMini decoder configuration variable
 uint8_t  EEMEM EEInitialWaitPeriodSEC;       // Stored AirMini decoder configuration variable
 //} RECEIVER
@@ -371,12 +463,15 @@ void printMsgSerial() {
 #if defined(TRANSMITTER)
 //{ TRANSMITTER
 
-  Serial.print("tx: notifyDccMsg: payload(Msg):\n"); 
-  Serial.print(" Size: "); Serial.print(payload[0],HEX); Serial.print("\n");
-  for(uint8_t i=0; i<payload[0]; i++) {
+  Serial.print("tx: notifyDccMsg: Msg:\n"); 
+  Serial.print(" Size: "); Serial.print(msg[msgIndexIn].Size,HEX); Serial.print("\n");
+  for(uint8_t i=0; i<msg[msgIndexIn].Size; i++) {
      Serial.print(" Data[: "); Serial.print(i,HEX); Serial.print("]: ");
-     Serial.print(payload[i+1],HEX); Serial.print("\n");
+     Serial.print(msg[msgIndexIn].Data[i],HEX); Serial.print("\n");
   }
+  Serial.print(" frames: "); Serial.print(txFrames,DEC);
+  Serial.print(" FIFO full: "); Serial.print(txFifoFull,DEC);
+  Serial.print(" dropped: "); Serial.print(txDropped,DEC); Serial.print("\n");
 
 //} TRANSMITTER
 #else
@@ -389,6 +484,10 @@ void printMsgSerial() {
      Serial.print(" data["); Serial.print(i,HEX); Serial.print("]: ");
      Serial.print(msg[msgIndexIn].Data[i],HEX); Serial.print("\n");
   }
+  Serial.print(" RX FIFO full: "); Serial.print(rxFifoFull,DEC);
+  Serial.print(" lost: "); Serial.print(nrfbRx.lost,DEC);
+  Serial.print(" copies: "); Serial.print(nrfbRx.copies,DEC);
+  Serial.print(" superseded: "); Serial.print(nrfbRx.superseded,DEC); Serial.print("\n");
 
 //} RECEIVER
 #endif
@@ -513,6 +612,9 @@ void LCD_Banner()
   lcd.setCursor(0,0);              // Set initial column, row
   if (LCDwhichBanner==INITIAL) lcd.print(bannerString);   // Banner
   else lcd.print("ProMini Air Info");
+#if defined(RECEIVER)
+  rxDrain(false);                  // Frames that came in meanwhile
+#endif
   lcd.setCursor(0,1);              // Set next line column, row
   lcd.print("H:1.0 S:1.6/NRF");    // Show state
   LCDprevTime  = micros();     // Set up the previous display time
@@ -525,6 +627,9 @@ void LCD_Addr_Ch_PL()
    if (!printIn) dccptrTmp = dccptrOut;
 
    lcd.clear();
+#if defined(RECEIVER)
+   rxDrain(false); // Frames that came in meanwhile
+#endif
    lcd.setCursor(0,0); // column, row
    if(printDCC) 
    {
@@ -557,6 +662,9 @@ void LCD_Addr_Ch_PL()
    }
     
    lcd.print(lcd_line);
+#if defined(RECEIVER)
+   rxDrain(false);
+#endif
    lcd.setCursor(0,1); // column, row
 
    if (printDCC) 
@@ -649,6 +757,65 @@ void LCD_Wait_Period_Over(int status)
    return;
 }
 
+// A bus held low by a hung device would stall every transfer: leave it alone
+bool I2C_Bus_Idle()
+{
+   pinMode(SDA, INPUT_PULLUP);
+   pinMode(SCL, INPUT_PULLUP);
+   delayMicroseconds(10); // Let the pullups raise the lines
+   return digitalRead(SDA) && digitalRead(SCL);
+}
+
+// Does a device acknowledge its address?
+bool I2C_Probe(uint8_t address)
+{
+   Wire.beginTransmission(address);
+   return Wire.endTransmission() == 0;
+}
+
+void LCD_Init(uint8_t address)
+{
+   LCDAddress = address;
+   LCDFound = true;
+   LCDrefresh = true;
+   lcd.init(LCDAddress,LCDCOLUMNS,LCDROWS);    // Initialize the LCD
+   lcd.backlight();                            // Backlight it
+   LCDwhichBanner = INITIAL;
+   LCDprevTime = micros()+LCDTimePeriod;
+   eeprom_update_byte(&EELCDAddress, LCDAddress); // Remember it for the next boot. No write if unchanged
+
+   return;
+}
+
+// A few addresses of the fallback scan. As with the old full scan, a
+// lone device on the bus is taken to be the LCD.
+void I2C_Scan_Step()
+{
+   for (uint8_t n = 0; (n < I2CSCANPERTICK) && (I2CScanAddress < 127); n++, I2CScanAddress++)
+   {
+      if (I2C_Probe(I2CScanAddress))
+      {
+         I2CScanFound++;
+         LCDAddress = I2CScanAddress;
+      }
+   }
+#if defined(WIRE_HAS_TIMEOUT)
+   if (Wire.getWireTimeoutFlag()) // Bus got stuck: give up on the LCD
+   {
+      Wire.clearWireTimeoutFlag();
+      I2CScanAddress = 0;
+      return;
+   }
+#endif
+   if (I2CScanAddress >= 127)
+   {
+      I2CScanAddress = 0;
+      if (I2CScanFound == 1) LCD_Init(LCDAddress);
+   }
+
+   return;
+}
+
 // USE_LCD //
 /////////////
 #endif
@@ -656,13 +823,70 @@ void LCD_Wait_Period_Over(int status)
 #if defined(TRANSMITTER)
 //{ TRANSMITTER
 
+// Load the frame built by nrfbatch, if any, into the radio's TX FIFO.
+// The radio sends it on its own: nothing here waits for the air.
+// Returns false if the FIFO is full; the frame stays in nrfbatch.
+bool sendFrame() {
+    if (radio.isFifo(true) == 2) {
+       txFifoFull++;
+       return false;
+    }
+    uint8_t n = nrfbTake(payload, micros());
+    if (n) {
+       radio.startFastWrite( payload, n, 1 ); // NOACK: Important for broadcast! CE stays high until the FIFO is empty
+       txFrames++;
+       txSending = true;
+    }
+    return true;
+}
+
+#if defined(NRF_TELEMETRY)
+// Poll the next receiver due, waiting for its ACK (about 1.5 ms), and
+// follow the worst one heard with the power level and copies
+void pollReceiver() {
+    uint8_t ack[NRFB_PAYLOAD], n = 0;
+    uint8_t id = nrftNextPoll(millis());
+    bool ok;
+
+    if (!id) return;
+    radio.openWritingPipe(pipe01 + id);   // Also where the ACK is looked for
+    radio.setRetries(NRFT_ARD, 0);         // An ACK payload at 250 kbps needs the wait
+    ok = radio.write(&id, 1);              // ACK asked for
+    if (ok && radio.available()) {
+       n = radio.getDynamicPayloadSize();
+       if (n > NRFB_PAYLOAD) n = 0;
+       radio.read(ack, n ? n : 1);
+    }
+    radio.setRetries(0,0);
+    radio.openWritingPipe(pipe01);
+    nrftResult(id, ok, ack, n, millis());
+
+#if defined(DEBUG)
+    if (ok) {
+       nrftLink_t *l = &nrftLinks[id];
+       Serial.print("tx: rx "); Serial.print(id,DEC);
+       Serial.print(" answered: "); Serial.print(l->ackPct,DEC);
+       Serial.print("% missed: "); Serial.print(l->lossPct,DEC);
+       Serial.print("% Vcc: "); Serial.print(l->last.vcc*20,DEC); Serial.print(" mV\n");
+    }
+#endif
+
+    if (nrftAdvise(&txCopies, &txPower, nrfCopies, powerLevel, POWERLEVEL_MAX, millis())) {
+       nrfbCopies(txCopies, (uint16_t)nrfSpacingMS*1000);
+       radio.setPALevel(txPower,LNA);
+    }
+}
+#endif
+
 extern void notifyDccMsg( DCC_MSG * Msg ) {
-    // noInterrupts(); // Turning on/off interrupts does not seem to be needed
-    payload[0] = Msg->Size;
-    // for(uint8_t i=0; i<payload[0]; i++) payload[i+1] = Msg->Data[i]; // Slow way
-    memcpy((void *)&payload[1],(void *)&Msg->Data[0],Msg->Size);
-    // interrupts(); // Turning on/off interrupts does not seem to be needed
-    radio.write( payload, payload[0]+1, 1 ); // NOACK: Important for broadcast!
+    uint32_t t = micros();
+    while (!nrfbAdd(Msg, t)) { // A due frame, maybe behind a copy that is due, is still waiting for the FIFO
+       if (!sendFrame()) {     // Still full: the newer packet wins
+          nrfbTake(payload, t);
+          txDropped++;
+       }
+    }
+    if (nrfbDue(t)) sendFrame(); // Without NRF_BATCH, always
 
     msgIndexIn = (msgIndexIn+1) % MAXMSG;
     memcpy((void *)&msg[msgIndexIn],(void *)Msg,sizeof(DCC_MSG));
@@ -858,6 +1082,40 @@ void ops_mode()
                            checkSetDefaultEE(&LNA, &EEisSetLNA, &EELNA, (uint8_t)LNA, 1); // Set powerLevel and reset EEPROM values. Ignore bad values
                            restartModemFlag = 1;
                         break;
+#if defined(TRANSMITTER)
+                        case  252:  // Set the times each frame is sent
+                           if((1<=CVval) && (CVval<=NRFB_COPIESMAX))
+                           {
+                              checkSetDefaultEE(&nrfCopies, &EEisSetnrfCopies, &EEnrfCopies, (uint8_t)CVval, 1);
+#if defined(NRF_TELEMETRY)
+                              txCopies = nrfCopies;
+#endif
+                              nrfbCopies(nrfCopies, (uint16_t)nrfSpacingMS*1000);
+                           }
+                           else
+                              CVStatus = IGNORED;
+                        break;
+                        case  251:  // Set the spacing of the copies in ms
+                           if(CVval<=SPACINGMS_MAX)
+                           {
+                              checkSetDefaultEE(&nrfSpacingMS, &EEisSetnrfSpacingMS, &EEnrfSpacingMS, (uint8_t)CVval, 1);
+#if defined(NRF_TELEMETRY)
+                              nrfbCopies(txCopies, (uint16_t)nrfSpacingMS*1000);
+#else
+                              nrfbCopies(nrfCopies, (uint16_t)nrfSpacingMS*1000);
+#endif
+                           }
+                           else
+                              CVStatus = IGNORED;
+                        break;
+#elif defined(NRF_TELEMETRY)
+                        case  250:  // Set the telemetry ID (0: none). Takes effect on the next power up.
+                           if(CVval<=NRFT_IDS)
+                              checkSetDefaultEE(&nrfTelemID, &EEisSetnrfTelemID, &EEnrfTelemID, (uint8_t)CVval, 1);
+                           else
+                              CVStatus = IGNORED;
+                        break;
+#endif
                         case 29:    // Set the Configuration CV and reset related EEPROM values. Verified this feature works.
                            checkSetDefaultEE(&AirMiniCV29, &EEisSetAirMiniCV29, &EEAirMiniCV29, (uint8_t)CVval, 1); 
                            AirMiniCV29Bit5 = AirMiniCV29 & 0b00100000; // Save the bit 5 value of CV29 (0: Short address, 1: Long address)
@@ -919,6 +1177,10 @@ void ops_mode()
                      {
                         radio.setChannel(CHANNEL); 
                         radio.setPALevel(powerLevel,LNA); 
+#if defined(TRANSMITTER) && defined(NRF_TELEMETRY)
+                        txPower = powerLevel;
+#endif
+                        nrfbResync();
                      }
 
                   } // end of if(!memcmp...
@@ -945,54 +1207,134 @@ void ops_mode()
 
 #if defined(RECEIVER)
 //{ RECEIVER
+// Look for the transmitter (nrfscan.h): the stored channel first, then
+// sweeps of all the channels reading the received power detector, then
+// the channels that had power, until a good frame is decoded
 void channel_search() {
+   uint8_t ch;
+
+   now = micros();
+   ch = nrfsPoll(now, rxHeard, nrfsSampling() && radio.testRPD());
+   rxHeard = false;
+   if (ch == NRFS_STAY) return;
 
-   // If we received a valid DCC signal during the intial wait period, stop waiting and proceed normally
-   if (timeOfValidDCC > startInitialWaitTime) 
+   if (ch == NRFS_FOUND) 
    {
       initialWait = 0; 
 #if defined(USE_LCD)
       if (LCDFound) LCD_Wait_Period_Over(1);
 #endif
+      return;
    }
-   else  // Othewise, continue to wait
+
+   if (ch == NRFS_GIVEUP) 
+   // Last resort
    {
-      now = micros();
-      // If it's too long, then reset the modem to the next channel
-      if (now > endInitialWaitTime) 
-      {
+      initialWait = 0;
+      ch = CHANNELDEFAULT;    // Reset to the last resort channel
+   }
+
+   // Set the radio to the new channel. Frames still in the RX FIFO came on the old one.
+   CHANNEL = ch;
+   radio.setChannel(CHANNEL); 
+   radio.setPALevel(powerLevel,LNA); 
+   radio.flush_rx();
+   nrfbResync(); // Another transmitter, maybe
 #if defined(USE_LCD)
-         if (LCDFound) LCD_Wait_Period_Over(0);
+   if (!initialWait && LCDFound) LCD_Wait_Period_Over(0);
 #endif
-         if (++searchChannelIndex <= CHANNELS_MAX+1)
-         // Keep searching...
-         {
-            // Update the seach channel and endInitialWaitTime
-            CHANNEL = searchChannelIndex-1;
-            // Re-initialize the start of the wait time
-            startInitialWaitTime = now;      
-            // Re-initialize the end of the wait time
-            endInitialWaitTime = 
-                startInitialWaitTime
-              + (uint64_t)InitialWaitPeriodSEC * SEC; 
-         }
-         else 
-         // Last resort
-         {
-            initialWait = 0;
-            CHANNEL=CHANNELDEFAULT;    // Reset to the last resort channel
-         }
-
-         // Set the radio to the new channel
-         radio.setChannel(CHANNEL); 
-         radio.setPALevel(powerLevel,LNA); 
 
-      } // end of wait time over
-   } // end of continue to wait
 } // end of channel_search
 //} RECEIVER
 #endif
 
+#if defined(RECEIVER)
+//{ RECEIVER
+
+#if defined(NRF_IRQ)
+// The nRF24 pulls its IRQ pin low for a received frame (the other
+// sources are masked) until the frame's RX_DR is cleared by read()
+ISR(PCINT0_vect) {
+   if (bit_is_clear(PINB, PB0)) rxReady = true;
+}
+#endif
+
+#if defined(NRF_TELEMETRY)
+// Supply voltage in 20 mV units, from the 1.1 V bandgap measured against
+// AVcc. The conversion started here is read at the next call: no waiting.
+uint8_t vcc20mV() {
+   static uint8_t v = 0;
+   if (bit_is_clear(ADCSRA, ADSC)) {
+      uint16_t adc = ADC;
+      if (adc) v = (uint8_t)min(255UL, 1125300UL / adc / 20); // 1.1 V * 1023, in mV
+      ADCSRA |= _BV(ADSC);
+   }
+   return v;
+}
+
+// Load the report the ACK of the next poll carries
+void telemReply() {
+   nrftReport_t r;
+   uint8_t buf[NRFT_REPORT];
+
+   r.id = nrfTelemID;
+   r.frames = nrfbRx.frames;
+   r.lost = nrfbRx.lost;
+   r.fifoFull = rxFifoFull;
+   r.vcc = vcc20mV();
+   r.copies = nrfbRx.copies;
+   radio.flush_tx(); // Only the newest report waits
+   radio.writeAckPayload(NRFT_PIPE, buf, nrftPack(&r, buf));
+}
+#endif
+
+// Read every frame waiting in the RX FIFO into the ring. ops: run
+// ops mode on each packet but the last, which loop() does; false from the
+// middle of a display update, where only the last one reaches ops mode.
+void rxDrain(bool ops) {
+   uint8_t Size, n;
+   DCC_MSG rxMsg[NRFB_RECORDS];
+
+#if defined(NRF_IRQ)
+   rxReady = false;
+#endif
+   if (!radio.available(&whatChannel)) return;
+   if (radio.rxFifoFull()) rxFifoFull++; // Frames may have been lost meanwhile
+
+   do {
+      Size = radio.getDynamicPayloadSize();
+      radio.read( &payload, Size );
+#if defined(NRF_TELEMETRY)
+      if (whatChannel == NRFT_PIPE) { // A poll: its ACK took the report, load the next
+         telemReply();
+         continue;
+      }
+#endif
+      n = nrfbUnpack(payload, Size, rxMsg, micros()); // One packet, or a batch of them
+      if (n && nrfsGood(rxMsg, n)) rxHeard = true;
+      for (uint8_t i = 0; i < n; i++) {
+#if defined(USE_OPS_MODE)
+         if (ops && newMsg) ops_mode(); // The packet before this one, still at dccptrIn
+#endif
+         noInterrupts();
+         msgIndexIn = (msgIndexIn+1) % MAXMSG;
+         msg[msgIndexIn].Size = rxMsg[i].Size;
+         memcpy((void *)&msg[msgIndexIn].Data[0],(void *)&rxMsg[i].Data[0],rxMsg[i].Size);
+         dccptrIn = &msg[msgIndexIn];
+         timeOfValidDCC = micros();
+         interrupts();
+         newMsg = true;
+      }
+#if defined(DEBUG)
+      if (n && !print_count) printMsgSerial();
+      print_count = (print_count+1) % PRINT_MAX;
+#endif
+   } while (radio.available(&whatChannel));
+}
+
+//} RECEIVER
+#endif
+
 void setup() {
 #if defined(DEBUG)
    Serial.begin(115200);
@@ -1043,6 +1385,27 @@ void setup() {
   checkSetDefaultEE(&AirMiniCV29, &EEisSetAirMiniCV29, &EEAirMiniCV29,  AIRMINICV29DEFAULT, SET_DEFAULT);  // Set CV29 so that it will use a long address
   AirMiniCV29Bit5 = AirMiniCV29 & 0b00100000;                                    // Save the bit 5 value of CV29 (0: Short address, 1: Long address)
 
+#if defined(TRANSMITTER)
+//{ TRANSMITTER
+  checkSetDefaultEE(&nrfCopies, &EEisSetnrfCopies, &EEnrfCopies, NRF_COPIESDEFAULT, SET_DEFAULT);
+  if((nrfCopies < 1) || (nrfCopies > NRFB_COPIESMAX))
+      checkSetDefaultEE(&nrfCopies, &EEisSetnrfCopies, &EEnrfCopies, NRF_COPIESDEFAULT, 1);
+  checkSetDefaultEE(&nrfSpacingMS, &EEisSetnrfSpacingMS, &EEnrfSpacingMS, NRF_SPACINGMSDEFAULT, SET_DEFAULT);
+  if(nrfSpacingMS > SPACINGMS_MAX)
+      checkSetDefaultEE(&nrfSpacingMS, &EEisSetnrfSpacingMS, &EEnrfSpacingMS, NRF_SPACINGMSDEFAULT, 1);
+#if defined(NRF_TELEMETRY)
+  txCopies = nrfCopies;
+  txPower = powerLevel;
+#endif
+//} TRANSMITTER
+#elif defined(NRF_TELEMETRY)
+//{ RECEIVER
+  checkSetDefaultEE(&nrfTelemID, &EEisSetnrfTelemID, &EEnrfTelemID, 0, SET_DEFAULT);
+  if(nrfTelemID > NRFT_IDS)
+      checkSetDefaultEE(&nrfTelemID, &EEisSetnrfTelemID, &EEnrfTelemID, 0, 1);
+//} RECEIVER
+#endif
+
 #if defined(RECEIVER)
 //{ RECEIVER
   // Set whether to always use modem data on transmit
@@ -1116,6 +1479,16 @@ void setup() {
 // Transmitter-specific
 #if defined(TRANSMITTER)
    radio.setRetries(0,0); // delay, count - Important for tranmitter broadcast!
+#if defined(NRF_BATCH)
+   nrfbBegin(1, NRF_BATCHFLUSHUS);
+#else
+   nrfbBegin(0, 0);
+#endif
+   nrfbCopies(nrfCopies, (uint16_t)nrfSpacingMS*1000);
+#if defined(NRF_TELEMETRY)
+   radio.enableAckPayload();
+   nrftBegin();
+#endif
 #endif
 
    radio.setPALevel(powerLevel,LNA); // Set the power level and LNA
@@ -1131,7 +1504,24 @@ void setup() {
 //{ RECEIVER
    radio.openWritingPipe(pipe00);
    radio.openReadingPipe(1, pipe01);
+#if defined(NRF_TELEMETRY)
+   if (nrfTelemID) {
+      ADMUX = _BV(REFS0) | 0x0E;                      // AVcc reference, the bandgap in
+      ADCSRA = _BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0); // 125 kHz ADC clock
+      radio.enableAckPayload();
+      radio.openReadingPipe(NRFT_PIPE, pipe01 + nrfTelemID); // Shares the upper bytes with pipe 1
+   }
+#endif
    radio.startListening();
+#if defined(NRF_TELEMETRY)
+   if (nrfTelemID) telemReply();
+#endif
+#if defined(NRF_IRQ)
+   radio.maskIRQ(1,1,0); // tx_ok, tx_fail, rx_ready: only received frames pull the IRQ pin
+   pinMode(NRF_IRQ_PIN, INPUT_PULLUP);
+   PCMSK0 |= _BV(PCINT0);
+   PCICR |= _BV(PCIE0);
+#endif
 //} RECEIVER
 #endif
  
@@ -1158,10 +1548,7 @@ void setup() {
    timeOfValidDCC = micros();
 
    initialWait = 1;
-   startInitialWaitTime = timeOfValidDCC;      // Initialize the start of the wait time (never is not a good value)
-   endInitialWaitTime = 
-      startInitialWaitTime
-    + (uint64_t)InitialWaitPeriodSEC * SEC; // Initialize the end of the wait time
+   nrfsBegin(CHANNEL, timeOfValidDCC, (uint32_t)(CHANNELS_MAX+2) * InitialWaitPeriodSEC * 1000UL); // Same limit as stepping through the channels
 
 //} RECEIVER
 #endif
@@ -1182,31 +1569,26 @@ void loop(){
 #if defined(TRANSMITTER)
 //{ TRANSMITTER
 
-   Dcc.process(); // The DCC library does it all with the callback notifyDccMsg!
+   Dcc.process(DCC_RX_QUEUE); // The DCC library does it all with the callback notifyDccMsg! All it has queued, after a slow pass
+   if (nrfbDue(micros())) sendFrame(); // A batch frame that has waited long enough, or one that found the FIFO full
+   if (txSending && radio.isFifo(true, true)) { // All sent: back to Standby-I
+      radio.txStandBy();
+      txSending = false;
+   }
+#if defined(NRF_TELEMETRY)
+   if (!txSending && !nrfbDue(micros())) pollReceiver(); // Only with the TX FIFO empty: the address changes
+#endif
 
 //} TRANSMITTER
 #else
 //{ RECEIVER
 
-   uint8_t Size;
-   if ( radio.available(&whatChannel) ) {
-      Size = radio.getDynamicPayloadSize();
-      radio.read( &payload, Size );
-      noInterrupts();
-      msgIndexIn = (msgIndexIn+1) % MAXMSG;
-      msg[msgIndexIn].Size = payload[0];
-      memcpy((void *)&msg[msgIndexIn].Data[0],(void *)&payload[1],payload[0]);
-      dccptrIn = &msg[msgIndexIn];
-      newMsg = true;
-      timeOfValidDCC = micros();
-      interrupts();
-#if defined(DEBUG)
-      if (!print_count) printMsgSerial();
-      print_count = (print_count+1) % PRINT_MAX;
+#if defined(NRF_IRQ)
+   if (rxReady || bit_is_clear(PINB, PB0)) rxDrain(true); // The pin too: a frame may have come in before rxReady was cleared
+#else
+   rxDrain(true);
 #endif
 
-   }
-
 //} RECEIVER
 #endif
 
@@ -1217,43 +1599,37 @@ void loop(){
 
       lcdInitialized = true;
 
-      // Scan for I2C devices
-      Wire.begin(); // Wire communication begin
-      byte nDevices = 0;
-      byte address;
-      byte error;
-      for (address = 1; address < 127; address++ )
+      // Look for the LCD: the address found last time, then the usual ones.
+      // Anything else is left to a scan spread over the following loop passes
+      LCDFound = false;
+      LCDrefresh = false;
+      if (I2C_Bus_Idle())
       {
-         // The i2c_scanner uses the return value of
-         // the Write.endTransmisstion to see if
-         // a device did acknowledge to the address.
-         Wire.beginTransmission(address);
-         error = Wire.endTransmission();
-     
-         if (error == 0)
+         Wire.begin(); // Wire communication begin
+#if defined(WIRE_HAS_TIMEOUT)
+         Wire.setWireTimeout(I2CTIMEOUTUS, true); // Never hang on a stuck bus
+#endif
+         uint8_t address = eeprom_read_byte(&EELCDAddress);
+         if ((address == 0) || (address > 126) || !I2C_Probe(address))
          {
-           nDevices++;
-           LCDAddress = address;
+            address = 0;
+            for (uint8_t i = 0; i < sizeof(LCDKnownAddress); i++)
+            {
+               if (I2C_Probe(pgm_read_byte(&LCDKnownAddress[i])))
+               {
+                  address = pgm_read_byte(&LCDKnownAddress[i]);
+                  break;
+               }
+            }
          }
-      }
-
-      if (nDevices == 1)
-      {
-         LCDFound = true;
-         LCDrefresh = true;
-         lcd.init(LCDAddress,LCDCOLUMNS,LCDROWS);    // Initialize the LCD
-         lcd.backlight();                            // Backlight it
-         LCDwhichBanner = INITIAL;
-         LCDprevTime = now+LCDTimePeriod;
-      }
-      else 
-      {
-         LCDFound = false;
-         LCDrefresh = false;
+         if (address) LCD_Init(address);
+         else I2CScanAddress = 1;
       }
 
    }
 
+   if (I2CScanAddress) I2C_Scan_Step(); // Background fallback scan for the LCD
+
    if(LCDrefresh && ((now-LCDprevTime) >= LCDTimePeriod)) {
        if (LCDwhichBanner==NONE) LCD_Addr_Ch_PL();           // Update the display of address, chanel #, and power level
        else if(!initialWait) {
@@ -0,0 +1,265 @@
+/*
+nrfbatch.cpp
+
+Several DCC packets per nRF24 payload: transmitter framing and receiver
+unpacking. See nrfbatch.h for the frame format.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "nrfbatch.h"
+#include <string.h>
+
+nrfbStats_t nrfbRx;
+
+static uint8_t frame[NRFB_PAYLOAD];
+static uint8_t len = 0;        // 0: no open frame
+static uint8_t closed = 0;     // Due: waiting for nrfbTake
+static uint8_t seq = 0;
+static uint8_t batching = 0;
+static uint16_t flush = 0;
+static uint32_t since;         // When the oldest packet of the frame was added
+static uint8_t copies = 1;
+static uint16_t spacing = 0;
+typedef struct {
+  uint8_t frame[NRFB_PAYLOAD];
+  uint8_t len;
+  uint8_t left;                // Copies still owed. 0: free
+  uint32_t at;                 // When the next one is due
+} nrfbOwed_t;
+static nrfbOwed_t owed[NRFB_OWED];  // Frames taken with copies owed
+
+static uint8_t lastSeq = 0xFF; // Receiver. 0xFF: none yet
+static uint8_t taken;          // Bit n: frame lastSeq-n was unpacked
+static uint32_t lastAt;        // When it was taken
+static uint16_t keys[NRFB_WINDOW][NRFB_RECORDS];  // keys[n]: stateKey() of the packets taken from frame lastSeq-n
+static uint8_t nKeys[NRFB_WINDOW];
+
+void nrfbBegin(uint8_t batch, uint16_t flushUs) {
+  batching = batch;
+  flush = flushUs;
+  len = 0;
+  closed = 0;
+  memset(owed, 0, sizeof(owed));
+}
+
+void nrfbCopies(uint8_t n, uint16_t spacingUs) {
+  copies = (n < 1) ? 1 : (n > NRFB_COPIESMAX) ? NRFB_COPIESMAX : n;
+  spacing = spacingUs;
+  memset(owed, 0, sizeof(owed));
+}
+
+uint8_t nrfbAdd(const DCC_MSG *Msg, uint32_t now) {
+  uint8_t size = Msg->Size;
+
+  if (closed) return 0;
+  if (size > NRFB_MAXSIZE) return 1;  // Not a DCC packet: nothing to send
+
+  if (!batching && (copies < 2)) {
+     frame[0] = size;
+     memcpy(&frame[1], (const void *)&Msg->Data[0], size);
+     len = 1 + size;
+     closed = 1;
+     return 1;
+  }
+
+  if (!len) {
+     frame[0] = NRFB_BATCH | seq;
+     len = 1;
+     since = now;
+  }
+  frame[len++] = size;
+  memcpy(&frame[len], (const void *)&Msg->Data[0], size);
+  len += size;
+  if (!batching || (len > NRFB_PAYLOAD - (1+NRFB_MAXSIZE))) closed = 1;  // The next packet might not fit
+  return 1;
+}  // end of nrfbAdd
+
+// The copy owed that has waited longest past its time, 0 if none is due
+static nrfbOwed_t *owedDue(uint32_t now) {
+  nrfbOwed_t *o = 0;
+
+  for (uint8_t i = 0; i < NRFB_OWED; i++) {
+     if (!owed[i].left || ((int32_t)(now - owed[i].at) < 0)) continue;
+     if (!o || ((int32_t)(owed[i].at - o->at) < 0)) o = &owed[i];
+  }
+  return o;
+}
+
+uint8_t nrfbDue(uint32_t now) {
+  return closed || (len && ((now - since) >= flush)) || owedDue(now);
+}
+
+uint8_t nrfbTake(uint8_t *out, uint32_t now) {
+  uint8_t n = len;
+  nrfbOwed_t *o = owedDue(now);
+
+  if (o) {
+     memcpy(out, o->frame, o->len);
+     o->left--;
+     o->at = now + spacing;
+     return o->len;
+  }
+  if (!n) return 0;
+  memcpy(out, frame, n);
+  len = 0;
+  closed = 0;
+  if (batching || (copies > 1)) seq = (seq+1) & NRFB_SEQMASK;
+  if (copies > 1) {  // A free entry, else the one sent most, oldest first
+     o = &owed[0];
+     for (uint8_t i = 1; (i < NRFB_OWED) && o->left; i++) {
+        if ((owed[i].left < o->left) || ((owed[i].left == o->left) && ((int32_t)(owed[i].at - o->at) < 0))) o = &owed[i];
+     }
+     memcpy(o->frame, out, n);
+     o->len = n;
+     o->left = copies-1;
+     o->at = now + spacing;
+  }
+  return n;
+}  // end of nrfbTake
+
+static uint8_t record(const uint8_t *p, uint8_t left, DCC_MSG *out) {
+  uint8_t size = p[0];
+
+  if ((size < NRFB_MINSIZE) || (size > NRFB_MAXSIZE) || (1+size > left)) return 0;
+  out->Size = size;
+  out->PreambleBits = 0;
+  memcpy((void *)&out->Data[0], &p[1], size);
+  return 1+size;
+}
+
+// The decoder state a packet sets: its address and instruction group, so
+// that a newer speed packet for a loco has the key of an older one. A
+// 14-bit address may share its keys with another address: a late packet
+// for it is then left out when it need not be. NRFB_BROADCAST for a
+// broadcast, NRFB_NOKEY for an idle packet.
+#define NRFB_BROADCAST 0x0000
+#define NRFB_NOKEY     0x00FF
+static uint16_t stateKey(const DCC_MSG *m) {
+  const uint8_t *d = (const uint8_t *)&m->Data[0];
+  uint8_t a = d[0], i;
+
+  if (a == 0) return NRFB_BROADCAST;
+  if (a == 0xFF) return NRFB_NOKEY;
+  if ((a >= 128) && (a < 192)) return ((uint16_t)(d[1] & 0x76) << 8) | a;  // Accessory: board and output pair, not the direction
+  if (a < 128) {
+     i = d[1];
+  } else {
+     a = d[1] ^ (uint8_t)((a & 0x3F) * 41);  // 14-bit: the low byte, the high bits folded in
+     i = d[2];
+  }
+  switch (i >> 5) {
+     case 1: case 2: case 3: i = 0x20; break;  // Speed and direction, both forms
+     case 5: i &= 0xF0; break;                 // F5-F8 or F9-F12
+     case 6: case 7: break;                    // Feature expansion, CV access: all of it
+     default: i &= 0xE0; break;
+  }
+  return ((uint16_t)i << 8) | a;
+}
+
+// A frame newer than frame lastSeq-back set the state of key, or a newer
+// broadcast came; for a broadcast, any packet taken from a newer frame
+static uint8_t superseded(uint16_t key, uint8_t back) {
+  for (uint8_t f = 0; f < back; f++) {
+     if (nKeys[f] && (key == NRFB_BROADCAST)) return 1;
+     for (uint8_t k = 0; k < nKeys[f]; k++) {
+        if ((keys[f][k] == key) || (keys[f][k] == NRFB_BROADCAST)) return 1;
+     }
+  }
+  return 0;
+}
+
+uint8_t nrfbUnpack(const uint8_t *in, uint8_t inLen, DCC_MSG *out, uint32_t now) {
+  uint8_t i, n = 0, r;
+
+  if (!inLen) return 0;
+  nrfbRx.frames++;
+
+  if (!(in[0] & NRFB_BATCH)) {  // One packet, no header
+     if (record(in, inLen, out)) n = 1;
+     else nrfbRx.bad++;
+     nrfbRx.packets += n;
+     return n;
+  }
+
+  uint8_t s = in[0] & NRFB_SEQMASK;
+  if ((lastSeq != 0xFF) && ((now - lastAt) >= NRFB_STALEUS)) {
+     lastSeq = 0xFF;  // A fade: the transmitter may have gone round the sequence numbers since
+  }
+  uint8_t back = (lastSeq - s) & NRFB_SEQMASK;
+  if ((lastSeq != 0xFF) && (back < NRFB_WINDOW)) {  // Not newer than the last
+     if (taken & (1 << back)) {  // Taken already: a copy
+        nrfbRx.copies++;
+        return 0;
+     }
+     taken |= 1 << back;         // Its first was missed; a copy came after a newer frame
+     if (nrfbRx.lost) nrfbRx.lost--;
+     nrfbRx.late++;
+  } else {
+     if (lastSeq == 0xFF) {
+        taken = 0;
+        back = NRFB_WINDOW;
+     } else {
+        uint8_t ahead = (s - lastSeq) & NRFB_SEQMASK;
+        nrfbRx.lost += ahead - 1;
+        taken = (ahead < NRFB_WINDOW) ? (taken << ahead) : 0;
+        back = (ahead < NRFB_WINDOW) ? ahead : NRFB_WINDOW;
+     }
+     memmove(&keys[back], &keys[0], (NRFB_WINDOW - back) * sizeof(keys[0]));
+     memmove(&nKeys[back], &nKeys[0], NRFB_WINDOW - back);
+     memset(nKeys, 0, back);
+     back = 0;
+     taken |= 1;
+     lastSeq = s;
+     lastAt = now;
+  }
+  nrfbRx.batches++;
+
+  for (i = 1; (i < inLen) && (n < NRFB_RECORDS); i += r) {
+     r = record(&in[i], inLen - i, &out[n]);
+     if (!r) {
+        nrfbRx.bad++;
+        break;
+     }
+     uint16_t k = stateKey(&out[n]);
+     if (k == NRFB_NOKEY) {
+        n++;
+        continue;
+     }
+     if (back && superseded(k, back)) {  // A newer frame set this state: the late packet would undo it
+        nrfbRx.superseded++;
+        continue;
+     }
+     keys[back][nKeys[back]++] = k;
+     n++;
+  }
+  nrfbRx.packets += n;
+  return n;
+}  // end of nrfbUnpack
+
+void nrfbResync(void) {
+  lastSeq = 0xFF;
+}
\ No newline at end of file
@@ -0,0 +1,123 @@
+/*
+nrfbatch.h
+
+Several DCC packets per nRF24 payload.
+
+Byte 0 of a batch frame is NRFB_BATCH with a 7-bit sequence number; the
+records follow, each one the packet's size and its bytes (XOR included).
+A frame from an older transmitter is a single record with no header: its
+first byte is the packet size, never above 6, so the receiver tells the
+two apart from bit 7 and takes either.
+
+The transmitter adds packets to the open frame. The frame is due when a
+largest packet would no longer fit or when its oldest packet has waited
+the flush time, and it is sent whole. Without batching every packet is
+its own frame, as before.
+
+For redundancy the transmitter can send each frame more than once, the
+copies spaced in time so that a burst of interference shorter than the
+spacing leaves one of them. Copies need the sequence number: without
+batching, frames then carry one packet in the batch format. New frames
+go out while a frame's copies wait their spacing, so a copy can come
+after newer frames. The receiver drops a frame it has already taken.
+When it takes a copy of a missed frame after a newer one, it leaves out
+the packets for an address and instruction group (speed, a function
+group, ...) that a newer frame had a packet for, and all of them after a
+newer broadcast: a late packet would undo a newer command, e.g., restart
+a loco that an e-stop stopped.
+
+The receiver counts frames missed from gaps in the sequence numbers.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef NRFBATCH_H_
+#define NRFBATCH_H_
+
+#include <stdint.h>
+#include <NmraDcc.h>
+
+#define NRFB_PAYLOAD 32                    // nRF24 payload limit
+#define NRFB_BATCH   0x80                  // Byte 0 of a batch frame: this bit and the sequence number
+#define NRFB_SEQMASK 0x7F
+#define NRFB_MINSIZE 3                     // DCC packet sizes, XOR included
+#define NRFB_MAXSIZE 6
+#define NRFB_RECORDS ((NRFB_PAYLOAD-1)/(1+NRFB_MINSIZE))  // Most packets in a frame
+#define NRFB_COPIESMAX 3                   // Times a frame may be sent
+#define NRFB_OWED    3                     // Frames that can have copies owed at once
+#define NRFB_WINDOW  8                     // Frames this far behind the newest are copies
+#define NRFB_STALEUS 250000UL              // No frame for this long: the next one is new, whatever its sequence number
+
+typedef struct {
+  uint32_t frames;   // Frames taken by nrfbUnpack
+  uint32_t batches;  // Of which batch frames, copies left out
+  uint32_t packets;  // Packets unpacked
+  uint32_t lost;     // Batch frames missed, from the sequence numbers (not across a fade of NRFB_STALEUS)
+  uint32_t copies;   // Frames dropped as copies of ones already taken
+  uint32_t late;     // Frames taken after a newer one: a copy of one whose first was missed
+  uint32_t superseded;  // Packets of late frames dropped: a newer frame had one for the same state
+  uint32_t bad;      // Frames with a bad record (the rest of the frame is dropped)
+} nrfbStats_t;
+
+extern nrfbStats_t nrfbRx;
+
+// Transmitter
+
+// batching 0: one packet per frame, the old format. flushUs: longest a
+// packet waits in an open batch frame.
+void nrfbBegin(uint8_t batching, uint16_t flushUs);
+
+// Add a packet to the open frame; now is micros(). Returns 0 if the frame
+// is due and has not been taken yet: the packet was not added.
+uint8_t nrfbAdd(const DCC_MSG *Msg, uint32_t now);
+
+// The frame should be sent now
+uint8_t nrfbDue(uint32_t now);
+
+// Send each frame copies times in all (1 to NRFB_COPIESMAX), spacingUs
+// apart at least. Old receivers need 1 and no batching.
+void nrfbCopies(uint8_t copies, uint16_t spacingUs);
+
+// Copy out the next frame to send (up to NRFB_PAYLOAD bytes): a copy
+// owed whose time has come, else the open frame, which is closed and a
+// new one started; now is micros(). A copy waits its spacing and new
+// frames go out meanwhile; past NRFB_OWED frames, the copies left of the
+// one sent most are given up. Returns its length, 0 if there is nothing to send.
+uint8_t nrfbTake(uint8_t *frame, uint32_t now);
+
+// Receiver
+
+// Unpack a received frame of either format into out[NRFB_RECORDS], in
+// order; now is micros(). Returns the number of packets, 0 for a copy of
+// a frame already unpacked. A copy of a missed frame may come after a
+// newer one: its packets are then late, by the copies' spacing at most,
+// and those for a state that a newer frame set are left out.
+uint8_t nrfbUnpack(const uint8_t *frame, uint8_t len, DCC_MSG *out, uint32_t now);
+
+// Forget the last sequence number, e.g., after a channel change
+void nrfbResync(void);
+
+#endif /* NRFBATCH_H_ */
\ No newline at end of file
@@ -0,0 +1,166 @@
+/*
+nrfscan.cpp
+
+Fast channel scan for the nRF24 receiver: energy ranking and the scan
+itself. See nrfscan.h.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "nrfscan.h"
+#include <string.h>
+
+#define SWEEP  0
+#define VERIFY 1
+
+static uint8_t score[NRFS_CHANNELS];
+
+static uint8_t state;
+static uint8_t cur;                  // Channel listened to
+static uint8_t sweepAt;              // Next channel of the sweep
+static uint8_t cands[NRFS_VERIFY];
+static uint8_t nCands, candAt;
+static uint8_t energySeen;
+static uint32_t since;               // When cur was tuned
+static uint32_t dwell;               // us per channel this sweep
+static uint32_t started;
+static uint32_t budget;              // us
+
+void nrfsClear(void) {
+  memset(score, 0, sizeof(score));
+}
+
+void nrfsEnergy(uint8_t ch) {
+  if (ch >= NRFS_CHANNELS) return;
+  score[ch] = (score[ch] > 255 - NRFS_HIT) ? 255 : score[ch] + NRFS_HIT;
+}
+
+void nrfsAge(void) {
+  for (uint8_t ch = 0; ch < NRFS_CHANNELS; ch++) score[ch] >>= 1;
+}
+
+void nrfsReject(uint8_t ch) {
+  if (ch < NRFS_CHANNELS) score[ch] = 0;
+}
+
+static uint8_t side(int16_t ch) {
+  return ((ch >= 0) && (ch < NRFS_CHANNELS)) ? score[ch] : 0;
+}
+
+// A transmitter is under 1 MHz wide, a Wi-Fi network 20: count only the
+// score above that of the channels 2 and 3 MHz away. The next channels
+// are left out, a strong transmitter nearby spills into them.
+static uint8_t narrow(uint8_t ch) {
+  uint8_t s = side(ch-2);
+
+  if (side(ch+2) > s) s = side(ch+2);
+  if (side(ch-3) > s) s = side(ch-3);
+  if (side(ch+3) > s) s = side(ch+3);
+  return (score[ch] > s) ? score[ch] - s : 0;
+}
+
+uint8_t nrfsRank(uint8_t *out, uint8_t max) {
+  uint8_t key[NRFS_VERIFY];
+  uint8_t n = 0, i, j, ch, k;
+
+  if (max > NRFS_VERIFY) max = NRFS_VERIFY;
+  for (ch = 0; ch < NRFS_CHANNELS; ch++) {
+     if (!score[ch] || !(k = narrow(ch))) continue;
+     // Insertion into out[], hottest first; a tie keeps the lower channel ahead
+     for (i = n; (i > 0) && (key[i-1] < k); i--);
+     if (i >= max) continue;
+     if (n < max) n++;
+     for (j = n-1; j > i; j--) {
+        out[j] = out[j-1];
+        key[j] = key[j-1];
+     }
+     out[i] = ch;
+     key[i] = k;
+  }
+  return n;
+}  // end of nrfsRank
+
+uint8_t nrfsGood(const DCC_MSG *m, uint8_t n) {
+  for (uint8_t k = 0; k < n; k++) {
+     uint8_t x = 0;
+     for (uint8_t i = 0; i < m[k].Size; i++) x ^= m[k].Data[i];
+     if (x) return 0;
+  }
+  return n;
+}
+
+static uint8_t tune(uint8_t ch, uint32_t now) {
+  cur = ch;
+  since = now;
+  energySeen = 0;
+  return ch;
+}
+
+void nrfsBegin(uint8_t ch, uint32_t now, uint32_t budgetMs) {
+  nrfsClear();
+  started = now;
+  budget = budgetMs * 1000UL;
+  cands[0] = (ch < NRFS_CHANNELS) ? ch : NRFS_CHANNELS-1;
+  nCands = 1;
+  candAt = 0;
+  state = VERIFY;
+  dwell = NRFS_DWELLUS;
+  tune(cands[0], now);
+}
+
+uint8_t nrfsSampling(void) {
+  return state == SWEEP;
+}
+
+uint8_t nrfsPoll(uint32_t now, uint8_t heard, uint8_t energy) {
+  if (heard) return NRFS_FOUND;
+  if (now - started >= budget) return NRFS_GIVEUP;
+
+  if (state == SWEEP) {
+     energySeen |= energy;
+     if (now - since < dwell) return NRFS_STAY;
+     if (energySeen) nrfsEnergy(cur);
+     if (sweepAt < NRFS_CHANNELS) return tune(sweepAt++, now);
+     nCands = nrfsRank(cands, NRFS_VERIFY);  // This sweep counts in full, older ones less
+     nrfsAge();
+     // Frames further apart than the dwell, or the dwell falling between
+     // them each time: listen longer next sweep
+     if (dwell < NRFS_DWELLMAXUS) dwell += dwell/2;
+     candAt = 0;
+     sweepAt = 0;
+     if (!nCands) return tune(sweepAt++, now);
+     state = VERIFY;
+     return tune(cands[0], now);
+  }
+
+  // VERIFY
+  if (now - since < NRFS_VERIFYUS) return NRFS_STAY;
+  nrfsReject(cur);
+  if (++candAt < nCands) return tune(cands[candAt], now);
+  state = SWEEP;
+  sweepAt = 0;
+  return tune(sweepAt++, now);
+}  // end of nrfsPoll
\ No newline at end of file
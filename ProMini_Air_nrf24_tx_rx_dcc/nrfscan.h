@@ -0,0 +1,104 @@
+/*
+nrfscan.h
+
+Fast channel scan for the nRF24 receiver.
+
+The channel used last is listened to first. Then each channel gets a
+short dwell, sampling the received power detector (testRPD) all along:
+a transmitter's frames show up as energy even when none is decoded in
+the dwell. Energy adds to a channel's score, and scores halve every
+sweep. After each sweep the hottest channels are verified, listening on
+each for long enough to decode a frame; energy spread over several
+channels, Wi-Fi say, does not count. A frame decoded at any time,
+with good DCC checksums, ends the scan on that channel.
+
+The ranking is kept apart from the radio so that it can be run on a host
+(sim/nrf24sim.cpp): the caller does the tuning, reads the detector when
+nrfsSampling() says so, and reports decoded frames.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef NRFSCAN_H_
+#define NRFSCAN_H_
+
+#include <stdint.h>
+#include <NmraDcc.h>
+
+#define NRFS_CHANNELS 126            // 0-125: RF24::setChannel() stops at 125
+
+// Time on each channel of the first sweep. Longer than the gap between
+// the transmitter's frames and every channel carrying one is caught in
+// one sweep. Each sweep after that listens half as long again, up to
+// NRFS_DWELLMAXUS, for long DCC packets and batched frames.
+#if !defined(NRFS_DWELLUS)
+#define NRFS_DWELLUS 10000UL
+#endif
+#if !defined(NRFS_DWELLMAXUS)
+#define NRFS_DWELLMAXUS 30000UL
+#endif
+
+// Time to decode a frame on a candidate: a few frame periods, batched
+#if !defined(NRFS_VERIFYUS)
+#define NRFS_VERIFYUS 40000UL
+#endif
+
+#define NRFS_VERIFY 3                // Candidates verified after a sweep
+#define NRFS_HIT    64               // Score for energy in a dwell
+
+// nrfsPoll() results other than a channel to tune to
+#define NRFS_STAY   0xFF             // Keep listening
+#define NRFS_FOUND  0xFE             // A frame was decoded on this channel
+#define NRFS_GIVEUP 0xFD             // Nothing found in the time allowed
+
+// Start a scan at now (micros()), listening on channel first, for at
+// most budgetMs. The radio is assumed to be on channel already.
+void nrfsBegin(uint8_t channel, uint32_t now, uint32_t budgetMs);
+
+// The next nrfsPoll() wants the received power detector
+uint8_t nrfsSampling(void);
+
+// Call from loop(). heard: a good frame was decoded since the last call;
+// energy: testRPD(), if nrfsSampling(). Returns the channel to tune to
+// (then flush the RX FIFO: frames from the old channel must not count),
+// or one of NRFS_STAY, NRFS_FOUND, NRFS_GIVEUP.
+uint8_t nrfsPoll(uint32_t now, uint8_t heard, uint8_t energy);
+
+// All n packets have a good XOR byte
+uint8_t nrfsGood(const DCC_MSG *m, uint8_t n);
+
+// The ranking, used by nrfsPoll()
+void nrfsClear(void);
+void nrfsEnergy(uint8_t channel);    // Energy seen in a dwell
+void nrfsAge(void);                  // A sweep is over: halve the scores
+void nrfsReject(uint8_t channel);    // Verified and nothing decoded: forget its score
+
+// Write up to max (at most NRFS_VERIFY) channels with a score above that
+// of the channels around them, hottest first (lowest channel first on a
+// tie), into out. Returns how many.
+uint8_t nrfsRank(uint8_t *out, uint8_t max);
+
+#endif /* NRFSCAN_H_ */
\ No newline at end of file
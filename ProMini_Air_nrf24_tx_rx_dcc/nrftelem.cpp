@@ -0,0 +1,168 @@
+/*
+nrftelem.cpp
+
+Link telemetry for the nRF24 link: reports and the transmitter's table
+of receivers. See nrftelem.h.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "nrftelem.h"
+#include "nrfbatch.h"
+#include <string.h>
+
+nrftLink_t nrftLinks[NRFT_IDS+1];
+
+static uint8_t at;            // Last ID polled
+static uint32_t pollMs;       // Last poll
+static uint32_t adaptMs;      // Last change of power or copies
+static uint32_t calmMs;       // Last change of power or copies, or a bad link
+
+uint8_t nrftPack(const nrftReport_t *r, uint8_t *out) {
+  out[0] = r->id;
+  out[1] = r->frames & 0xFF;
+  out[2] = r->frames >> 8;
+  out[3] = r->lost & 0xFF;
+  out[4] = r->lost >> 8;
+  out[5] = r->fifoFull;
+  out[6] = r->vcc;
+  out[7] = r->copies;
+  return NRFT_REPORT;
+}
+
+static uint8_t unpack(const uint8_t *in, uint8_t len, nrftReport_t *r) {
+  if (len < NRFT_REPORT) return 0;
+  r->id = in[0];
+  r->frames = in[1] | ((uint16_t)in[2] << 8);
+  r->lost = in[3] | ((uint16_t)in[4] << 8);
+  r->fifoFull = in[5];
+  r->vcc = in[6];
+  r->copies = in[7];
+  return 1;
+}
+
+void nrftBegin(void) {
+  memset(nrftLinks, 0, sizeof(nrftLinks));
+  at = 0;
+  calmMs = 0;
+}
+
+uint8_t nrftNextPoll(uint32_t nowMs) {
+  nrftLink_t *l;
+
+  if (nowMs - pollMs < NRFT_POLLMS) return 0;
+  for (uint8_t i = 0; i < NRFT_IDS; i++) {
+     at = (at % NRFT_IDS) + 1;
+     l = &nrftLinks[at];
+     if (l->heard || (nowMs - l->triedMs >= NRFT_PROBEMS) || !l->triedMs) {
+        l->triedMs = nowMs ? nowMs : 1;
+        pollMs = nowMs;
+        return at;
+     }
+  }
+  return 0;
+}  // end of nrftNextPoll
+
+// Weight 1/4 on the new percentage v; *avg is in 1/16 %. Returns the percentage.
+static uint8_t smooth(uint16_t *avg, uint8_t v) {
+  *avg = (3*(uint32_t)*avg + 16*(uint16_t)v) / 4;
+  return (uint8_t)((*avg + 8) / 16);
+}
+
+// Add a poll to the window. Returns the percentage answered
+static uint8_t answered(nrftLink_t *l, uint8_t ok) {
+  uint8_t n = 0;
+
+  l->acks = (l->acks << 1) | ok;
+  if (l->polls < NRFT_ACKPOLLS) l->polls++;
+  for (uint8_t i = 0; i < l->polls; i++) n += (l->acks >> i) & 1;
+  return (uint8_t)((100U*n + l->polls/2) / l->polls);
+}
+
+void nrftResult(uint8_t id, uint8_t ok, const uint8_t *ack, uint8_t len, uint32_t nowMs) {
+  nrftLink_t *l;
+  nrftReport_t r;
+
+  if (!id || (id > NRFT_IDS)) return;
+  l = &nrftLinks[id];
+  if (!ok) {
+     if (l->heard) {
+        l->ackPct = answered(l, 0);
+        if (nowMs - l->seenMs >= NRFT_LOSTMS) l->heard = 0;
+     }
+     return;
+  }
+  if (!l->heard) l->polls = 0;  // Back: a new window
+  l->ackPct = answered(l, 1);
+  l->heard = 1;
+  l->seenMs = nowMs;
+  if (!unpack(ack, len, &r) || (r.id != id)) return;  // Nothing loaded yet, or not a report
+
+  if (l->reports) {
+     uint8_t copies = r.copies - l->last.copies;
+     uint16_t frames = r.frames - l->last.frames - copies;  // Copies dropped are not new frames
+     uint16_t lost = r.lost - l->last.lost;
+     uint32_t all = (uint32_t)frames + lost;
+     if (all) l->lossPct = smooth(&l->loss16, (uint8_t)((100UL*lost + all/2) / all));
+  }
+  if (l->reports < 255) l->reports++;
+  l->last = r;
+}  // end of nrftResult
+
+uint8_t nrftAdvise(uint8_t *copies, uint8_t *power, uint8_t minCopies, uint8_t minPower, uint8_t maxPower, uint32_t nowMs) {
+  uint8_t ack = 100, loss = 0;
+
+  if (nowMs - adaptMs < NRFT_ADAPTMS) return 0;
+  for (uint8_t id = 1; id <= NRFT_IDS; id++) {
+     nrftLink_t *l = &nrftLinks[id];
+     if (!l->heard) continue;
+     if (l->ackPct < ack) ack = l->ackPct;
+     if (l->lossPct > loss) loss = l->lossPct;
+  }
+
+  // No receiver heard counts as a good link: back to the CV settings
+  // Polls unanswered: more power. Copies would not help them, nor a
+  // receiver that has left the layout and stopped answering.
+  // A link between bad and good holds the settings, and does not hold
+  // off the step down.
+  if ((ack < NRFT_ACKLOW) || (loss > NRFT_LOSSHIGH)) calmMs = nowMs;
+  if ((ack < NRFT_ACKLOW) && (*power < maxPower)) (*power)++;
+  else if (loss > NRFT_LOSSHIGH) {
+     if (*copies < NRFB_COPIESMAX) (*copies)++;
+     else if (*power < maxPower) (*power)++;
+     else return 0;
+  } else if ((ack >= NRFT_ACKGOOD) && (loss <= NRFT_LOSSGOOD)) {
+     if (nowMs - calmMs < NRFT_CALMMS) return 0;  // Down slower than up
+     if (*copies > minCopies) (*copies)--;
+     else if (*power > minPower) (*power)--;
+     else return 0;
+  } else {
+     return 0;
+  }
+  calmMs = nowMs;
+  adaptMs = nowMs;
+  return 1;
+}  // end of nrftAdvise
\ No newline at end of file
@@ -0,0 +1,115 @@
+/*
+nrftelem.h
+
+Link telemetry for the nRF24 link, through ACK payloads.
+
+The link is broadcast and one-way. A receiver given an ID (1 to
+NRFT_IDS) also listens on a pipe of its own, address pipe01 + ID, with
+auto-ACK. Now and then the transmitter sends a 1-byte poll to one ID,
+asking for the ACK, and the receiver's ACK carries a report it loaded
+beforehand: frames received, frames missed by sequence number, RX FIFO
+full counts and supply voltage. Having sent it, the receiver loads the
+next one, so a report is one poll old.
+
+The transmitter keeps a table of the receivers: polls answered, frames
+missed between reports and the last supply voltage, smoothed. The worst
+receiver heard sets the power level, from the polls it answers, and
+the copies of each frame, from the frames it misses: every receiver
+gets the same frames. Good links bring them back down to the CV
+settings, once no link has been bad for a while.
+
+Frames missed are only known with sequence numbers: NRF_BATCH or more
+than one copy on the transmitter.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef NRFTELEM_H_
+#define NRFTELEM_H_
+
+#include <stdint.h>
+
+#define NRFT_IDS     8               // Receiver IDs 1-8; 0: no telemetry
+#define NRFT_PIPE    2               // The receiver's pipe for polls
+#define NRFT_ARD     3               // setRetries() delay for a poll, 250 us units after the first: an ACK payload at 250 kbps needs 500 us at least
+#define NRFT_REPORT  8               // Bytes in a report
+#define NRFT_POLLMS  100             // One poll every so often
+#define NRFT_PROBEMS 2000            // A receiver not heard from is polled this seldom
+#define NRFT_LOSTMS  5000            // Unanswered this long: not heard
+#define NRFT_ADAPTMS 2000            // Power and copies change no faster
+#define NRFT_CALMMS  10000           // and come down only with no bad link for this long
+#define NRFT_ACKPOLLS 32             // Polls answered are counted over the last so many
+
+// Thresholds on the worst receiver, percent. Between the low and good
+// ones, nothing changes
+#define NRFT_ACKLOW  50              // Polls answered below this: more power
+#define NRFT_LOSSHIGH 5              // Frames missed above this: more copies, then more power
+#define NRFT_ACKGOOD 90              // Polls answered at least this, and
+#define NRFT_LOSSGOOD 1              // frames missed at most this: fewer copies, then less power
+
+typedef struct {
+  uint8_t id;
+  uint16_t frames;   // Frames received, wrapping
+  uint16_t lost;     // Frames missed by sequence number, wrapping
+  uint8_t fifoFull;  // RX FIFO found full, wrapping
+  uint8_t vcc;       // Supply in 20 mV units; 0: unknown
+  uint8_t copies;    // Copies of frames dropped, wrapping
+} nrftReport_t;
+
+typedef struct {
+  uint8_t heard;     // Answered within NRFT_LOSTMS
+  uint8_t ackPct;    // Polls answered, of the last NRFT_ACKPOLLS
+  uint8_t lossPct;   // Frames missed, smoothed
+  uint8_t reports;   // Reports taken, up to 255
+  uint32_t acks;     // Bit n: poll n before the last was answered
+  uint8_t polls;     // Polls in acks, up to NRFT_ACKPOLLS
+  uint16_t loss16;   // lossPct in 1/16 %
+  nrftReport_t last; // The last report
+  uint32_t seenMs;   // Last answer
+  uint32_t triedMs;  // Last poll
+} nrftLink_t;
+
+extern nrftLink_t nrftLinks[NRFT_IDS+1];  // By ID; 0 unused
+
+// Receiver: the report on the air. Returns its length.
+uint8_t nrftPack(const nrftReport_t *r, uint8_t *out);
+
+// Transmitter
+
+void nrftBegin(void);
+
+// The ID to poll now, 0 for none; nowMs is millis()
+uint8_t nrftNextPoll(uint32_t nowMs);
+
+// The poll of id was answered (ok) with the ACK payload ack[len] (len 0: none)
+void nrftResult(uint8_t id, uint8_t ok, const uint8_t *ack, uint8_t len, uint32_t nowMs);
+
+// Adjust *copies and *power to the worst receiver heard, one step at a
+// time, not below minCopies and minPower, up to NRFB_COPIESMAX copies and
+// maxPower. With none heard, back down. Returns 1 if either changed.
+uint8_t nrftAdvise(uint8_t *copies, uint8_t *power, uint8_t minCopies, uint8_t minPower, uint8_t maxPower, uint32_t nowMs);
+
+#endif /* NRFTELEM_H_ */
\ No newline at end of file
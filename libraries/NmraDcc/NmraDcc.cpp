@@ -39,6 +39,14 @@
 //            2019-02-17 added ESP32 specific changes by Hans Tanner
 //            2020-05-15 changes to pass NMRA Tests ( always search for preamble )
 //            2021-03-11 fix ESP32 bug on interrupt reinitialisation
+//            2026-10-19 Added getPacketEndMicros for latency measurement
+//            2026-10-19 Receive queue of DCC_RX_QUEUE packets in place of the single PacketCopy.
+//                       process(maxPackets) takes up to maxPackets of them and returns how many;
+//                       process() takes one and returns 1 or 0, as before
+//            2026-10-19 Address filter for FLAGS_MY_ADDRESS_ONLY
+//            2026-10-19 FLAGS_MY_ADDRESS_ONLY compares the address type too: a 14-bit address no longer matches the same 7-bit one
+//            2026-10-19 RAM cache of CVs, written back to EEPROM from process(); flushCVs(), FLAGS_CV_COMMIT_BEFORE_ACK
+//            2026-10-19 decodeSymbols(): packets from captured half-bit durations; ESP32 RMT capture (NMRA_DCC_ESP32_RMT)
 //------------------------------------------------------------------------
 //
 // purpose:   Provide a simplified interface to decode NMRA DCC packets
@@ -299,18 +307,58 @@ typedef enum
 }
 OpsInstructionType;
 
+#if (DCC_RX_QUEUE < 1) || (DCC_RX_QUEUE > 128) || (DCC_RX_QUEUE & (DCC_RX_QUEUE - 1))
+    #error "DCC_RX_QUEUE must be a power of 2 from 1 to 128"
+#endif
+
+// Orders the queue slot against the index that hands it over, for the compiler and,
+// where the ISR and loop() can be on different cores, the CPU
+#if defined(__AVR__)
+    #define DCC_RX_BARRIER() __asm__ __volatile__ ("" ::: "memory")
+#else
+    #define DCC_RX_BARRIER() __sync_synchronize()
+#endif
+
+typedef struct
+{
+    DCC_MSG         Msg;
+    unsigned int    EndMicros;  // micros() at the end bit of Msg
+}
+DccRxSlot_t ;
+
 struct DccRx_t
 {
     DccRxWaitState  State ;
-    uint8_t         DataReady ;
     uint8_t         BitCount ;
     uint8_t         TempByte ;
     uint8_t         chkSum;
     DCC_MSG         PacketBuf;
-    DCC_MSG         PacketCopy;
+    // Valid packets from the ISR to process(). Single producer, single consumer:
+    // QueueIn is only written by the ISR and QueueOut only by process(), so neither
+    // turns interrupts off. Both run freely; the count is QueueIn - QueueOut.
+    DccRxSlot_t     Queue[DCC_RX_QUEUE];
+    volatile uint8_t QueueIn;
+    volatile uint8_t QueueOut;
+    uint16_t        Overruns;   // Valid packets dropped with the queue full
+    uint8_t         QueuedMax;  // Most packets the queue has held
 }
 DccRx ;
 
+static unsigned int packetEndMicros;  // End bit time of the packet last passed to notifyDccMsg
+
+// What the first bytes of a packet for this decoder can be, from its address CVs.
+// 0 is "none" for Short and LongHi: address 0 is the broadcast address.
+typedef struct
+{
+    uint8_t   Valid ;             // 0: rebuild from the CVs before use
+    uint8_t   AllMultiFunction ;  // Pass all multi-function packets (accessory decoder with an Ops Mode address)
+    uint8_t   Short ;             // Primary address, if not using the extended one
+    uint8_t   LongHi ;            // Extended address (CV17, CV18)
+    uint8_t   LongLo ;
+    uint8_t   Acc[2] ;            // Low 6 bits of the board address of accessory packets for us
+}
+ADDR_FILTER ;
+
 typedef struct
 {
     uint8_t   Flags ;
@@ -325,6 +373,7 @@ typedef struct
     volatile uint8_t   *ExtIntPort;     // use port and bitmask to read input at AVR in ISR
     uint8_t   ExtIntMask;     // digitalRead is too slow on AVR
     int16_t   myDccAddress;	// Cached value of DCC Address from CVs
+    ADDR_FILTER AddrFilter;     // Built from the same CVs, for FLAGS_MY_ADDRESS_ONLY
     uint8_t   inAccDecDCCAddrNextReceivedMode;
     uint8_t	cv29Value;
     #ifdef DCC_DEBUG
@@ -337,6 +386,26 @@ DCC_PROCESSOR_STATE ;
 
 DCC_PROCESSOR_STATE DccProcState ;
 
+// Valid packet: queue it unless process() has fallen that far behind.
+// Always inlined, so that it is in the ISR's own memory section.
+static inline __attribute__ ( (always_inline)) void queueRxPacket (DCC_MSG * pMsg, unsigned int EndMicros)
+{
+    uint8_t queueIn = DccRx.QueueIn;
+    uint8_t queued = (uint8_t) (queueIn - DccRx.QueueOut);
+    if (queued < DCC_RX_QUEUE)
+    {
+        DccRxSlot_t *slot = &DccRx.Queue[queueIn & (DCC_RX_QUEUE - 1)];
+        slot->Msg = *pMsg ;
+        slot->EndMicros = EndMicros ;
+        DCC_RX_BARRIER();
+        DccRx.QueueIn = queueIn + 1 ;
+        if (queued >= DccRx.QueuedMax)
+            DccRx.QueuedMax = queued + 1 ;
+    }
+    else if (DccRx.Overruns != 0xFFFF)
+        DccRx.Overruns++ ;
+}
+
 #ifdef ESP32
     portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
 
@@ -679,15 +748,7 @@ DCC_PROCESSOR_STATE DccProcState ;
             SET_TP1;
             if (DccRx.chkSum == 0)
             {
-                // Packet is valid
-                #ifdef ESP32
-                portENTER_CRITICAL_ISR (&mux);
-                #endif
-                DccRx.PacketCopy = DccRx.PacketBuf ;
-                DccRx.DataReady += 1 ;
-                #ifdef ESP32
-                portEXIT_CRITICAL_ISR (&mux);
-                #endif
+                queueRxPacket (&DccRx.PacketBuf, actMicros) ;
                 // SET_TP2; CLR_TP2;
                 preambleBitCount = 0 ;
             }
@@ -785,34 +846,282 @@ DCC_PROCESSOR_STATE DccProcState ;
     CLR_TP3;
 }
 
-void ackCV (void)
+//------------------------------------------------------------------------
+// Symbol decoder: the same packets from a capture of the whole input, as
+// (level, duration) pairs, instead of from an interrupt at every edge. An
+// ESP32's RMT peripheral times the edges in hardware and hands over such
+// captures in blocks, so neither interrupt latency nor Wi-Fi can skew the
+// bit timing. Nothing in here depends on the platform.
+//
+// It works as the edge interrupt does. Until the start bit, every edge
+// counts and each level is one half of a bit: 35 to 82us for a '1',
+// longer for a '0'. The two '0' halves of the start bit give the phase:
+// from there, bits are timed from one edge to the level the start bit
+// began with to the next, and a '1' is shorter than 146us. An edge sooner
+// than the shortest half bit (or bit) after the last one is a spike and is
+// ignored.
+//------------------------------------------------------------------------
+
+#define MAX_ZEROBITHALF 10000   // Longest stretched '0' half the decoder takes
+
+#define HALF_BIT_ERR    0
+#define HALF_BIT_ONE    1
+#define HALF_BIT_ZERO   2
+
+struct DccSym_t
 {
-    if (notifyCVAck)
+    DccRxWaitState  State ;
+    uint8_t         Level ;      // Level being timed
+    uint16_t        Duration ;   // us since the last edge that was not a spike
+    uint8_t         BitLevel ;   // Level each bit begins with, from the start bit
+    uint8_t         Halves ;     // '1' halves in a row while looking for a preamble
+    uint8_t         BitCount ;
+    uint8_t         TempByte ;
+    uint8_t         chkSum ;
+    DCC_MSG         PacketBuf ;
+}
+DccSym ;
+
+// A half bit at Level, of Duration us, before the start bit
+void symbolHalfBit (uint16_t Duration, uint8_t Level)
+{
+    uint8_t half = HALF_BIT_ERR ;
+
+    if ( (Duration >= MIN_ONEBITHALF) && (Duration <= MAX_ONEBITHALF))
+        half = HALF_BIT_ONE ;
+    else if ( (Duration > MAX_ONEBITHALF) && (Duration <= MAX_ZEROBITHALF))
+        half = HALF_BIT_ZERO ;
+
+    if (DccSym.State == WAIT_START_BIT)
     {
-        DB_PRINT ("ackCV: Send Basic ACK");
-        notifyCVAck() ;
+        if (half == HALF_BIT_ZERO)    // we got the startbit
+        {
+            DccSym.State = WAIT_DATA ;
+            DccSym.PacketBuf.Size = 0 ;
+            DccSym.PacketBuf.PreambleBits = DccSym.Halves / 2 ;
+            DccSym.BitCount = 0 ;
+            DccSym.TempByte = 0 ;
+            DccSym.chkSum = 0 ;
+            return ;
+        }
+        DccSym.State = WAIT_PREAMBLE ;   // Only half a '0': this '1' may begin a preamble
+        DccSym.Halves = 0 ;
+    }
+
+    if (half == HALF_BIT_ONE)
+    {
+        if (DccSym.Halves != 0xFF)
+            DccSym.Halves++ ;
+    }
+    else if ( (half == HALF_BIT_ZERO) && (DccSym.Halves >= 20))   // 10 '1' bits, then the first half of the start bit
+    {
+        DccSym.State = WAIT_START_BIT ;
+        DccSym.BitLevel = Level ;
     }
+    else
+        DccSym.Halves = 0 ;
 }
 
-void ackAdvancedCV (void)
+// A bit, from the start bit on; EdgeMicros is when it ended
+void symbolBit (uint8_t DccBitVal, unsigned int EdgeMicros)
 {
-    if (notifyAdvancedCVAck && (DccProcState.cv29Value & CV29_RAILCOM_ENABLE))
+    if (DccSym.State == WAIT_DATA)
     {
-        DB_PRINT ("ackAdvancedCV: Send RailCom ACK");
-        notifyAdvancedCVAck() ;
+        DccSym.TempByte = (DccSym.TempByte << 1) | DccBitVal ;
+        if (++DccSym.BitCount == 8)
+        {
+            if (DccSym.PacketBuf.Size == MAX_DCC_MESSAGE_LEN)  // Packet is too long - abort
+            {
+                DccSym.State = WAIT_PREAMBLE ;
+                DccSym.Halves = 0 ;
+            }
+            else
+            {
+                DccSym.State = WAIT_END_BIT ;
+                DccSym.PacketBuf.Data[ DccSym.PacketBuf.Size++ ] = DccSym.TempByte ;
+                DccSym.chkSum ^= DccSym.TempByte ;
+            }
+        }
     }
+    else if (DccBitVal)     // End of packet
+    {
+        if (DccSym.chkSum == 0)
+            queueRxPacket (&DccSym.PacketBuf, EdgeMicros) ;
+        DccSym.State = WAIT_PREAMBLE ;
+        DccSym.Halves = 2 ;   // The end bit may be the first bit of the next preamble
+    }
+    else    // Get next Byte
+    {
+        DccSym.State = WAIT_DATA ;
+        DccSym.BitCount = 0 ;
+        DccSym.TempByte = 0 ;
+    }
+}
+
+uint16_t addDuration (uint16_t a, uint16_t b)
+{
+    uint16_t sum = a + b ;
+    return (sum < a) ? 0xFFFF : sum ;
 }
 
+// Symbols in the RMT layout: duration0 in bits 0-14, level0 in bit 15,
+// duration1 in bits 16-30, level1 in bit 31. A duration of 0 ends a capture.
+uint8_t decodeDccSymbols (const uint32_t * symbols, uint16_t count, unsigned int EndMicros)
+{
+    uint8_t queueIn = DccRx.QueueIn ;
+    unsigned int t = EndMicros ;
+    uint16_t i ;
+
+    for (i = 0; i < count; i++)     // Back to when the first symbol began
+        t -= (symbols[i] & 0x7FFF) + ( (symbols[i] >> 16) & 0x7FFF) ;
+
+    for (i = 0; i < 2 * count; i++)
+    {
+        uint16_t half = (uint16_t) (symbols[i / 2] >> (16 * (i & 1))) ;
+        uint16_t Duration = half & 0x7FFF ;
+        uint8_t  Level = half >> 15 ;
+        uint8_t  bits = (DccSym.State == WAIT_DATA) || (DccSym.State == WAIT_END_BIT) ;
+
+        if (Duration == 0)      // Idle: whatever was going on is over
+        {
+            DccSym.State = WAIT_PREAMBLE ;
+            DccSym.Halves = 0 ;
+            DccSym.Duration = 0 ;
+            break ;
+        }
+
+        if ( (Level == DccSym.Level) || (DccSym.Duration == 0))   // Long levels come in several symbols
+            DccSym.Duration = addDuration (DccSym.Duration, Duration) ;
+        else if (!bits && (DccSym.Duration >= MIN_ONEBITHALF))
+        {
+            symbolHalfBit (DccSym.Duration, DccSym.Level) ;
+            DccSym.Duration = Duration ;
+        }
+        else if (bits && (Level == DccSym.BitLevel) && (DccSym.Duration >= MIN_ONEBITFULL))
+        {
+            symbolBit (DccSym.Duration < MAX_ONEBITFULL, t) ;
+            DccSym.Duration = Duration ;
+        }
+        else    // A spike, or the middle of a bit
+        {
+            DccSym.Duration = addDuration (DccSym.Duration, Duration) ;
+            if (bits && (DccSym.Duration > 2 * MAX_ZEROBITHALF))   // No more bits
+            {
+                DccSym.State = WAIT_PREAMBLE ;
+                DccSym.Halves = 0 ;
+            }
+        }
+        DccSym.Level = Level ;
+        t += Duration ;
+    }
+
+    return (uint8_t) (DccRx.QueueIn - queueIn) ;
+}
+
+#if defined(ESP32) && defined(NMRA_DCC_ESP32_RMT)
+#include "esp_idf_version.h"
+#include "driver/rmt_rx.h"
+#include "freertos/stream_buffer.h"
+
+#if ESP_IDF_VERSION < ESP_IDF_VERSION_VAL(5, 3, 0)
+    #error "NMRA_DCC_ESP32_RMT needs ESP-IDF 5.3 or later (Arduino-ESP32 3.1 or later)"
+#endif
+
+#ifndef DCC_RMT_SYMBOLS
+#define DCC_RMT_SYMBOLS         64      // Symbols (bits) the RMT hands over at a time
+#endif
+#ifndef DCC_RMT_TASK_PRIORITY
+#define DCC_RMT_TASK_PRIORITY   5       // Above loop(), so that decoding keeps up with it busy
+#endif
+
+static rmt_channel_handle_t rmtChannel ;
+static StreamBufferHandle_t rmtStream ;            // Symbols from the RMT interrupt to the task
+static volatile uint8_t     rmtStopped ;           // Capture ended on an idle input: start another
+static rmt_symbol_word_t    rmtBuf[DCC_RMT_SYMBOLS] ;
+// Symbol blocks the interrupt cut short with the stream buffer full. Only rmtReceived()
+// writes it, and it runs beside rmtTask(), which owns DccRx.Overruns: a counter of its own,
+// and clearRxOverruns() moves the base instead of writing it.
+static volatile uint32_t    rmtOverruns ;
+static uint32_t             rmtOverrunsBase ;
+
+static const rmt_receive_config_t rmtReceiveConfig =
+{
+    .signal_range_min_ns = 3000,        // Glitch filter: shorter pulses are not DCC
+    .signal_range_max_ns = 12000000,    // No edge for longer than a stretched '0': idle
+    .flags = { .en_partial_rx = 1 },    // DCC never idles: take it a block at a time
+} ;
+
+static bool IRAM_ATTR rmtReceived (rmt_channel_handle_t channel, const rmt_rx_done_event_data_t * edata, void * user_ctx)
+{
+    BaseType_t woken = pdFALSE ;
+    size_t bytes = xStreamBufferSpacesAvailable (rmtStream) & ~ (sizeof (uint32_t) - 1) ;   // Whole symbols only
+    size_t size = edata->num_symbols * sizeof (uint32_t) ;
+
+    (void) channel ;
+    (void) user_ctx ;
+    if (edata->flags.is_last)
+        rmtStopped = 1 ;
+    if (size > bytes)
+    {
+        size = bytes ;
+        rmtOverruns++ ;
+    }
+    xStreamBufferSendFromISR (rmtStream, edata->received_symbols, size, &woken) ;
+    return woken == pdTRUE ;
+}
+
+static void rmtTask (void * arg)
+{
+    uint32_t symbols[DCC_RMT_SYMBOLS] ;
+
+    (void) arg ;
+    for (;;)
+    {
+        size_t bytes = xStreamBufferReceive (rmtStream, symbols, sizeof (symbols), portMAX_DELAY) ;
+        decodeDccSymbols (symbols, bytes / sizeof (uint32_t), micros()) ;
+        if (rmtStopped)
+        {
+            rmtStopped = 0 ;
+            rmt_receive (rmtChannel, rmtBuf, sizeof (rmtBuf), &rmtReceiveConfig) ;
+        }
+    }
+}
+
+void startRmtCapture (uint8_t pin)
+{
+    if (rmtChannel)     // Already running
+        return ;
+
+    rmt_rx_channel_config_t config = { } ;
+    config.gpio_num = (gpio_num_t) pin ;
+    config.clk_src = RMT_CLK_SRC_DEFAULT ;
+    config.resolution_hz = 1000000 ;   // Durations in us, as the decoder wants them
+    config.mem_block_symbols = SOC_RMT_MEM_WORDS_PER_CHANNEL ;
+
+    rmt_rx_event_callbacks_t callbacks = { } ;
+    callbacks.on_recv_done = rmtReceived ;
+
+    memset (&DccSym, 0, sizeof (DccSym)) ;
+    rmtStream = xStreamBufferCreate (8 * sizeof (rmtBuf), sizeof (uint32_t)) ;
+    if ( (rmtStream == NULL) || (rmt_new_rx_channel (&config, &rmtChannel) != ESP_OK))
+    {
+        DB_PRINT ("RMT: no channel for pin %d", pin) ;
+        return ;
+    }
+    rmt_rx_register_event_callbacks (rmtChannel, &callbacks, NULL) ;
+    rmt_enable (rmtChannel) ;
+    xTaskCreatePinnedToCore (rmtTask, "DccRmt", 3072, NULL, DCC_RMT_TASK_PRIORITY, NULL, ARDUINO_RUNNING_CORE) ;
+    rmt_receive (rmtChannel, rmtBuf, sizeof (rmtBuf), &rmtReceiveConfig) ;
+}
+#endif
 
 uint8_t readEEPROM (unsigned int CV)
 {
     return EEPROM.read (CV) ;
 }
 
-void writeEEPROM (unsigned int CV, uint8_t Value)
+void commitEEPROM (void)
 {
-    EEPROM.write (CV, Value) ;
-    
 	#if defined(ESP8266)
 	noInterrupts();
 	#endif
@@ -826,6 +1135,12 @@ void writeEEPROM (unsigned int CV, uint8_t Value)
 	#endif
 }
 
+void writeEEPROM (unsigned int CV, uint8_t Value)
+{
+    EEPROM.write (CV, Value) ;
+    commitEEPROM() ;
+}
+
 bool readyEEPROM()
 {
     #if defined ARDUINO_ARCH_MEGAAVR
@@ -837,6 +1152,193 @@ bool readyEEPROM()
     #endif
 }
 
+#ifndef NMRA_DCC_NO_CV_CACHE
+// Write-through cache of CVs, so that neither reading one nor writing one waits for the EEPROM.
+// The first CV_CACHE_RESIDENT entries hold the address CVs from init() on; the others take
+// any CV read or written, replacing the next clean one round robin. A written entry stays
+// dirty until process() finds the EEPROM ready and writes it back, or flushCVs() is called.
+#define CV_CACHE_RESIDENT   6
+#define CV_CACHE_SIZE       (CV_CACHE_RESIDENT + DCC_CV_CACHE)
+
+#define CV_CACHE_VALID      0x01
+#define CV_CACHE_DIRTY      0x02
+
+typedef struct
+{
+    uint16_t  CV ;
+    uint8_t   Value ;
+    uint8_t   State ;   // CV_CACHE_ bits
+}
+CV_CACHE_ENTRY ;
+
+struct CvCache_t
+{
+    CV_CACHE_ENTRY  Entry[CV_CACHE_SIZE];
+    uint8_t         Next ;    // General entry to take next, from 0 to DCC_CV_CACHE - 1
+    uint8_t         Dirty ;   // Entries not written back yet
+}
+CvCache ;
+
+CV_CACHE_ENTRY * findCachedCV (uint16_t CV)
+{
+    for (uint8_t i = 0; i < CV_CACHE_SIZE; i++)
+    {
+        if ( (CvCache.Entry[i].State & CV_CACHE_VALID) && (CvCache.Entry[i].CV == CV))
+            return &CvCache.Entry[i] ;
+    }
+    return 0 ;
+}
+
+void commitCachedCV (CV_CACHE_ENTRY * e)
+{
+    writeEEPROM (e->CV, e->Value) ;
+    e->State &= ~CV_CACHE_DIRTY ;
+    CvCache.Dirty-- ;
+}
+
+// A general entry for CV, replacing a clean one if there is one, or else writing back
+// the oldest. 0 if there are no general entries.
+CV_CACHE_ENTRY * newCachedCV (uint16_t CV)
+{
+    if (DCC_CV_CACHE == 0)
+        return 0 ;
+
+    uint8_t i = CvCache.Next ;
+    for (uint8_t n = 0; n < DCC_CV_CACHE; n++)
+    {
+        if (! (CvCache.Entry[CV_CACHE_RESIDENT + i].State & CV_CACHE_DIRTY))
+            break ;
+        if (++i >= DCC_CV_CACHE)
+            i = 0 ;
+    }
+    CV_CACHE_ENTRY * e = &CvCache.Entry[CV_CACHE_RESIDENT + i] ;
+    if (e->State & CV_CACHE_DIRTY)   // All dirty: i is back at Next
+        commitCachedCV (e) ;
+    CvCache.Next = (i + 1 < DCC_CV_CACHE) ? i + 1 : 0 ;
+
+    e->CV = CV ;
+    e->State = 0 ;
+    return e ;
+}
+
+uint8_t readCachedCV (uint16_t CV)
+{
+    CV_CACHE_ENTRY * e = findCachedCV (CV) ;
+    if (e)
+        return e->Value ;
+
+    uint8_t Value = readEEPROM (CV) ;
+    e = newCachedCV (CV) ;
+    if (e)
+    {
+        e->Value = Value ;
+        e->State = CV_CACHE_VALID ;
+    }
+    return Value ;
+}
+
+void writeCachedCV (uint16_t CV, uint8_t Value)
+{
+    CV_CACHE_ENTRY * e = findCachedCV (CV) ;
+    if (!e)
+        e = newCachedCV (CV) ;
+    if (!e)
+    {
+        writeEEPROM (CV, Value) ;
+        return ;
+    }
+
+    if (! (e->State & CV_CACHE_DIRTY))
+        CvCache.Dirty++ ;
+    e->Value = Value ;
+    e->State = CV_CACHE_VALID | CV_CACHE_DIRTY ;
+}
+
+// Write back one dirty entry if the EEPROM is ready, or all of them with wait.
+// Flash-backed EEPROMs take all of them at once, for one commit.
+void flushCachedCVs (uint8_t wait)
+{
+    if (!CvCache.Dirty)
+        return ;
+
+    #if defined(ESP8266) ||  defined(ESP32) || defined(ARDUINO_ARCH_RP2040)
+    for (uint8_t i = 0; i < CV_CACHE_SIZE; i++)
+    {
+        CV_CACHE_ENTRY * e = &CvCache.Entry[i] ;
+        if (e->State & CV_CACHE_DIRTY)
+        {
+            EEPROM.write (e->CV, e->Value) ;
+            e->State &= ~CV_CACHE_DIRTY ;
+        }
+    }
+    CvCache.Dirty = 0 ;
+    commitEEPROM() ;
+    (void) wait ;
+    #else
+    for (uint8_t i = 0; (i < CV_CACHE_SIZE) && CvCache.Dirty; i++)
+    {
+        CV_CACHE_ENTRY * e = &CvCache.Entry[i] ;
+        if (e->State & CV_CACHE_DIRTY)
+        {
+            if (!wait && !readyEEPROM())
+                return ;
+            commitCachedCV (e) ;
+            if (!wait)
+                return ;
+        }
+    }
+    while (!readyEEPROM())
+        ;
+    #endif
+}
+
+void loadCachedCVs (void)
+{
+    static const uint16_t residentCVs[CV_CACHE_RESIDENT] =
+    {
+        CV_ACCESSORY_DECODER_ADDRESS_LSB, CV_ACCESSORY_DECODER_ADDRESS_MSB,
+        CV_MULTIFUNCTION_EXTENDED_ADDRESS_MSB, CV_MULTIFUNCTION_EXTENDED_ADDRESS_LSB,
+        CV_MULTIFUNCTION_CONSIST_ADDRESS, CV_29_CONFIG
+    } ;
+
+    flushCachedCVs (1) ;
+    memset (&CvCache, 0, sizeof (CvCache)) ;
+    for (uint8_t i = 0; i < CV_CACHE_RESIDENT; i++)
+    {
+        CvCache.Entry[i].CV = residentCVs[i] ;
+        CvCache.Entry[i].Value = readEEPROM (residentCVs[i]) ;
+        CvCache.Entry[i].State = CV_CACHE_VALID ;
+    }
+}
+#else
+#define readCachedCV(CV)            readEEPROM (CV)
+#define writeCachedCV(CV, Value)    writeEEPROM (CV, Value)
+#define flushCachedCVs(wait)
+#define loadCachedCVs()
+#endif
+
+void ackCV (void)
+{
+    if (notifyCVAck)
+    {
+        DB_PRINT ("ackCV: Send Basic ACK");
+        if (DccProcState.Flags & FLAGS_CV_COMMIT_BEFORE_ACK)
+            flushCachedCVs (1) ;
+        notifyCVAck() ;
+    }
+}
+
+void ackAdvancedCV (void)
+{
+    if (notifyAdvancedCVAck && (DccProcState.cv29Value & CV29_RAILCOM_ENABLE))
+    {
+        DB_PRINT ("ackAdvancedCV: Send RailCom ACK");
+        if (DccProcState.Flags & FLAGS_CV_COMMIT_BEFORE_ACK)
+            flushCachedCVs (1) ;
+        notifyAdvancedCVAck() ;
+    }
+}
+
 uint8_t validCV (uint16_t CV, uint8_t Writable)
 {
     if (notifyCVResetFactoryDefault && (CV == CV_MANUFACTURER_ID)  && Writable)
@@ -863,7 +1365,7 @@ uint8_t readCV (unsigned int CV)
     if (notifyCVRead)
         return notifyCVRead (CV) ;
 
-    Value = readEEPROM (CV);
+    Value = readCachedCV (CV);
     return Value ;
 }
 
@@ -877,20 +1379,23 @@ uint8_t writeCV (unsigned int CV, uint8_t Value)
         // because you cannot build a Bidi decoder with this lib.
         DccProcState.cv29Value = Value;
         DccProcState.Flags = (DccProcState.Flags & ~FLAGS_CV29_BITS) | (Value & FLAGS_CV29_BITS);
-    // no break, because myDccAdress must also be reset
+    // fall through - myDccAdress must also be reset
     case CV_ACCESSORY_DECODER_ADDRESS_LSB:	// Also same CV for CV_MULTIFUNCTION_PRIMARY_ADDRESS
     case CV_ACCESSORY_DECODER_ADDRESS_MSB:
     case CV_MULTIFUNCTION_EXTENDED_ADDRESS_MSB:
     case CV_MULTIFUNCTION_EXTENDED_ADDRESS_LSB:
         DccProcState.myDccAddress = -1;	// Assume any CV Write Operation might change the Address
+    // fall through - the filter takes the address too
+    case CV_MULTIFUNCTION_CONSIST_ADDRESS:
+        DccProcState.AddrFilter.Valid = 0;
     }
 
     if (notifyCVWrite)
         return notifyCVWrite (CV, Value) ;
 
-    if (readEEPROM (CV) != Value)
+    if (readCachedCV (CV) != Value)
     {
-        writeEEPROM (CV, Value) ;
+        writeCachedCV (CV, Value) ;
 
         if (notifyCVChange)
             notifyCVChange (CV, Value) ;
@@ -899,7 +1404,7 @@ uint8_t writeCV (unsigned int CV, uint8_t Value)
             notifyDccCVChange (CV, Value);
     }
 
-    return readEEPROM (CV) ;
+    return readCachedCV (CV) ;
 }
 
 uint16_t getMyAddr (void)
@@ -926,6 +1431,64 @@ uint16_t getMyAddr (void)
     return DccProcState.myDccAddress ;
 }
 
+void buildAddrFilter (void)
+{
+    ADDR_FILTER *f = &DccProcState.AddrFilter ;
+    uint16_t myAddr = getMyAddr() ;
+
+    memset (f, 0, sizeof (ADDR_FILTER)) ;
+    if (DccProcState.Flags & FLAGS_DCC_ACCESSORY_DECODER)
+    {
+        f->AllMultiFunction = (DccProcState.OpsModeAddressBaseCV != 0) ;
+        if (DccProcState.Flags & FLAGS_OUTPUT_ADDRESS_MODE)
+            f->Acc[0] = ( ( (myAddr - 1) >> 2) + 1) & 0b00111111 ;  // The board the output is on
+        else
+            f->Acc[0] = myAddr & 0b00111111 ;
+        f->Acc[1] = myAddr & 0b00111111 ;  // Legacy CV access compares the board address with it as is
+    }
+    else
+    {
+        if (DccProcState.cv29Value & CV29_EXT_ADDRESSING)
+        {
+            f->LongHi = readCV (CV_MULTIFUNCTION_EXTENDED_ADDRESS_MSB) ;
+            f->LongLo = readCV (CV_MULTIFUNCTION_EXTENDED_ADDRESS_LSB) ;
+        }
+        else if (myAddr < 128)
+            f->Short = myAddr ;
+    }
+    f->Valid = 1 ;
+}
+
+// 0 if the packet cannot be for this decoder, from its first bytes. Broadcasts,
+// idles and anything addressed to us go on to the full decode, which still checks.
+uint8_t addrFilterPass (DCC_MSG * pDccMsg)
+{
+    ADDR_FILTER *f = &DccProcState.AddrFilter ;
+    uint8_t a = pDccMsg->Data[0] ;
+
+    if (!f->Valid)
+        buildAddrFilter() ;
+
+    if ( (a == 0) || (a == 0b11111111))  // Broadcast, reset, idle
+        return 1 ;
+
+    if (a < 128)  // Multi-function, 7-bit address
+        return f->AllMultiFunction || (a == f->Short) ;
+
+    if (a < 192)  // Accessory: broadcast boards 0 and 511, ours, or any while taking the next address
+    {
+        if (! (DccProcState.Flags & FLAGS_DCC_ACCESSORY_DECODER))
+            return 0 ;
+        a &= 0b00111111 ;
+        return (a == f->Acc[0]) || (a == f->Acc[1]) || (a == 0) || (a == 0b00111111) || DccProcState.inAccDecDCCAddrNextReceivedMode ;
+    }
+
+    if (a < 232)  // Multi-function, 14-bit address, or its broadcast
+        return f->AllMultiFunction || ( (a == f->LongHi) && (pDccMsg->Data[1] == f->LongLo)) || ( (a == 192) && (pDccMsg->Data[1] == 0)) ;
+
+    return 0 ;    // Reserved
+}
+
 void processDirectCVOperation (uint8_t Cmd, uint16_t CVAddr, uint8_t Value, void (*ackFunction) ())
 {
     // is it a Byte Operation
@@ -1025,8 +1588,10 @@ void processMultiFunctionMessage (uint16_t Addr, DCC_ADDR_TYPE AddrType, uint8_t
             return ;
     }
 
-    // We are looking for FLAGS_MY_ADDRESS_ONLY but it does not match and it is not a Broadcast Address then return
-    else if ( (DccProcState.Flags & FLAGS_MY_ADDRESS_ONLY) && (Addr != getMyAddr()) && (Addr != 0))
+    // We are looking for FLAGS_MY_ADDRESS_ONLY but it does not match and it is not a Broadcast Address then return.
+    // 14-bit address 3 is not 7-bit address 3
+    else if ( (DccProcState.Flags & FLAGS_MY_ADDRESS_ONLY) && (Addr != 0) &&
+              ( (Addr != getMyAddr()) || ( (AddrType == DCC_ADDR_LONG) != ( (DccProcState.cv29Value & CV29_EXT_ADDRESSING) != 0))))
         return ;
 
     switch (CmdMasked)
@@ -1287,6 +1852,12 @@ void SerialPrintPacketHex (const __FlashStringHelper *strLabel, DCC_MSG * pDccMs
 ///////////////////////////////////////////////////////////////////////////////
 void execDccProcessor (DCC_MSG * pDccMsg)
 {
+    #ifndef NMRA_DCC_NO_ADDRESS_FILTER
+    // Packets for other decoders go no further. In Service Mode all packets count
+    if ( (DccProcState.Flags & FLAGS_MY_ADDRESS_ONLY) && !DccProcState.inServiceMode && !addrFilterPass (pDccMsg))
+        return ;
+    #endif
+
     if ( (pDccMsg->Data[0] == 0) && (pDccMsg->Data[1] == 0))
     {
         if (notifyDccReset)
@@ -1627,14 +2198,18 @@ void NmraDcc::init (uint8_t ManufacturerId, uint8_t VersionId, uint8_t Flags, ui
     DccProcState.Flags = Flags ;
     DccProcState.OpsModeAddressBaseCV = OpsModeAddressBaseCV ;
     DccProcState.myDccAddress = -1;
+    DccProcState.AddrFilter.Valid = 0;
     DccProcState.inAccDecDCCAddrNextReceivedMode = 0;
+    loadCachedCVs();
 
     ISREdge = RISING;
     // level checking to detect false IRQ's fired by glitches
     ISRLevel = DccProcState.ExtIntMask;
     ISRChkMask = DccProcState.ExtIntMask;
 
-    #if defined(ESP32)|| defined ( ARDUINO_ARCH_RP2040)
+    #if defined(ESP32) && defined(NMRA_DCC_ESP32_RMT)
+    startRmtCapture (DccProcState.ExtIntPinNum);
+    #elif defined(ESP32)|| defined ( ARDUINO_ARCH_RP2040)
     ISRWatch = ISREdge;
     attachInterrupt (DccProcState.ExtIntNum, ExternalInterruptHandler, CHANGE);
     #else
@@ -1683,6 +2258,67 @@ uint16_t NmraDcc::getAddr (void)
     return getMyAddr();
 }
 
+////////////////////////////////////////////////////////////////////////
+uint16_t NmraDcc::getPacketEndMicros (void)
+{
+    return (uint16_t) packetEndMicros;
+}
+
+////////////////////////////////////////////////////////////////////////
+uint16_t NmraDcc::getRxOverruns (void)
+{
+    uint16_t overruns ;
+
+    #ifdef ESP32
+    portENTER_CRITICAL (&mux);
+    #else
+    noInterrupts();
+    #endif
+    overruns = DccRx.Overruns ;
+    #ifdef ESP32
+    portEXIT_CRITICAL (&mux);
+    #else
+    interrupts();
+    #endif
+    #if defined(ESP32) && defined(NMRA_DCC_ESP32_RMT)
+    uint32_t rmt = rmtOverruns - rmtOverrunsBase ;
+    overruns = (rmt >= (uint32_t) (0xFFFF - overruns)) ? 0xFFFF : overruns + rmt ;
+    #endif
+    return overruns ;
+}
+
+////////////////////////////////////////////////////////////////////////
+uint8_t NmraDcc::decodeSymbols (const uint32_t * symbols, uint16_t count, unsigned int endMicros)
+{
+    return decodeDccSymbols (symbols, count, endMicros) ;
+}
+
+////////////////////////////////////////////////////////////////////////
+uint8_t NmraDcc::getRxQueuedMax (void)
+{
+    return DccRx.QueuedMax ;
+}
+
+////////////////////////////////////////////////////////////////////////
+void NmraDcc::clearRxOverruns (void)
+{
+    #ifdef ESP32
+    portENTER_CRITICAL (&mux);
+    #else
+    noInterrupts();
+    #endif
+    DccRx.Overruns = 0 ;
+    DccRx.QueuedMax = 0 ;
+    #ifdef ESP32
+    portEXIT_CRITICAL (&mux);
+    #else
+    interrupts();
+    #endif
+    #if defined(ESP32) && defined(NMRA_DCC_ESP32_RMT)
+    rmtOverrunsBase = rmtOverruns ;
+    #endif
+}
+
 ////////////////////////////////////////////////////////////////////////
 uint8_t NmraDcc::isSetCVReady (void)
 {
@@ -1691,6 +2327,22 @@ uint8_t NmraDcc::isSetCVReady (void)
     return readyEEPROM();
 }
 
+////////////////////////////////////////////////////////////////////////
+void NmraDcc::flushCVs (void)
+{
+    flushCachedCVs (1) ;
+}
+
+////////////////////////////////////////////////////////////////////////
+uint8_t NmraDcc::getCVsPending (void)
+{
+    #ifndef NMRA_DCC_NO_CV_CACHE
+    return CvCache.Dirty ;
+    #else
+    return 0 ;
+    #endif
+}
+
 ////////////////////////////////////////////////////////////////////////
 #ifdef DCC_DEBUG
 uint8_t NmraDcc::getIntCount (void)
@@ -1732,8 +2384,14 @@ void NmraDcc::setAccDecDCCAddrNextReceived (uint8_t enable)
 ////////////////////////////////////////////////////////////////////////
 uint8_t NmraDcc::process()
 {
-	uint8_t	copyDataReady ;
-	
+    return process (1);
+}
+
+////////////////////////////////////////////////////////////////////////
+uint8_t NmraDcc::process (uint8_t maxPackets)
+{
+    uint8_t processed = 0 ;
+
     if (DccProcState.inServiceMode)
     {
         if ( (millis() - DccProcState.LastServiceModeMillis) > 20L)
@@ -1742,23 +2400,18 @@ uint8_t NmraDcc::process()
         }
     }
 
-    if (DccRx.DataReady)
+    flushCachedCVs (0) ;  // Write back one cached CV, if the EEPROM is free
+
+    while ( (processed < maxPackets) && (DccRx.QueueOut != DccRx.QueueIn))
     {
-        // We need to do this check with interrupts disabled
-        #ifdef ESP32
-        portENTER_CRITICAL (&mux);
-        #else
-        noInterrupts();
-        #endif
-        Msg = DccRx.PacketCopy ;
-        copyDataReady = DccRx.DataReady;
-        DccRx.DataReady = 0 ;
+        uint8_t queueOut = DccRx.QueueOut;
+        DCC_RX_BARRIER();  // Read the slot only after QueueIn has shown it
+        DccRxSlot_t *slot = &DccRx.Queue[queueOut & (DCC_RX_QUEUE - 1)];
+        Msg = slot->Msg ;
+        packetEndMicros = slot->EndMicros ;
+        DCC_RX_BARRIER();  // and be done with it before handing it back
+        DccRx.QueueOut = queueOut + 1 ;
 
-        #ifdef ESP32
-        portEXIT_CRITICAL (&mux);
-        #else
-        interrupts();
-        #endif
         // Checking of the XOR-byte is now done in the ISR already
         #ifdef DCC_DBGVAR
         countOf.Tel++;
@@ -1769,8 +2422,8 @@ uint8_t NmraDcc::process()
         if (notifyDccMsg) 	notifyDccMsg (&Msg);
 
         execDccProcessor (&Msg);
-        return copyDataReady ;
+        processed++ ;
     }
 
-    return 0 ;
+    return processed ;
 };
@@ -48,6 +48,19 @@
 // Uncomment the following line to Enable 14 Speed Step Support
 //#define NMRA_DCC_ENABLE_14_SPEED_STEP_MODE
 
+// Uncomment the following line to take packets for other decoders through the full
+// decode with FLAGS_MY_ADDRESS_ONLY, instead of rejecting them on their first bytes
+//#define NMRA_DCC_NO_ADDRESS_FILTER
+
+// Uncomment the following line to read and write every CV straight from and to EEPROM,
+// instead of through the RAM cache that process() writes back in the background
+//#define NMRA_DCC_NO_CV_CACHE
+
+// Uncomment the following line to time the DCC input of an ESP32 with its RMT peripheral
+// and decode it from a task, instead of taking an interrupt at every edge. Needs ESP-IDF 5.3
+// or later (Arduino-ESP32 3.1 or later), and an RMT receive channel for pin()
+//#define NMRA_DCC_ESP32_RMT
+
 #if defined(ARDUINO) && ARDUINO >= 100
     #include "Arduino.h"
 #else
@@ -63,6 +76,14 @@
 
 //#define ALLOW_NESTED_IRQ      // uncomment to enable nested IRQ's ( only for AVR! )
 
+#ifndef DCC_RX_QUEUE
+#define DCC_RX_QUEUE        4    // Valid packets the ISR can hold until process() takes them. Power of 2, at most 128
+#endif
+
+#ifndef DCC_CV_CACHE
+#define DCC_CV_CACHE        4    // CVs held in RAM besides the address ones (1, 9, 17, 18, 19, 29), which always are
+#endif
+
 typedef struct
 {
     uint8_t	Size ;
@@ -105,6 +126,7 @@ typedef struct
 #define CV_MULTIFUNCTION_PRIMARY_ADDRESS       1
 #define CV_MULTIFUNCTION_EXTENDED_ADDRESS_MSB 17
 #define CV_MULTIFUNCTION_EXTENDED_ADDRESS_LSB 18
+#define CV_MULTIFUNCTION_CONSIST_ADDRESS      19
 
 #define CALC_MULTIFUNCTION_EXTENDED_ADDRESS_LSB(x) (x & 0xFF)
 #define CALC_MULTIFUNCTION_EXTENDED_ADDRESS_MSB(x) (((x>>8) & 0x7F) + 192)
@@ -238,6 +260,7 @@ public:
 // Flag values to be logically ORed together and passed into the init() method
 #define FLAGS_MY_ADDRESS_ONLY        0x01	// Only process DCC Packets with My Address
 #define FLAGS_AUTO_FACTORY_DEFAULT   0x02	// Call notifyCVResetFactoryDefault() if CV 7 & 8 == 255
+#define FLAGS_CV_COMMIT_BEFORE_ACK   0x04	// Write cached CVs to EEPROM before calling notifyCVAck() or notifyAdvancedCVAck()
 #define FLAGS_SETCV_CALLED           0x10   // only used internally !!
 #define FLAGS_OUTPUT_ADDRESS_MODE    0x40  // CV 29/541 bit 6
 #define FLAGS_DCC_ACCESSORY_DECODER  0x80  // CV 29/541 bit 7
@@ -284,12 +307,17 @@ public:
      *    VersionId             - Version ID returned in CV 7.
      *    Flags                 - ORed flags beginning with FLAGS_...
      *                            FLAGS_MY_ADDRESS_ONLY       - Only process packets with My Address.
+     *                                                          A 14-bit address matches only with CV29 bit 5 set,
+     *                                                          a 7-bit one only with it clear. Packets for the
+     *                                                          consist address in CV19 are not taken.
      *                            FLAGS_DCC_ACCESSORY_DECODER - Decoder is an accessory decoder.
      *                            FLAGS_OUTPUT_ADDRESS_MODE   - This flag applies to accessory decoders only.
      *                                                          Accessory decoders normally have 4 paired outputs
      *                                                          and a single address refers to all 4 outputs.
      *                                                          Setting FLAGS_OUTPUT_ADDRESS_MODE causes each
      *                                                          address to refer to a single output.
+     *                            FLAGS_CV_COMMIT_BEFORE_ACK  - Write cached CVs to EEPROM before any acknowledgement,
+     *                                                          for programmers that read back right after it.
      *    OpsModeAddressBaseCV  - Ops Mode base address. Set it to 0?
      *
      *  Returns:
@@ -327,6 +355,74 @@ public:
      */
     uint8_t process();
 
+    /*+
+     *  process(maxPackets) as process(), but takes up to maxPackets packets
+     *            from the receive queue, for a loop() that may have been held up.
+     *
+     *  Inputs:
+     *    maxPackets - Most packets to pass to notifyDccMsg() on this call.
+     *
+     *  Returns:
+     *    Number of packets taken from the queue on this call, 0 to maxPackets.
+     *    process() is process(1), so it still returns 1 or 0.
+     */
+    uint8_t process (uint8_t maxPackets);
+
+    /*+
+     *  getRxOverruns() return how many valid packets the ISR dropped because the
+     *            receive queue (DCC_RX_QUEUE deep) was full, i.e., process() was
+     *            not called often enough. With NMRA_DCC_ESP32_RMT it adds the blocks
+     *            of symbols the RMT interrupt dropped because its task fell behind.
+     *
+     *  Inputs:
+     *    None.
+     *
+     *  Returns:
+     *    Packets dropped since init() or the last clearRxOverruns(). Saturates at 65535.
+     */
+    uint16_t getRxOverruns (void);
+
+    /*+
+     *  getRxQueuedMax() return the most packets the receive queue has held.
+     *
+     *  Inputs:
+     *    None.
+     *
+     *  Returns:
+     *    0 to DCC_RX_QUEUE. Reaching DCC_RX_QUEUE means packets may have been dropped.
+     */
+    uint8_t getRxQueuedMax (void);
+
+    /*+
+     *  clearRxOverruns() reset getRxOverruns() and getRxQueuedMax().
+     *
+     *  Inputs:
+     *    None.
+     *
+     *  Returns:
+     *    None.
+     */
+    void clearRxOverruns (void);
+
+    /*+
+     *  decodeSymbols() decode DCC from a capture of the input, instead of from the
+     *            pin interrupt, and queue its packets for process(). The ESP32 RMT
+     *            capture (NMRA_DCC_ESP32_RMT) comes through here, and so can any other
+     *            capture of the levels and their durations.
+     *
+     *  Inputs:
+     *    symbols   - Pairs of levels, in the layout of the ESP32's RMT symbols:
+     *                duration in us in bits 0-14 and level in bit 15, then the same
+     *                in bits 16-31. A duration of 0 ends the capture (no more edges).
+     *                Captures are decoded as one stream from call to call.
+     *    count     - Number of symbols.
+     *    endMicros - micros() at the end of the last symbol, to time the packets with.
+     *
+     *  Returns:
+     *    Number of packets queued for process().
+     */
+    uint8_t decodeSymbols (const uint32_t * symbols, uint16_t count, unsigned int endMicros);
+
     /*+
      *  getCV() returns the selected CV value.
      *
@@ -380,6 +476,32 @@ public:
      */
     uint8_t isSetCVReady (void);
 
+    /*+
+     *  flushCVs() write every CV still waiting in the RAM cache to EEPROM, and
+     *            wait for the last write to finish. Otherwise process() writes
+     *            them one at a time, whenever the EEPROM is ready. Call it
+     *            before an acknowledgement that must follow a stored CV, or
+     *            before power down.
+     *
+     *  Inputs:
+     *    None.
+     *
+     *  Returns:
+     *    None.
+     */
+    void flushCVs (void);
+
+    /*+
+     *  getCVsPending() return how many written CVs are not in EEPROM yet.
+     *
+     *  Inputs:
+     *    None.
+     *
+     *  Returns:
+     *    Number of cached CVs waiting to be written. Always 0 with NMRA_DCC_NO_CV_CACHE.
+     */
+    uint8_t getCVsPending (void);
+
     /*+
      *  getAddr() return the currently active decoder address.
      *            based on decoder type and current address size.
@@ -393,6 +515,18 @@ public:
      */
     uint16_t getAddr (void);
 
+    /*+
+     *  getPacketEndMicros() return when the end bit of the packet last passed to
+     *            notifyDccMsg() was seen, for measuring how long it takes to act on it.
+     *
+     *  Inputs:
+     *    None.
+     *
+     *  Returns:
+     *    The low 16 bits of micros() at the end bit. Valid inside notifyDccMsg().
+     */
+    uint16_t getPacketEndMicros (void);
+
     /*+
      *  getX()  return debugging data if DCC_DEBUG is defined.
      *          You would really need to be modifying the library to need them.
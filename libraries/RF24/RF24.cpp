@@ -102,6 +102,13 @@ void RF24::csn(bool mode)
 
 void RF24::ce(bool level)
 {
+#if defined(RF24_SPI_BATCH)
+    _SPI.flush(); // Queued commands go before CE changes
+    if (level == ce_level) {
+        return; // Saves the GPIO write, e.g., for each writeFast()
+    }
+    ce_level = level;
+#endif
 #ifndef RF24_LINUX
     //Allow for 3-pin use on ATTiny
     if (ce_pin != csn_pin) {
@@ -334,6 +341,16 @@ void RF24::write_register(uint8_t reg, uint8_t value, bool is_cmd_only)
 
 /****************************************************************************/
 
+#if defined(RF24_SPI_BATCH)
+void RF24::queue_register(uint8_t reg, uint8_t value, bool is_cmd_only, uint8_t* rx)
+{
+    uint8_t tx[2] = {static_cast<uint8_t>(is_cmd_only ? reg : (W_REGISTER | reg)), value};
+    _SPI.queue(tx, rx, is_cmd_only ? 1 : 2);
+}
+#endif
+
+/****************************************************************************/
+
 void RF24::write_payload(const void* buf, uint8_t data_len, const uint8_t writeType)
 {
     const uint8_t* current = reinterpret_cast<const uint8_t*>(buf);
@@ -368,9 +385,12 @@ void RF24::write_payload(const void* buf, uint8_t data_len, const uint8_t writeT
 
     #if defined(RF24_RP2)
     _spi->transfernb((const uint8_t*)spi_txbuff, spi_rxbuff, size);
-    #else  // !defined(RF24_RP2)
+    #elif defined(RF24_SPI_BATCH)
+    _SPI.queue(spi_txbuff, spi_rxbuff, size);
+    tx_room = !(_SPI.transfer(RF24_NOP) & _BV(TX_FULL)); // The status after the payload, in the same ioctl
+    #else  // !defined(RF24_RP2) && !defined(RF24_SPI_BATCH)
     _SPI.transfernb(reinterpret_cast<char*>(spi_txbuff), reinterpret_cast<char*>(spi_rxbuff), size);
-    #endif // !defined(RF24_RP2)
+    #endif // !defined(RF24_RP2) && !defined(RF24_SPI_BATCH)
 
     status = *prx; // status is 1st byte of receive buffer
     endTransaction();
@@ -1162,8 +1182,13 @@ void RF24::startListening(void)
     powerUp();
 #endif
     config_reg |= _BV(PRIM_RX);
+#if defined(RF24_SPI_BATCH)
+    queue_register(NRF_CONFIG, config_reg); // Both go out in ce()
+    queue_register(NRF_STATUS, _BV(RX_DR) | _BV(TX_DS) | _BV(MAX_RT));
+#else
     write_register(NRF_CONFIG, config_reg);
     write_register(NRF_STATUS, _BV(RX_DR) | _BV(TX_DS) | _BV(MAX_RT));
+#endif
     ce(HIGH);
 
     // Restore the pipe0 address, if exists
@@ -1186,12 +1211,21 @@ void RF24::stopListening(void)
 
     //delayMicroseconds(100);
     delayMicroseconds(static_cast<int>(txDelay));
+#if defined(RF24_SPI_BATCH)
+    if (ack_payloads_enabled) { // These go out with the EN_RXADDR read below
+        queue_register(FLUSH_TX, RF24_NOP, true);
+    }
+
+    config_reg = static_cast<uint8_t>(config_reg & ~_BV(PRIM_RX));
+    queue_register(NRF_CONFIG, config_reg);
+#else
     if (ack_payloads_enabled) {
         flush_tx();
     }
 
     config_reg = static_cast<uint8_t>(config_reg & ~_BV(PRIM_RX));
     write_register(NRF_CONFIG, config_reg);
+#endif
 
 #if defined(RF24_TINY) || defined(LITTLEWIRE)
     // for 3 pins solution TX mode is only left with additional powerDown/powerUp cycle
@@ -1273,6 +1307,19 @@ bool RF24::write(const void* buf, uint8_t len, const bool multicast)
 
     ce(LOW);
 
+#if defined(RF24_SPI_BATCH)
+    // The flags cleared and, on failure, the FIFO flushed in one ioctl
+    uint8_t rx[2];
+    queue_register(NRF_STATUS, _BV(RX_DR) | _BV(TX_DS) | _BV(MAX_RT), false, rx);
+    if (status & _BV(MAX_RT)) {
+        queue_register(FLUSH_TX, RF24_NOP, true);
+    }
+    _SPI.flush();
+    status = rx[0];
+    if (status & _BV(MAX_RT)) {
+        return 0;
+    }
+#else
     write_register(NRF_STATUS, _BV(RX_DR) | _BV(TX_DS) | _BV(MAX_RT));
 
     //Max retries exceeded
@@ -1280,6 +1327,7 @@ bool RF24::write(const void* buf, uint8_t len, const bool multicast)
         flush_tx(); // Only going to be 1 packet in the FIFO at a time using this method, so just flush
         return 0;
     }
+#endif
     //TX OK 1 or 0
     return 1;
 }
@@ -1349,6 +1397,9 @@ bool RF24::writeFast(const void* buf, uint8_t len, const bool multicast)
 #endif
 
     //Blocking only if FIFO is full. This will loop and block until TX is successful or fail
+#if defined(RF24_SPI_BATCH)
+    if (!tx_room) // Else there was room after the last payload written, and there is no less now
+#endif
     while ((get_status() & (_BV(TX_FULL)))) {
         if (status & _BV(MAX_RT)) {
             return 0; //Return 0. The previous payload has not been retransmitted
@@ -1535,7 +1586,11 @@ bool RF24::available(uint8_t* pipe_num)
 
     // If the caller wants the pipe number, include that
     if (*pipe_num != RF24_NO_FETCH_PIPE)
+#if defined(RF24_SPI_BATCH)
+        *pipe_num = (status >> RX_P_NO) & 0x07; // The status byte came with FIFO_STATUS
+#else
         *pipe_num = (get_status() >> RX_P_NO) & 0x07;
+#endif
 
     return 1;
 }
@@ -1544,12 +1599,26 @@ bool RF24::available(uint8_t* pipe_num)
 
 void RF24::read(void* buf, uint8_t len)
 {
-
+#if defined(RF24_SPI_BATCH)
+    // The payload and the RX_DR clear in one ioctl
+    uint8_t data_len = dynamic_payloads_enabled ? rf24_min(len, static_cast<uint8_t>(32)) : rf24_min(len, payload_size);
+    uint8_t size = static_cast<uint8_t>((dynamic_payloads_enabled ? data_len : payload_size) + 1);
+    uint8_t rx[2];
+
+    memset(spi_txbuff, RF24_NOP, size);
+    spi_txbuff[0] = R_RX_PAYLOAD;
+    _SPI.queue(spi_txbuff, spi_rxbuff, size);
+    queue_register(NRF_STATUS, _BV(RX_DR), false, rx);
+    _SPI.flush();
+    memcpy(buf, spi_rxbuff + 1, data_len);
+    status = rx[0];
+#else
     // Fetch the payload
     read_payload(buf, len);
 
     //Clear the only applicable interrupt flags
     write_register(NRF_STATUS, _BV(RX_DR));
+#endif
 }
 
 /****************************************************************************/
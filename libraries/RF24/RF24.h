@@ -144,6 +144,10 @@ private:
     uint8_t config_reg;               /* For storing the value of the NRF_CONFIG register */
     bool _is_p_variant;               /* For storing the result of testing the toggleFeatures() affect */
     bool _is_p0_rx;                   /* For keeping track of pipe 0's usage in user-triggered RX mode. */
+#if defined(RF24_SPI_BATCH)
+    bool tx_room = false;    /* The last payload written left room in the TX FIFO, which can only have emptied since */
+    uint8_t ce_level = 0xFF; /* Last level written to CE. 0xFF: none yet */
+#endif
 
 protected:
     /**
@@ -1916,6 +1920,20 @@ private:
      */
     void ce(bool level);
 
+#if defined(RF24_SPI_BATCH)
+    /**
+     * Queue a register write or a command to go out with the next SPI
+     * transfer, in the same ioctl
+     *
+     * @param reg Which register or command. Use constants from nRF24L01.h
+     * @param value The value to write (ignored for a command)
+     * @param is_cmd_only if this parameter is true, then the `reg` parameter is
+     * sent alone as a command
+     * @param[out] rx If not NULL, 2 bytes: the status byte lands in rx[0] once sent
+     */
+    void queue_register(uint8_t reg, uint8_t value, bool is_cmd_only = false, uint8_t* rx = NULL);
+#endif
+
     /**
      * Write a chunk of data to a register
      *
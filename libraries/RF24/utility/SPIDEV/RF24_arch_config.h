@@ -11,6 +11,11 @@
 
 #define RF24_LINUX
 
+// Several SPI transfers in one ioctl where RF24 can; define RF24_SPIDEV_NO_BATCH for one each
+#if !defined(RF24_SPIDEV_NO_BATCH)
+    #define RF24_SPI_BATCH
+#endif
+
 #include <stddef.h>
 #include "spi.h"
 #include "gpio.h"
@@ -135,32 +135,20 @@ void SPI::init(uint32_t speed)
 
 uint8_t SPI::transfer(uint8_t tx)
 {
-    struct spi_ioc_transfer tr;
-    memset(&tr, 0, sizeof(tr));
-    tr.tx_buf = (unsigned long)&tx;
     uint8_t rx;
-    tr.rx_buf = (unsigned long)&rx;
-    tr.len = sizeof(tx);
-    tr.speed_hz = _spi_speed; //RF24_SPI_SPEED;
-    tr.delay_usecs = 0;
-    tr.bits_per_word = RF24_SPIDEV_BITS;
-    tr.cs_change = 0;
-
-    int ret;
-    ret = ioctl(this->fd, SPI_IOC_MESSAGE(1), &tr);
-    if (ret < 1) {
-        throw SPIException("can't send spi message");
-    }
-    /*{
-        perror("can't send spi message");
-        abort();
-    }*/
-
+    transfernb(reinterpret_cast<char*>(&tx), reinterpret_cast<char*>(&rx), 1);
     return rx;
 }
 
 void SPI::transfernb(char* tbuf, char* rbuf, uint32_t len)
 {
+    if (queued && len <= RF24_SPIDEV_XFER) { // Goes out with the queue, last
+        queue(reinterpret_cast<uint8_t*>(tbuf), reinterpret_cast<uint8_t*>(rbuf), static_cast<uint8_t>(len));
+        flush();
+        return;
+    }
+    flush();
+
     struct spi_ioc_transfer tr;
     memset(&tr, 0, sizeof(tr));
     tr.tx_buf = (unsigned long)tbuf;
@@ -172,6 +160,7 @@ void SPI::transfernb(char* tbuf, char* rbuf, uint32_t len)
     tr.cs_change = 0;
 
     int ret;
+    ioctls++;
     ret = ioctl(this->fd, SPI_IOC_MESSAGE(1), &tr);
     if (ret < 1) {
         throw SPIException("can't send spi message");
@@ -182,6 +171,47 @@ void SPI::transfernb(char* tbuf, char* rbuf, uint32_t len)
     }*/
 }
 
+void SPI::queue(const uint8_t* tbuf, uint8_t* rbuf, uint8_t len)
+{
+    if (queued == RF24_SPIDEV_QUEUE) {
+        flush();
+    }
+    memcpy(qtx[queued], tbuf, len);
+    qlen[queued] = len;
+    qout[queued] = rbuf;
+    queued++;
+}
+
+void SPI::flush()
+{
+    struct spi_ioc_transfer tr[RF24_SPIDEV_QUEUE];
+    uint8_t n = queued;
+
+    if (!n) {
+        return;
+    }
+    queued = 0; // Emptied even if the ioctl throws
+    memset(tr, 0, sizeof(tr));
+    for (uint8_t i = 0; i < n; i++) {
+        tr[i].tx_buf = (unsigned long)qtx[i];
+        tr[i].rx_buf = (unsigned long)qrx[i];
+        tr[i].len = qlen[i];
+        tr[i].speed_hz = _spi_speed;
+        tr[i].bits_per_word = RF24_SPIDEV_BITS;
+        tr[i].cs_change = (i < n - 1); // Each is a command of its own: CS high in between
+    }
+
+    ioctls++;
+    if (ioctl(this->fd, SPI_IOC_MESSAGE(n), tr) < 1) {
+        throw SPIException("can't send spi message");
+    }
+    for (uint8_t i = 0; i < n; i++) {
+        if (qout[i]) {
+            memcpy(qout[i], qrx[i], qlen[i]);
+        }
+    }
+}
+
 void SPI::transfern(char* buf, uint32_t len)
 {
     transfernb(buf, buf, len);
@@ -15,6 +15,11 @@
 
 #include "../../RF24_config.h" // This is cyclical and should be fixed
 
+/** Most transfers queued for one ioctl */
+#define RF24_SPIDEV_QUEUE 6
+/** Longest transfer: a command and a 32 byte payload */
+#define RF24_SPIDEV_XFER 33
+
 /** Specific excpetion for SPI errors */
 class SPIException : public std::runtime_error
 {
@@ -39,6 +44,20 @@ public:
 
     void transfern(char* buf, uint32_t len);
 
+    /**
+     * Queue a transfer of up to RF24_SPIDEV_XFER bytes. Queued transfers go
+     * out in one SPI_IOC_MESSAGE ioctl with the next flush(), transfer() or
+     * transfernb(), in order and with CS released between them.
+     * tbuf is copied now; rbuf, if not NULL, is filled in when they go out.
+     */
+    void queue(const uint8_t* tbuf, uint8_t* rbuf, uint8_t len);
+
+    /** Send the queued transfers, if any */
+    void flush();
+
+    /** ioctl calls that carried transfers, for measuring */
+    uint32_t ioctls = 0;
+
     ~SPI();
 
 private:
@@ -46,6 +65,12 @@ private:
     uint32_t _spi_speed;
     bool spiIsInitialized = false;
     void init(uint32_t spi_speed = RF24_SPI_SPEED);
+
+    uint8_t queued = 0;
+    uint8_t qlen[RF24_SPIDEV_QUEUE];
+    uint8_t qtx[RF24_SPIDEV_QUEUE][RF24_SPIDEV_XFER];
+    uint8_t qrx[RF24_SPIDEV_QUEUE][RF24_SPIDEV_XFER];
+    uint8_t* qout[RF24_SPIDEV_QUEUE];
 };
 
 #endif // RF24_UTILITY_SPIDEV_SPI_H_
@@ -116,6 +116,17 @@ caution or for development only.
 // #define AUTOIDLEOFFDEFAULT 1
 #endif
 
+#if defined(TRANSMITTER)
+/* Preamble bits on air, by the receivers in use. Also set with CV232*/
+/* 0: Airwire (30 bits on every packet and the long cutout pulse)*/
+/* 1: Tam Valley DRS1 (20 bits, 24 for resets/e-stops and CV/ops packets)*/
+/* 2: ProMiniAir receivers only (16 bits, 20 for resets/e-stops and CV/ops packets)*/
+/* Use 0 if ANY Airwire receiver is listening. The default is 0*/
+/* Writing CV242 (or defining PREAMBLE_BITS) overrides the profile, as before: that many*/
+/* bits on every packet, and the long cutout pulse at 30 or more. Writing CV232 undoes it*/
+// #define PREAMBLE_PROFILE 2
+#endif
+
 #if defined(NAEU_900MHz)
 /* For 915MHz NA only Repeater transmitters/receivers. Not for European operation!*/
 // #define CHANNELDEFAULT 15
@@ -167,6 +178,12 @@ caution or for development only.
 // The default value is 1
 // #define REPEATPACKETDEFAULT 0
 //////////////////////////
+// Receiver: through an RF dropout, keep sending
+// the latest speed and functions of each loco
+// for up to this many 1/4 sec intervals (CV231).
+// 0 turns it off. The default is 8
+// #define CONCEALCUTOFFDEFAULT 4
+//////////////////////////
 //}
 
 ///////////////////////
@@ -175,6 +192,24 @@ caution or for development only.
 // #define PRINT_LATENCY
 ///////////////////////
 
+///////////////////////////////
+// Add an OLED/LCD page showing
+// the packet queue statistics
+// (also readable in CV200-214)
+///////////////////////////////
+// #define SHOW_RING_STATS
+///////////////////////////////
+
+///////////////////////////////
+// Time each packet from its end
+// bit at the DCC input to its
+// preamble on air (transmitter)
+// (readable in CV216-229, and
+// on serial with DEBUG)
+///////////////////////////////
+// #define LATENCY_STATS
+///////////////////////////////
+
 
 /*Test of new 2.4GHz setting*/
 // #define ALTERNATIVE2P4
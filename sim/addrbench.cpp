@@ -0,0 +1,330 @@
+/*
+sim/addrbench.cpp
+
+Host benchmark of NmraDcc's packet decoder with FLAGS_MY_ADDRESS_ONLY, as
+the receivers run it: a capture of a busy layout's DCC (scripts/layout.hex
+by default) goes through execDccProcessor(), the function process() hands
+each packet to, over and over, for decoders with different addresses.
+
+Built twice: with the address filter and with NMRA_DCC_NO_ADDRESS_FILTER,
+the full decode for every packet. Both should make the same callbacks
+(the same count and check value); the filter only makes it cheaper to
+turn away packets for others.
+
+Then CV writes, on an EEPROM that takes EE_WRITE_US per byte and, like
+avr-libc's, makes reads and writes wait for the one in progress: ops mode
+writes off the track, and a burst of setCV() calls. It shows how long the
+decoder was held up waiting for the EEPROM, and when the last CV was in
+it. addr-bench-nocache is built with NMRA_DCC_NO_CV_CACHE to compare.
+
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <NmraDcc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+// The decoder behind process(), in NmraDcc.cpp
+void execDccProcessor(DCC_MSG *pDccMsg);
+
+///////////////////////////////
+// What NmraDcc needs of Arduino
+///////////////////////////////
+
+#define EE_WRITE_US 3400   // ATmega328P erase and write of a byte
+#define PACKET_US   6000   // A 3-byte packet and the preamble of the next, at the track's bit rate
+
+static uint8_t eeprom[E2END + 1];
+static uint64_t eeReads = 0, eeWrites = 0;
+static bool eeTimed = false;           // The CV runs: the EEPROM takes time, in simulated us
+static uint64_t simUs, eeBusyUntil, eeWaitUs, eeWaitMaxUs;
+SimEEPROM EEPROM;
+
+static uint64_t nowNs(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+// Wait out a write in progress, as avr-libc does before any access
+static void eeWait(void) {
+  if (eeTimed && (simUs < eeBusyUntil)) {
+     uint64_t w = eeBusyUntil - simUs;
+     eeWaitUs += w;
+     if (w > eeWaitMaxUs) eeWaitMaxUs = w;
+     simUs = eeBusyUntil;
+  }
+}
+
+extern "C" {
+volatile uint8_t PINB, PINC, PIND;
+uint8_t eeprom_read_byte(const uint8_t *addr) { eeWait(); eeReads++; return eeprom[(uintptr_t)addr]; }
+void eeprom_write_byte(uint8_t *addr, uint8_t val) {
+  eeWait();
+  eeWrites++;
+  eeprom[(uintptr_t)addr] = val;
+  eeBusyUntil = simUs + EE_WRITE_US;
+}
+void eeprom_update_byte(uint8_t *addr, uint8_t val) { if (eeprom[(uintptr_t)addr] != val) eeprom_write_byte(addr, val); }
+int eeprom_is_ready(void) { return !eeTimed || (simUs >= eeBusyUntil); }
+uint32_t millis(void) { return (uint32_t)(nowNs() / 1000000); }
+uint32_t micros(void) { return (uint32_t)(nowNs() / 1000); }
+void pinMode(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return 0; }
+void attachInterrupt(uint8_t, void (*)(void), int) {}
+void sim_cli(void) {}
+void sim_sei(void) {}
+}
+
+////////////
+// Callbacks
+////////////
+
+static uint64_t calls, check;
+
+static void called(uint32_t a, uint32_t b, uint32_t c) {
+  calls++;
+  check = check * 1000003 + ((uint64_t)a << 32 | b << 8 | c);
+}
+
+void notifyDccSpeed(uint16_t Addr, DCC_ADDR_TYPE AddrType, uint8_t Speed, DCC_DIRECTION Dir, DCC_SPEED_STEPS SpeedSteps) {
+  called(Addr | AddrType << 16, Speed | Dir << 8, SpeedSteps);
+}
+void notifyDccFunc(uint16_t Addr, DCC_ADDR_TYPE AddrType, FN_GROUP FuncGrp, uint8_t FuncState) {
+  called(Addr | AddrType << 16, FuncGrp, FuncState);
+}
+void notifyDccAccTurnoutBoard(uint16_t BoardAddr, uint8_t OutputPair, uint8_t Direction, uint8_t OutputPower) {
+  called(BoardAddr, OutputPair, Direction | OutputPower << 1);
+}
+void notifyDccAccTurnoutOutput(uint16_t Addr, uint8_t Direction, uint8_t OutputPower) {
+  called(Addr, 1, Direction | OutputPower << 1);
+}
+void notifyDccSigOutputState(uint16_t Addr, uint8_t State) {
+  called(Addr, 2, State);
+}
+void notifyCVChange(uint16_t CV, uint8_t Value) {
+  called(CV, 3, Value);
+}
+void notifyDccIdle(void) {
+  called(0, 4, 0);
+}
+void notifyDccReset(uint8_t hardReset) {
+  called(0, 5, hardReset);
+}
+
+////////////
+// The bench
+////////////
+
+static std::vector<DCC_MSG> trace;
+
+static void load(const char *path) {
+  FILE *f = fopen(path, "r");
+  char line[256];
+
+  if (!f) {
+     perror(path);
+     exit(1);
+  }
+  while (fgets(line, sizeof(line), f)) {
+     DCC_MSG m;
+     char *p = line, *e;
+     uint8_t x = 0;
+
+     if (line[0] == '#') continue;
+     memset(&m, 0, sizeof(m));
+     while (m.Size < MAX_DCC_MESSAGE_LEN - 1) {
+        unsigned long b = strtoul(p, &e, 16);
+        if (e == p) break;
+        m.Data[m.Size++] = (uint8_t)b;
+        x ^= (uint8_t)b;
+        p = e;
+     }
+     if (m.Size < 2) continue;
+     m.Data[m.Size++] = x;   // The XOR byte, as the ISR leaves it
+     m.PreambleBits = 14;
+     trace.push_back(m);
+  }
+  fclose(f);
+  if (trace.empty()) {
+     fprintf(stderr, "%s: no packets\n", path);
+     exit(1);
+  }
+}
+
+typedef struct {
+  const char *label;
+  uint8_t flags;
+  uint16_t cv[4][2];   // CV, value; CV 0 ends
+} decoder_t;
+
+static NmraDcc Dcc;
+
+static void pass(void) {
+  for (size_t i = 0; i < trace.size(); i++) {
+     DCC_MSG m = trace[i];  // The decoder may write to it
+     execDccProcessor(&m);
+  }
+}
+
+static void run(const decoder_t *d, double seconds) {
+  uint64_t packets = 0, t0, t;
+
+  memset(eeprom, 0xFF, sizeof(eeprom));
+  Dcc.init(MAN_ID_DIY, 10, FLAGS_MY_ADDRESS_ONLY | d->flags, 0);
+  for (uint8_t i = 0; (i < 4) && d->cv[i][0]; i++) Dcc.setCV(d->cv[i][0], (uint8_t)d->cv[i][1]);
+
+  calls = check = eeReads = eeWrites = 0;
+  pass();  // The callbacks of one pass, to compare builds with
+  uint64_t passCalls = calls, passCheck = check;
+
+  eeReads = 0;
+  t0 = nowNs();
+  do {
+     pass();
+     packets += trace.size();
+     t = nowNs();
+  } while ((t - t0) < seconds * 1e9);
+
+  printf("%-32s %12.0f %8.1f %10llu %8.2f %18llx\n", d->label, packets / ((t - t0) * 1e-9), (double)(t - t0) / packets,
+         (unsigned long long)passCalls, (double)eeReads / packets, (unsigned long long)passCheck);
+}
+
+//////////////
+// The CV runs
+//////////////
+
+typedef struct {
+  const char *label;
+  uint8_t ops;         // CVs written in ops mode, each packet twice, from CV 50
+  uint8_t setCVs;      // CVs written with setCV(), back to back, from CV 30
+} cvRun_t;
+
+static void append(std::vector<DCC_MSG> &v, uint8_t n, const uint8_t *b) {
+  DCC_MSG m;
+  uint8_t x = 0;
+
+  memset(&m, 0, sizeof(m));
+  for (uint8_t i = 0; i < n; i++) x ^= m.Data[m.Size++] = b[i];
+  m.Data[m.Size++] = x;
+  m.PreambleBits = 14;
+  v.push_back(m);
+}
+
+static void cvRun(const cvRun_t *r) {
+  std::vector<DCC_MSG> packets;
+  uint64_t t0;
+
+  for (uint8_t k = 0; k < r->ops; k++) {
+     const uint8_t pom[] = {3, 0xEC, (uint8_t)(49 + k), (uint8_t)(10 + k)};  // CV 50+k := 10+k
+     const uint8_t speed[] = {3, 0x3F, 0x90};
+     append(packets, sizeof(pom), pom);
+     append(packets, sizeof(pom), pom);
+     append(packets, sizeof(speed), speed);
+  }
+
+  memset(eeprom, 0xFF, sizeof(eeprom));
+  eeTimed = false;
+  Dcc.init(MAN_ID_DIY, 10, FLAGS_MY_ADDRESS_ONLY, 0);
+  Dcc.setCV(CV_29_CONFIG, 0x06);
+  Dcc.setCV(1, 3);
+  Dcc.flushCVs();
+
+  eeTimed = true;
+  simUs = eeBusyUntil = eeWaitUs = eeWaitMaxUs = eeWrites = 0;
+  for (uint8_t k = 0; k < r->setCVs; k++) Dcc.setCV(30 + k, 40 + k);
+  for (size_t i = 0; i < packets.size(); i++) {
+     DCC_MSG m = packets[i];
+     execDccProcessor(&m);
+     Dcc.process();
+     simUs += PACKET_US;
+  }
+  t0 = simUs;
+  while (Dcc.getCVsPending() || !eeprom_is_ready()) {  // The loop goes on with no more CV traffic
+     Dcc.process();
+     simUs += 100;
+  }
+  eeTimed = false;
+
+  bool ok = true;
+  for (uint8_t k = 0; k < r->ops; k++) ok = ok && (eeprom[50 + k] == 10 + k);
+  for (uint8_t k = 0; k < r->setCVs; k++) ok = ok && (eeprom[30 + k] == 40 + k);
+  printf("%-32s %8u %10.1f %10.1f %12.1f %8s\n", r->label, (unsigned)eeWrites, eeWaitUs / 1000.0, eeWaitMaxUs / 1000.0,
+         (simUs - t0) / 1000.0, ok ? "ok" : "WRONG");
+}
+
+int main(int argc, char **argv) {
+  static const decoder_t decoders[] = {
+     {"Loco 3",                      0,                                                    {{CV_29_CONFIG, 0x06}, {1, 3}}},
+     {"Loco 1234, consist 10",       0,                                                    {{CV_29_CONFIG, 0x26}, {17, 0xC4}, {18, 0xD2}, {19, 10}}},
+     {"Accessory board 5",           FLAGS_DCC_ACCESSORY_DECODER,                          {{CV_29_CONFIG, 0x80}, {1, 5}, {9, 0}}},
+     {"Accessory output 17",         FLAGS_DCC_ACCESSORY_DECODER | FLAGS_OUTPUT_ADDRESS_MODE, {{CV_29_CONFIG, 0xC0}, {1, 17}, {9, 0}}},
+  };
+  const char *path = "scripts/layout.hex";
+  double seconds = 1;
+  int c;
+
+  while ((c = getopt(argc, argv, "f:t:")) != -1) {
+     switch (c) {
+        case 'f': path = optarg; break;
+        case 't': seconds = atof(optarg); break;
+        default:
+           fprintf(stderr, "Usage: %s [-f capture] [-t seconds per decoder]\n", argv[0]);
+           return 1;
+     }
+  }
+  load(path);
+
+#if defined(NMRA_DCC_NO_ADDRESS_FILTER)
+  printf("NmraDcc, full decode of every packet, %s: %u packets\n", path, (unsigned)trace.size());
+#else
+  printf("NmraDcc, address filter, %s: %u packets\n", path, (unsigned)trace.size());
+#endif
+  printf("%-32s %12s %8s %10s %8s %18s\n", "FLAGS_MY_ADDRESS_ONLY", "Packets/s", "ns/pkt", "Callbacks", "CV rd/pk", "Check");
+  for (size_t i = 0; i < sizeof(decoders)/sizeof(decoders[0]); i++) run(&decoders[i], seconds);
+
+  static const cvRun_t cvRuns[] = {
+     {"Ops mode writes to loco 3",   12, 0},
+     {"setCV() x 4",                  0, 4},
+     {"setCV() x 12",                 0, 12},
+  };
+#if defined(NMRA_DCC_NO_CV_CACHE)
+  printf("\nCV writes, straight to EEPROM (%u us a byte)\n", EE_WRITE_US);
+#else
+  printf("\nCV writes, through the RAM cache of %u CVs (%u us a byte)\n", DCC_CV_CACHE, EE_WRITE_US);
+#endif
+  printf("%-32s %8s %10s %10s %12s %8s\n", "", "Writes", "Waited ms", "Longest ms", "In EEPROM ms", "EEPROM");
+  for (size_t i = 0; i < sizeof(cvRuns)/sizeof(cvRuns[0]); i++) cvRun(&cvRuns[i]);
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,201 @@
+/*
+sim/cvstoretest.cpp
+
+Power-loss test of the transmitter's CV journal (cvstore.cpp) on the host.
+
+The journal is built with CVS_POLL and drained from here, on an EEPROM
+stand-in that can lose power. Random CVs are written in bursts; during
+some bursts the power is cut after a random number of byte writes: that
+byte is left torn (erased, half programmed or garbage) and every write
+after it is lost. cvsBegin() then rebuilds the cache from the EEPROM,
+and every CV must read as its last committed value. A CV written in the
+burst that was cut may read as its value before the burst or as any
+value the burst gave it, nothing else.
+
+Clean reboots between bursts must bring back every value exactly.
+
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <avr/eeprom.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "cvstore.h"
+
+//////////////////////////
+// An EEPROM that can die
+//////////////////////////
+
+static uint8_t eeMem[E2END + 1];
+static uint16_t eeCellWrites[E2END + 1];
+static uint64_t eeWrites;
+static long cutIn = -1;     // Byte writes left before the power goes; -1 never
+static uint64_t torn[3];    // Erased, half programmed, garbage
+
+struct PowerCut {};
+
+extern "C" {
+uint8_t eeprom_read_byte(const uint8_t *addr) { return eeMem[(uintptr_t)addr & E2END]; }
+void eeprom_write_byte(uint8_t *addr, uint8_t val) {
+  uint16_t a = (uintptr_t)addr & E2END;
+
+  if ((cutIn >= 0) && (cutIn-- == 0)) {
+     uint8_t how = rand() % 3;
+     torn[how]++;
+     eeMem[a] = (how == 0) ? 0xFF : (how == 1) ? (eeMem[a] & val) : (uint8_t)rand();
+     throw PowerCut();
+  }
+  eeMem[a] = val;
+  eeWrites++;
+  eeCellWrites[a]++;
+}
+void eeprom_update_byte(uint8_t *addr, uint8_t val) {
+  if (eeprom_read_byte(addr) != val) eeprom_write_byte(addr, val);
+}
+int eeprom_is_ready(void) { return 1; }
+uint8_t sim_irq_save(void) { return 0; }
+void sim_irq_restore(uint8_t) {}
+void sim_cli(void) {}
+void sim_sei(void) {}
+}
+
+////////////
+// The model
+////////////
+
+#define IDS      20     // Distinct CVs, within CVS_CACHE
+#define DEFAULT  0x5A   // What cvsRead() must give for a CV never committed
+
+static int committed[IDS + 1];   // Last value in the EEPROM, -1 none
+
+static uint32_t check(const char *when, const std::vector<int> *allowed) {
+  uint32_t bad = 0;
+
+  for (uint8_t id = 1; id <= IDS; id++) {
+     int want = (committed[id] < 0) ? DEFAULT : committed[id];
+     uint8_t got = cvsRead(id, DEFAULT);
+     bool ok = (got == want);
+     for (size_t k = 0; !ok && allowed && (k < allowed[id].size()); k++) ok = (got == allowed[id][k]);
+     if (!ok) {
+        if (bad < 5) printf("  %s: CV id %u reads %u, committed %d\n", when, id, got, committed[id]);
+        bad++;
+     }
+  }
+  return bad;
+}
+
+int main(int argc, char **argv) {
+  long writes = 200000;
+  int cutEvery = 20;   // One burst in this many loses power
+  unsigned seed = 1;
+  uint64_t cuts = 0, reboots = 0, bursts = 0;
+  uint32_t bad = 0;
+  long done = 0;
+  int c;
+
+  while ((c = getopt(argc, argv, "c:n:s:")) != -1) {
+     switch (c) {
+        case 'c': cutEvery = atoi(optarg); break;
+        case 'n': writes = atol(optarg); break;
+        case 's': seed = atoi(optarg); break;
+        default:
+           fprintf(stderr, "Usage: %s [-n writes] [-c 1 burst in c loses power] [-s seed]\n", argv[0]);
+           return 1;
+     }
+  }
+  srand(seed);
+  memset(eeMem, 0xFF, sizeof(eeMem));
+  for (uint8_t id = 0; id <= IDS; id++) committed[id] = -1;
+  cvsBegin();
+
+  while (done < writes) {
+     std::vector<int> allowed[IDS + 1];
+     int burst[CVS_PENDING * 3][2];
+     int n = 1 + rand() % (CVS_PENDING * 3);   // Fewer and more than the queue holds
+     bool cut = (cutEvery > 0) && (rand() % cutEvery == 0);
+
+     for (int k = 0; k < n; k++) {
+        burst[k][0] = 1 + rand() % IDS;
+        burst[k][1] = rand() % 256;
+        allowed[burst[k][0]].push_back(burst[k][1]);
+     }
+     cutIn = cut ? rand() % (n * 6 * 2) : -1;   // Anywhere in the burst, or after it
+     bursts++;
+     try {
+        for (int k = 0; k < n; k++) cvsWrite(burst[k][0], burst[k][1]);
+        cvsFlush();
+        cutIn = -1;
+        for (int k = 0; k < n; k++) committed[burst[k][0]] = burst[k][1];
+     } catch (PowerCut &) {
+        cuts++;
+        cvsBegin();
+        bad += check("after a power cut", allowed);
+        for (uint8_t id = 1; id <= IDS; id++) {   // What came back is what is committed now
+           if (allowed[id].empty()) continue;
+           uint8_t v = cvsRead(id, DEFAULT);
+           bool never = (v == DEFAULT) && (cvsRead(id, (uint8_t)~DEFAULT) == (uint8_t)~DEFAULT);
+           committed[id] = never ? -1 : v;
+        }
+     }
+     done += n;
+
+     if (bursts % 50 == 0) {   // A clean reboot
+        reboots++;
+        cvsBegin();
+        bad += check("after a reboot", NULL);
+     }
+  }
+  cvsBegin();
+  bad += check("at the end", NULL);
+
+  uint16_t maxCell = 0;
+  for (uint16_t a = CVS_BASE; a <= E2END; a++) if (eeCellWrites[a] > maxCell) maxCell = eeCellWrites[a];
+  printf("CV journal: %ld writes to %u CVs in %llu bursts, %llu EEPROM byte writes\n", done, IDS,
+         (unsigned long long)bursts, (unsigned long long)eeWrites);
+  printf("Power cuts: %llu (torn byte erased %llu, half programmed %llu, garbage %llu), clean reboots: %llu\n",
+         (unsigned long long)cuts, (unsigned long long)torn[0], (unsigned long long)torn[1], (unsigned long long)torn[2],
+         (unsigned long long)reboots);
+  printf("Most writes to one byte: %u, %.1f times the mean\n", maxCell,
+         maxCell / ((double)eeWrites / (E2END + 1 - CVS_BASE)));
+
+  // A full cache refuses a new id and counts it, and drops nothing at the next boot
+  for (uint16_t id = IDS + 1; id <= CVS_CACHE; id++) cvsWrite(id, id);
+  uint8_t over = cvsWrite(CVS_CACHE + 1, 0);
+  uint8_t lost = cvsLost();
+  cvsFlush();
+  cvsBegin();
+  printf("Cache full at %u ids: write refused %s, counted %u, lost at the next boot %u\n", CVS_CACHE,
+         over ? "no" : "yes", lost, cvsLost());
+  if (over || (lost != 1) || cvsLost()) bad++;
+  for (uint16_t id = IDS + 1; id <= CVS_CACHE; id++) if (cvsRead(id, DEFAULT) != id) bad++;
+  printf("Values wrong after a restart: %u\n", bad);
+  if (bad) printf("FAILED\n");
+  return bad ? 1 : 0;
+}
\ No newline at end of file
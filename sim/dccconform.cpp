@@ -0,0 +1,560 @@
+/*
+sim/dccconform.cpp
+
+NMRA conformance and throughput of NmraDcc's packet decoder on the host.
+
+A corpus of S-9.2 and S-9.2.1 packets is generated with the callbacks
+each one must make: resets and idles, 14, 28 and 128 speed steps,
+function groups F0-F68, ops mode CV access, basic and extended
+accessory packets, consists and the address filter. Every packet is
+taken through execDccProcessor() on the decoder it is meant for, the
+callbacks are recorded and compared with the expected ones, and the
+packets of each group are then timed.
+
+Packets the standard defines but NmraDcc does not decode (F29-F68,
+consist control, speed and functions by the consist address) are expected to make no callback, and are counted
+apart so that adding them shows up here.
+
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <NmraDcc.h>
+#include <initializer_list>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+// The decoder behind process(), in NmraDcc.cpp
+void execDccProcessor(DCC_MSG *pDccMsg);
+
+///////////////////////////////
+// What NmraDcc needs of Arduino
+///////////////////////////////
+
+static uint8_t eeprom[E2END + 1];
+SimEEPROM EEPROM;
+
+static uint64_t nowNs(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+extern "C" {
+volatile uint8_t PINB, PINC, PIND;
+uint8_t eeprom_read_byte(const uint8_t *addr) { return eeprom[(uintptr_t)addr]; }
+void eeprom_write_byte(uint8_t *addr, uint8_t val) { eeprom[(uintptr_t)addr] = val; }
+void eeprom_update_byte(uint8_t *addr, uint8_t val) { eeprom[(uintptr_t)addr] = val; }
+int eeprom_is_ready(void) { return 1; }
+uint32_t millis(void) { return (uint32_t)(nowNs() / 1000000); }
+uint32_t micros(void) { return (uint32_t)(nowNs() / 1000); }
+void pinMode(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return 0; }
+void attachInterrupt(uint8_t, void (*)(void), int) {}
+void sim_cli(void) {}
+void sim_sei(void) {}
+}
+
+/////////////////////////
+// Callbacks, as recorded
+/////////////////////////
+
+enum {
+  EV_RESET, EV_IDLE, EV_SPEED, EV_SPEEDRAW, EV_FUNC, EV_ACCBOARD, EV_ACCOUTPUT, EV_SIG, EV_CV,
+  EV_BOARDSET, EV_OUTPUTSET
+};
+static const char *evNames[] = {
+  "Reset", "Idle", "Speed", "SpeedRaw", "Func", "AccTurnoutBoard", "AccTurnoutOutput", "SigOutputState", "CVChange",
+  "AccBoardAddrSet", "AccOutputAddrSet"
+};
+
+typedef struct {
+  uint8_t kind;
+  uint8_t type;    // DCC_ADDR_TYPE of a multi-function callback
+  uint16_t addr;
+  uint8_t a, b, c;
+} ev_t;
+
+#define MAX_EV 4   // Callbacks one packet may make
+
+static ev_t got[MAX_EV];
+static uint8_t nGot;
+
+static void rec(uint8_t kind, uint16_t addr, uint8_t type, uint8_t a, uint8_t b, uint8_t c) {
+  if (nGot < MAX_EV) {
+     ev_t *e = &got[nGot];
+     e->kind = kind;
+     e->type = type;
+     e->addr = addr;
+     e->a = a;
+     e->b = b;
+     e->c = c;
+  }
+  if (nGot < 255) nGot++;
+}
+
+void notifyDccReset(uint8_t hardReset) { rec(EV_RESET, 0, 0, hardReset, 0, 0); }
+void notifyDccIdle(void) { rec(EV_IDLE, 0, 0, 0, 0, 0); }
+void notifyDccSpeed(uint16_t Addr, DCC_ADDR_TYPE AddrType, uint8_t Speed, DCC_DIRECTION Dir, DCC_SPEED_STEPS SpeedSteps) {
+  rec(EV_SPEED, Addr, AddrType, Speed, Dir, SpeedSteps);
+}
+void notifyDccSpeedRaw(uint16_t Addr, DCC_ADDR_TYPE AddrType, uint8_t Raw) { rec(EV_SPEEDRAW, Addr, AddrType, Raw, 0, 0); }
+void notifyDccFunc(uint16_t Addr, DCC_ADDR_TYPE AddrType, FN_GROUP FuncGrp, uint8_t FuncState) {
+  rec(EV_FUNC, Addr, AddrType, FuncGrp, FuncState, 0);
+}
+void notifyDccAccTurnoutBoard(uint16_t BoardAddr, uint8_t OutputPair, uint8_t Direction, uint8_t OutputPower) {
+  rec(EV_ACCBOARD, BoardAddr, 0, OutputPair, Direction, OutputPower);
+}
+void notifyDccAccTurnoutOutput(uint16_t Addr, uint8_t Direction, uint8_t OutputPower) {
+  rec(EV_ACCOUTPUT, Addr, 0, Direction, OutputPower, 0);
+}
+void notifyDccAccBoardAddrSet(uint16_t BoardAddr) { rec(EV_BOARDSET, BoardAddr, 0, 0, 0, 0); }
+void notifyDccAccOutputAddrSet(uint16_t Addr) { rec(EV_OUTPUTSET, Addr, 0, 0, 0, 0); }
+void notifyDccSigOutputState(uint16_t Addr, uint8_t State) { rec(EV_SIG, Addr, 0, State, 0, 0); }
+void notifyCVChange(uint16_t CV, uint8_t Value) { rec(EV_CV, CV, 0, Value, 0, 0); }
+
+/////////////
+// The corpus
+/////////////
+
+typedef struct {
+  DCC_MSG msg;
+  uint8_t nEv;
+  ev_t ev[MAX_EV];
+  bool notDecoded;   // In the standard, not in NmraDcc: no callback expected
+} case_t;
+
+typedef struct {
+  const char *label;
+  uint8_t flags;
+  uint16_t cv[4][2];   // CV, value; CV 0 ends. The EEPROM starts erased: CV 19 is 0xFF until set
+} decoder_t;
+
+enum { LOCO3, LOCO3_14, LOCO1234, LOCO3_ALL, ACC_BOARD5, ACC_OUTPUT17, LOCO1234_REV };
+
+static const decoder_t decoders[] = {
+  {"loco 3",                 FLAGS_MY_ADDRESS_ONLY, {{CV_29_CONFIG, 0x06}, {1, 3}, {19, 0}}},
+  {"loco 3, 14 steps",       FLAGS_MY_ADDRESS_ONLY, {{CV_29_CONFIG, 0x04}, {1, 3}, {19, 0}}},
+  {"loco 1234, consist 10",  FLAGS_MY_ADDRESS_ONLY, {{CV_29_CONFIG, 0x26}, {17, 0xC4}, {18, 0xD2}, {19, 10}}},
+  {"loco 3, every address",  0,                     {{CV_29_CONFIG, 0x06}, {1, 3}, {19, 0}}},
+  {"accessory board 5",      FLAGS_MY_ADDRESS_ONLY | FLAGS_DCC_ACCESSORY_DECODER, {{CV_29_CONFIG, 0x80}, {1, 5}, {9, 0}}},
+  {"accessory output 17",    FLAGS_MY_ADDRESS_ONLY | FLAGS_DCC_ACCESSORY_DECODER | FLAGS_OUTPUT_ADDRESS_MODE,
+                                                    {{CV_29_CONFIG, 0xC0}, {1, 17}, {9, 0}}},
+  {"loco 1234, consist 138", FLAGS_MY_ADDRESS_ONLY, {{CV_29_CONFIG, 0x26}, {17, 0xC4}, {18, 0xD2}, {19, 0x8A}}},
+};
+
+typedef struct {
+  const char *label;
+  uint8_t decoder;
+  std::vector<case_t> cases;
+} group_t;
+
+static std::vector<group_t> groups;
+
+static void group(const char *label, uint8_t decoder) {
+  groups.push_back(group_t());
+  groups.back().label = label;
+  groups.back().decoder = decoder;
+}
+
+// A packet, with the XOR byte as the ISR leaves it
+static case_t &packet(std::initializer_list<uint8_t> bytes) {
+  case_t c;
+  uint8_t x = 0;
+
+  memset(&c, 0, sizeof(c));
+  for (uint8_t b : bytes) x ^= c.msg.Data[c.msg.Size++] = b;
+  c.msg.Data[c.msg.Size++] = x;
+  c.msg.PreambleBits = 14;
+  groups.back().cases.push_back(c);
+  return groups.back().cases.back();
+}
+
+// A multi-function packet: the address, then up to 3 instruction bytes
+static case_t &loco(uint16_t addr, DCC_ADDR_TYPE type, uint8_t i0, int i1 = -1, int i2 = -1) {
+  uint8_t b[5];
+  uint8_t n = 0;
+
+  if (type == DCC_ADDR_LONG) {
+     b[n++] = 0xC0 | (addr >> 8);
+     b[n++] = addr & 0xFF;
+  } else {
+     b[n++] = (uint8_t)addr;
+  }
+  b[n++] = i0;
+  if (i1 >= 0) b[n++] = (uint8_t)i1;
+  if (i2 >= 0) b[n++] = (uint8_t)i2;
+  switch (n) {
+     case 2:  return packet({b[0], b[1]});
+     case 3:  return packet({b[0], b[1], b[2]});
+     case 4:  return packet({b[0], b[1], b[2], b[3]});
+     default: return packet({b[0], b[1], b[2], b[3], b[4]});
+  }
+}
+
+static void expect(case_t &c, uint8_t kind, uint16_t addr, uint8_t type, uint8_t a, uint8_t b = 0, uint8_t x = 0) {
+  ev_t *e = &c.ev[c.nEv++];
+
+  e->kind = kind;
+  e->type = type;
+  e->addr = addr;
+  e->a = a;
+  e->b = b;
+  e->c = x;
+}
+
+// Basic accessory packet for a 9-bit board address: 10AAAAAA 1AAACDDD, the high bits inverted
+static case_t &basicAcc(uint16_t board, uint8_t pair, uint8_t dir, uint8_t power) {
+  return packet({(uint8_t)(0x80 | (board & 0x3F)),
+                 (uint8_t)(0x80 | ((~board >> 2) & 0x70) | (power << 3) | (pair << 1) | dir)});
+}
+
+// Extended accessory packet for an 11-bit output address from 1: 10AAAAAA 0AAA0AA1 XXXXXXXX
+static case_t &extAcc(uint16_t output, uint8_t aspect) {
+  uint16_t a = output - 1 + 4;   // Board 1 output 1 is 4 on the wire
+
+  return packet({(uint8_t)(0x80 | ((a >> 2) & 0x3F)),
+                 (uint8_t)(((~a >> 4) & 0x70) | ((a & 3) << 1) | 1), aspect});
+}
+
+// 28 speed steps, as S-9.2 tabulates them: index CSSSS with C the low bit, 0-1 stop, 2-3 e-stop,
+// 4-31 steps 1-28. NmraDcc reports stop as 1, e-stop as 0 and step n as n+1
+static void speed28(uint16_t addr, DCC_ADDR_TYPE type, uint16_t expAddr) {
+  for (uint8_t dir = 0; dir < 2; dir++) {
+     for (uint8_t idx = 0; idx < 32; idx++) {
+        uint8_t cmd = 0x40 | (dir << 5) | ((idx & 1) << 4) | (idx >> 1);
+        uint8_t speed = (idx < 2) ? 1 : (idx < 4) ? 0 : (idx - 3) + 1;
+        case_t &c = loco(addr, type, cmd);
+        expect(c, EV_SPEED, expAddr, type, speed, dir, SPEED_STEP_28);
+        expect(c, EV_SPEEDRAW, expAddr, type, cmd);
+     }
+  }
+}
+
+// 128 speed steps: 0 stop, 1 e-stop, 2-127 steps 1-126
+static void speed128(uint16_t addr, DCC_ADDR_TYPE type, uint16_t expAddr) {
+  for (uint16_t d = 0; d < 256; d++) {
+     uint8_t step = d & 0x7F;
+     uint8_t speed = (step == 0) ? 1 : (step == 1) ? 0 : step;
+     expect(loco(addr, type, 0x3F, d), EV_SPEED, expAddr, type, speed, d >> 7, SPEED_STEP_128);
+  }
+}
+
+static void functions(uint16_t addr, DCC_ADDR_TYPE type, uint16_t expAddr, bool all) {
+  uint8_t step = all ? 1 : 7;
+
+  for (uint8_t f = 0; f < 32; f += step) expect(loco(addr, type, 0x80 | f), EV_FUNC, expAddr, type, FN_0_4, f);
+  for (uint8_t f = 0; f < 16; f += step) expect(loco(addr, type, 0xB0 | f), EV_FUNC, expAddr, type, FN_5_8, f);
+  for (uint8_t f = 0; f < 16; f += step) expect(loco(addr, type, 0xA0 | f), EV_FUNC, expAddr, type, FN_9_12, f);
+  for (uint16_t f = 0; f < 256; f += step) expect(loco(addr, type, 0xDE, f), EV_FUNC, expAddr, type, FN_13_20, f);
+  for (uint16_t f = 0; f < 256; f += step) expect(loco(addr, type, 0xDF, f), EV_FUNC, expAddr, type, FN_21_28, f);
+}
+
+// Packets from here on are not for this decoder: no callbacks
+static void noneFrom(size_t first) {
+  std::vector<case_t> &v = groups.back().cases;
+
+  for (size_t i = first; i < v.size(); i++) v[i].nEv = 0;
+}
+
+static void build(void) {
+  size_t mark;
+
+  group("Reset and idle", LOCO3);
+  expect(packet({0x00, 0x00}), EV_RESET, 0, 0, 0);
+  expect(packet({0xFF, 0x00}), EV_IDLE, 0, 0, 0);
+  expect(loco(3, DCC_ADDR_SHORT, 0x00), EV_RESET, 0, 0, 0);
+  expect(loco(3, DCC_ADDR_SHORT, 0x01), EV_RESET, 0, 0, 1);
+  loco(4, DCC_ADDR_SHORT, 0x00);
+  expect(loco(0, DCC_ADDR_SHORT, 0x01), EV_RESET, 0, 0, 1);
+
+  group("28 speed steps", LOCO3);
+  speed28(3, DCC_ADDR_SHORT, 3);
+  speed28(0, DCC_ADDR_SHORT, 0);   // Broadcast
+
+#if defined(NMRA_DCC_ENABLE_14_SPEED_STEP_MODE)
+  // 01DCSSSS with C the headlight: 0 stop, 1 e-stop, 2-15 steps 1-14
+  group("14 speed steps", LOCO3_14);
+  for (uint8_t dir = 0; dir < 2; dir++) {
+     for (uint8_t fl = 0; fl < 2; fl++) {
+        for (uint8_t s = 0; s < 16; s++) {
+           uint8_t cmd = 0x40 | (dir << 5) | (fl << 4) | s;
+           case_t &c = loco(3, DCC_ADDR_SHORT, cmd);
+           expect(c, EV_SPEED, 3, DCC_ADDR_SHORT, (s == 0) ? 1 : (s == 1) ? 0 : s, dir, SPEED_STEP_14);
+           expect(c, EV_SPEEDRAW, 3, DCC_ADDR_SHORT, cmd);
+           expect(c, EV_FUNC, 3, DCC_ADDR_SHORT, FN_0, fl << 4);
+        }
+     }
+  }
+#endif
+
+  group("128 speed steps", LOCO3);
+  speed128(3, DCC_ADDR_SHORT, 3);
+
+  group("Speed, 14-bit address", LOCO1234);
+  speed28(1234, DCC_ADDR_LONG, 1234);
+  speed128(1234, DCC_ADDR_LONG, 1234);
+
+  group("Functions F0-F28", LOCO3);
+  functions(3, DCC_ADDR_SHORT, 3, true);
+  mark = groups.back().cases.size();
+  functions(1234, DCC_ADDR_LONG, 1234, false);
+  noneFrom(mark);
+
+  // Feature expansion 11011000-11011100: F29-F36 ... F61-F68
+  group("Functions F29-F68", LOCO3);
+  for (uint8_t g = 0; g < 5; g++) {
+     static const uint8_t states[] = {0x00, 0xFF, 0x55, 0xAA, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
+     for (uint8_t s = 0; s < sizeof(states); s++) loco(3, DCC_ADDR_SHORT, 0xD8 + g, states[s]).notDecoded = true;
+  }
+
+  // 1110CCVV VVVVVVVV DDDDDDDD, CV from 1. A command station sends each twice
+  group("Ops mode CV access", LOCO3);
+  for (uint8_t k = 0; k < 32; k++) {
+     expect(loco(3, DCC_ADDR_SHORT, 0xEC, 49 + k, k + 1), EV_CV, 50 + k, 0, k + 1);
+     loco(3, DCC_ADDR_SHORT, 0xEC, 49 + k, k + 1);      // Same value: no change
+     loco(3, DCC_ADDR_SHORT, 0xE4, 49 + k, k + 1);      // Verify byte
+  }
+  expect(loco(3, DCC_ADDR_SHORT, 0xE8, 49, 0xFF), EV_CV, 50, 0, 0x81);   // Write bit 7 of CV 50 to 1
+  expect(loco(3, DCC_ADDR_SHORT, 0xE8, 49, 0xF0), EV_CV, 50, 0, 0x80);   // Bit 0 to 0
+  loco(3, DCC_ADDR_SHORT, 0xE8, 49, 0xEF);                                 // Verify bit 7
+  loco(3, DCC_ADDR_SHORT, 0xEC, 6, 99);                                    // CV 7, read only
+  loco(3, DCC_ADDR_SHORT, 0xEC, 7, 99);                                    // CV 8, read only
+  loco(3, DCC_ADDR_SHORT, 0xEF, 0xFF, 99);                                 // CV 1024, past the EEPROM
+  loco(4, DCC_ADDR_SHORT, 0xEC, 49, 7);                                    // Another loco's
+
+  static const uint16_t boards[] = {5, 6, 4, 69, 511};   // 69 differs from 5 only in the high bits. 511 is broadcast
+  group("Basic accessory, by board", ACC_BOARD5);
+  for (uint8_t i = 0; i < sizeof(boards)/sizeof(boards[0]); i++) {
+     for (uint8_t k = 0; k < 16; k++) {
+        case_t &c = basicAcc(boards[i], k >> 2, k & 1, (k >> 1) & 1);
+        if ((boards[i] == 5) || (boards[i] == 511)) expect(c, EV_ACCBOARD, boards[i], 0, k >> 2, k & 1, (k >> 1) & 1);
+     }
+  }
+
+  group("Basic accessory, by output", ACC_OUTPUT17);
+  for (uint8_t i = 0; i < 4; i++) {
+     for (uint8_t k = 0; k < 16; k++) {
+        case_t &c = basicAcc(boards[i], k >> 2, k & 1, (k >> 1) & 1);
+        if ((boards[i] == 5) && ((k >> 2) == 0)) expect(c, EV_ACCOUTPUT, 17, 0, k & 1, (k >> 1) & 1);   // Board 5 pair 0
+     }
+  }
+
+  group("Extended accessory, by output", ACC_OUTPUT17);
+  for (uint16_t out = 16; out <= 21; out++) {
+     for (uint8_t s = 0; s < 32; s++) {
+        case_t &c = extAcc(out, s);
+        if (out == 17) expect(c, EV_SIG, 17, 0, s);
+     }
+  }
+
+  group("Extended accessory, by board", ACC_BOARD5);
+  for (uint16_t out = 16; out <= 21; out++) {
+     for (uint8_t s = 0; s < 32; s += 3) {
+        case_t &c = extAcc(out, s);
+        if ((out >= 17) && (out <= 20)) expect(c, EV_SIG, out, 0, s);   // The outputs of board 5
+     }
+  }
+
+  // S-9.2.1 has a consist member take speed (flipped by CV19 bit 7) and the functions CV21/22
+  // choose by its consist address, and never CV access. NmraDcc does no consist handling: it
+  // takes none of them. The loco's own address still works
+  static const uint8_t members[] = {LOCO1234, LOCO1234_REV};
+  for (uint8_t d = 0; d < sizeof(members); d++) {
+     group(d ? "Consist 10, reversed" : "Consist 10", members[d]);
+     mark = groups.back().cases.size();
+     speed28(10, DCC_ADDR_SHORT, 10);
+     speed128(10, DCC_ADDR_SHORT, 10);
+     functions(10, DCC_ADDR_SHORT, 10, false);
+     noneFrom(mark);
+     for (size_t i = mark; i < groups.back().cases.size(); i++) groups.back().cases[i].notDecoded = true;
+     loco(10, DCC_ADDR_SHORT, 0xEC, 49, 7);                  // CV 50, ops mode: never by consist
+     loco(10, DCC_ADDR_SHORT, 0xEC, 18, 11);                 // CV 19
+     loco(10, DCC_ADDR_SHORT, 0xE8, 49, 0xFF);               // Bit write
+     functions(11, DCC_ADDR_SHORT, 11, false);                // Another consist
+     noneFrom(mark);
+     expect(loco(1234, DCC_ADDR_LONG, 0x3F, 0x85), EV_SPEED, 1234, DCC_ADDR_LONG, 5, 1, SPEED_STEP_128);
+     loco(1234, DCC_ADDR_LONG, 0x12, 11).notDecoded = true;   // Consist control: set consist 11
+     loco(1234, DCC_ADDR_LONG, 0x13, 11).notDecoded = true;   // The same, reversed
+  }
+
+  // Nothing for other decoders, whatever the instruction
+  group("Other addresses", LOCO3);
+  for (uint8_t a = 1; a < 128; a++) {
+     if (a == 3) continue;
+     loco(a, DCC_ADDR_SHORT, 0x3F, 0x85);
+     loco(a, DCC_ADDR_SHORT, 0x90);
+     loco(a, DCC_ADDR_SHORT, 0xEC, 49, 1);
+  }
+  loco(3, DCC_ADDR_LONG, 0x3F, 0x85);   // 14-bit 3 is not 7-bit 3
+  loco(1234, DCC_ADDR_LONG, 0x3F, 0x85);
+  basicAcc(3, 0, 1, 1);
+  extAcc(9, 5);
+
+  group("Every address, no FLAGS_MY_ADDRESS_ONLY", LOCO3_ALL);
+  for (uint8_t a = 0; a < 128; a++) {
+     expect(loco(a, DCC_ADDR_SHORT, 0x3F, 0x85), EV_SPEED, a, DCC_ADDR_SHORT, 5, 1, SPEED_STEP_128);
+     expect(loco(a, DCC_ADDR_SHORT, 0x90), EV_FUNC, a, DCC_ADDR_SHORT, FN_0_4, 0x10);
+  }
+  for (uint16_t a = 0; a < 10240; a += 97)
+     expect(loco(a, DCC_ADDR_LONG, 0x3F, 0x02), EV_SPEED, a, DCC_ADDR_LONG, 2, 0, SPEED_STEP_128);
+}
+
+/////////////
+// The checks
+/////////////
+
+static NmraDcc Dcc;
+static bool verbose = false;
+
+static void setup(const decoder_t *d) {
+  memset(eeprom, 0xFF, sizeof(eeprom));
+  Dcc.init(MAN_ID_DIY, 10, d->flags, 0);
+  for (uint8_t i = 0; (i < 4) && d->cv[i][0]; i++) Dcc.setCV(d->cv[i][0], (uint8_t)d->cv[i][1]);
+  Dcc.flushCVs();
+}
+
+static bool same(const ev_t *x, const ev_t *y) {
+  return (x->kind == y->kind) && (x->type == y->type) && (x->addr == y->addr) && (x->a == y->a) && (x->b == y->b) && (x->c == y->c);
+}
+
+static void printEv(const char *what, const ev_t *e, uint8_t n) {
+  printf("      %s:", what);
+  if (!n) printf(" nothing");
+  for (uint8_t i = 0; (i < n) && (i < MAX_EV); i++)
+     printf(" %s(%u%s, %u, %u, %u)", evNames[e[i].kind], e[i].addr, e[i].type == DCC_ADDR_LONG ? "L" : "", e[i].a, e[i].b, e[i].c);
+  printf("\n");
+}
+
+// The callbacks of every packet, against the expected ones. Returns the packets that failed
+static uint32_t check(group_t *g, uint32_t *callbacks) {
+  uint32_t failed = 0;
+
+  setup(&decoders[g->decoder]);
+  for (size_t i = 0; i < g->cases.size(); i++) {
+     case_t *c = &g->cases[i];
+     DCC_MSG m = c->msg;  // The decoder may write to it
+     bool ok;
+
+     nGot = 0;
+     execDccProcessor(&m);
+     Dcc.process();
+     *callbacks += nGot;
+     ok = (nGot == c->nEv);
+     for (uint8_t k = 0; ok && (k < c->nEv); k++) ok = same(&got[k], &c->ev[k]);
+     if (!ok) {
+        if (verbose || (failed < 3)) {
+           printf("    ");
+           for (uint8_t k = 0; k < c->msg.Size; k++) printf("%02X ", c->msg.Data[k]);
+           printf("\n");
+           printEv("expected", c->ev, c->nEv);
+           printEv("got     ", got, nGot);
+        }
+        failed++;
+     }
+  }
+  return failed;
+}
+
+// Packets/s through the decoder, the group over and over
+static double timed(group_t *g, double seconds, uint64_t *packets) {
+  uint64_t t0, t;
+
+  *packets = 0;
+  t0 = nowNs();
+  do {
+     for (size_t i = 0; i < g->cases.size(); i++) {
+        DCC_MSG m = g->cases[i].msg;
+        nGot = 0;
+        execDccProcessor(&m);
+     }
+     *packets += g->cases.size();
+     t = nowNs();
+  } while ((t - t0) < seconds * 1e9);
+  return (t - t0) * 1e-9;
+}
+
+int main(int argc, char **argv) {
+  double seconds = 0.2;
+  uint64_t allPackets = 0;
+  double allSeconds = 0;
+  uint32_t allFailed = 0, allCases = 0;
+  int c;
+
+  while ((c = getopt(argc, argv, "t:v")) != -1) {
+     switch (c) {
+        case 't': seconds = atof(optarg); break;
+        case 'v': verbose = true; break;
+        default:
+           fprintf(stderr, "Usage: %s [-t seconds per group] [-v]\n", argv[0]);
+           return 1;
+     }
+  }
+  build();
+
+  printf("NmraDcc against S-9.2 and S-9.2.1%s%s\n",
+#if defined(NMRA_DCC_ENABLE_14_SPEED_STEP_MODE)
+         ", 14 speed steps",
+#else
+         "",
+#endif
+#if defined(NMRA_DCC_NO_ADDRESS_FILTER)
+         ", no address filter");
+#else
+         "");
+#endif
+  printf("%-40s %-22s %8s %9s %8s %7s %12s %8s\n", "", "Decoder", "Packets", "Callbacks", "Not dec.", "Failed", "Packets/s", "ns/pkt");
+  for (size_t i = 0; i < groups.size(); i++) {
+     group_t *g = &groups[i];
+     uint32_t callbacks = 0, notDecoded = 0, failed;
+     uint64_t packets;
+     double s;
+
+     for (size_t k = 0; k < g->cases.size(); k++) notDecoded += g->cases[k].notDecoded;
+     failed = check(g, &callbacks);
+     s = timed(g, seconds, &packets);
+     printf("%-40s %-22s %8u %9u %8u %7u %12.0f %8.1f\n", g->label, decoders[g->decoder].label, (unsigned)g->cases.size(),
+            (unsigned)callbacks, (unsigned)notDecoded, (unsigned)failed, packets / s, s * 1e9 / packets);
+     allPackets += packets;
+     allSeconds += s;
+     allFailed += failed;
+     allCases += g->cases.size();
+  }
+#if !defined(NMRA_DCC_ENABLE_14_SPEED_STEP_MODE)
+  printf("%-40s not built: NMRA_DCC_ENABLE_14_SPEED_STEP_MODE\n", "14 speed steps");
+#endif
+  printf("%-40s %-22s %8u %9s %8s %7u %12.0f %8.1f\n", "All", "", (unsigned)allCases, "", "", (unsigned)allFailed,
+         allPackets / allSeconds, allSeconds * 1e9 / allPackets);
+  if (allFailed) printf("FAILED\n");
+  return allFailed ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,201 @@
+/*
+sim/main.cpp
+
+Host simulation of the ProMiniAir sketch: runs setup() and loop() against
+simulated time, feeds the DCC input from a script, and reports throughput,
+latency and interrupt budgets.
+
+usage: airmini-sim [-t seconds] [-f script] [-e eeprom.bin] [-i i2caddr]
+                   [-l loopcycles] [-s]
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "simcore.h"
+#include "simdcc.h"
+#include <Arduino.h>
+#include <NmraDcc.h>
+#include <dccpreamble.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if !defined(SIM_MODE)
+#define SIM_MODE "transmitter"
+#endif
+
+extern void setup(void);
+
+// A command station refreshing 8 locos
+static const char defaultScript[] =
+  "station 8 60000\n";
+
+#define MAX_CVS 16
+
+static const char *profileName[DCCP_PROFILES] = {"Airwire", "Tam Valley", "ProMiniAir"};
+
+static char *readFile(const char *path) {
+  FILE *f = fopen(path, "rb");
+  char *text;
+  long n;
+
+  if (!f) {
+     perror(path);
+     exit(2);
+  }
+  fseek(f, 0, SEEK_END);
+  n = ftell(f);
+  rewind(f);
+  text = (char *)malloc(n + 1);
+  if (fread(text, 1, n, f) != (size_t)n) {
+     perror(path);
+     exit(2);
+  }
+  text[n] = 0;
+  fclose(f);
+  return text;
+}
+
+static void usage(void) {
+  fprintf(stderr,
+     "usage: airmini-sim [-t seconds] [-f script] [-e eeprom.bin] [-i i2caddr] [-l loopcycles] [-c cv=value]... [-r channel] [-s]\n"
+     "  -t  simulated time, default 60 s\n"
+     "  -f  DCC input script (see simdcc.cpp), default: a station refreshing 8 locos\n"
+     "  -e  EEPROM image, read at the start and written at the end\n"
+     "  -i  I2C address of the display, default 0x3C; 0 for none\n"
+     "  -l  cycles charged for each pass of loop(), default %u\n"
+     "  -c  write a CV after setup(), as the command station would\n"
+     "  -r  the command station's radio channel; default: whatever the sketch is on\n"
+     "  -s  show the sketch's Serial output\n", simCost.loop);
+  exit(2);
+}
+
+static void report(double seconds, double hostSeconds) {
+  uint32_t p50, p90, p99, max, recMean, recMax;
+  uint64_t lost = simDccLost();
+  uint64_t isrCycles = 0;
+
+  printf("%s: %.1f s simulated in %.2f s (%.0fx)\n", SIM_MODE, seconds, hostSeconds,
+         hostSeconds > 0 ? seconds / hostSeconds : 0.0);
+  printf("DCC in:  %llu packets (%.1f/s), %llu gaps\n",
+         (unsigned long long)simDcc.in, simDcc.in / seconds, (unsigned long long)simDcc.gaps);
+  printf("DCC out: %llu packets (%.1f/s), %llu bad; matched %llu, extra %llu\n",
+         (unsigned long long)simDcc.out, simDcc.out / seconds, (unsigned long long)simDcc.outBad,
+         (unsigned long long)simDcc.matched, (unsigned long long)simDcc.outExtra);
+  printf("         inputs superseded %llu, lost %llu\n",
+         (unsigned long long)simDcc.superseded, (unsigned long long)lost);
+  simDccLatency(&p50, &p90, &p99, &max);
+  printf("Latency, input end bit to output end bit (us): p50 %u  p90 %u  p99 %u  max %u\n", p50, p90, p99, max);
+  if (simDccChannel >= 0) {
+     if (simDcc.firstOut) printf("First input packet out at %.2f s\n", (double)simDcc.firstOut / SIM_F_CPU);
+     else printf("No packet out: channel %d never found\n", simDccChannel);
+  }
+  printf("Output half-bits (us): 1 %u-%u  0 %u-%u\n", simDcc.oneMin, simDcc.oneMax, simDcc.zeroMin, simDcc.zeroMax);
+  printf("Speed packets on the output, per loco: longest gap %u ms, %llu gaps of 500 ms or more\n",
+         simDcc.speedGapMax, (unsigned long long)simDcc.speedGaps);
+  simDccRecovery(&recMean, &recMax);
+  if (simDcc.drops) {
+     printf("Air drops: %llu, locos left wrong %llu; recovered %llu, mean %u ms, max %u ms; never %llu\n",
+            (unsigned long long)simDcc.drops, (unsigned long long)simDcc.dropStale,
+            (unsigned long long)simDcc.dropRecovered, recMean, recMax, (unsigned long long)simDcc.dropNever);
+  }
+  if (!strcmp(SIM_MODE, "transmitter")) {
+     printf("Air capacity for this packet mix, by preamble profile (packets/s):");
+     for (uint8_t p = 0; p < DCCP_PROFILES; p++) printf("  %s %.1f", profileName[p], simDccProfileRate(p));
+     printf("\n");
+  }
+
+  printf("\n%-14s %9s %8s %8s %6s %11s %7s %8s\n",
+         "Interrupt", "calls/s", "avg us", "max us", "CPU%", "max lat us", "missed", "host ns");
+  for (int v = 0; v < SIM_VECTORS; v++) {
+     simIsrStats_t *s = &simIsr[v];
+     if (!s->count) continue;
+     printf("%-14s %9.1f %8.2f %8.2f %6.2f %11.2f %7llu %8.0f\n",
+            s->name, s->count / seconds,
+            (double)s->cycles / s->count / SIM_CPU_US, (double)s->maxCycles / SIM_CPU_US,
+            100.0 * s->cycles / simNow, (double)s->latencyMax / SIM_CPU_US,
+            (unsigned long long)s->missed,
+            (double)s->hostNs / s->count);
+     isrCycles += s->cycles;
+  }
+  printf("%-14s %9.1f %8.2f %8.2f\n", "loop()", simLoopPasses / seconds,
+         (double)simNow / (simLoopPasses ? simLoopPasses : 1) / SIM_CPU_US, (double)simLoopMaxCycles / SIM_CPU_US);
+  printf("CPU: %.1f%% in interrupts\n", 100.0 * isrCycles / simNow);
+
+  printf("\nI2C: %llu transactions, %llu bytes, %llu NACKs\n",
+         (unsigned long long)simTwi.transactions, (unsigned long long)simTwi.bytes, (unsigned long long)simTwi.nacks);
+  printf("EEPROM: %llu writes, at most %u to one byte\n", (unsigned long long)simEepromWrites, simEepromMaxCellWrites);
+}
+
+int main(int argc, char **argv) {
+  double seconds = 60;
+  const char *scriptPath = 0;
+  const char *eepromPath = 0;
+  struct timespec h0, h1;
+  uint16_t cvNum[MAX_CVS];
+  uint8_t cvVal[MAX_CVS];
+  int cvs = 0;
+  uint64_t end;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:f:e:i:l:c:r:s")) != -1) {
+     switch (opt) {
+        case 't': seconds = atof(optarg); break;
+        case 'f': scriptPath = optarg; break;
+        case 'e': eepromPath = optarg; break;
+        case 'i': simDisplayAddr = strtoul(optarg, 0, 0); break;
+        case 'l': simCost.loop = strtoul(optarg, 0, 0); break;
+        case 'c': {
+           char *eq = strchr(optarg, '=');
+           if (!eq || (cvs >= MAX_CVS)) usage();
+           cvNum[cvs] = strtoul(optarg, 0, 0);
+           cvVal[cvs++] = strtoul(eq + 1, 0, 0);
+           break;
+        }
+        case 'r': simDccChannel = atoi(optarg); break;
+        case 's': sim_serial = stdout; break;
+        default: usage();
+     }
+  }
+  if ((optind != argc) || (seconds <= 0)) usage();
+
+  simDccScript(scriptPath ? readFile(scriptPath) : defaultScript);
+  simEepromLoad(eepromPath);
+
+  clock_gettime(CLOCK_MONOTONIC, &h0);
+  simDccBegin();
+  setup();
+  for (int i = 0; i < cvs; i++) notifyCVWrite(cvNum[i], cvVal[i]);
+  end = (uint64_t)(seconds * SIM_F_CPU);
+  while (simNow < end) simLoop();
+  clock_gettime(CLOCK_MONOTONIC, &h1);
+
+  simEepromSave(eepromPath);
+  report((double)simNow / SIM_F_CPU, (h1.tv_sec - h0.tv_sec) + (h1.tv_nsec - h0.tv_nsec) / 1e9);
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,967 @@
+/*
+sim/nrf24sim.cpp
+
+Host test of the nRF24 link of ProMini_Air_nrf24_tx_rx_dcc: its nrfbatch
+module between a command station and a mock radio.
+
+The station sends DCC back to back (bit times as on the rails) to the
+transmitter side, which is run the way the sketch runs it: NmraDcc queues
+decoded packets (DCC_RX_QUEUE, or -q) and loop() takes up to that many. The mock radio charges the SPI
+upload, the 130 us TX settling and the frame at 250 kbps, keeps the
+3-deep TX FIFO, and loses frames at random or to bursts of interference.
+The receiver side drains the RX FIFO like the sketch's loop(), also
+between the steps of its display updates, and unpacks into the ring.
+Every packet is checked against what the station sent.
+
+The same traffic is run one packet per frame and batched, each with the
+blocking radio.write() the sketch used to have and with frames loaded
+into the TX FIFO by startFastWrite(), as it does now. -r instead runs
+the FIFO columns with each frame sent 1 to 3 times: loss against airtime.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <nrfbatch.h>
+#include <nrfscan.h>
+#include <nrftelem.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+
+#define LOOPUS       20     // One pass of loop(), either side
+#define SETTLEUS     130    // Standby to TX
+#define SPIUS(n)     (24 + 2*(n))  // Commands and payload upload
+#define REGUS        8      // One register access over SPI
+#define TXFIFO       3
+#define RXFIFO       3
+#define DISPLAYUS    2000000  // The receiver's display update period
+#define CLEARUS      2500     // lcd.clear()
+
+typedef struct {
+  uint8_t data[NRFB_MAXSIZE];
+  uint8_t size;
+  uint64_t end;             // End bit at the DCC input, us
+} pkt_t;
+
+typedef struct {
+  uint8_t buf[NRFB_PAYLOAD];
+  uint8_t len;
+  uint64_t arrive;
+  std::vector<pkt_t> pkts;  // What the station sent, for checking
+} frame_t;
+
+typedef struct {
+  uint64_t in, overruns, frames, framesLost, airUs, payloadBytes;
+  uint64_t delivered, late, mismatched, reordered, rxOverflow, rxFullSeen;
+  uint64_t fifoFull, dropped, droppedPkts;
+  uint64_t notifyMax;       // Longest notifyDccMsg()
+  uint64_t passMax;         // Longest transmitter work in one loop() pass
+  std::vector<uint32_t> latency;
+} stats_t;
+
+static uint32_t rng;             // Station
+static uint32_t lossRng;         // Radio: the traffic is the same whatever is lost
+static uint32_t seed = 1;
+static double frameLoss = 0.0;   // Probability
+static double ber = 0.0;
+static uint32_t locos = 8;
+static uint16_t flushUs = 10000;
+static uint32_t lineUs = 30000;  // Writing one line of the receiver's display
+static bool oldRx = false;       // Receiver reads one frame per loop() pass, none during the display
+static uint32_t burstUs = 0;     // Mean length of an interference burst; 0: none
+static double busy = 0.05;       // Share of the time taken by the bursts
+static uint8_t copies = 1;       // Times each frame is sent
+static uint16_t spacingUs = 3000;
+static uint8_t rxQueue = DCC_RX_QUEUE;  // NmraDcc's receive queue
+
+static uint32_t rand32(uint32_t *r) {
+  *r ^= *r << 13;
+  *r ^= *r >> 17;
+  *r ^= *r << 5;
+  return *r;
+}
+
+static double uniform(void) {
+  return (rand32(&lossRng) >> 8) / 16777216.0;
+}
+
+////////////////////
+// Command station
+////////////////////
+
+static uint64_t stationAt;       // End of the last packet
+static uint32_t stationNext;
+static uint64_t stationChange;
+static int stationUrgent;
+static uint8_t speeds[128];
+
+static uint8_t address(uint32_t addr, uint8_t *p) {
+  if (addr <= 127) {
+     p[0] = addr;
+     return 1;
+  }
+  p[0] = 0xC0 | ((addr >> 8) & 0x3F);
+  p[1] = addr & 0xFF;
+  return 2;
+}
+
+// Odd locos have long addresses
+static uint32_t locoAddress(uint32_t loco) {
+  return (loco & 1) ? 1000 + loco : 3 + loco;
+}
+
+static void stationPacket(pkt_t *pk) {
+  uint8_t *p = pk->data;
+  uint8_t n, i, x = 0;
+  uint32_t bits;
+
+  if (stationAt >= stationChange) {  // A throttle moves
+     stationUrgent = rand32(&rng) % locos;
+     speeds[stationUrgent] = rand32(&rng) % 127;
+     stationChange = stationAt + 500000;
+  }
+  if (!locos) {                      // Idle
+     p[0] = 0xFF;
+     p[1] = 0x00;
+     n = 2;
+  } else if (stationUrgent >= 0) {
+     n = address(locoAddress(stationUrgent), p);
+     p[n++] = 0x3F;
+     p[n++] = 0x80 | (speeds[stationUrgent] ? speeds[stationUrgent] + 1 : 0);
+     stationUrgent = -1;
+  } else {
+     uint32_t loco = (stationNext / 2) % locos;
+     n = address(locoAddress(loco), p);
+     if (stationNext & 1) p[n++] = 0x80 | ((loco & 1) ? 0x10 : 0x00);
+     else {
+        p[n++] = 0x3F;
+        p[n++] = 0x80 | (speeds[loco] ? speeds[loco] + 1 : 0);
+     }
+     stationNext++;
+  }
+  for (i = 0; i < n; i++) x ^= p[i];
+  p[n++] = x;
+  pk->size = n;
+
+  // 16 preamble bits, start bit, and for each byte its bits and a separator or end bit
+  uint32_t us = 16*116 + 232;
+  for (i = 0; i < n; i++) {
+     for (bits = 0x80; bits; bits >>= 1) us += (p[i] & bits) ? 116 : 232;
+     us += (i < n-1) ? 232 : 116;
+  }
+  stationAt += us;
+  pk->end = stationAt;
+}
+
+/////////////
+// Mock radio
+/////////////
+
+static std::deque<frame_t> air;  // Frames on their way, in order of arrival
+static std::deque<frame_t> rxFifo;
+static frame_t txFrame;          // The frame going on the air, with the packets in it
+
+static uint32_t frameUs(uint8_t len) {
+  return 4 * (8 + 40 + 9 + 8*len + 16);  // Preamble, address, control field, payload, CRC at 250 kbps
+}
+
+static std::vector<pkt_t> openPkts;  // The packets of the open frame
+typedef struct {
+  uint8_t buf[NRFB_PAYLOAD], len;
+  std::vector<pkt_t> pkts;
+} taken_t;
+static std::deque<taken_t> recent;   // The last frames taken, for their copies
+static bool tookCopy;
+
+// nrfbTake(); the packets of what it gave go to txFrame.pkts. With copies
+// every frame has a sequence number: one the same as a recent one is a copy.
+static uint8_t take(uint8_t *frame, uint64_t t) {
+  uint8_t n = nrfbTake(frame, (uint32_t)t);
+
+  if ((copies > 1) && n) {
+     for (size_t i = 0; i < recent.size(); i++) {
+        if ((n == recent[i].len) && !memcmp(frame, recent[i].buf, n)) {
+           txFrame.pkts = recent[i].pkts;
+           tookCopy = true;
+           return n;
+        }
+     }
+  }
+  tookCopy = false;
+  recent.push_back(taken_t());
+  if (recent.size() > NRFB_OWED) recent.pop_front();
+  recent.back().pkts.swap(openPkts);
+  openPkts.clear();
+  txFrame.pkts = recent.back().pkts;
+  memcpy(recent.back().buf, frame, n);
+  recent.back().len = n;
+  return n;
+}
+
+// Interference: bursts and gaps of random length, generated ahead
+static std::deque<std::pair<uint64_t, uint64_t> > jams;
+static uint64_t jamsTo;
+
+static double expo(double mean) {
+  return -mean * log(1.0 - uniform());
+}
+
+// A burst overlaps [start, end). Asked in order of start, more or less.
+static bool jammed(uint64_t start, uint64_t end) {
+  if (!burstUs) return false;
+  while (jamsTo < end) {
+     uint64_t from = jamsTo + (uint64_t)expo(burstUs * (1.0 - busy) / busy);
+     jamsTo = from + 1 + (uint64_t)expo(burstUs);
+     jams.push_back(std::make_pair(from, jamsTo));
+  }
+  while (!jams.empty() && (jams.front().second + 100000 < start)) jams.pop_front();
+  for (size_t i = 0; i < jams.size(); i++) {
+     if ((jams[i].first < end) && (jams[i].second > start)) return true;
+  }
+  return false;
+}
+
+static std::deque<uint64_t> txFifo;  // When each frame in the TX FIFO is out
+static uint64_t txLast;              // When the radio is done with all it was given
+static bool txSending;               // The sketch's flag: frames loaded, CE high
+
+// A frame on the air from start, maybe lost. Returns when it is out.
+static uint64_t radioAir(stats_t *st, uint64_t start, const uint8_t *buf, uint8_t len) {
+  uint32_t air_us = frameUs(len);
+  double pOk = (1.0 - frameLoss);
+
+  if (ber > 0) {
+     for (uint32_t b = 0; b < 8u*len + 16 + 9; b++) pOk *= (1.0 - ber);
+  }
+  st->frames++;
+  st->airUs += air_us;
+  st->payloadBytes += len;
+  if ((uniform() < pOk) && !jammed(start, start + air_us)) {
+     txFrame.arrive = start + air_us;
+     txFrame.len = len;
+     memcpy(txFrame.buf, buf, len);
+     air.push_back(txFrame);
+  } else st->framesLost++;
+  return start + air_us;
+}
+
+// radio.write(buf, len, 1): returns when the frame is out. Returns the time taken.
+static uint32_t radioWrite(stats_t *st, uint64_t now, const uint8_t *buf, uint8_t len) {
+  txLast = radioAir(st, now + SPIUS(len) + SETTLEUS, buf, len);
+  return txLast - now;
+}
+
+// radio.isFifo(true): 2 if full, 1 if empty
+static uint8_t radioTxFifo(uint64_t now) {
+  while (!txFifo.empty() && (txFifo.front() <= now)) txFifo.pop_front();
+  return (txFifo.size() >= TXFIFO) ? 2 : txFifo.empty() ? 1 : 0;
+}
+
+// radio.startFastWrite(buf, len, 1): uploads the frame, which goes right
+// after the one on the air, or after settling if the radio was idle.
+// Returns the time taken.
+static uint32_t radioStartFastWrite(stats_t *st, uint64_t now, const uint8_t *buf, uint8_t len) {
+  uint64_t loaded = now + SPIUS(len);
+
+  txLast = radioAir(st, (txLast > loaded) ? txLast : loaded + SETTLEUS, buf, len);
+  txFifo.push_back(txLast);
+  return SPIUS(len);
+}
+
+static void radioReceive(stats_t *st, uint64_t now) {
+  while (!air.empty() && (air.front().arrive <= now)) {
+     if (rxFifo.size() >= RXFIFO) st->rxOverflow++;
+     else rxFifo.push_back(air.front());
+     air.pop_front();
+  }
+}
+
+///////////
+// Receiver
+///////////
+
+static std::deque<pkt_t> sent;   // Sent by the station, not yet received or known lost
+static std::deque<pkt_t> skipped;  // Passed over for newer ones: a late copy may still bring them
+static std::map<uint32_t, uint64_t> newest;  // By state: the input time of the newest packet delivered
+static uint64_t newestAny;                   // Of any but an idle
+
+// The decoder state a packet sets: its address and instruction group, with
+// speed in either form one group. 0 for a broadcast, 0xFF for an idle.
+static uint32_t stateOf(const uint8_t *d) {
+  uint32_t a = d[0];
+  uint8_t i;
+
+  if ((a == 0) || (a == 0xFF)) return a;
+  if ((a >= 128) && (a < 192)) return (a << 8) | (d[1] & 0x76);  // Board and pair
+  if (a < 128) {
+     i = d[1];
+  } else {
+     a = (a << 8) | d[1];
+     i = d[2];
+  }
+  switch (i >> 5) {
+     case 1: case 2: case 3: i = 0x20; break;
+     case 5: i &= 0xF0; break;
+     case 6: case 7: break;
+     default: i &= 0xE0; break;
+  }
+  return (a << 8) | i;
+}
+
+// A late packet must not undo a newer one for the same state, or follow a newer
+// broadcast; a late broadcast must not follow any newer packet
+static void checkOrder(stats_t *st, const pkt_t &p) {
+  uint32_t k = stateOf(p.data);
+
+  if (k == 0xFF) return;
+  if ((newest.count(k) && (p.end < newest[k])) || (newest.count(0) && (p.end < newest[0])) ||
+      ((k == 0) && (p.end < newestAny))) st->reordered++;
+  if (!newest.count(k) || (p.end > newest[k])) newest[k] = p.end;
+  if (p.end > newestAny) newestAny = p.end;
+}
+
+// Read one frame from the RX FIFO, unpack it and check its packets
+static void rxRead(stats_t *st, uint64_t *t) {
+  DCC_MSG rx[NRFB_RECORDS];
+  frame_t f = rxFifo.front();
+  uint32_t superseded = nrfbRx.superseded;
+  size_t j = 0;
+
+  rxFifo.pop_front();
+  *t += 2*REGUS + SPIUS(f.len);  // available(), getDynamicPayloadSize(), read()
+  uint8_t n = nrfbUnpack(f.buf, f.len, rx, (uint32_t)*t);
+  superseded = nrfbRx.superseded - superseded;
+  for (uint8_t i = 0; i < n; i++, j++) {
+     // The packets left out of a late frame are passed over
+     while ((j < f.pkts.size()) && superseded && ((rx[i].Size != f.pkts[j].size) || memcmp(rx[i].Data, f.pkts[j].data, rx[i].Size))) {
+        j++;
+        superseded--;
+     }
+     if (j >= f.pkts.size()) {
+        st->mismatched++;
+        continue;
+     }
+     // Packets of lost frames are skipped over: this one must be the next still expected,
+     // or one skipped over, from a copy of a frame that came after a newer one
+     while (!sent.empty() && (sent.front().end < f.pkts[j].end)) {
+        skipped.push_back(sent.front());
+        sent.pop_front();
+     }
+     while (!skipped.empty() && (skipped.front().end + 200000 < f.pkts[j].end)) skipped.pop_front();
+     if (!sent.empty() && (sent.front().end == f.pkts[j].end)) {
+        if ((rx[i].Size != sent.front().size) || memcmp(rx[i].Data, sent.front().data, rx[i].Size)) {
+           st->mismatched++;
+           continue;
+        }
+        sent.pop_front();
+     } else {
+        size_t k = 0;
+        while ((k < skipped.size()) && (skipped[k].end != f.pkts[j].end)) k++;
+        if ((k == skipped.size()) || (rx[i].Size != skipped[k].size) || memcmp(rx[i].Data, skipped[k].data, rx[i].Size)) {
+           st->mismatched++;
+           continue;
+        }
+        skipped.erase(skipped.begin() + k);
+        st->late++;
+     }
+     checkOrder(st, f.pkts[j]);
+     st->delivered++;
+     st->latency.push_back((uint32_t)(*t - f.pkts[j].end));
+  }
+}
+
+// The sketch's rxDrain(): everything in the RX FIFO at t
+static void rxDrain(stats_t *st, uint64_t *t) {
+  radioReceive(st, *t);
+  if (rxFifo.empty()) return;
+  *t += REGUS;                   // rxFifoFull()
+  if (rxFifo.size() >= RXFIFO) st->rxFullSeen++;
+  while (!rxFifo.empty()) {
+     rxRead(st, t);
+     radioReceive(st, *t);
+  }
+}
+
+/////////
+// A run
+/////////
+
+// The sketch's sendFrame(); pipelined: through the TX FIFO, else with
+// the blocking radio.write(). t is advanced by the time taken.
+static bool sendFrame(stats_t *st, uint64_t *t, uint8_t pipelined) {
+  uint8_t frame[NRFB_PAYLOAD], n;
+
+  if (!pipelined) {
+     n = take(frame, *t);
+     if (n) *t += radioWrite(st, *t, frame, n);
+     return true;
+  }
+  *t += REGUS;
+  if (radioTxFifo(*t) == 2) {
+     st->fifoFull++;
+     return false;
+  }
+  n = take(frame, *t);
+  if (n) {
+     *t += radioStartFastWrite(st, *t, frame, n);
+     txSending = true;
+  }
+  return true;
+}
+
+static void run(stats_t *st, uint8_t batching, uint8_t pipelined, double seconds) {
+  uint64_t end = (uint64_t)(seconds * 1e6);
+  uint64_t now, txFree = 0, rxFree = 0, display = DISPLAYUS;
+  uint8_t rxPhase = 0;      // Display: 1 clearing, 2 and 3 writing a line
+  pkt_t next;
+  std::deque<pkt_t> decoded;  // NmraDcc's receive queue
+  uint8_t frame[NRFB_PAYLOAD];
+  DCC_MSG m;
+
+  rng = seed;
+  lossRng = seed ^ 0x5A5A5A5A;
+  stationAt = 0;
+  stationNext = 0;
+  stationChange = 0;
+  stationUrgent = -1;
+  memset(speeds, 0, sizeof(speeds));
+  air.clear();
+  rxFifo.clear();
+  txFifo.clear();
+  txLast = 0;
+  txSending = false;
+  txFrame.pkts.clear();
+  openPkts.clear();
+  recent.clear();
+  jams.clear();
+  jamsTo = 0;
+  sent.clear();
+  skipped.clear();
+  newest.clear();
+  newestAny = 0;
+  memset(&nrfbRx, 0, sizeof(nrfbRx));
+  nrfbResync();
+  nrfbBegin(batching, flushUs);
+  nrfbCopies(copies, spacingUs);
+  stationPacket(&next);
+
+  for (now = 0; now < end; now += LOOPUS) {
+     // The DCC input: NmraDcc queues the packets decoded, dropping them with its queue full
+     while (next.end <= now) {
+        if (decoded.size() < rxQueue) decoded.push_back(next);
+        else st->overruns++;
+        st->in++;
+        stationPacket(&next);
+     }
+
+     // Transmitter loop(), unless still busy from the last pass
+     if (now >= txFree) {
+        uint64_t t = now;
+        for (uint8_t k = 0; (k < rxQueue) && !decoded.empty(); k++) {  // Dcc.process(DCC_RX_QUEUE) calls notifyDccMsg()
+           uint64_t t0 = t;
+           pkt_t held = decoded.front();
+           decoded.pop_front();
+           m.Size = held.size;
+           memcpy(m.Data, held.data, held.size);
+           while (!nrfbAdd(&m, (uint32_t)t)) {
+              if (!sendFrame(st, &t, pipelined)) {  // The newer packet wins
+                 take(frame, t);
+                 st->dropped++;
+                 if (!tookCopy) st->droppedPkts += txFrame.pkts.size();
+              }
+           }
+           openPkts.push_back(held);
+           sent.push_back(held);
+           if (nrfbDue((uint32_t)t)) sendFrame(st, &t, pipelined);
+           if (t - t0 > st->notifyMax) st->notifyMax = t - t0;
+        }
+        if (nrfbDue((uint32_t)t)) sendFrame(st, &t, pipelined);
+        if (txSending) {       // All sent: txStandBy()
+           t += REGUS;
+           if (radioTxFifo(t) == 1) {
+              t += REGUS;
+              txSending = false;
+           }
+        }
+        if (t - now > st->passMax) st->passMax = t - now;
+        txFree = t;
+     }
+
+     // Receiver loop(), unless still busy from the last pass. The display
+     // is cleared and written a line at a time every DISPLAYUS; the
+     // receiver drains the RX FIFO between the steps, the old one did not.
+     radioReceive(st, now);
+     if (now >= rxFree) {
+        uint64_t t = now;
+        if (rxPhase && (rxPhase < 3)) {  // Between two steps of the display
+           if (!oldRx) rxDrain(st, &t);
+           rxPhase++;
+           t += lineUs;
+        } else {
+           rxPhase = 0;
+           if (oldRx) {
+              t += REGUS;
+              if (!rxFifo.empty()) rxRead(st, &t);
+           } else rxDrain(st, &t);  // Flagged by the IRQ: nothing to do otherwise
+           if (lineUs && (now >= display)) {
+              display += DISPLAYUS;
+              rxPhase = 1;
+              t += CLEARUS;
+           }
+        }
+        rxFree = t;
+     }
+  }
+}  // end of run
+
+static uint32_t percentile(std::vector<uint32_t> &v, double pct) {
+  if (v.empty()) return 0;
+  size_t i = (size_t)(pct / 100.0 * (v.size() - 1));
+  return v[i];
+}
+
+////////////////
+// Channel scan
+////////////////
+
+#define TUNEUS       340    // stopListening() (155 us at 250 kbps), setChannel(), flush_rx(), startListening(), RX settling
+#define WIFILO       26     // A Wi-Fi network on 2437 MHz covers nRF24 channels 26-48
+#define WIFIHI       48
+
+static double wifiDuty = 0.2;    // Share of the time the Wi-Fi channel is busy
+static bool weak = false;        // The transmitter is below the -64 dBm of the power detector
+
+typedef struct {
+  uint64_t start, end;
+  uint8_t buf[NRFB_PAYLOAD];
+  uint8_t len;
+} burst_t;
+
+// The transmitter's frames, from the station through nrfbatch, from -offset
+static std::deque<burst_t> bursts;
+static uint64_t burstsTo;        // Generated up to here
+static uint32_t burstsOpen;      // Packets in the open frame
+static uint64_t burstsFirst;     // When the first of them was added
+static pkt_t burstsNext;
+
+static void burstEmit(uint64_t t) {
+  burst_t b;
+  b.len = nrfbTake(b.buf, (uint32_t)t);
+  b.start = (t > burstsTo ? t : burstsTo) + SPIUS(b.len) + SETTLEUS;
+  b.end = b.start + frameUs(b.len);
+  burstsTo = b.end;
+  burstsOpen = 0;
+  bursts.push_back(b);
+}
+
+static void burstsUntil(uint64_t t) {
+  DCC_MSG m;
+
+  while (burstsTo < t + 20000) {
+     if (burstsOpen && (burstsFirst + flushUs < burstsNext.end)) {
+        burstEmit(burstsFirst + flushUs);
+        continue;
+     }
+     m.Size = burstsNext.size;
+     memcpy(m.Data, burstsNext.data, m.Size);
+     nrfbAdd(&m, (uint32_t)burstsNext.end);
+     if (!burstsOpen++) burstsFirst = burstsNext.end;
+     if (nrfbDue((uint32_t)burstsNext.end)) burstEmit(burstsNext.end);
+     stationPacket(&burstsNext);
+  }
+}
+
+// The ranking on its own: known energy in, known order out
+static int rankCheck(void) {
+  uint8_t out[NRFS_VERIFY], n;
+  int bad = 0;
+
+  nrfsClear();
+  n = nrfsRank(out, NRFS_VERIFY);
+  bad += (n != 0);
+  nrfsEnergy(70); nrfsEnergy(70); nrfsEnergy(12); nrfsEnergy(99); nrfsEnergy(40); nrfsEnergy(40);
+  n = nrfsRank(out, NRFS_VERIFY);    // 40 and 70 tie: the lower channel first
+  bad += (n != 3) || (out[0] != 40) || (out[1] != 70) || (out[2] != 12);
+  nrfsAge();
+  nrfsEnergy(99);                    // One new hit beats two older ones
+  nrfsReject(40);
+  n = nrfsRank(out, NRFS_VERIFY);
+  bad += (n != 3) || (out[0] != 99) || (out[1] != 70) || (out[2] != 12);
+  for (int i = 0; i < 8; i++) nrfsAge();
+  bad += (nrfsRank(out, NRFS_VERIFY) != 0);
+  nrfsClear();
+  if (bad) printf("nrfsRank: %d checks failed\n", bad);
+  return bad;
+}
+
+typedef struct {
+  uint32_t found, wrong, gaveUp;
+  std::vector<uint32_t> fast, old;   // Acquisition times, us
+} scanStats_t;
+
+// One cold start: the transmitter on channel tx, the receiver's stored channel elsewhere
+static void scanTrial(scanStats_t *ss, uint8_t batching, uint8_t tx, uint8_t stored, uint32_t budgetMs) {
+  DCC_MSG rx[NRFB_RECORDS];
+  uint64_t offset = rand32(&lossRng) % 50000;
+  uint64_t now = offset, listenFrom = offset, last = offset;
+  uint8_t ch = stored, heard = 0, r;
+
+  rng = rand32(&lossRng) | 1;
+  stationAt = 0;
+  stationNext = 0;
+  stationChange = 0;
+  stationUrgent = -1;
+  memset(speeds, 0, sizeof(speeds));
+  bursts.clear();
+  burstsTo = 0;
+  burstsOpen = 0;
+  nrfbBegin(batching, flushUs);
+  nrfbCopies(1, 0);
+  stationPacket(&burstsNext);
+  nrfsBegin(stored, (uint32_t)(now - offset), budgetMs);
+
+  for (;;) {
+     uint8_t sampling = nrfsSampling();
+     uint8_t energy = 0;
+
+     now += LOOPUS + (sampling ? REGUS : 0);
+     burstsUntil(now);
+     while (!bursts.empty() && (bursts.front().end <= last)) bursts.pop_front();
+     for (size_t i = 0; (ch == tx) && (i < bursts.size()) && (bursts[i].start <= now); i++) {
+        const burst_t *b = &bursts[i];
+        if (sampling && !weak && (b->end >= now - REGUS)) energy = 1;
+        // Decoded if the receiver was listening for all of it; rxDrain() then reports it
+        if ((b->end > last) && (b->end <= now) && (b->start >= listenFrom) && (uniform() >= frameLoss)) {
+           uint8_t n = nrfbUnpack(b->buf, b->len, rx, (uint32_t)now);
+           if (nrfsGood(rx, n)) heard = 1;
+        }
+     }
+     if (sampling && (ch >= WIFILO) && (ch <= WIFIHI) && (uniform() < wifiDuty)) energy = 1;
+     last = now;
+
+     r = nrfsPoll((uint32_t)(now - offset), heard, energy);
+     heard = 0;
+     if (r == NRFS_STAY) continue;
+     if (r == NRFS_FOUND) {
+        if (ch == tx) ss->found++;
+        else ss->wrong++;
+        ss->fast.push_back((uint32_t)(now - offset));
+        break;
+     }
+     if (r == NRFS_GIVEUP) {
+        ss->gaveUp++;
+        break;
+     }
+     ch = r;
+     now += TUNEUS;
+     listenFrom = now;
+  }
+  // The old search: the stored channel for 1 s, then 0, 1, ... 1 s each
+  ss->old.push_back(1000000u * (1 + tx));
+}  // end of scanTrial
+
+static int scan(uint32_t trials) {
+  scanStats_t ss[2];
+  const char *name[2] = {"single", "batched"};
+  uint32_t budgetMs = 129000;      // (CHANNELS_MAX+2) * InitialWaitPeriodSEC, the old search's total
+
+  if (rankCheck()) return 1;
+  for (uint8_t b = 0; b < 2; b++) {
+     ss[b] = scanStats_t();
+     lossRng = seed;
+     for (uint32_t i = 0; i < trials; i++) {
+        uint8_t tx = rand32(&lossRng) % NRFS_CHANNELS;
+        uint8_t stored = (tx + 1 + rand32(&lossRng) % (NRFS_CHANNELS-1)) % NRFS_CHANNELS;
+        scanTrial(&ss[b], b, tx, stored, budgetMs);
+     }
+     std::sort(ss[b].fast.begin(), ss[b].fast.end());
+     std::sort(ss[b].old.begin(), ss[b].old.end());
+  }
+
+  printf("Channel scan, %u cold starts, %u locos, frame loss %.1f%%, Wi-Fi %.0f%% busy on channels %u-%u, %s signal, dwell %lu us\n",
+         trials, locos, 100*frameLoss, 100*wifiDuty, WIFILO, WIFIHI, weak ? "weak" : "strong", (unsigned long)NRFS_DWELLUS);
+  printf("%-28s %12s %12s %12s\n", "", name[0], name[1], "old search");
+  printf("%-28s %12u %12u %12u\n", "Found", ss[0].found, ss[1].found, trials);
+  printf("%-28s %12u %12u %12u\n", "Wrong channel", ss[0].wrong, ss[1].wrong, 0);
+  printf("%-28s %12u %12u %12u\n", "Gave up", ss[0].gaveUp, ss[1].gaveUp, 0);
+  printf("%-28s %12.3f %12.3f %12.3f\n", "Acquisition p50 (s)",
+         percentile(ss[0].fast, 50) / 1e6, percentile(ss[1].fast, 50) / 1e6, percentile(ss[0].old, 50) / 1e6);
+  printf("%-28s %12.3f %12.3f %12.3f\n", "Acquisition p90 (s)",
+         percentile(ss[0].fast, 90) / 1e6, percentile(ss[1].fast, 90) / 1e6, percentile(ss[0].old, 90) / 1e6);
+  printf("%-28s %12.3f %12.3f %12.3f\n", "Acquisition max (s)",
+         ss[0].fast.empty() ? 0 : ss[0].fast.back() / 1e6, ss[1].fast.empty() ? 0 : ss[1].fast.back() / 1e6,
+         ss[0].old.back() / 1e6);
+  return (ss[0].wrong || ss[1].wrong) ? 1 : 0;
+}  // end of scan
+
+// Loss against airtime: the FIFO columns, each frame sent 1 to NRFB_COPIESMAX times
+static int redundancy(double seconds) {
+  int bad = 0;
+
+  printf("nRF24 redundancy, %.0f s, %u locos, frame loss %.1f%%, BER %g, bursts of %u us %.0f%% of the time, copies %u us apart\n",
+         seconds, locos, 100*frameLoss, ber, burstUs, burstUs ? 100*busy : 0.0, spacingUs);
+  printf("%-16s %10s %12s %12s %12s %12s\n", "", "Air busy %", "Frames lost%", "Packets lost", "Lat p99 (us)", "Lat max (us)");
+  for (uint8_t b = 0; b < 2; b++) {
+     for (copies = 1; copies <= NRFB_COPIESMAX; copies++) {
+        stats_t st = stats_t();
+        char label[32];
+
+        run(&st, b, 1, seconds);
+        std::sort(st.latency.begin(), st.latency.end());
+        uint64_t want = st.in - st.overruns;
+        snprintf(label, sizeof(label), "%s x%u", b ? "batched" : "single", copies);
+        printf("%-16s %10.2f %12.2f %12llu %12u %12u\n", label,
+               100.0 * st.airUs / (seconds * 1e6), st.frames ? 100.0 * st.framesLost / st.frames : 0.0,
+               (unsigned long long)(want - st.delivered), percentile(st.latency, 99),
+               st.latency.empty() ? 0 : st.latency.back());
+        if (st.mismatched || st.reordered || nrfbRx.bad) bad = 1;
+     }
+  }
+  return bad;
+}  // end of redundancy
+
+////////////
+// Telemetry
+////////////
+
+#define FRAMEUS 8400        // A frame of one packet, about
+
+typedef struct {
+  double p;                 // Chance of losing one copy at the lowest power
+  double leaveS;            // Gone from the layout from then on; 0: never
+  uint32_t frames, lost, copies, sent;
+  uint8_t lastSeq;          // 0xFF: none
+  uint8_t loaded[NRFT_REPORT], loadedLen;
+  uint32_t polls, answers;
+} telemRx_t;
+
+#define JAMFROM 0.15        // Interference on every link over this share of the run
+#define JAMTO   0.30
+#define JAMX    8           // multiplies the losses
+
+// Receivers with IDs 1 to 4 and ever worse links; 3 leaves half way. The
+// transmitter's copies and power level act on every one: each power step
+// halves the loss of a copy, and a frame is lost only with all its copies.
+// Interference hits every link for a while: the power must come back down
+// after it, with the links good again.
+static int telemetry(double seconds) {
+  telemRx_t rx[NRFT_IDS+1];
+  const double p[4] = {0.002, 0.01, 0.04, 0.12};
+  uint8_t nCopies = 1, power = 0, seq = 0, peak = 0;
+  uint32_t polls = 0, absent = 0;
+
+  memset(rx, 0, sizeof(rx));
+  for (uint8_t id = 1; id <= 4; id++) {
+     rx[id].p = p[id-1];
+     rx[id].lastSeq = 0xFF;
+  }
+  rx[3].leaveS = seconds / 2;
+  lossRng = seed;
+  nrftBegin();
+
+  printf("nRF24 telemetry, %.0f s, a frame every %u us, copies %u us apart, receivers 1-4 losing %.1f/%.1f/%.1f/%.1f%% of copies, 3 leaving at %.0f s, x%u from %.0f to %.0f s\n",
+         seconds, FRAMEUS, spacingUs, 100*p[0], 100*p[1], 100*p[2], 100*p[3], seconds / 2, JAMX, seconds * JAMFROM, seconds * JAMTO);
+  printf("%10s %8s %8s\n", "Time (s)", "Copies", "Power");
+  printf("%10.1f %8u %8u\n", 0.0, nCopies, power);
+  for (uint64_t now = 0; now < (uint64_t)(seconds * 1e6); now += FRAMEUS) {
+     uint32_t ms = (uint32_t)(now / 1000);
+     double jam = ((now >= seconds * JAMFROM * 1e6) && (now < seconds * JAMTO * 1e6)) ? JAMX : 1;
+
+     for (uint8_t id = 1; id <= 4; id++) {
+        telemRx_t *r = &rx[id];
+        double q = fmin(0.95, jam * r->p / (1 << power));
+        uint8_t got = 0;
+        if (r->leaveS && (now >= r->leaveS * 1e6)) continue;
+        r->sent++;
+        for (uint8_t c = 0; c < nCopies; c++) {
+           if (uniform() < q) continue;
+           r->frames++;
+           if (got++) r->copies++;
+        }
+        if (!got) continue;
+        if (r->lastSeq != 0xFF) r->lost += (uint8_t)(seq - r->lastSeq - 1) & NRFB_SEQMASK;
+        r->lastSeq = seq;
+     }
+     seq = (seq+1) & NRFB_SEQMASK;
+
+     uint8_t id = nrftNextPoll(ms), ok = 0, len = 0, ack[NRFT_REPORT];
+     if (!id) continue;
+     polls++;
+     telemRx_t *r = &rx[id];
+     r->polls++;
+     if (!r->p || (r->leaveS && (now >= r->leaveS * 1e6))) absent++;
+     else {
+        double q = fmin(0.95, jam * r->p / (1 << power));
+        if ((uniform() >= q) && (uniform() >= q)) {  // The poll and its ACK
+           nrftReport_t rep;
+           ok = 1;
+           r->answers++;
+           len = r->loadedLen;
+           memcpy(ack, r->loaded, len);
+           rep.id = id;
+           rep.frames = r->frames;
+           rep.lost = r->lost;
+           rep.fifoFull = 0;
+           rep.vcc = 250;
+           rep.copies = r->copies;
+           r->loadedLen = nrftPack(&rep, r->loaded);
+        }
+     }
+     nrftResult(id, ok, ack, len, ms);
+     if (nrftAdvise(&nCopies, &power, 1, 0, 3, ms)) printf("%10.1f %8u %8u\n", ms / 1000.0, nCopies, power);
+     if (power > peak) peak = power;
+  }
+
+  printf("%-4s %8s %8s %10s %10s %8s %12s\n", "ID", "Polls", "Answered", "Answered%", "Missed%", "Heard", "True missed%");
+  for (uint8_t id = 1; id <= NRFT_IDS; id++) {
+     nrftLink_t *l = &nrftLinks[id];
+     telemRx_t *r = &rx[id];
+     printf("%-4u %8u %8u %10u %10u %8s %12.2f\n", id, r->polls, r->answers, l->ackPct, l->lossPct, l->heard ? "yes" : "no",
+            r->sent ? 100.0 * r->lost / r->sent : 0.0);
+  }
+  printf("Polls: %u, %u of them to receivers not there\n", polls, absent);
+  if (!peak || (power >= peak)) {
+     printf("FAIL: power %u at the end, %u at most: it should have gone up in the interference and come back down\n", power, peak);
+     return 1;
+  }
+  return 0;
+}  // end of telemetry
+
+static void usage(void) {
+  fprintf(stderr,
+     "usage: nrf24-sim [-t seconds] [-l locos] [-p loss%%] [-e ber] [-b burstus] [-u busy%%] [-c copies] [-g spacingus]\n"
+     "                 [-f flushus] [-d lineus] [-q depth] [-o] [-r] [-s seed]\n"
+     "       nrf24-sim -y [-t seconds] [-g spacingus] [-s seed]\n"
+     "       nrf24-sim -a trials [-l locos] [-p loss%%] [-f flushus] [-w wifi%%] [-x] [-s seed]\n"
+     "  -t  simulated time, default 60 s\n"
+     "  -l  locos the station refreshes, default 8; 0 for idle packets only\n"
+     "  -p  frames lost at random, percent\n"
+     "  -e  bit error rate: longer frames are lost more often\n"
+     "  -b  mean length of bursts of interference, us; a frame hit by one is lost\n"
+     "  -u  share of the time the bursts take, default 5%%\n"
+     "  -c  times each frame is sent, 1-3, default 1\n"
+     "  -g  spacing of the copies, default 3000 us\n"
+     "  -f  batch flush time, default 10000 us\n"
+     "  -d  time to write a line of the receiver's display, default 30000 us; 0 for no display\n"
+     "  -q  NmraDcc's receive queue, 1 to 128 packets, default %u\n"
+     "  -o  the old receiver loop: one frame per pass, none during the display\n"
+     "  -r  instead, the FIFO columns with each frame sent 1 to 3 times\n"
+     "  -s  random seed\n"
+     "  -y  instead, link telemetry: the transmitter's table and its power and copies\n"
+     "  -a  instead, cold starts of the receiver's channel scan against the old search\n"
+     "  -w  share of the time a Wi-Fi network is on channels 26-48, default 20%%\n"
+     "  -x  the transmitter is too weak for the power detector\n", DCC_RX_QUEUE);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  double seconds = 60;
+  uint32_t trials = 0;
+  int opt;
+  stats_t st[4];
+  nrfbStats_t rx[4];
+  const char *name[4] = {"write", "write/batch", "FIFO", "FIFO/batch"};
+
+  bool redund = false, telem = false;
+
+  while ((opt = getopt(argc, argv, "t:l:p:e:b:u:c:g:f:d:q:ors:a:w:xy")) != -1) {
+     switch (opt) {
+        case 't': seconds = atof(optarg); break;
+        case 'l': locos = strtoul(optarg, 0, 0); break;
+        case 'p': frameLoss = atof(optarg) / 100.0; break;
+        case 'e': ber = atof(optarg); break;
+        case 'b': burstUs = strtoul(optarg, 0, 0); break;
+        case 'u': busy = atof(optarg) / 100.0; break;
+        case 'c': copies = strtoul(optarg, 0, 0); break;
+        case 'g': spacingUs = strtoul(optarg, 0, 0); break;
+        case 'f': flushUs = strtoul(optarg, 0, 0); break;
+        case 'd': lineUs = strtoul(optarg, 0, 0); break;
+        case 'q': rxQueue = strtoul(optarg, 0, 0); break;
+        case 'o': oldRx = true; break;
+        case 'r': redund = true; break;
+        case 's': seed = strtoul(optarg, 0, 0); break;
+        case 'a': trials = strtoul(optarg, 0, 0); break;
+        case 'w': wifiDuty = atof(optarg) / 100.0; break;
+        case 'x': weak = true; break;
+        case 'y': telem = true; break;
+        default: usage();
+     }
+  }
+  if ((seconds <= 0) || (locos > 127) || !seed || (copies < 1) || (copies > NRFB_COPIESMAX) || (busy <= 0) || (busy >= 1) || !rxQueue || (rxQueue > 128)) usage();
+  if (trials) return scan(trials);
+  if (redund) return redundancy(seconds);
+  if (telem) return telemetry(seconds);
+
+  for (uint8_t b = 0; b < 4; b++) {
+     st[b] = stats_t();
+     run(&st[b], b & 1, b >> 1, seconds);
+     rx[b] = nrfbRx;
+     std::sort(st[b].latency.begin(), st[b].latency.end());
+  }
+
+  printf("nRF24 link, %.0f s, %u locos, frame loss %.1f%%, BER %g, bursts of %u us, flush %u us, %u cop%s, display line %u us, %s receiver loop, DCC queue %u\n",
+         seconds, locos, 100*frameLoss, ber, burstUs, flushUs, copies, (copies > 1) ? "ies" : "y", lineUs, oldRx ? "old" : "draining", rxQueue);
+  printf("%-35s %12s %12s %12s %12s\n", "", name[0], name[1], name[2], name[3]);
+#define ROW(label, fmt, expr) do { \
+     printf("%-35s", label); \
+     for (uint8_t b = 0; b < 4; b++) { stats_t *s = &st[b]; nrfbStats_t *r = &rx[b]; (void)s; (void)r; printf(" " fmt, expr); } \
+     printf("\n"); } while (0)
+  ROW("DCC packets in/s",               "%12.1f", s->in / seconds);
+  ROW("Lost at the DCC input",          "%12llu", (unsigned long long)s->overruns);
+  ROW("Frames/s",                       "%12.1f", s->frames / seconds);
+  ROW("Packets/frame",                  "%12.2f", s->frames ? (double)(s->in - s->overruns) / s->frames : 0.0);
+  ROW("Payload bytes/frame",            "%12.1f", s->frames ? (double)s->payloadBytes / s->frames : 0.0);
+  ROW("Air busy %",                     "%12.2f", 100.0 * s->airUs / (seconds * 1e6));
+  ROW("Longest notifyDccMsg() (us)",     "%12llu", (unsigned long long)s->notifyMax);
+  ROW("Longest TX work in a loop() (us)", "%12llu", (unsigned long long)s->passMax);
+  ROW("TX FIFO full",                   "%12llu", (unsigned long long)s->fifoFull);
+  ROW("Frames dropped, FIFO still full", "%12llu", (unsigned long long)s->dropped);
+  ROW("  packets in them",              "%12llu", (unsigned long long)s->droppedPkts);
+  ROW("Frames lost",                    "%12llu", (unsigned long long)s->framesLost);
+  ROW("  seen by sequence number",      "%12lu",  (unsigned long)r->lost);
+  ROW("Copies dropped by the receiver", "%12lu",  (unsigned long)r->copies);
+  ROW("Frames late, after a newer one", "%12lu",  (unsigned long)r->late);
+  ROW("Packets delivered %",            "%12.2f", s->in ? 100.0 * s->delivered / s->in : 0.0);
+  ROW("  late, after newer ones",       "%12llu", (unsigned long long)s->late);
+  ROW("  late, left out as superseded",  "%12lu",  (unsigned long)r->superseded);
+  ROW("  late, after a newer one for it", "%12llu", (unsigned long long)s->reordered);
+  ROW("Packets bad or out of order",    "%12llu", (unsigned long long)(s->mismatched + r->bad));
+  ROW("RX FIFO overflows (frames lost)", "%12llu", (unsigned long long)s->rxOverflow);
+  ROW("  RX FIFO found full",           "%12llu", (unsigned long long)s->rxFullSeen);
+  ROW("Latency p50 (us)",               "%12u",   percentile(s->latency, 50));
+  ROW("Latency p99 (us)",               "%12u",   percentile(s->latency, 99));
+  ROW("Latency max (us)",               "%12u",   s->latency.empty() ? 0 : s->latency.back());
+  for (uint8_t b = 0; b < 4; b++) {
+     if (st[b].mismatched || st[b].reordered || rx[b].bad) return 1;
+  }
+  return 0;
+}
\ No newline at end of file
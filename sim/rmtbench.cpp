@@ -0,0 +1,322 @@
+/*
+sim/rmtbench.cpp
+
+Host harness for NmraDcc's two ways in: the edge interrupt and
+decodeSymbols(), which an ESP32 feeds from its RMT peripheral.
+
+A capture of packets (scripts/layout.hex by default) is turned into the
+track signal, half bit by half bit. The edge interrupt path gets each edge
+late, by a latency that Wi-Fi on an ESP32 stretches now and then, and
+measures the bits with micros() as it runs. The symbol path gets the
+levels and their durations as the RMT timed them, in blocks. The packets
+that come out of process() are checked against those sent.
+
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <NmraDcc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#define ONE_HALF_US   58   // Command station timing, NMRA S-9.1
+#define ZERO_HALF_US  100
+#define PREAMBLE_BITS 14
+#define ISR_US        4    // Time the edge ISR takes: a second edge in it waits
+#define RMT_SYMBOLS   64   // Symbols per hand-over, as DCC_RMT_SYMBOLS
+
+//////////////////////////////
+// What NmraDcc needs of Arduino
+//////////////////////////////
+
+static uint8_t eeprom[E2END + 1];
+SimEEPROM EEPROM;
+static uint64_t simUs;                 // Simulated time
+static void (*isrFn)(void);
+static int isrMode;                    // Edges the pin interrupt is set for
+
+extern "C" {
+volatile uint8_t PINB, PINC, PIND;
+uint8_t eeprom_read_byte(const uint8_t *addr) { return eeprom[(uintptr_t)addr]; }
+void eeprom_write_byte(uint8_t *addr, uint8_t val) { eeprom[(uintptr_t)addr] = val; }
+void eeprom_update_byte(uint8_t *addr, uint8_t val) { eeprom[(uintptr_t)addr] = val; }
+int eeprom_is_ready(void) { return 1; }
+uint32_t millis(void) { return (uint32_t)(simUs / 1000); }
+uint32_t micros(void) { return (uint32_t)simUs; }
+void pinMode(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return (PIND >> 2) & 1; }
+void attachInterrupt(uint8_t, void (*fn)(void), int mode) { isrFn = fn; isrMode = mode; }
+void sim_cli(void) {}
+void sim_sei(void) {}
+}
+
+static std::vector<DCC_MSG> received;
+
+void notifyDccMsg(DCC_MSG *Msg) {
+  received.push_back(*Msg);
+}
+
+///////////
+// Packets
+///////////
+
+static std::vector<DCC_MSG> trace;
+
+static void load(const char *path) {
+  FILE *f = fopen(path, "r");
+  char line[256];
+
+  if (!f) {
+     perror(path);
+     exit(1);
+  }
+  while (fgets(line, sizeof(line), f)) {
+     DCC_MSG m;
+     char *p = line, *e;
+     uint8_t x = 0;
+
+     if (line[0] == '#') continue;
+     memset(&m, 0, sizeof(m));
+     while (m.Size < MAX_DCC_MESSAGE_LEN - 1) {
+        unsigned long b = strtoul(p, &e, 16);
+        if (e == p) break;
+        m.Data[m.Size++] = (uint8_t)b;
+        x ^= (uint8_t)b;
+        p = e;
+     }
+     if (m.Size < 2) continue;
+     m.Data[m.Size++] = x;
+     trace.push_back(m);
+  }
+  fclose(f);
+  if (trace.empty()) {
+     fprintf(stderr, "%s: no packets\n", path);
+     exit(1);
+  }
+}
+
+static uint32_t rng = 1;
+
+static uint32_t rnd(uint32_t n) {   // 0 to n-1
+  rng = rng * 1103515245 + 12345;
+  return n ? (rng >> 8) % n : 0;
+}
+
+// The track signal as half-bit durations in us, from a 1 level, with
+// every half off by up to +-jitter us, and noise in 10000 halves cut by
+// a 10 us spike of the other level
+static std::vector<uint16_t> encode(int jitter, int noise) {
+  std::vector<uint16_t> halves;
+
+  for (size_t i = 0; i < trace.size(); i++) {
+     std::vector<uint8_t> bits(PREAMBLE_BITS, 1);
+     const DCC_MSG &m = trace[i];
+     for (uint8_t b = 0; b < m.Size; b++) {
+        bits.push_back(0);
+        for (int k = 7; k >= 0; k--) bits.push_back((m.Data[b] >> k) & 1);
+     }
+     bits.push_back(1);
+     for (size_t k = 0; k < bits.size(); k++) {
+        for (int h = 0; h < 2; h++) {
+           uint16_t d = (bits[k] ? ONE_HALF_US : ZERO_HALF_US) + (int)rnd(2*jitter + 1) - jitter;
+           if ((int)rnd(10000) < noise) {
+              halves.push_back(d / 2);
+              halves.push_back(10);
+              d -= d / 2 + 10;
+           }
+           halves.push_back(d);
+        }
+     }
+  }
+  for (int k = 0; k < 2*PREAMBLE_BITS; k++) halves.push_back(ONE_HALF_US);  // The next preamble: the end bit of the last packet has an edge after it
+  return halves;
+}
+
+// Sent packets found in order among those received
+static size_t matched(void) {
+  size_t n = 0, s = 0;
+
+  for (size_t r = 0; r < received.size(); r++) {
+     for (size_t k = s; k < trace.size(); k++) {
+        if ((trace[k].Size == received[r].Size) && !memcmp(trace[k].Data, received[r].Data, trace[k].Size)) {
+           n++;
+           s = k + 1;
+           break;
+        }
+     }
+  }
+  return n;
+}
+
+typedef struct {
+  const char *label;
+  int jitter;          // Track signal, +-us per half bit
+  int latMin, latMax;  // Interrupt latency, us
+  int burstPct;        // Edges held up by something else (Wi-Fi), percent
+  int burstMax;        // and for up to this long, us
+  int noise;           // Spikes, in 10000 half bits
+  int split;           // RMT: every split-th level comes in two pieces, as levels too long for one do. 0: none
+} run_t;
+
+static NmraDcc Dcc;
+
+// The edge interrupt: each edge that the pin is set for raises it, and it runs
+// after the latency, or after the one before it ends. Edges while it is
+// pending only set the same flag again.
+static uint32_t runGpio(const run_t *r, const std::vector<uint16_t> &halves) {
+  uint64_t t = simUs, entry = 0, free = simUs;
+  uint32_t calls = 0;
+  bool pending = false;
+  uint8_t level = 1;
+
+  received.clear();
+  Dcc.pin(0, 2, 0);
+  Dcc.init(MAN_ID_DIY, 10, 0, 0);
+  for (size_t k = 0; k <= halves.size(); k++) {
+     if (pending && (k == halves.size() || entry <= t)) {
+        simUs = entry;
+        PIND = level << 2;
+        isrFn();
+        calls++;
+        pending = false;
+        free = entry + ISR_US;
+        Dcc.process(DCC_RX_QUEUE);
+     }
+     if (k == halves.size()) break;
+
+     // The edge at t, to the level of half k
+     level = (k & 1) ? 0 : 1;
+     if (isrFn && ((isrMode == CHANGE) || (isrMode == (level ? RISING : FALLING)))) {
+        if (!pending) {
+           uint64_t lat = r->latMin + rnd(r->latMax - r->latMin + 1);
+           if ((int)rnd(100) < r->burstPct) lat += rnd(r->burstMax + 1);
+           entry = (t + lat > free) ? t + lat : free;
+           pending = true;
+        }
+     }
+     t += halves[k];
+  }
+  simUs = t;
+  return calls;
+}
+
+// The RMT: symbols of two levels each, handed over RMT_SYMBOLS at a time
+static uint32_t runRmt(const run_t *r, const std::vector<uint16_t> &halves) {
+  std::vector<uint32_t> symbols;
+  uint32_t batches = 0, pieces = 0;
+  static const uint32_t idle = 0;
+
+  received.clear();
+  Dcc.init(MAN_ID_DIY, 10, 0, 0);
+  Dcc.decodeSymbols(&idle, 1, (unsigned int)simUs);   // Whatever the last run left, it is over
+  for (size_t k = 0; k < halves.size(); k++) {
+     uint32_t level = (k & 1) ? 0 : 1;
+     uint16_t d = halves[k];
+     if (r->split && (++pieces % r->split == 0)) {
+        symbols.push_back(0);
+        symbols.back() = (d / 3) | level << 15;
+        d -= d / 3;
+        symbols.back() |= ((uint32_t)d | level << 15) << 16;
+     }
+     else if (k + 1 < halves.size()) {
+        uint32_t next = (uint32_t)halves[k + 1] | (level ^ 1) << 15;
+        symbols.push_back(d | level << 15 | next << 16);
+        k++;
+     }
+     else symbols.push_back(d | level << 15);
+  }
+  for (size_t i = 0; i < symbols.size(); i += RMT_SYMBOLS) {
+     uint16_t n = (symbols.size() - i < RMT_SYMBOLS) ? (uint16_t)(symbols.size() - i) : RMT_SYMBOLS;
+     for (uint16_t j = 0; j < n; j++) simUs += (symbols[i + j] & 0x7FFF) + ((symbols[i + j] >> 16) & 0x7FFF);
+     Dcc.decodeSymbols(&symbols[i], n, (unsigned int)simUs);
+     batches++;
+     Dcc.process(DCC_RX_QUEUE);
+  }
+  return batches;
+}
+
+static uint64_t nowNs(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+int main(int argc, char **argv) {
+  static const run_t runs[] = {
+     {"Clean",                               0, 1,  1, 0,   0,  0, 0},
+     {"Track jitter +-4 us",                 4, 1,  1, 0,   0,  0, 0},
+     {"Spikes in 0.1% of half bits",         0, 1,  1, 0,   0, 10, 0},
+     {"Interrupt latency 1-10 us",           0, 1, 10, 0,   0,  0, 0},
+     {"Wi-Fi: 2% of edges up to +60 us",     0, 1, 10, 2,  60,  0, 0},
+     {"Wi-Fi: 5% of edges up to +120 us",    0, 1, 10, 5, 120,  0, 0},
+     {"Jitter, Wi-Fi, split RMT levels",     4, 1, 10, 5, 120,  0, 7},
+  };
+  const char *path = "scripts/layout.hex";
+  int c;
+
+  while ((c = getopt(argc, argv, "f:")) != -1) {
+     switch (c) {
+        case 'f': path = optarg; break;
+        default:
+           fprintf(stderr, "Usage: %s [-f capture]\n", argv[0]);
+           return 1;
+     }
+  }
+  load(path);
+
+  printf("NmraDcc input, %s: %u packets\n", path, (unsigned)trace.size());
+  printf("%-36s %22s %22s\n", "", "---- Edge interrupt ---", "----- RMT symbols -----");
+  printf("%-36s %8s %6s %6s %8s %6s %6s\n", "", "Int/pkt", "Got", "Lost%", "Int/pkt", "Got", "Lost%");
+  for (size_t i = 0; i < sizeof(runs)/sizeof(runs[0]); i++) {
+     const run_t *r = &runs[i];
+     std::vector<uint16_t> halves = encode(r->jitter, r->noise);
+     uint32_t gpioCalls = runGpio(r, halves);
+     size_t gpioGot = matched();
+     uint32_t rmtCalls = runRmt(r, halves);
+     size_t rmtGot = matched();
+     double n = trace.size();
+     printf("%-36s %8.1f %6u %6.2f %8.2f %6u %6.2f\n", r->label,
+            gpioCalls / n, (unsigned)gpioGot, 100.0 * (n - gpioGot) / n,
+            rmtCalls / n, (unsigned)rmtGot, 100.0 * (n - rmtGot) / n);
+  }
+
+  // Host cost of the symbol decoder alone
+  std::vector<uint16_t> halves = encode(0, 0);
+  uint64_t t0 = nowNs(), packets = 0;
+  do {
+     runRmt(&runs[0], halves);
+     packets += received.size();
+  } while (nowNs() - t0 < 500000000ULL);
+  printf("\nSymbol decoder and process() on this host: %.0f ns per packet\n", (double)(nowNs() - t0) / packets);
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,169 @@
+/*
+sim/shim/Arduino.h
+
+The Arduino core for the host simulation: time, pins, interrupts and
+Serial, all run against simulated time (see sim/simcore.cpp).
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+
+#ifndef __cplusplus
+#include <stdbool.h>
+#endif
+
+typedef bool boolean;
+typedef uint8_t byte;
+typedef uint16_t word;
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define SS   10
+#define MOSI 11
+#define MISO 12
+#define SCK  13
+#define SDA  18
+#define SCL  19
+
+#define NOT_A_PORT 0
+#define PB 2
+#define PC 3
+#define PD 4
+#define NOT_AN_INTERRUPT -1
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : NOT_AN_INTERRUPT))
+#define digitalPinToPort(p) ((p) < 8 ? PD : ((p) < 14 ? PB : ((p) < 20 ? PC : NOT_A_PORT)))
+#define digitalPinToBitMask(p) ((uint8_t)(1 << ((p) < 8 ? (p) : ((p) < 14 ? (p) - 8 : (p) - 14))))
+#ifdef __cplusplus
+#define SIM_PORTD_REG (&sim_PORTD.v)            // Bypasses the output timestamps: not for the DCC pin
+#else
+#define SIM_PORTD_REG ((volatile uint8_t *)0)   // No C source here drives port D
+#endif
+#define portOutputRegister(P) ((P) == PB ? &PORTB : ((P) == PC ? &PORTC : SIM_PORTD_REG))
+#define portInputRegister(P) ((P) == PB ? &PINB : ((P) == PC ? &PINC : &PIND))
+#define portModeRegister(P) ((P) == PB ? &DDRB : ((P) == PC ? &DDRC : &DDRD))
+
+#define bitRead(v, b) (((v) >> (b)) & 0x01)
+#define bitSet(v, b) ((v) |= (1UL << (b)))
+#define bitClear(v, b) ((v) &= ~(1UL << (b)))
+#define bitWrite(v, b, x) ((x) ? bitSet(v, b) : bitClear(v, b))
+#define bit(b) (1UL << (b))
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+#define constrain(a, lo, hi) ((a) < (lo) ? (lo) : ((a) > (hi) ? (hi) : (a)))
+
+#define noInterrupts() cli()
+#define interrupts() sei()
+
+#define F(s) (s)
+
+#ifdef __cplusplus
+template<class T, class U> static inline T min(T a, U b) { return (b < a) ? b : a; }
+template<class T, class U> static inline T max(T a, U b) { return (a < b) ? b : a; }
+extern "C" {
+#endif
+// 32 bits, as on the AVR, so time arithmetic wraps the same way
+uint32_t millis(void);
+uint32_t micros(void);
+void delay(uint32_t ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t num, void (*fn)(void), int mode);
+void detachInterrupt(uint8_t num);
+#ifdef __cplusplus
+}
+
+// Serial goes to the simulator's log, if any (sim -s)
+extern FILE *sim_serial;
+
+class SimSerial {
+public:
+  void begin(unsigned long) {}
+  void end() {}
+  int available() { return 0; }
+  int read() { return -1; }
+  int peek() { return -1; }
+  void flush() { if (sim_serial) fflush(sim_serial); }
+  size_t write(uint8_t c) { if (sim_serial) fputc(c, sim_serial); return 1; }
+  size_t print(const char *s) { if (sim_serial) fputs(s, sim_serial); return strlen(s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned long n, int base = DEC) { return number(n, base); }
+  size_t print(long n, int base = DEC) {
+     if ((n < 0) && (base == DEC)) return print('-') + number(-(unsigned long)n, base);
+     return number((unsigned long)n, base);
+  }
+  size_t print(unsigned int n, int base = DEC) { return number(n, base); }
+  size_t print(int n, int base = DEC) { return print((long)n, base); }
+  size_t print(unsigned char n, int base = DEC) { return number(n, base); }
+  size_t print(unsigned long long n, int base = DEC) { return number((unsigned long)n, base); }
+  size_t print(double d, int digits = 2) { if (sim_serial) fprintf(sim_serial, "%.*f", digits, d); return 1; }
+  size_t println() { return print("\n"); }
+  template<class T> size_t println(T v) { size_t n = print(v); return n + println(); }
+  template<class T> size_t println(T v, int b) { size_t n = print(v, b); return n + println(); }
+  operator bool() { return true; }
+private:
+  size_t number(unsigned long n, int base) {
+     char buf[8*sizeof(long) + 1];
+     char *p = &buf[sizeof(buf) - 1];
+     *p = 0;
+     do {
+        char d = n % base;
+        *--p = d < 10 ? '0' + d : 'A' + d - 10;
+        n /= base;
+     } while (n);
+     return print(p);
+  }
+};
+extern SimSerial Serial;
+#endif
+
+#endif
\ No newline at end of file
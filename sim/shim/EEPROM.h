@@ -0,0 +1,47 @@
+/*
+sim/shim/EEPROM.h
+
+Arduino's EEPROM object over the simulated EEPROM.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SIM_EEPROM_H
+#define SIM_EEPROM_H
+
+#include <stdint.h>
+#include <avr/eeprom.h>
+
+class SimEEPROM {
+public:
+  uint8_t read(int a) { return eeprom_read_byte((const uint8_t *)(uintptr_t)a); }
+  void write(int a, uint8_t v) { eeprom_write_byte((uint8_t *)(uintptr_t)a, v); }
+  void update(int a, uint8_t v) { eeprom_update_byte((uint8_t *)(uintptr_t)a, v); }
+  uint16_t length() { return E2END + 1; }
+};
+extern SimEEPROM EEPROM;
+
+#endif
\ No newline at end of file
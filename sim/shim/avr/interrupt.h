@@ -0,0 +1,67 @@
+/*
+sim/shim/avr/interrupt.h
+
+Interrupt control for the host simulation. cli()/sei() gate the
+simulated interrupts; ISR() defines a plain function the simulator
+calls.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void sim_cli(void);
+void sim_sei(void);
+#ifdef __cplusplus
+}
+#define SIM_ISR_LINKAGE extern "C"
+#else
+#define SIM_ISR_LINKAGE
+#endif
+
+#define cli() sim_cli()
+#define sei() sim_sei()
+
+#define ISR(vector, ...) SIM_ISR_LINKAGE void vector(void); SIM_ISR_LINKAGE void vector(void)
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR_NAKED
+
+#define INT0_vect         sim_INT0_vect
+#define INT1_vect         sim_INT1_vect
+#define TIMER1_OVF_vect   sim_TIMER1_OVF_vect
+#define TIMER2_COMPA_vect sim_TIMER2_COMPA_vect
+#define TIMER2_OVF_vect   sim_TIMER2_OVF_vect
+#define EE_READY_vect     sim_EE_READY_vect
+#define TWI_vect          sim_TWI_vect
+
+#endif
\ No newline at end of file
@@ -0,0 +1,165 @@
+/*
+sim/shim/avr/io.h
+
+ATmega328P registers for the host simulation. Most are plain bytes that
+the simulator reads and writes; TCNT1, TWCR and PORTD are objects so
+that the simulated Timer1, TWI and DCC output see every access.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+extern volatile uint8_t TCNT2, TCCR2A, TCCR2B, TIMSK2, OCR2A, OCR2B;
+extern volatile uint8_t PORTB, DDRB, PINB, PORTC, DDRC, PINC, DDRD, PIND;
+extern volatile uint8_t SPCR, SPSR, SPDR;
+extern volatile uint8_t EIMSK, EICRA, EIFR;
+extern volatile uint8_t TWBR, TWSR, TWDR, TWAR;
+extern volatile uint8_t EECR;
+extern volatile uint8_t SREG;
+extern volatile uint8_t MCUSR, WDTCSR;
+#ifdef __cplusplus
+}
+
+// Timer1 counts with simulated time; reading it costs a few cycles so busy-waits on it end
+class SimTCNT1 {
+public:
+  operator uint16_t() const;
+  SimTCNT1 &operator=(uint16_t v);
+  SimTCNT1 &operator+=(uint16_t v) { return *this = (uint16_t)(*this + v); }
+};
+extern SimTCNT1 sim_TCNT1;
+#define TCNT1 sim_TCNT1
+
+// Port D carries the DCC output: the simulator timestamps every change of it
+class SimPORTD {
+public:
+  operator uint8_t() const { return v; }
+  SimPORTD &operator=(uint8_t x);
+  SimPORTD &operator|=(uint8_t x) { return *this = (uint8_t)(v | x); }
+  SimPORTD &operator&=(uint8_t x) { return *this = (uint8_t)(v & x); }
+  volatile uint8_t v;
+};
+extern SimPORTD sim_PORTD;
+#define PORTD sim_PORTD
+
+// TWI control: a write starts the bus operation, TWINT is set when it is done
+class SimTWCR {
+public:
+  operator uint8_t() const;
+  SimTWCR &operator=(uint8_t v);
+  SimTWCR &operator|=(uint8_t v) { return *this = (uint8_t)(*this | v); }
+  SimTWCR &operator&=(uint8_t v) { return *this = (uint8_t)(*this & v); }
+};
+extern SimTWCR sim_TWCR;
+#define TWCR sim_TWCR
+#endif
+
+// Timer1
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define TOIE1 0
+#define TOV1 0
+
+// Timer2
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define TOIE2 0
+#define OCIE2A 1
+#define WGM20 0
+#define WGM21 1
+
+// Ports
+#define PB0 0
+#define PB1 1
+#define PB2 2
+#define PB3 3
+#define PB4 4
+#define PB5 5
+#define PB6 6
+#define PB7 7
+#define PC0 0
+#define PC1 1
+#define PC2 2
+#define PC3 3
+#define PC4 4
+#define PC5 5
+#define PD0 0
+#define PD1 1
+#define PD2 2
+#define PD3 3
+#define PD4 4
+#define PD5 5
+#define PD6 6
+#define PD7 7
+
+// SPI
+#define SPIE 7
+#define SPE 6
+#define DORD 5
+#define MSTR 4
+#define CPOL 3
+#define CPHA 2
+#define SPR1 1
+#define SPR0 0
+#define SPIF 7
+#define SPI2X 0
+
+// External interrupts
+#define INT0 0
+#define INT1 1
+#define INTF0 0
+#define INTF1 1
+
+// EEPROM
+#define EERIE 3
+#define EEMPE 2
+#define EEPE 1
+#define EERE 0
+
+// TWI
+#define TWINT 7
+#define TWEA 6
+#define TWSTA 5
+#define TWSTO 4
+#define TWWC 3
+#define TWEN 2
+#define TWIE 0
+
+#define _BV(b) (1 << (b))
+#define bit_is_set(r, b) ((r) & _BV(b))
+#define bit_is_clear(r, b) (!((r) & _BV(b)))
+
+#endif
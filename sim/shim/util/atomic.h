@@ -0,0 +1,52 @@
+/*
+sim/shim/util/atomic.h
+
+ATOMIC_BLOCK for the host simulation: interrupts are held off for the
+block, then restored (and anything pending is taken).
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SIM_UTIL_ATOMIC_H
+#define SIM_UTIL_ATOMIC_H
+
+#include <avr/interrupt.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+uint8_t sim_irq_save(void);
+void sim_irq_restore(uint8_t);
+#ifdef __cplusplus
+}
+#endif
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define NONATOMIC_BLOCK(type) for (uint8_t sim_s_ = sim_irq_save(), sim_i_ = (sim_sei(), 1); sim_i_; sim_irq_restore(sim_s_), sim_i_ = 0)
+#define ATOMIC_BLOCK(type) for (uint8_t sim_s_ = sim_irq_save(), sim_i_ = 1; sim_i_; sim_irq_restore(sim_s_), sim_i_ = 0)
+
+#endif
\ No newline at end of file
@@ -0,0 +1,481 @@
+/*
+sim/simcore.cpp
+
+Simulated ATmega328P for the host build of the sketch: the cycle clock,
+interrupt dispatch, Timer1, the TWI with a stub display, the EEPROM, and
+the Arduino calls that touch them.
+
+The charged costs are rough figures for a 16 MHz ATmega328P, enough to
+put the interrupts and loop() in the right proportion. They are not
+cycle-exact; compare runs with each other, not with a scope.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "simcore.h"
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <avr/eeprom.h>
+#include <util/atomic.h>
+#include <util/twi.h>
+#include <time.h>
+
+#if !defined(SIM_INPUT_PIN)
+#define SIM_INPUT_PIN 3       // Transmitter: DCC in on PD3 (INT1)
+#endif
+#if !defined(SIM_OUTPUT_BIT)
+#define SIM_OUTPUT_BIT PD2    // Transmitter: DCC out to the modem on PD2
+#endif
+
+#define EEPROM_WRITE_CYCLES (34 * SIM_F_CPU / 10000)  // 3.4 ms
+
+extern void setup(void);
+extern void loop(void);
+
+// Handlers the sketch may or may not define
+extern "C" void sim_TIMER1_OVF_vect(void) __attribute__((weak));
+extern "C" void sim_EE_READY_vect(void) __attribute__((weak));
+extern "C" void sim_TWI_vect(void) __attribute__((weak));
+
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+volatile uint8_t TCNT2, TCCR2A, TCCR2B, TIMSK2, OCR2A, OCR2B;
+volatile uint8_t PORTB, DDRB, PINB, PORTC, DDRC, PINC, DDRD, PIND;
+volatile uint8_t SPCR, SPDR;
+volatile uint8_t SPSR = _BV(SPIF);   // The modem stub takes no time: every SPI transfer is done
+volatile uint8_t EIMSK, EICRA, EIFR;
+volatile uint8_t TWBR, TWSR, TWDR, TWAR;
+volatile uint8_t EECR;
+volatile uint8_t SREG;
+volatile uint8_t MCUSR, WDTCSR;
+
+SimTCNT1 sim_TCNT1;
+SimPORTD sim_PORTD;
+SimTWCR sim_TWCR;
+SimSerial Serial;
+SimEEPROM EEPROM;
+FILE *sim_serial = 0;
+
+uint64_t simNow = 0;
+simCost_t simCost = {
+  320,   // loop
+  60,    // micros
+  40,    // pin
+  12,    // reg: one turn of "while (TCNT1 < advance)" is about this
+  20,    // eeprom
+  { 80, 80, 90, 80, 80 }    // INT0, INT1 (NmraDcc's edge handler, besides its micros()), T1OVF, EE_READY, TWI
+};
+simIsrStats_t simIsr[SIM_VECTORS] = {
+  { "INT0 (DCC in)" }, { "INT1 (DCC in)" }, { "TIMER1_OVF" }, { "EE_READY" }, { "TWI" }
+};
+simTwiStats_t simTwi;
+uint8_t simDisplayAddr = 0x3C;
+uint64_t simEepromWrites = 0;
+uint32_t simEepromMaxCellWrites = 0;
+uint64_t simLoopPasses = 0;
+uint64_t simLoopMaxCycles = 0;
+
+/////////////
+// Interrupts
+/////////////
+
+static uint8_t irqOn = 1;       // Arduino's init() enables interrupts before setup()
+static uint8_t inIsr = 0;
+static uint8_t flags = 0;       // Pending edge-triggered interrupts (INT0, INT1, TIMER1_OVF)
+static uint64_t flagAt[SIM_VECTORS];
+static void (*extHandler[2])(void);
+static int extMode[2];
+static uint8_t inLevel = 1;     // Idle DCC input
+static uint8_t outLevel = 0;
+
+static uint64_t t1Overflow = SIM_NEVER;
+static uint64_t twiDone = SIM_NEVER;
+static uint64_t eeBusyUntil = 0;
+static uint64_t eeEvent = SIM_NEVER;
+static uint8_t twcr = 0;
+
+static void raise(uint8_t v, uint64_t when) {
+  if (flags & _BV(v)) {
+     simIsr[v].missed++;
+     return;
+  }
+  flags |= _BV(v);
+  flagAt[v] = when;
+}
+
+static int nextVector(void) {
+  if ((flags & _BV(SIM_INT0)) && extHandler[0]) return SIM_INT0;
+  if ((flags & _BV(SIM_INT1)) && extHandler[1]) return SIM_INT1;
+  if ((flags & _BV(SIM_T1OVF)) && (TIMSK1 & _BV(TOIE1)) && sim_TIMER1_OVF_vect) return SIM_T1OVF;
+  if ((EECR & _BV(EERIE)) && (simNow >= eeBusyUntil) && sim_EE_READY_vect) return SIM_EEREADY;
+  if (((twcr & (_BV(TWINT) | _BV(TWIE) | _BV(TWEN))) == (_BV(TWINT) | _BV(TWIE) | _BV(TWEN))) && sim_TWI_vect) return SIM_TWI;
+  return -1;
+}
+
+static uint64_t hostNs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+SimPORTD &SimPORTD::operator=(uint8_t x) {
+  uint8_t level = (x >> SIM_OUTPUT_BIT) & 1;
+  v = x;
+  if (level != outLevel) {
+     outLevel = level;
+     simDccOutput(simNow, level);
+  }
+  return *this;
+}
+
+static void take(int v) {
+  simIsrStats_t *s = &simIsr[v];
+  uint64_t t0 = simNow;
+  uint64_t latency;
+  uint64_t h0, h;
+
+  if (v == SIM_EEREADY) latency = simNow - eeBusyUntil;
+  else latency = simNow - flagAt[v];
+  flags &= ~_BV(v);
+  inIsr = 1;
+  irqOn = 0;
+  h0 = hostNs();
+  simSpend(simCost.isr[v]);
+  switch (v) {
+     case SIM_INT0:    extHandler[0](); break;
+     case SIM_INT1:    extHandler[1](); break;
+     case SIM_T1OVF:   sim_TIMER1_OVF_vect(); break;
+     case SIM_EEREADY: sim_EE_READY_vect(); break;
+     case SIM_TWI:     sim_TWI_vect(); break;
+  }
+  h = hostNs() - h0;
+  inIsr = 0;
+  irqOn = 1;            // reti
+
+  s->count++;
+  s->cycles += simNow - t0;
+  if (simNow - t0 > s->maxCycles) s->maxCycles = simNow - t0;
+  if (latency > s->latencyMax) s->latencyMax = latency;
+  s->hostNs += h;
+}
+
+static void dispatch(void) {
+  int v;
+  if (!irqOn || inIsr) return;
+  while ((v = nextVector()) >= 0) take(v);
+}
+
+extern "C" {
+void sim_cli(void) { irqOn = 0; }
+void sim_sei(void) { irqOn = 1; dispatch(); }
+uint8_t sim_irq_save(void) { uint8_t s = irqOn; irqOn = 0; return s; }
+void sim_irq_restore(uint8_t s) { irqOn = s; if (s) dispatch(); }
+}
+
+/////////
+// Timer1
+/////////
+
+static uint16_t t1Base;         // TCNT1 at t1BaseAt
+static uint64_t t1BaseAt;
+
+static uint16_t t1Prescale(void) {
+  static const uint16_t ps[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+  return ps[TCCR1B & 7];
+}
+
+static uint16_t t1Read(void) {
+  uint16_t ps = t1Prescale();
+  return ps ? (uint16_t)(t1Base + (simNow - t1BaseAt) / ps) : t1Base;
+}
+
+static void t1Fire(void) {
+  raise(SIM_T1OVF, t1Overflow);
+  t1Overflow += 65536ULL * t1Prescale();
+}
+
+SimTCNT1::operator uint16_t() const {
+  simSpend(simCost.reg);
+  return t1Read();
+}
+
+SimTCNT1 &SimTCNT1::operator=(uint16_t v) {
+  uint16_t ps = t1Prescale();
+  t1Base = v;
+  t1BaseAt = simNow;
+  t1Overflow = ps ? simNow + (65536ULL - v) * ps : SIM_NEVER;
+  return *this;
+}
+
+/////////////////////////////
+// TWI, with one stub display
+/////////////////////////////
+
+#define TWI_START     1
+#define TWI_STOP      2
+#define TWI_STOPSTART 3
+#define TWI_BYTE      4
+
+static uint8_t twiOp;
+static uint8_t twiPhase = 0;    // 0: bus free, 1: START sent, 2: addressed
+static uint8_t twiAck = 0;
+
+static uint64_t twiBit(void) {  // Cycles per SCL period
+  return 16 + 2ULL * TWBR * (1 << (2 * (TWSR & 3)));
+}
+
+static void twiFire(void) {
+  twiDone = SIM_NEVER;
+  switch (twiOp) {
+     case TWI_STOP:
+     case TWI_STOPSTART:
+        twcr &= ~_BV(TWSTO);
+        twiPhase = 0;
+        if (twiOp == TWI_STOPSTART) {
+           twiOp = TWI_START;
+           twiDone = simNow + twiBit();
+        }
+        return;
+     case TWI_START:
+        TWSR = (TWSR & 3) | (twiPhase ? TW_REP_START : TW_START);
+        twiPhase = 1;
+        break;
+     case TWI_BYTE:
+        if (twiPhase == 1) {
+           twiAck = simDisplayAddr && ((TWDR >> 1) == simDisplayAddr) && !(TWDR & 1);
+           TWSR = (TWSR & 3) | (twiAck ? TW_MT_SLA_ACK : TW_MT_SLA_NACK);
+           if (twiAck) simTwi.transactions++;
+           else simTwi.nacks++;
+           twiPhase = 2;
+        } else {
+           TWSR = (TWSR & 3) | (twiAck ? TW_MT_DATA_ACK : TW_MT_DATA_NACK);
+           if (twiAck) simTwi.bytes++;
+        }
+        break;
+  }
+  twcr |= _BV(TWINT);
+  flagAt[SIM_TWI] = simNow;
+}
+
+SimTWCR::operator uint8_t() const {
+  simSpend(simCost.reg);
+  return twcr;
+}
+
+SimTWCR &SimTWCR::operator=(uint8_t v) {
+  simSpend(simCost.reg);
+  if (!(v & _BV(TWEN))) {         // TWI off: abandon whatever was on the bus
+     twcr = v & ~_BV(TWINT);
+     twiDone = SIM_NEVER;
+     twiPhase = 0;
+     return *this;
+  }
+  if (!(v & _BV(TWINT))) {        // Only the enables change
+     twcr = (twcr & _BV(TWINT)) | (v & ~_BV(TWINT));
+     return *this;
+  }
+  twcr = v & ~_BV(TWINT);         // Writing 1 clears TWINT and starts the next action
+  if (v & _BV(TWSTO)) {
+     twiOp = (v & _BV(TWSTA)) ? TWI_STOPSTART : TWI_STOP;
+     twiDone = simNow + twiBit();
+  } else if (v & _BV(TWSTA)) {
+     twiOp = TWI_START;
+     twiDone = simNow + twiBit();
+  } else {
+     twiOp = TWI_BYTE;
+     twiDone = simNow + 9 * twiBit();
+  }
+  return *this;
+}
+
+/////////
+// EEPROM
+/////////
+
+static uint8_t eeMem[E2END+1];
+static uint32_t eeCellWrites[E2END+1];
+
+static void eeWait(void) {      // avr-libc waits for a write in progress
+  if (simNow < eeBusyUntil) simSpend(eeBusyUntil - simNow);
+}
+
+extern "C" {
+uint8_t eeprom_read_byte(const uint8_t *addr) {
+  eeWait();
+  simSpend(simCost.eeprom);
+  return eeMem[(uintptr_t)addr & E2END];
+}
+
+void eeprom_write_byte(uint8_t *addr, uint8_t val) {
+  uint16_t a = (uintptr_t)addr & E2END;
+  eeWait();
+  simSpend(simCost.eeprom);
+  eeMem[a] = val;
+  simEepromWrites++;
+  if (++eeCellWrites[a] > simEepromMaxCellWrites) simEepromMaxCellWrites = eeCellWrites[a];
+  eeBusyUntil = simNow + EEPROM_WRITE_CYCLES;
+  eeEvent = eeBusyUntil;
+}
+
+void eeprom_update_byte(uint8_t *addr, uint8_t val) {
+  if (eeprom_read_byte(addr) != val) eeprom_write_byte(addr, val);
+}
+
+int eeprom_is_ready(void) {
+  simSpend(simCost.reg);
+  return simNow >= eeBusyUntil;
+}
+}
+
+void simEepromLoad(const char *path) {
+  FILE *f;
+  memset(eeMem, 0xFF, sizeof(eeMem));
+  if (path && (f = fopen(path, "rb"))) {
+     if (fread(eeMem, 1, sizeof(eeMem), f) != sizeof(eeMem)) fprintf(stderr, "sim: %s is short\n", path);
+     fclose(f);
+  }
+}
+
+void simEepromSave(const char *path) {
+  FILE *f;
+  if (!path) return;
+  if (!(f = fopen(path, "wb")) || (fwrite(eeMem, 1, sizeof(eeMem), f) != sizeof(eeMem))) {
+     fprintf(stderr, "sim: cannot write %s\n", path);
+  }
+  if (f) fclose(f);
+}
+
+//////////////
+// Event clock
+//////////////
+
+static uint64_t nextEvent(void) {
+  uint64_t t = t1Overflow;
+  if (simDccNextEdge < t) t = simDccNextEdge;
+  if (twiDone < t) t = twiDone;
+  if (eeEvent < t) t = eeEvent;
+  return t;
+}
+
+void simSpend(uint64_t cycles) {
+  uint64_t end = simNow + cycles;
+
+  for (;;) {
+     uint64_t t = nextEvent();
+     if (t > end) break;
+     if (t > simNow) simNow = t;
+     if (t1Overflow <= simNow) t1Fire();
+     if (simDccNextEdge <= simNow) simDccEdge();
+     if (twiDone <= simNow) twiFire();
+     if (eeEvent <= simNow) eeEvent = SIM_NEVER;  // EE_READY is level-triggered: just look again
+     if (irqOn && !inIsr) {       // Interrupts stretch the code they interrupt
+        uint64_t t0 = simNow;
+        dispatch();
+        end += simNow - t0;
+     }
+  }
+  simNow = end;
+}
+
+void simLoop(void) {
+  uint64_t t0 = simNow;
+
+  dispatch();
+  loop();
+  simSpend(simCost.loop);
+  simLoopPasses++;
+  if (simNow - t0 > simLoopMaxCycles) simLoopMaxCycles = simNow - t0;
+}
+
+//////////////////////
+// DCC input and pins
+//////////////////////
+
+void simInputLevel(uint8_t level) {
+  uint8_t num = SIM_INPUT_PIN - 2;
+  int mode = extMode[num];
+
+  inLevel = level;
+  if (level) PIND |= _BV(SIM_INPUT_PIN);
+  else PIND &= ~_BV(SIM_INPUT_PIN);
+  if (!extHandler[num]) return;
+  if ((mode == CHANGE) || ((mode == RISING) && level) || ((mode == FALLING) && !level)) {
+     raise(num == 0 ? SIM_INT0 : SIM_INT1, simNow);
+  }
+}
+
+extern "C" {
+uint32_t micros(void) {
+  simSpend(simCost.micros);
+  return (uint32_t)(simNow / SIM_CPU_US);
+}
+
+uint32_t millis(void) {
+  simSpend(simCost.micros);
+  return (uint32_t)(simNow / (1000 * SIM_CPU_US));
+}
+
+void delay(uint32_t ms) {
+  simSpend((uint64_t)ms * 1000 * SIM_CPU_US);
+}
+
+void delayMicroseconds(unsigned int us) {
+  simSpend((uint64_t)us * SIM_CPU_US);
+}
+
+static volatile uint8_t *port(uint8_t pin) {
+  return (pin < 8) ? &PORTD.v : ((pin < 14) ? &PORTB : &PORTC);
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  simSpend(simCost.pin);
+  if (pin < 8) PORTD = val ? (PORTD | digitalPinToBitMask(pin)) : (PORTD & ~digitalPinToBitMask(pin));
+  else if (val) *port(pin) |= digitalPinToBitMask(pin);
+  else *port(pin) &= ~digitalPinToBitMask(pin);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  simSpend(simCost.pin);
+  if (mode == INPUT_PULLUP) digitalWrite(pin, HIGH);
+}
+
+int digitalRead(uint8_t pin) {
+  simSpend(simCost.pin);
+  if (pin == SIM_INPUT_PIN) return inLevel;
+  if ((pin == SDA) || (pin == SCL)) return HIGH;  // Pulled up, idle
+  return (*port(pin) & digitalPinToBitMask(pin)) ? HIGH : LOW;
+}
+
+void attachInterrupt(uint8_t num, void (*fn)(void), int mode) {
+  if (num > 1) return;
+  extHandler[num] = fn;
+  extMode[num] = mode;
+}
+
+void detachInterrupt(uint8_t num) {
+  if (num > 1) return;
+  extHandler[num] = 0;
+}
+}
\ No newline at end of file
@@ -0,0 +1,110 @@
+/*
+sim/simcore.h
+
+Internals of the host simulation of the ProMiniAir sketch.
+
+Time is counted in 16 MHz CPU cycles. Host code takes no simulated time
+by itself: the simulator charges a fixed cost for each pass of loop(),
+each interrupt entry, and each access to the time or the hardware
+(micros(), TCNT1, digitalRead(), ...). Interrupts are taken as on the
+AVR: one at a time, lowest vector first, never while cli() or inside
+another interrupt.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SIMCORE_H_
+#define SIMCORE_H_
+
+#include <stdint.h>
+
+#define SIM_F_CPU   16000000ULL
+#define SIM_CPU_US  16            // Cycles per us
+#define SIM_NEVER   UINT64_MAX
+
+// Interrupt vectors, in AVR priority order
+#define SIM_INT0    0
+#define SIM_INT1    1
+#define SIM_T1OVF   2
+#define SIM_EEREADY 3
+#define SIM_TWI     4
+#define SIM_VECTORS 5
+
+// Charged costs, in cycles. Rough ATmega328P figures; see simcore.cpp.
+typedef struct {
+  uint32_t loop;        // One pass of loop(), not counting what it calls below
+  uint32_t micros;      // micros(), millis()
+  uint32_t pin;         // digitalRead(), digitalWrite(), pinMode()
+  uint32_t reg;         // A TCNT1 or TWCR access, one turn of a busy-wait on it
+  uint32_t eeprom;      // An EEPROM access, not counting the 3.4 ms write time
+  uint32_t isr[SIM_VECTORS];  // Entry and exit of each interrupt
+} simCost_t;
+
+typedef struct {
+  const char *name;
+  uint64_t count;
+  uint64_t cycles;      // Simulated time spent inside, including the entry cost
+  uint64_t maxCycles;
+  uint64_t latencyMax;  // From the interrupt flag being set to entry, in cycles
+  uint64_t missed;      // Flags set again before the first one was taken
+  uint64_t hostNs;      // Host time spent in the handler: compares builds of the same code
+} simIsrStats_t;
+
+typedef struct {
+  uint64_t transactions;
+  uint64_t bytes;
+  uint64_t nacks;
+} simTwiStats_t;
+
+extern uint64_t simNow;            // Cycles since reset
+extern simCost_t simCost;
+extern simIsrStats_t simIsr[SIM_VECTORS];
+extern simTwiStats_t simTwi;
+extern uint8_t simDisplayAddr;     // I2C address the stub display answers on. 0: none
+extern uint64_t simEepromWrites;
+extern uint32_t simEepromMaxCellWrites;
+
+// Let cycles of simulated time pass in the running code, taking interrupts as they come due
+void simSpend(uint64_t cycles);
+
+// Run the sketch's loop() once, and charge for it
+void simLoop(void);
+extern uint64_t simLoopPasses;
+extern uint64_t simLoopMaxCycles;
+
+// EEPROM image file. A missing file is an erased EEPROM.
+void simEepromLoad(const char *path);
+void simEepromSave(const char *path);
+
+// DCC input (simdcc.cpp): the level to drive and the time of the next edge
+extern uint64_t simDccNextEdge;
+void simDccEdge(void);
+void simInputLevel(uint8_t level);  // Drive the DCC input pin; raises its interrupt
+
+// DCC output decoder (simdcc.cpp): called when the output pin changes
+void simDccOutput(uint64_t when, uint8_t level);
+
+#endif /* SIMCORE_H_ */
\ No newline at end of file
@@ -0,0 +1,621 @@
+/*
+sim/simdcc.cpp
+
+DCC for the host simulation: a scripted command station driving the
+sketch's DCC input, and a decoder watching its DCC output.
+
+Each input packet is remembered with the time its end bit finished.
+When the same bytes come out of the sketch, the latency is the time from
+the newest such input to the end of the output packet. Outputs with no
+matching input are the sketch's own (repeats, idles, refresh); inputs
+that never come out are lost.
+
+The decoder also keeps the speed and F0-F4 each loco was last given, on
+the input (what the command station wants) and on the output (what a
+loco hears). "drop" loses the output on the air for a while; each loco
+whose two states differ when it ends is timed until they agree again.
+
+Script, one command per line ('#' starts a comment). Commands that send
+packets take an optional count, e.g. "x5".
+  preamble <bits>           Preamble for the packets that follow (default 16)
+  jitter <us>               Random +-us on every input half-bit (default 0)
+  seed <n>                  Seed for jitter and station
+  drop <ms>                 For ms from now, output packets are lost on the air
+  idle [xN]                 Idle packet
+  reset [xN]                Reset packet
+  speed <addr> <step> [rev] [xN]  128-step speed, step 0-126
+  func <addr> <bits> [xN]   F0-F4; bits is FL F4 F3 F2 F1, hex, e.g. 10 for FL
+  raw <hex bytes> [xN]      Any packet; the XOR byte is added
+  wait <ms>                 Idle packets for ms
+  gap <ms>                  No DCC for ms: the input is held low
+  station <locos> <ms>      For ms, refresh the speed and F0-F4 of locos
+                            1..locos in turn, and change one loco's
+                            speed every 100 ms
+The script starts over when it ends. Addresses above 127 are long.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "simcore.h"
+#include "simdcc.h"
+#include <dccpreamble.h>
+#include <dccqueue.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define HALF_ONE_US   58    // Half of a 1 bit
+#define HALF_ZERO_US  100   // Half of a 0 bit
+#define ONE_MAX_US    80    // Output half-bits shorter than this are 1s
+#define ZERO_MAX_US   12000 // Longer than this is a gap, not a 0 (stretched zero limit)
+#define STATION_CHANGE_MS 100
+#define AIR_ONE_US    116   // Bits as the transmitter's Timer1 sends them
+#define AIR_ZERO_US   232
+#define SPEED_GAP_MS  500   // A loco this long without a speed packet on the output may coast or stop
+
+enum { C_IDLE, C_RESET, C_SPEED, C_FUNC, C_RAW, C_WAIT, C_GAP, C_STATION, C_PREAMBLE, C_JITTER, C_SEED, C_DROP };
+
+typedef struct {
+  uint8_t kind;
+  uint32_t count;
+  uint32_t a, b, c;
+  uint8_t size;
+  uint8_t data[6];
+} cmd_t;
+
+static std::vector<cmd_t> script;
+static size_t pc = 0;
+static uint32_t left = 0;          // Repeats left of script[pc]
+static uint64_t cmdEnd = 0;        // End of a timed command (wait, gap, station)
+static uint8_t preamble = 16;
+static uint32_t jitterUs = 0;
+static uint32_t rng = 1;
+
+// Station
+static uint8_t speeds[128];
+static uint32_t stationNext = 0;   // Next packet of the refresh cycle
+static uint64_t stationChange = 0;
+static int stationUrgent = -1;     // Loco whose new speed goes out next
+
+// Input bit stream
+static uint8_t bits[16 + 40 + 6*9 + 1];
+static uint8_t nBits = 0, bitAt = 0, halfAt = 0;
+static uint8_t inPacket[6];
+static uint8_t inSize = 0;
+static uint8_t level = 1;
+uint64_t simDccNextEdge = SIM_NEVER;
+int simDccChannel = -1;
+extern uint8_t CHANNEL;            // The sketch's radio channel
+
+// Statistics
+simDccStats_t simDcc;
+static std::unordered_map<uint64_t, std::deque<uint64_t> > sent;
+static std::vector<uint32_t> latencies;
+static uint64_t airUs[DCCP_PROFILES];  // Airtime of the output packets under each preamble profile
+static std::unordered_map<uint16_t, uint64_t> speedOut;  // Last output speed packet of each loco
+
+// Loco state, input and output sides
+typedef struct {
+  int16_t speed;                   // Speed instruction byte (28 or 128 step), -1: none yet
+  int16_t f0;                      // F0-F4 bits, -1: none yet
+} loco_t;
+
+static std::unordered_map<uint16_t, loco_t> wanted;   // From the input
+static std::unordered_map<uint16_t, loco_t> heard;    // From the output, less the air drops
+static std::unordered_map<uint16_t, uint64_t> stale;  // Locos wrong after a drop, and its end
+static std::vector<uint32_t> recoveries;               // Time to correct state, ms
+static uint64_t dropFrom = 0, dropUntil = 0;           // Air drop, cycles. dropUntil 0: none
+
+static uint32_t rand32(void) {
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng;
+}
+
+static uint64_t key(const uint8_t *data, uint8_t size) {
+  uint64_t k = size;
+  for (uint8_t i = 0; i < size; i++) k = (k << 8) | data[i];
+  return k;
+}
+
+/////////
+// Script
+/////////
+
+static uint8_t address(uint32_t addr, uint8_t *p) {
+  if (addr <= 127) {
+     p[0] = addr;
+     return 1;
+  }
+  p[0] = 0xC0 | ((addr >> 8) & 0x3F);
+  p[1] = addr & 0xFF;
+  return 2;
+}
+
+static uint8_t speedPacket(uint32_t addr, uint8_t step, uint8_t rev, uint8_t *p) {
+  uint8_t n = address(addr, p);
+  p[n++] = 0x3F;                   // 128 speed steps
+  p[n++] = (rev ? 0x00 : 0x80) | (step ? step + 1 : 0);
+  return n;
+}
+
+static uint8_t funcPacket(uint32_t addr, uint8_t fbits, uint8_t *p) {
+  uint8_t n = address(addr, p);
+  p[n++] = 0x80 | (fbits & 0x1F);
+  return n;
+}
+
+static void parseError(int line, const char *msg) {
+  fprintf(stderr, "sim: script line %d: %s\n", line, msg);
+  exit(2);
+}
+
+void simDccScript(const char *text) {
+  const char *p = text;
+  int line = 0;
+
+  script.clear();
+  while (*p) {
+     char buf[256], word[16];
+     const char *eol = strchr(p, '\n');
+     size_t len = eol ? (size_t)(eol - p) : strlen(p);
+     cmd_t c;
+     char *s, *hash;
+     int n;
+
+     line++;
+     if (len >= sizeof(buf)) len = sizeof(buf) - 1;
+     memcpy(buf, p, len);
+     buf[len] = 0;
+     p += len + (eol ? 1 : 0);
+     if ((hash = strchr(buf, '#'))) *hash = 0;
+     s = buf;
+     if (sscanf(s, "%15s%n", word, &n) != 1) continue;
+     s += n;
+
+     memset(&c, 0, sizeof(c));
+     c.count = 1;
+     if (char *x = strstr(s, " x")) {
+        c.count = strtoul(x + 2, 0, 0);
+        *x = 0;
+     }
+     if (!strcmp(word, "idle")) c.kind = C_IDLE;
+     else if (!strcmp(word, "reset")) c.kind = C_RESET;
+     else if (!strcmp(word, "speed")) {
+        char dir[8] = "";
+        c.kind = C_SPEED;
+        if (sscanf(s, "%u %u %7s", &c.a, &c.b, dir) < 2) parseError(line, "speed <addr> <step> [rev]");
+        c.c = !strcmp(dir, "rev");
+        if (c.b > 126) parseError(line, "speed step is 0-126");
+     } else if (!strcmp(word, "func")) {
+        c.kind = C_FUNC;
+        if (sscanf(s, "%u %x", &c.a, &c.b) != 2) parseError(line, "func <addr> <hex bits>");
+     } else if (!strcmp(word, "raw")) {
+        unsigned v;
+        c.kind = C_RAW;
+        while ((sscanf(s, "%x%n", &v, &n) == 1) && (c.size < 5)) {
+           c.data[c.size++] = v;
+           s += n;
+        }
+        if (c.size < 2) parseError(line, "raw needs 2 to 5 bytes");
+     } else if (!strcmp(word, "wait") || !strcmp(word, "gap")) {
+        c.kind = (word[0] == 'w') ? C_WAIT : C_GAP;
+        if (sscanf(s, "%u", &c.a) != 1) parseError(line, "wait/gap <ms>");
+     } else if (!strcmp(word, "station")) {
+        c.kind = C_STATION;
+        if ((sscanf(s, "%u %u", &c.a, &c.b) != 2) || !c.a || (c.a > 127)) parseError(line, "station <1-127 locos> <ms>");
+     } else if (!strcmp(word, "preamble")) {
+        c.kind = C_PREAMBLE;
+        if ((sscanf(s, "%u", &c.a) != 1) || (c.a < 10) || (c.a > 40)) parseError(line, "preamble <10-40>");
+     } else if (!strcmp(word, "jitter")) {
+        c.kind = C_JITTER;
+        if (sscanf(s, "%u", &c.a) != 1) parseError(line, "jitter <us>");
+     } else if (!strcmp(word, "seed")) {
+        c.kind = C_SEED;
+        if (sscanf(s, "%u", &c.a) != 1) parseError(line, "seed <n>");
+     } else if (!strcmp(word, "drop")) {
+        c.kind = C_DROP;
+        if ((sscanf(s, "%u", &c.a) != 1) || !c.a) parseError(line, "drop <ms>");
+     } else {
+        parseError(line, "unknown command");
+     }
+     script.push_back(c);
+  }
+  if (script.empty()) parseError(line, "no commands");
+  pc = 0;
+  left = script[0].count;
+  cmdEnd = 0;
+}
+
+// The next packet to send, in p. Returns its size, or 0 for a gap of *gapUs.
+static uint8_t nextPacket(uint8_t *p, uint32_t *gapUs) {
+  for (;;) {
+     cmd_t *c = &script[pc];
+     uint64_t now = simNow / SIM_CPU_US / 1000;  // ms
+     uint8_t n = 0;
+
+     if (!left) {
+        pc = (pc + 1) % script.size();
+        left = script[pc].count;
+        cmdEnd = 0;
+        continue;
+     }
+     switch (c->kind) {
+        case C_PREAMBLE: preamble = c->a; left--; continue;
+        case C_JITTER:   jitterUs = c->a; left--; continue;
+        case C_SEED:     rng = c->a ? c->a : 1; left--; continue;
+        case C_DROP:
+           dropFrom = simNow;
+           dropUntil = simNow + (uint64_t)c->a * 1000 * SIM_CPU_US;
+           left--;
+           continue;
+        case C_IDLE:     p[0] = 0xFF; p[1] = 0x00; n = 2; left--; break;
+        case C_RESET:    p[0] = 0x00; p[1] = 0x00; n = 2; left--; break;
+        case C_SPEED:    n = speedPacket(c->a, c->b, c->c, p); left--; break;
+        case C_FUNC:     n = funcPacket(c->a, c->b, p); left--; break;
+        case C_RAW:      memcpy(p, c->data, c->size); n = c->size; left--; break;
+        case C_WAIT:
+        case C_GAP:
+        case C_STATION:
+           if (!cmdEnd) {
+              cmdEnd = now + ((c->kind == C_STATION) ? c->b : c->a);
+              stationChange = now + STATION_CHANGE_MS;
+           }
+           if (now >= cmdEnd) {
+              cmdEnd = 0;
+              left--;
+              continue;
+           }
+           if (c->kind == C_GAP) {
+              *gapUs = (cmdEnd - now) * 1000;
+              cmdEnd = now;             // Done after this gap
+              return 0;
+           }
+           if (c->kind == C_WAIT) {
+              p[0] = 0xFF; p[1] = 0x00; n = 2;
+              break;
+           }
+           if (now >= stationChange) {  // The throttle moves
+              stationUrgent = rand32() % c->a;
+              speeds[stationUrgent] = rand32() % 127;
+              stationChange = now + STATION_CHANGE_MS;
+           }
+           if (stationUrgent >= 0) {
+              n = speedPacket(stationUrgent + 1, speeds[stationUrgent], 0, p);
+              stationUrgent = -1;
+           } else {
+              uint32_t loco = (stationNext / 2) % c->a;
+              if (stationNext & 1) n = funcPacket(loco + 1, (loco & 1) ? 0x10 : 0x00, p);
+              else n = speedPacket(loco + 1, speeds[loco], 0, p);
+              stationNext++;
+           }
+           break;
+     }
+     p[n] = 0;
+     for (uint8_t i = 0; i < n; i++) p[n] ^= p[i];
+     return n + 1;
+  }
+}
+
+/////////////
+// Loco state
+/////////////
+
+// Note the speed or F0-F4 a multi-function packet gives its loco
+static void track(std::unordered_map<uint16_t, loco_t> &locos, const uint8_t *p, uint8_t size) {
+  uint16_t addr;
+  uint8_t i;
+
+  if ((p[0] >= 1) && (p[0] <= 127)) {
+     addr = p[0];
+     i = 1;
+  } else if ((p[0] >= 0xC0) && (p[0] <= 0xE7)) {
+     addr = ((p[0] & 0x3F) << 8) | p[1];
+     i = 2;
+  } else {
+     return;
+  }
+  if (i + 1 >= size) return;       // No instruction before the XOR byte
+  loco_t &l = locos.emplace(addr, loco_t{-1, -1}).first->second;
+  if ((p[i] == 0x3F) && (i + 2 < size)) l.speed = p[i+1];
+  else if ((p[i] & 0xC0) == 0x40) l.speed = p[i];
+  else if ((p[i] & 0xE0) == 0x80) l.f0 = p[i] & 0x1F;
+}
+
+static bool agree(uint16_t addr) {
+  const loco_t &w = wanted[addr];
+  auto it = heard.find(addr);
+  if (it == heard.end()) return false;
+  return (w.speed == it->second.speed) && (w.f0 == it->second.f0);
+}
+
+// An output packet ended at when: apply it unless the air lost it, and
+// time the locos that were wrong after the last drop
+static void heardPacket(const uint8_t *p, uint8_t size, uint64_t when) {
+  if (dropUntil && (when >= dropUntil)) {   // The drop is over
+     simDcc.dropNever += stale.size();         // Still wrong from the drop before
+     stale.clear();
+     for (auto &kv : wanted) if (!agree(kv.first)) stale[kv.first] = dropUntil;
+     simDcc.drops++;
+     simDcc.dropStale += stale.size();
+     dropUntil = 0;
+  }
+  if (dropUntil && (when >= dropFrom)) return;
+  track(heard, p, size);
+  for (auto it = stale.begin(); it != stale.end(); ) {
+     if (agree(it->first)) {
+        recoveries.push_back((uint32_t)((when - it->second) / SIM_CPU_US / 1000));
+        it = stale.erase(it);
+     } else {
+        ++it;
+     }
+  }
+}
+
+/////////////
+// DCC input
+/////////////
+
+static void load(void) {
+  uint32_t gapUs = 0;
+  uint8_t i, b;
+
+  nBits = bitAt = halfAt = 0;
+  inSize = nextPacket(inPacket, &gapUs);
+  if (!inSize) {                   // Gap: hold the input low
+     if (level) simInputLevel(level = 0);
+     simDccNextEdge = simNow + (uint64_t)gapUs * SIM_CPU_US;
+     return;
+  }
+  for (i = 0; i < preamble; i++) bits[nBits++] = 1;
+  for (b = 0; b < inSize; b++) {
+     bits[nBits++] = 0;
+     for (i = 0; i < 8; i++) bits[nBits++] = (inPacket[b] >> (7 - i)) & 1;
+  }
+  bits[nBits++] = 1;
+}
+
+void simDccBegin(void) {
+  level = 1;
+  load();
+  if (inSize) simDccNextEdge = simNow;
+}
+
+void simDccEdge(void) {
+  int32_t us;
+
+  if (!inSize || (bitAt >= nBits)) {  // End of a gap or of a packet
+     if (inSize) {
+        sent[key(inPacket, inSize)].push_back(simNow);
+        track(wanted, inPacket, inSize);
+        simDcc.in++;
+     } else {
+        simDcc.gaps++;
+     }
+     load();
+     if (!inSize) return;
+  }
+  level ^= 1;
+  if ((simDccChannel < 0) || (CHANNEL == simDccChannel)) simInputLevel(level);
+  us = bits[bitAt] ? HALF_ONE_US : HALF_ZERO_US;
+  if (jitterUs) us += (int32_t)(rand32() % (2*jitterUs + 1)) - (int32_t)jitterUs;
+  if (us < 1) us = 1;
+  simDccNextEdge = simNow + (uint64_t)us * SIM_CPU_US;
+  if (++halfAt == 2) {
+     halfAt = 0;
+     bitAt++;
+  }
+}
+
+//////////////
+// DCC output
+//////////////
+
+#define OUT_PREAMBLE 0
+#define OUT_START    1
+#define OUT_BITS     2
+
+static uint8_t outState = OUT_PREAMBLE;
+static uint16_t outOnes = 0;       // 1 half-bits in a row
+static int8_t outHalf = -1;        // First half of the bit being read, -1: none
+static uint8_t outBit = 0;         // Bits of the byte read so far; 8: separator next
+static uint8_t outBytes[8];
+static uint8_t outSize = 0;
+static uint64_t outLast = 0;
+
+// Add the airtime a packet would take under each profile: preamble, start bit and
+// separators, data, end bit and the cutout bit(s)
+static void airtime(void) {
+  DCC_MSG m;
+  uint16_t addr;
+  uint8_t group, cls;
+  uint32_t us = outSize * AIR_ZERO_US + AIR_ONE_US;
+
+  m.Size = outSize;
+  memcpy(m.Data, outBytes, outSize);
+  cls = dccqClassify(&m, &addr, &group);
+  if (addr && ((cls == DCCQ_SPEED) || (cls == DCCQ_ESTOP))) {
+     auto it = speedOut.find(addr);
+     if (it != speedOut.end()) {
+        uint32_t ms = (uint32_t)((simNow - it->second) / SIM_CPU_US / 1000);
+        if (ms > simDcc.speedGapMax) simDcc.speedGapMax = ms;
+        if (ms >= SPEED_GAP_MS) simDcc.speedGaps++;
+     }
+     speedOut[addr] = simNow;
+  }
+  for (uint8_t i = 0; i < outSize; i++) {
+     for (uint8_t b = 0x80; b; b >>= 1) us += (outBytes[i] & b) ? AIR_ONE_US : AIR_ZERO_US;
+  }
+  for (uint8_t p = 0; p < DCCP_PROFILES; p++) {
+     airUs[p] += us + dccpBits(p, cls) * AIR_ONE_US +
+                 (dccpLongCutout(p) ? AIR_ONE_US/2 + AIR_ZERO_US/2 : AIR_ONE_US);
+  }
+}
+
+static void outPacket(uint64_t when) {
+  uint8_t x = 0;
+  for (uint8_t i = 0; i < outSize; i++) x ^= outBytes[i];
+  if ((outSize < 3) || (outSize > 6) || x) {
+     simDcc.outBad++;
+     return;
+  }
+  simDcc.out++;
+  airtime();
+  heardPacket(outBytes, outSize, when);
+  auto it = sent.find(key(outBytes, outSize));
+  if (it == sent.end() || it->second.empty() || (it->second.front() > when)) {
+     simDcc.outExtra++;
+     return;
+  }
+  std::deque<uint64_t> &q = it->second;
+  size_t i = 0;
+  while ((i + 1 < q.size()) && (q[i+1] <= when)) i++;
+  latencies.push_back((uint32_t)((when - q[i]) / SIM_CPU_US));
+  simDcc.superseded += i;
+  q.erase(q.begin(), q.begin() + i + 1);
+  simDcc.matched++;
+  if (!simDcc.firstOut) simDcc.firstOut = when;
+}
+
+static void outHalfBit(uint8_t one, uint64_t when) {
+  switch (outState) {
+     case OUT_PREAMBLE:
+        if (one) outOnes++;
+        else if (outOnes >= 20) outState = OUT_START;   // At least 10 one bits, then the start bit
+        else outOnes = 0;
+        return;
+     case OUT_START:
+        if (one) {
+           outState = OUT_PREAMBLE;
+           outOnes = 1;
+           return;
+        }
+        outState = OUT_BITS;
+        outHalf = -1;
+        outBit = 0;
+        outSize = 0;
+        return;
+     case OUT_BITS:
+        if (outHalf < 0) {
+           outHalf = one;
+           return;
+        }
+        if (outHalf != one) {       // Halves differ: lost sync
+           simDcc.outBad++;
+           outState = OUT_PREAMBLE;
+           outOnes = one;
+           return;
+        }
+        outHalf = -1;
+        if (outBit < 8) {
+           if (outSize >= sizeof(outBytes)) {
+              simDcc.outBad++;
+              outState = OUT_PREAMBLE;
+              outOnes = 0;
+              return;
+           }
+           if (!outBit) outBytes[outSize] = 0;
+           outBytes[outSize] = (outBytes[outSize] << 1) | one;
+           if (++outBit == 8) outSize++;
+           return;
+        }
+        if (one) {                  // End bit
+           outPacket(when);
+           outState = OUT_PREAMBLE;
+           outOnes = 2;
+        } else {
+           outBit = 0;              // Separator: another byte
+        }
+        return;
+  }
+}
+
+void simDccOutput(uint64_t when, uint8_t lvl) {
+  uint64_t us = (when - outLast) / SIM_CPU_US;
+  (void)lvl;
+
+  outLast = when;
+  if (us < ONE_MAX_US) {
+     if (us < simDcc.oneMin || !simDcc.oneMin) simDcc.oneMin = us;
+     if (us > simDcc.oneMax) simDcc.oneMax = us;
+     outHalfBit(1, when);
+  } else if (us < ZERO_MAX_US) {
+     if (us < simDcc.zeroMin || !simDcc.zeroMin) simDcc.zeroMin = us;
+     if (us > simDcc.zeroMax) simDcc.zeroMax = us;
+     outHalfBit(0, when);
+  } else {                          // A gap: start over
+     outState = OUT_PREAMBLE;
+     outOnes = 0;
+  }
+}
+
+/////////
+// Report
+/////////
+
+void simDccLatency(uint32_t *p50, uint32_t *p90, uint32_t *p99, uint32_t *max) {
+  size_t n = latencies.size();
+  *p50 = *p90 = *p99 = *max = 0;
+  if (!n) return;
+  std::sort(latencies.begin(), latencies.end());
+  *p50 = latencies[n * 50 / 100];
+  *p90 = latencies[n * 90 / 100];
+  *p99 = latencies[n * 99 / 100];
+  *max = latencies[n - 1];
+}
+
+uint64_t simDccLost(void) {
+  uint64_t lost = 0;
+  uint64_t recent = simNow - (uint64_t)100000 * SIM_CPU_US;  // Still in flight at the end: not lost
+  for (auto &kv : sent) {
+     for (uint64_t t : kv.second) if (t < recent) lost++;
+  }
+  return lost;
+}
+void simDccRecovery(uint32_t *mean, uint32_t *max) {
+  uint64_t sum = 0;
+  *mean = *max = 0;
+  for (uint32_t ms : recoveries) {
+     sum += ms;
+     if (ms > *max) *max = ms;
+  }
+  if (!recoveries.empty()) *mean = (uint32_t)(sum / recoveries.size());
+  simDcc.dropRecovered = recoveries.size();
+  simDcc.dropNever += stale.size();
+  stale.clear();
+}
+
+double simDccProfileRate(uint8_t profile) {
+  if ((profile >= DCCP_PROFILES) || !airUs[profile]) return 0;
+  return simDcc.out * 1e6 / airUs[profile];
+}
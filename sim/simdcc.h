@@ -0,0 +1,82 @@
+/*
+sim/simdcc.h
+
+DCC input script and output decoder of the host simulation.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SIMDCC_H_
+#define SIMDCC_H_
+
+#include <stdint.h>
+
+typedef struct {
+  uint64_t in;          // Packets sent to the sketch
+  uint64_t gaps;        // Gaps in the input
+  uint64_t out;         // Good packets from the sketch
+  uint64_t outBad;      // Bad XOR, bad length, or lost bit sync
+  uint64_t matched;     // Outputs matching an input
+  uint64_t outExtra;    // Outputs with no input: repeats, idles, refresh
+  uint64_t superseded;  // Inputs replaced by a newer copy before they came out
+  uint32_t oneMin, oneMax;    // Output half-bit lengths, us
+  uint32_t zeroMin, zeroMax;
+  uint32_t speedGapMax;       // Longest time a loco went without a speed packet on the output, ms
+  uint64_t speedGaps;         // Times that was 500 ms or more
+  uint64_t firstOut;          // Time of the first output matching an input, cycles. 0: none
+  uint64_t drops;             // Air drops over
+  uint64_t dropStale;         // Locos whose speed or F0-F4 was wrong after one
+  uint64_t dropRecovered;     // Of those, locos put right before the next drop
+  uint64_t dropNever;         // And those still wrong at the next drop or at the end
+} simDccStats_t;
+
+extern simDccStats_t simDcc;
+
+// Channel the command station is on. While the sketch's CHANNEL differs,
+// its DCC input sees nothing. -1: any channel
+extern int simDccChannel;
+
+// Parse the script (see simdcc.cpp). Exits on an error.
+void simDccScript(const char *text);
+
+// Start driving the input
+void simDccBegin(void);
+
+// Latency percentiles of the matched packets, us
+void simDccLatency(uint32_t *p50, uint32_t *p90, uint32_t *p99, uint32_t *max);
+
+// Packets per second the transmitter could send back to back with the
+// mix of packets that came out, if sent with the given preamble profile
+double simDccProfileRate(uint8_t profile);
+
+// Inputs that never came out, not counting the last 100 ms
+uint64_t simDccLost(void);
+
+// Time from the end of an air drop until a loco it left wrong was right
+// again, ms. Counts the locos still wrong as never recovered; call once.
+void simDccRecovery(uint32_t *mean, uint32_t *max);
+
+#endif /* SIMDCC_H_ */
\ No newline at end of file
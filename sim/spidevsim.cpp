@@ -0,0 +1,348 @@
+/*
+sim/spidevsim.cpp
+
+Host test of RF24's Linux SPIDEV driver: syscalls and packets per second
+of RF24's read and write paths, with and without several SPI transfers
+batched into one ioctl (build flag RF24_SPIDEV_NO_BATCH turns that off).
+
+RF24.cpp and utility/SPIDEV are built unchanged, but linked with open(),
+ioctl(), lseek(), write(), fopen() and close() wrapped: /dev/spidev* and
+the sysfs GPIO files go to a stand-in here, the rest to the C library.
+Each SPI_IOC_MESSAGE is played through a model nRF24L01+ (registers,
+3-deep TX and RX FIFOs, CE), which sends a frame as soon as CE is high in
+TX, or after 130 us settling and 250 kbps air time with -a, and keeps its
+RX FIFO full while listening. Every call to the stand-in makes one real
+syscall, so the packets per second carry this machine's syscall cost,
+plus the SPI bus time at the speed RF24 set, plus -k us for a driver.
+
+Copyright (c) 2024, Darrell Lamm
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or
+without modification, are permitted provided that the following
+conditions are met:
+1. Redistributions of source code must retain the above copyright
+notice, this list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright
+notice, this list of conditions and the following disclaimer in the
+documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND
+CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <RF24.h>
+#include <nRF24L01.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/spi/spidev.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SPIFD     1000   // The stand-in's file descriptors
+#define GPIOFD    1001
+#define SETTLEUS  130    // Standby to TX
+#define AIRUS     548    // An 8 byte payload at 250 kbps
+#define FIFO      3
+#define PAYLOAD   8      // Bytes per test frame
+
+typedef struct {
+  uint32_t syscalls;     // All the calls that reach the stand-in's devices
+  uint32_t ioctls;       // Of which SPI messages
+  uint32_t transfers;    // Transfers in them
+  uint32_t bytes;        // Bytes on the bus
+  uint32_t frames;       // Frames the model radio sent or that were read from it
+} count_t;
+
+static count_t cnt;
+static uint32_t spiHz = RF24_SPI_SPEED;
+static uint32_t driverUs = 0;
+static uint8_t air = 0;
+
+// The model radio
+static uint8_t reg[0x20];
+static uint8_t txN = 0, rxN = 0;
+static bool ce = false, busy = false;
+static uint64_t txAt;   // When the frame on the air is out
+
+static uint64_t nowUs(void) {
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static void spend(uint32_t us) {
+  uint64_t end = nowUs() + us;
+
+  while (nowUs() < end);
+}
+
+// One trip into the kernel, as the real device would take
+static void kernel(void) {
+  cnt.syscalls++;
+  syscall(SYS_getppid);
+  if (driverUs) spend(driverUs);
+}
+
+static void advance(void) {
+  uint64_t now = nowUs();
+  bool up = reg[NRF_CONFIG] & _BV(PWR_UP);
+
+  if (up && ce && !(reg[NRF_CONFIG] & _BV(PRIM_RX))) {
+     if (txN && !busy) {
+        busy = true;
+        txAt = now + (air ? SETTLEUS + AIRUS : 0);
+     }
+     while (busy && (now >= txAt)) {
+        txN--;
+        cnt.frames++;
+        reg[NRF_STATUS] |= _BV(TX_DS);
+        busy = txN > 0;
+        txAt += air ? AIRUS : 0;
+     }
+  } else busy = false;
+  if (up && ce && (reg[NRF_CONFIG] & _BV(PRIM_RX)) && (rxN < FIFO)) {  // Always something to hear
+     rxN = FIFO;
+     reg[NRF_STATUS] |= _BV(RX_DR);
+  }
+}
+
+static uint8_t status(void) {
+  return (reg[NRF_STATUS] & 0x70) | ((rxN ? 1 : 7) << RX_P_NO) | (txN >= FIFO);
+}
+
+static void transfer(const uint8_t *t, uint8_t *r, uint32_t len) {
+  uint8_t c = t[0], v = (len > 1) ? t[1] : 0;  // Before r is written: RF24 may pass one buffer for both
+
+  advance();
+  r[0] = status();
+  memset(r + 1, 0, len - 1);
+  if (c < W_REGISTER) {
+     if ((c & REGISTER_MASK) == FIFO_STATUS) {
+        r[1] = ((txN >= FIFO) << FIFO_FULL) | (!txN << TX_EMPTY) | ((rxN >= FIFO) << RX_FULL) | !rxN;
+     } else r[1] = reg[c & REGISTER_MASK];
+  } else if (c < (W_REGISTER + 0x20)) {
+     if ((c & REGISTER_MASK) == NRF_STATUS) reg[NRF_STATUS] &= ~(v & 0x70);  // Write 1 to clear
+     else if (len > 1) reg[c & REGISTER_MASK] = v;
+  } else if (c == R_RX_PL_WID) {
+     r[1] = rxN ? PAYLOAD : 0;
+  } else if (c == R_RX_PAYLOAD) {
+     if (rxN) {
+        rxN--;
+        cnt.frames++;
+     }
+  } else if ((c == W_TX_PAYLOAD) || (c == W_TX_PAYLOAD_NO_ACK) || ((c & 0xF8) == W_ACK_PAYLOAD)) {
+     if (txN < FIFO) txN++;
+  } else if (c == FLUSH_TX) {
+     txN = 0;
+     busy = false;
+  } else if (c == FLUSH_RX) {
+     rxN = 0;
+  }
+  cnt.transfers++;
+  cnt.bytes += len;
+  spend((len * 8 * 1000000ULL + spiHz - 1) / spiHz);  // On the bus
+  advance();
+}
+
+extern "C" {
+int __real_open(const char *path, int flags, ...);
+int __real_close(int fd);
+int __real_ioctl(int fd, unsigned long req, ...);
+off_t __real_lseek(int fd, off_t off, int whence);
+ssize_t __real_write(int fd, const void *buf, size_t n);
+FILE *__real_fopen(const char *path, const char *mode);
+
+int __wrap_open(const char *path, int flags, ...) {
+  va_list ap;
+  va_start(ap, flags);
+  int mode = va_arg(ap, int);
+  va_end(ap);
+
+  if (!strncmp(path, "/dev/spidev", 11)) return SPIFD;
+  if (!strncmp(path, "/sys/class/gpio/", 16)) return GPIOFD;  // There is only CE
+  return __real_open(path, flags, mode);
+}
+
+int __wrap_close(int fd) {
+  return ((fd == SPIFD) || (fd == GPIOFD)) ? 0 : __real_close(fd);
+}
+
+int __wrap_ioctl(int fd, unsigned long req, ...) {
+  va_list ap;
+  va_start(ap, req);
+  void *arg = va_arg(ap, void *);
+  va_end(ap);
+
+  if (fd != SPIFD) return __real_ioctl(fd, req, arg);
+  kernel();
+  if ((_IOC_TYPE(req) == SPI_IOC_MAGIC) && (_IOC_NR(req) == 0) && (_IOC_DIR(req) == _IOC_WRITE)) {  // SPI_IOC_MESSAGE(n)
+     const struct spi_ioc_transfer *tr = (const struct spi_ioc_transfer *)arg;
+     uint32_t n = _IOC_SIZE(req) / sizeof(*tr), total = 0;
+     cnt.ioctls++;
+     for (uint32_t i = 0; i < n; i++) {
+        transfer((const uint8_t *)(uintptr_t)tr[i].tx_buf, (uint8_t *)(uintptr_t)tr[i].rx_buf, tr[i].len);
+        total += tr[i].len;
+     }
+     return (int)total;
+  }
+  if (req == SPI_IOC_WR_MAX_SPEED_HZ) spiHz = *(const uint32_t *)arg;
+  return 0;
+}
+
+off_t __wrap_lseek(int fd, off_t off, int whence) {
+  if (fd != GPIOFD) return __real_lseek(fd, off, whence);
+  kernel();
+  return 0;
+}
+
+ssize_t __wrap_write(int fd, const void *buf, size_t n) {
+  if (fd != GPIOFD) return __real_write(fd, buf, n);
+  kernel();
+  ce = ((const char *)buf)[0] == '1';
+  advance();
+  return (ssize_t)n;
+}
+
+FILE *__wrap_fopen(const char *path, const char *mode) {
+  return __real_fopen(strncmp(path, "/sys/class/gpio/", 16) ? path : "/dev/null", mode);  // export, direction
+}
+}  // extern "C"
+
+////////////
+// The tests
+////////////
+
+static const uint64_t pipe01 = 0xE8E8F0F0A1ULL;
+static RF24 radio(22, 0);
+
+static void tx(void) {
+  radio.setRetries(0, 0);
+  radio.openWritingPipe(pipe01);
+  radio.stopListening();
+}
+
+// writeFast() back to back, NOACK, then txStandBy()
+static uint32_t stream(uint32_t n) {
+  uint8_t buf[PAYLOAD] = {0};
+
+  tx();
+  memset(&cnt, 0, sizeof(cnt));
+  for (uint32_t i = 0; i < n; i++) {
+     buf[0] = (uint8_t)i;
+     radio.writeFast(buf, PAYLOAD, 1);
+  }
+  radio.txStandBy();
+  return n;
+}
+
+// As the gateway and the sketch's transmitter: a frame when the FIFO has
+// room, with CE dropped once it is empty
+static uint32_t frames(uint32_t n) {
+  uint8_t buf[PAYLOAD] = {0};
+
+  tx();
+  memset(&cnt, 0, sizeof(cnt));
+  for (uint32_t i = 0; i < n;) {
+     if (radio.isFifo(true) != 2) {
+        radio.startFastWrite(buf, PAYLOAD, 1);
+        i++;
+     }
+     if (radio.isFifo(true, true)) radio.txStandBy();
+  }
+  radio.txStandBy();
+  return n;
+}
+
+// write(): one frame at a time, waiting for it to go
+static uint32_t blocking(uint32_t n) {
+  uint8_t buf[PAYLOAD] = {0};
+
+  tx();
+  memset(&cnt, 0, sizeof(cnt));
+  for (uint32_t i = 0; i < n; i++) radio.write(buf, PAYLOAD, 1);
+  return n;
+}
+
+// The receiver: available(&pipe), getDynamicPayloadSize(), read()
+static uint32_t receive(uint32_t n) {
+  uint8_t buf[32], pipe;
+  uint32_t got = 0;
+
+  radio.openReadingPipe(1, pipe01);
+  radio.startListening();
+  memset(&cnt, 0, sizeof(cnt));
+  while (got < n) {
+     if (!radio.available(&pipe)) continue;
+     uint8_t len = radio.getDynamicPayloadSize();
+     radio.read(buf, len);
+     got++;
+  }
+  radio.stopListening();
+  return got;
+}
+
+int main(int argc, char **argv) {
+  static const struct {
+     const char *label;
+     uint32_t (*run)(uint32_t);
+  } rows[] = {
+     {"writeFast() stream",        stream},
+     {"Frame per FIFO check",      frames},
+     {"write()",                   blocking},
+     {"available()/read()",        receive},
+  };
+  uint32_t n = 20000;
+  int c;
+
+  while ((c = getopt(argc, argv, "n:k:a")) != -1) {
+     switch (c) {
+        case 'n': n = (uint32_t)atoi(optarg); break;
+        case 'k': driverUs = (uint32_t)atoi(optarg); break;
+        case 'a': air = 1; break;
+        default:
+           fprintf(stderr, "Usage: %s [-n packets] [-k driver us per syscall] [-a]\n", argv[0]);
+           return 1;
+     }
+  }
+  if (!radio.begin()) {
+     fprintf(stderr, "RF24 did not start on the stand-in\n");
+     return 1;
+  }
+  radio.setChannel(10);
+  radio.setDataRate(RF24_250KBPS);
+  radio.enableDynamicPayloads();
+  radio.enableDynamicAck();
+
+#if defined(RF24_SPI_BATCH)
+  printf("RF24 SPIDEV, transfers batched, %u packets, SPI %u MHz, driver %u us/syscall%s\n", n, spiHz / 1000000, driverUs, air ? ", 250 kbps air time" : "");
+#else
+  printf("RF24 SPIDEV, one transfer per ioctl, %u packets, SPI %u MHz, driver %u us/syscall%s\n", n, spiHz / 1000000, driverUs, air ? ", 250 kbps air time" : "");
+#endif
+  printf("%-24s %10s %10s %10s %10s %10s %8s\n", "", "Packets/s", "Syscalls", "ioctls", "Transfers", "SPI bytes", "Frames");
+  for (size_t r = 0; r < sizeof(rows)/sizeof(rows[0]); r++) {
+     uint64_t t0 = nowUs();
+     uint32_t p = rows[r].run(n);
+     double s = (nowUs() - t0) * 1e-6;
+     printf("%-24s %10.0f %10.2f %10.2f %10.2f %10.1f %8u\n", rows[r].label, p / s,
+            (double)cnt.syscalls / p, (double)cnt.ioctls / p, (double)cnt.transfers / p, (double)cnt.bytes / p, cnt.frames);
+  }
+  printf("Per packet, but Packets/s and Frames (sent or read by the radio).\n");
+  return 0;
+}
\ No newline at end of file